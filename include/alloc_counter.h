@@ -0,0 +1,49 @@
+/**
+ * \file alloc_counter.h
+ *
+ * \brief Heap allocation counter
+ *
+ * The global operator new is replaced by a version that counts the
+ * calls, so that a loop can be checked for heap allocations. Every
+ * allocation then pays for an atomic add, so alloc_counter.cpp is only
+ * linked into the check and bench programs, which define
+ * ALLOC_COUNTER.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <cstdint>
+
+#include "macros.h"
+
+/**
+ * \brief Check if the allocations are counted in this program
+ *
+ * \return true if alloc_counter.cpp is linked in
+ */
+inline bool has_alloc_counter()
+{
+#ifdef ALLOC_COUNTER
+        return true;
+#else
+        return false;
+#endif
+}
+
+#ifdef ALLOC_COUNTER
+/**
+ * \brief Number of heap allocations since the program started
+ *
+ * \return the number of calls to operator new
+ */
+uint64_t get_no_of_allocations();
+#else
+// Not counted, check has_alloc_counter first
+inline uint64_t get_no_of_allocations()
+{
+        return 0;
+}
+#endif
@@ -14,6 +14,7 @@
 #include <armadillo>
 
 #include "macros.h"
+#include "sample_file.h"
 
 /**
  * \class Analyser
@@ -48,6 +49,14 @@ public:
          * \param[in] data the data to be analysed
          */
         void add_data(std::vector<std::complex<int16_t>> data);
+        /**
+         * \brief Add data for analysis
+         *
+         * \param[in] data the data to be analysed, e.g. a pool buffer
+         * \param[in] no_of_samples number of samples in data
+         */
+        void add_data(const std::complex<int16_t> *data,
+                      size_t no_of_samples);
         /**
          * \brief Add data for analysis
          *
@@ -79,12 +88,25 @@ public:
         /**
          * \brief Save data to a file
          *
-         * Save data to a file, that has been added with
-         * the add_data method
+         * Save data to a binary CF32 sample file <filename>.cf32, that
+         * has been added with the add_data method. Load it with
+         * SampleFile.
+         *
+         * \param[in] filename filename, with no given extension
+         * \param[in] info the sample rate, frequency and time, if known
+         */
+        void save_data(std::string filename,
+                       const SampleFileInfo &info = SampleFileInfo());
+        /**
+         * \brief Save data to two text files
+         *
+         * Save the real and imaginary parts of the data, that has been
+         * added with the add_data method, to <filename>_re.arm and
+         * <filename>_im.arm in the raw_ascii format.
          *
          * \param[in] filename filename, with no given extension
          */
-        void save_data(std::string filename);
+        void save_data_ascii(std::string filename);
 private:
         void plot(std::vector<float> y, std::string title);
         void plot(std::vector<float> y);
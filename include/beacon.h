@@ -17,6 +17,7 @@
 #include <unistd.h>
 #include <armadillo>
 #include "macros.h"
+#include "sample_file.h"
 
 class Beacon
 {
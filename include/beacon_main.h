@@ -25,20 +25,45 @@
 
 #include "sdr_config.h"
 #include "sdr.h"
+#include "sim_radio.h"
+#include "file_radio.h"
 #include "modulator.h"
 #include "analyser.h"
 #include "detector.h"
+#include "rt_thread.h"
+#include "buffer_pool.h"
+#include "tdma.h"
+#include "ranging.h"
+#include "results_ring.h"
+#include "burst_tracer.h"
+#include "metrics.h"
+#include "logger.h"
+#include "live_plot.h"
+#include "spectrum.h"
 
 typedef std::chrono::_V2::system_clock::time_point TimePoint;
 
-void run_beacon(bool plot_data, uint32_t device);
+void run_beacon(bool plot_data, uint32_t device, SDR_Device_Config dev_cfg);
+template <typename RadioType>
+void run_beacon_loop(RadioType &radio, SDR_Device_Config dev_cfg,
+                     bool plot_data);
 void sigIntHandler(const int);
 void list_device_info();
-void transmit_ping(SDR sdr, int64_t tx_start_tick);
+template <typename RadioType>
+void transmit_ping(RadioType &radio, SDR_Device_Config dev_cfg,
+                   int64_t tx_start_tick);
 TimePoint print_spin(TimePoint time_last_spin, int spin_index);
 int64_t calculate_tx_start_tick(int64_t now_tick);
 int64_t ticks_per_period(double period);
-int64_t look_for_pong(SDR sdr, Detector &detector);
+template <typename RadioType>
+int64_t look_for_pong(RadioType &radio, Detector &detector,
+                      PoolBuffer<std::complex<int16_t>> &buff_data_pong,
+                      RangeTracker &range, ResultsPublisher *results,
+                      LivePlot &live_plot, SpectrumMonitor &spectrum,
+                      const SDR_Device_Config &dev_cfg);
+template <typename RadioType>
+size_t look_for_pongs(RadioType &radio, TdmaDetector &tdma,
+                      PoolBuffer<std::complex<int16_t>> &buff_data_pong,
+                      SpectrumMonitor &spectrum,
+                      const SDR_Device_Config &dev_cfg);
 bool return_ok(int ret, size_t expected_num_samples);
-void calculate_tof(int64_t tx_start_time_hw_ns,
-                   int64_t last_pong_time_hw_ns);
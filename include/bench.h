@@ -0,0 +1,80 @@
+/**
+ * \file bench.h
+ *
+ * \brief Micro-benchmarks of the DSP kernels
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <tclap/CmdLine.h>
+#include <iostream>
+#include <complex>
+#include <functional>
+#include <string>
+#include <vector>
+#include <armadillo>
+
+#include "macros.h"
+#include "sdr_config.h"
+#include "detector.h"
+#include "modulator.h"
+#include "analyser.h"
+#include "sample_file.h"
+#include "live_plot.h"
+#include "spectrum.h"
+#include "dc_iq_corrector.h"
+#include "alloc_counter.h"
+
+/**
+ * \struct DspBench
+ *
+ * \brief Access to the private kernels of Detector and Modulator
+ */
+struct DspBench
+{
+        static void correlate(Detector &detector);
+        static double calculate_threshold(Detector &detector);
+        static size_t find_peaks(Detector &detector, double threshold);
+        static void gen_scr_code(Modulator &modulator, uint16_t code_nr,
+                                 arma::cx_vec &Z);
+        static size_t get_reference_length(const Detector &detector);
+};
+
+/**
+ * \struct BenchCase
+ *
+ * \brief One kernel with one set of sizes
+ */
+struct BenchCase
+{
+        std::string name;
+        uint16_t novs; //!< Oversampling of the sizes
+        size_t samples_per_call; //!< Samples the ns/sample is based on
+        std::function<void()> call;
+};
+
+/**
+ * \struct BenchResult
+ *
+ * \brief Timing and allocations of a BenchCase
+ */
+struct BenchResult
+{
+        std::string name;
+        uint16_t novs;
+        size_t samples_per_call;
+        uint64_t no_of_calls;
+        double ns_per_call;
+        double ns_per_sample;
+        double allocs_per_call; //!< Calls to operator new per call
+};
+
+SDR_Device_Config bench_config(uint16_t novs);
+std::vector<std::complex<int16_t>> bench_rx_data(
+        const SDR_Device_Config &dev_cfg, size_t no_of_samples);
+BenchResult run_bench_case(const BenchCase &bench_case, double min_time);
+void write_bench_json(std::string filename,
+                      const std::vector<BenchResult> &results);
@@ -0,0 +1,185 @@
+/**
+ * \file buffer_pool.h
+ *
+ * \brief Sample buffer pool
+ *
+ * A fixed number of equally sized, 64 byte aligned buffers, allocated
+ * once. Buffers are acquired and released without locks, so the RX,
+ * TX and detection loops can get their buffers without touching the
+ * heap.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+#include "macros.h"
+
+/**
+ * \class BufferPool
+ *
+ * \brief Pool of aligned sample buffers
+ *
+ * The free buffers are kept in a lock-free stack. The head of the stack
+ * carries a tag that is incremented on every update, to avoid the ABA
+ * problem when buffers are acquired and released from several threads.
+ *
+ */
+class BufferPool
+{
+public:
+        /**
+         * \brief BufferPool constructor
+         *
+         * \param[in] buffer_bytes size of each buffer [bytes]
+         * \param[in] no_of_buffers number of buffers in the pool
+         * \param[in] huge_pages try to back the pool with huge pages,
+         * normal pages are used if that fails
+         */
+        BufferPool(size_t buffer_bytes, size_t no_of_buffers,
+                   bool huge_pages);
+        ~BufferPool();
+        BufferPool(const BufferPool &) = delete;
+        BufferPool &operator=(const BufferPool &) = delete;
+        /**
+         * \brief Acquire a buffer
+         *
+         * \return a free buffer, nullptr if there is none
+         */
+        void *acquire();
+        /**
+         * \brief Release a buffer back to the pool
+         *
+         * \param[in] buffer a buffer acquired from this pool
+         */
+        void release(void *buffer);
+        /**
+         * \brief Size of each buffer
+         *
+         * \return the buffer size [bytes]
+         */
+        size_t get_buffer_bytes() const;
+        /**
+         * \brief Number of free buffers
+         *
+         * \return the number of buffers that can be acquired
+         */
+        size_t get_no_of_free() const;
+        /**
+         * \brief Check if the pool is backed by huge pages
+         *
+         * \return true if huge pages are used
+         */
+        bool uses_huge_pages() const;
+
+        static const size_t alignment = 64; //!< Alignment of the buffers
+
+private:
+        static const uint32_t empty = UINT32_MAX;
+
+        char *m_memory;
+        size_t m_memory_bytes;
+        size_t m_buffer_bytes;
+        size_t m_stride;
+        size_t m_no_of_buffers;
+        bool m_huge_pages;
+        std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+        std::atomic<uint64_t> m_head; //!< Tag in high, index in low bits
+        std::atomic<size_t> m_no_of_free;
+};
+
+/**
+ * \class PoolBuffer
+ *
+ * \brief A buffer of T acquired from a BufferPool
+ *
+ * The buffer is released back to the pool when destroyed.
+ *
+ */
+template <typename T>
+class PoolBuffer
+{
+public:
+        /**
+         * \brief PoolBuffer constructor
+         *
+         * Throws if the pool is empty or if the buffers are too small.
+         *
+         * \param[in] pool the pool to acquire the buffer from
+         * \param[in] size number of elements in the buffer
+         */
+        PoolBuffer(BufferPool &pool, size_t size)
+                : m_pool(&pool),
+                  m_data(nullptr),
+                  m_size(size)
+        {
+                if (size * sizeof(T) > pool.get_buffer_bytes()) {
+                        throw std::runtime_error(
+                                "pool: Buffers are too small");
+                }
+                m_data = static_cast<T *>(pool.acquire());
+                if (m_data == nullptr) {
+                        throw std::runtime_error("pool: No free buffers");
+                }
+                for (size_t n=0; n<m_size; n++) {
+                        m_data[n] = T();
+                }
+        }
+        ~PoolBuffer()
+        {
+                if (m_data != nullptr) {
+                        m_pool->release(m_data);
+                }
+        }
+        PoolBuffer(const PoolBuffer &) = delete;
+        PoolBuffer &operator=(const PoolBuffer &) = delete;
+        PoolBuffer(PoolBuffer &&other)
+                : m_pool(other.m_pool),
+                  m_data(other.m_data),
+                  m_size(other.m_size)
+        {
+                other.m_data = nullptr;
+                other.m_size = 0;
+        }
+        /**
+         * \brief The buffer
+         *
+         * \return pointer to the first element
+         */
+        T *data()
+        {
+                return m_data;
+        }
+        const T *data() const
+        {
+                return m_data;
+        }
+        /**
+         * \brief Number of elements
+         *
+         * \return the size of the buffer
+         */
+        size_t size() const
+        {
+                return m_size;
+        }
+        T &operator[](size_t n)
+        {
+                return m_data[n];
+        }
+        const T &operator[](size_t n) const
+        {
+                return m_data[n];
+        }
+
+private:
+        BufferPool *m_pool;
+        T *m_data;
+        size_t m_size;
+};
@@ -0,0 +1,245 @@
+/**
+ * \file burst_tracer.h
+ *
+ * \brief Tracing of the processing stages of each burst
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "macros.h"
+
+/**
+ * \brief enum
+ *
+ * The stages traced for every burst
+ */
+enum TraceStage {
+        TRACE_READ, /**< RX read, hw time of the first sample */
+        TRACE_ADD_DATA, /**< Detector::add_data */
+        TRACE_CORRELATE, /**< Correlation with one code */
+        TRACE_PEAKS, /**< Threshold and peak search */
+        TRACE_DECISION, /**< Burst found or missed, hw time of the burst */
+        TRACE_WRITE, /**< TX write submitted, hw time of the burst */
+        TRACE_WRITE_STATUS, /**< TX stream status of the write */
+        TRACE_NO_OF_STAGES
+};
+
+/**
+ * \brief Name of a trace stage
+ *
+ * \param[in] stage the stage
+ * \return the name, as shown in the trace viewer
+ */
+const char *trace_stage_name(TraceStage stage);
+
+/**
+ * \struct TraceSlot
+ *
+ * \brief One event in the trace ring, with its sequence lock
+ *
+ * Same scheme as ResultsRingSlot, so that the ring can be dumped while
+ * other threads are tracing.
+ */
+struct TraceSlot
+{
+        std::atomic<uint64_t> sequence;
+        std::atomic<int64_t> start_ns; //!< Monotonic time, stage started
+        std::atomic<int64_t> end_ns; //!< Monotonic time, stage done
+        std::atomic<int64_t> hw_ns; //!< hw time of the stage, -1 if none
+        std::atomic<int64_t> value; //!< Samples, status or decision
+        std::atomic<uint32_t> stage;
+        std::atomic<uint32_t> thread;
+};
+
+/**
+ * \class BurstTracer
+ *
+ * \brief Records the stages of every burst into a preallocated ring
+ *
+ * Any thread can record events, a record is a few relaxed atomic
+ * stores into the next slot of the ring, with no lock and no
+ * allocation. The oldest events are overwritten when the ring is full.
+ * The ring is written as Chrome trace event JSON, for chrome://tracing
+ * or Perfetto, when the program exits and whenever SIGUSR1 is
+ * received, see trace_signal_handler. When tracing is not configured,
+ * an event costs one load and a branch.
+ *
+ */
+class BurstTracer
+{
+public:
+        /**
+         * \brief BurstTracer constructor, not tracing
+         */
+        BurstTracer();
+        BurstTracer(const BurstTracer &) = delete;
+        BurstTracer &operator=(const BurstTracer &) = delete;
+        /**
+         * \brief Set up the ring and start tracing
+         *
+         * \param[in] filename the trace file, "" to not trace
+         * \param[in] capacity number of events kept, rounded up to a
+         * power of two
+         */
+        void configure(std::string filename, size_t capacity);
+        /**
+         * \brief Check if events are recorded
+         *
+         * \return true if tracing
+         */
+        bool is_enabled() const
+        {
+                return m_enabled.load(std::memory_order_relaxed);
+        }
+        /**
+         * \brief Record an event
+         *
+         * \param[in] stage the stage
+         * \param[in] start_ns monotonic time when the stage started
+         * \param[in] end_ns monotonic time when the stage was done
+         * \param[in] hw_ns hw time of the stage, -1 if none
+         * \param[in] value stage specific value
+         */
+        void record(TraceStage stage, int64_t start_ns, int64_t end_ns,
+                    int64_t hw_ns, int64_t value);
+        /**
+         * \brief Name the calling thread in the trace
+         *
+         * \param[in] name the name
+         */
+        void set_thread_name(std::string name);
+        /**
+         * \brief Ask for a dump at the next dump_if_requested
+         *
+         * Async signal safe.
+         */
+        void request_dump();
+        /**
+         * \brief Dump the ring if a dump has been requested
+         *
+         * Called once per iteration by the loops, the dump itself
+         * allocates and writes a file.
+         */
+        void dump_if_requested();
+        /**
+         * \brief Write the ring to the trace file
+         */
+        void dump();
+        /**
+         * \brief Current monotonic time
+         *
+         * \return the time [ns]
+         */
+        static int64_t now_ns()
+        {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).
+                        count();
+        }
+
+private:
+        uint32_t get_thread_ix();
+
+        static const size_t max_no_of_threads = 64;
+        static const size_t max_name_length = 32;
+
+        std::string m_filename;
+        std::unique_ptr<TraceSlot[]> m_slots;
+        size_t m_mask; //!< Capacity - 1
+        std::atomic<bool> m_enabled;
+        std::atomic<bool> m_dump_requested;
+        std::atomic<uint64_t> m_next; //!< Number of the next event
+        std::atomic<uint32_t> m_no_of_threads;
+        char m_thread_names[max_no_of_threads][max_name_length];
+};
+
+extern BurstTracer g_tracer;
+
+/**
+ * \brief Signal handler requesting a dump of the trace
+ *
+ * Install for SIGUSR1.
+ */
+void trace_signal_handler(const int);
+
+/**
+ * \brief Record a stage without duration, as a decision
+ *
+ * \param[in] stage the stage
+ * \param[in] hw_ns hw time of the stage, -1 if none
+ * \param[in] value stage specific value
+ */
+inline void trace_event(TraceStage stage, int64_t hw_ns, int64_t value)
+{
+        if (g_tracer.is_enabled()) {
+                int64_t now_ns = BurstTracer::now_ns();
+                g_tracer.record(stage, now_ns, now_ns, hw_ns, value);
+        }
+}
+
+/**
+ * \class TraceSpan
+ *
+ * \brief Records a stage from construction to destruction
+ *
+ */
+class TraceSpan
+{
+public:
+        /**
+         * \brief TraceSpan constructor, starts the stage
+         *
+         * \param[in] stage the stage
+         * \param[in] hw_ns hw time of the stage, -1 if none
+         */
+        explicit TraceSpan(TraceStage stage, int64_t hw_ns = -1)
+                : m_stage(stage),
+                  m_hw_ns(hw_ns),
+                  m_value(0),
+                  m_start_ns(g_tracer.is_enabled() ?
+                             BurstTracer::now_ns() : 0)
+        {}
+        ~TraceSpan()
+        {
+                if (g_tracer.is_enabled()) {
+                        g_tracer.record(m_stage, m_start_ns,
+                                        BurstTracer::now_ns(), m_hw_ns,
+                                        m_value);
+                }
+        }
+        TraceSpan(const TraceSpan &) = delete;
+        TraceSpan &operator=(const TraceSpan &) = delete;
+        /**
+         * \brief Set the hw time of the stage
+         *
+         * \param[in] hw_ns the hw time [ns]
+         */
+        void set_hw_ns(int64_t hw_ns)
+        {
+                m_hw_ns = hw_ns;
+        }
+        /**
+         * \brief Set the stage specific value
+         *
+         * \param[in] value the value
+         */
+        void set_value(int64_t value)
+        {
+                m_value = value;
+        }
+
+private:
+        TraceStage m_stage;
+        int64_t m_hw_ns;
+        int64_t m_value;
+        int64_t m_start_ns;
+};
@@ -0,0 +1,159 @@
+/**
+ * \file dc_iq_corrector.h
+ *
+ * \brief DC offset and IQ imbalance correction of the RX data
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <complex>
+#include <vector>
+
+#include "macros.h"
+#include "sdr_config.h"
+
+/**
+ * \class DcIqCorrector
+ *
+ * \brief Adaptive DC and IQ gain/phase correction, in place
+ *
+ * The samples are corrected in blocks of block_length. Within a block
+ * the DC estimate is subtracted and Q is replaced by d * (Q - c * I),
+ * which makes I and Q uncorrelated and of equal power. After each
+ * block the DC estimate follows the block mean with a one-pole filter
+ * of time constant dc_time_constant, and the powers and the cross
+ * power of I and Q, from which c and d are taken, with time constant
+ * iq_time_constant. Until that many blocks have been seen the
+ * estimates are plain means, so they settle quickly after a reset. The
+ * IQ correction starts once iq_time_constant of samples have been
+ * seen, a noisier estimate would cost more than it corrects.
+ *
+ * While frozen the samples are corrected, but the estimates are kept.
+ * This is meant for data that is mostly a known burst, like a gated
+ * RX window, whose own I/Q statistics would be taken as imbalance.
+ *
+ * The estimates are only updated between blocks, so correcting costs
+ * a few SIMD operations per sample and does not allocate. AVX2 is used
+ * when the CPU has it, otherwise SSE2.
+ *
+ */
+class DcIqCorrector
+{
+public:
+        DcIqCorrector();
+        /**
+         * \brief Set the time constants and reset the estimates
+         *
+         * \param[in] dev_cfg configuration parameters
+         */
+        void configure(const SDR_Device_Config &dev_cfg);
+        /**
+         * \brief Restart the estimates, e.g. before unrelated data
+         */
+        void reset();
+        /**
+         * \brief Stop or resume updating the estimates
+         *
+         * A partial block is dropped when the state changes, so each
+         * update is of samples of one kind.
+         *
+         * \param[in] frozen true to keep the current estimates
+         */
+        void freeze(bool frozen);
+        /**
+         * \brief Correct samples in place
+         *
+         * The result is rounded and saturated to int16.
+         *
+         * \param[in,out] data the samples, following the previous ones
+         * \param[in] no_of_samples number of samples
+         */
+        void process(std::complex<int16_t> *data, size_t no_of_samples);
+        /**
+         * \brief Correct samples in place
+         *
+         * \param[in,out] data the samples, following the previous ones
+         * \param[in] no_of_samples number of samples
+         */
+        void process(std::complex<float> *data, size_t no_of_samples);
+        /**
+         * \brief Correct samples split in real and imaginary parts
+         *
+         * \param[in,out] re real parts
+         * \param[in,out] im imaginary parts
+         * \param[in] no_of_samples number of samples
+         */
+        void process(float *re, float *im, size_t no_of_samples);
+        /**
+         * \brief Correct samples while splitting them to float
+         *
+         * As converting and then correcting in place, in one pass.
+         *
+         * \param[in] data the samples, following the previous ones
+         * \param[in] no_of_samples number of samples
+         * \param[out] re real parts
+         * \param[out] im imaginary parts
+         */
+        void process(const std::complex<int16_t> *data, size_t no_of_samples,
+                     float *re, float *im);
+        std::complex<float> get_dc() const;
+        /**
+         * \brief The estimated IQ imbalance
+         *
+         * \param[out] gain Q to I amplitude ratio
+         * \param[out] phase_deg phase error of Q [degrees]
+         */
+        void get_imbalance(double &gain, double &phase_deg) const;
+        /**
+         * \brief Print the DC and IQ estimates
+         */
+        void print_stats() const;
+
+        static const size_t block_length = 256; //!< Samples per update
+
+private:
+        /**
+         * \brief Sums of one block, of the samples with the DC removed
+         */
+        struct BlockSums
+        {
+                float i = 0;
+                float q = 0;
+                float ii = 0;
+                float qq = 0;
+                float iq = 0;
+        };
+
+        size_t next_count(size_t no_of_samples) const;
+        void add_count(size_t count);
+        void correct(std::complex<int16_t> *data, size_t count);
+        void correct(std::complex<float> *data, size_t count);
+        void correct(float *re, float *im, size_t count);
+        void correct(const std::complex<int16_t> *data, size_t count,
+                     float *re, float *im);
+        void add_sums(const float sums[5]);
+        void correct_sample(float &re, float &im);
+        void update();
+
+        double m_dc_alpha; //!< One-pole coefficient per block
+        double m_iq_alpha;
+        uint64_t m_iq_min_blocks; //!< Before the IQ correction starts
+        size_t m_fill; //!< Samples of the current block
+        uint64_t m_no_of_blocks; //!< Since reset
+        bool m_frozen;
+        bool m_avx2; //!< Use the AVX2 kernels, checked at run time
+        BlockSums m_sums;
+        double m_dc_re;
+        double m_dc_im;
+        double m_power_i; //!< Smoothed E[I^2], DC removed
+        double m_power_q;
+        double m_cross; //!< Smoothed E[IQ]
+        float m_offset_re; //!< The DC used in the block, as float
+        float m_offset_im;
+        float m_c; //!< Share of I removed from Q
+        float m_d; //!< Gain of Q
+};
@@ -0,0 +1,90 @@
+/**
+ * \file detect_batch.h
+ *
+ * \brief Offline detection over recorded captures
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <tclap/CmdLine.h>
+#include <iostream>
+#include <complex>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+#include "sdr_config.h"
+#include "detector.h"
+#include "buffer_pool.h"
+#include "worker_pool.h"
+#include "sample_file.h"
+
+/**
+ * \struct BatchDetection
+ *
+ * \brief One burst found by detect_batch, as written in binary output
+ */
+struct BatchDetection
+{
+        uint64_t sample_ix; //!< Index of the peak in the capture
+        float fractional_offset; //!< Sub-sample peak offset [samples]
+        float corr_peak; //!< Magnitude of the correlation peak
+        float snr_db; //!< SNR estimate [dB]
+        uint32_t capture; //!< Index of the capture on the command line
+};
+
+/**
+ * \struct Capture
+ *
+ * \brief A memory mapped ci16_le SigMF recording or sample file
+ *
+ * A CF32 sample file is converted to CS16, the rest are used in place.
+ */
+struct Capture
+{
+        std::string basename; //!< Or the name of a .cs16 or .cf32 file
+        const std::complex<int16_t> *data = nullptr;
+        size_t no_of_samples = 0;
+        size_t bytes = 0; //!< Size of the mapping
+        double sample_rate = 0;
+        std::shared_ptr<SampleFile> sample_file;
+        std::vector<std::complex<int16_t>> converted; //!< From CF32
+};
+
+/**
+ * \struct Chunk
+ *
+ * \brief A part of a capture, detected as one job
+ *
+ * The chunk is overlap samples longer than the step to the next chunk,
+ * so a burst across the border is whole in the first of them. The
+ * correlation peak is at the last sample of a burst, and only the peaks
+ * from owned_begin to before owned_end belong to the chunk, so each
+ * burst is reported once, from the chunk holding all of it.
+ */
+struct Chunk
+{
+        uint32_t capture = 0;
+        size_t start_ix = 0;
+        size_t no_of_samples = 0;
+        int64_t owned_begin = 0; //!< First owned peak index in the chunk
+        int64_t owned_end = 0; //!< End of the owned peak indices
+};
+
+void map_capture(Capture &capture, const SDR_Device_Config &dev_cfg);
+void map_sample_file(Capture &capture, const SDR_Device_Config &dev_cfg);
+void unmap_capture(Capture &capture);
+double read_sample_rate(std::string basename, double default_rate);
+std::vector<Chunk> split_capture(const Capture &capture, uint32_t capture_ix,
+                                 size_t chunk_samples, size_t overlap,
+                                 size_t burst_length);
+void write_detections(std::string filename, bool binary,
+                      const std::vector<Capture> &captures,
+                      const std::vector<BatchDetection> &detections);
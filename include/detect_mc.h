@@ -0,0 +1,146 @@
+/**
+ * \file detect_mc.h
+ *
+ * \brief Monte Carlo detection performance of the Detector
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <tclap/CmdLine.h>
+#include <iostream>
+#include <complex>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+#include "sdr_config.h"
+#include "detector.h"
+#include "modulator.h"
+#include "buffer_pool.h"
+#include "worker_pool.h"
+
+/**
+ * \struct McSettings
+ *
+ * \brief The channel and the search of the trials
+ */
+struct McSettings
+{
+        double noise_amplitude = 100; //!< Noise std dev per component, as SimRadio
+        double cfo_max = 0; //!< CFOs uniform in +-cfo_max [Hz]
+        double timing_offset = 1; //!< Burst offsets uniform in +-timing_offset [samples]
+        double tolerance = 1; //!< Max timing error of a detection [samples]
+        int64_t guard = 2; //!< Guard of the search window [samples]
+        uint64_t seed = 1;
+};
+
+/**
+ * \struct McPoint
+ *
+ * \brief The trials at one SNR, summed
+ *
+ * A detection within the tolerance of the true burst index is counted
+ * as detected, any other detection as misplaced. The timing error is
+ * summed over the detected trials only.
+ */
+struct McPoint
+{
+        double snr_db = 0; //!< Per sample at the RX rate
+        bool noise_only = false; //!< No burst, every detection a false alarm
+        uint64_t no_of_trials = 0;
+        uint64_t no_of_detections = 0;
+        uint64_t no_of_misplaced = 0;
+        double sum_error = 0; //!< [samples]
+        double sum_squared_error = 0; //!< [samples^2]
+        void add(const McPoint &other);
+};
+
+/**
+ * \struct McJob
+ *
+ * \brief A block of trials at one point, run by one thread
+ *
+ * The random numbers of a job are seeded from the seed, the point and
+ * the block only, so the results do not depend on the no of threads.
+ */
+struct McJob
+{
+        size_t point = 0;
+        uint64_t block = 0;
+        size_t no_of_trials = 0;
+};
+
+/**
+ * \class McTrialRunner
+ *
+ * \brief Synthesizes and detects trials, one instance per thread
+ *
+ * A trial is a read buffer with white gaussian noise, and unless noise
+ * only, a burst from the Modulator. The burst is delayed by a uniform
+ * fractional offset from the expected index, with a windowed sinc, and
+ * rotated by a uniform CFO and carrier phase. The buffer is quantized
+ * to int16 like the radios deliver it, and searched with
+ * Detector::look_for_ping around the expected index, as the tracking
+ * tag does.
+ *
+ */
+class McTrialRunner
+{
+public:
+        /**
+         * \brief McTrialRunner constructor
+         *
+         * \param[in] dev_cfg the configuration, incl threshold_factor
+         * \param[in] code the scrambling code of the bursts
+         * \param[in] settings the channel and the search
+         */
+        McTrialRunner(const SDR_Device_Config &dev_cfg, uint32_t code,
+                      const McSettings &settings);
+        McTrialRunner(const McTrialRunner &) = delete;
+        McTrialRunner &operator=(const McTrialRunner &) = delete;
+        /**
+         * \brief Run the trials of a job
+         *
+         * \param[in] job the job
+         * \param[in,out] point the results are added to point
+         */
+        void run(const McJob &job, McPoint &point);
+        size_t get_no_of_samples() const;
+
+        static const size_t no_of_delay_taps = 16;
+
+private:
+        void synthesize(bool with_burst, double amplitude, double delay);
+
+        SDR_Device_Config m_dev_cfg;
+        McSettings m_settings;
+        std::vector<std::complex<float>> m_burst; //!< Unit amplitude
+        double m_burst_power; //!< Mean power of m_burst
+        size_t m_no_of_samples; //!< Read buffer length
+        int64_t m_expected_ix; //!< Nominal last sample of the burst
+        std::vector<std::complex<float>> m_samples;
+        std::vector<std::complex<int16_t>> m_buffer;
+        float m_taps[no_of_delay_taps];
+        std::mt19937_64 m_rng;
+        std::normal_distribution<float> m_noise;
+        std::uniform_real_distribution<double> m_uniform;
+        std::unique_ptr<BufferPool> m_pool;
+        Detector m_detector;
+};
+
+std::vector<std::complex<float>> make_mc_burst(
+        const SDR_Device_Config &dev_cfg, uint32_t code);
+void design_fractional_delay(double fraction, float *taps, size_t no_of_taps);
+std::vector<McJob> split_trials(const std::vector<McPoint> &points,
+                                uint64_t no_of_trials,
+                                uint64_t no_of_noise_trials,
+                                size_t trials_per_job);
+void write_mc_results(std::string filename,
+                      const std::vector<McPoint> &points);
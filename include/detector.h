@@ -11,11 +11,15 @@
 
 #include <vector>
 #include <complex>
+#include <memory>
 #include <armadillo>
 
 #include "macros.h"
 #include "sdr_config.h"
 #include "modulator.h"
+#include "buffer_pool.h"
+#include "burst_tracer.h"
+#include "dc_iq_corrector.h"
 
 /**
  * \brief enum
@@ -34,6 +38,16 @@ enum DetectorType {
  *
  * This class supports data detection
  *
+ * The data, the reference bursts and the correlation result are kept
+ * in buffers set up by configure, so that adding data and looking for
+ * bursts does not allocate any memory.
+ *
+ * With dev_cfg.dc_iq_correction the DC offset and the IQ imbalance are
+ * removed from the data as it is added. The estimates follow the data
+ * from one add_data to the next, see reset_front_end. Data shorter than
+ * a burst period, such as a window around an expected burst, is mostly
+ * burst and is corrected without updating the estimates.
+ *
  */
 class Detector
 {
@@ -47,13 +61,21 @@ public:
          *
          * \param[in] data the data to be analysed for detection
          */
-        void add_data(std::vector<std::complex<float>> data);
+        void add_data(const std::vector<std::complex<float>> &data);
         /**
          * \brief Add data for detection
          *
          * \param[in] data the data to be analysed for detection
          */
-        void add_data(std::vector<std::complex<int16_t>> data);
+        void add_data(const std::vector<std::complex<int16_t>> &data);
+        /**
+         * \brief Add data for detection
+         *
+         * \param[in] data the data to be analysed for detection
+         * \param[in] no_of_samples number of samples in data
+         */
+        void add_data(const std::complex<int16_t> *data,
+                      size_t no_of_samples);
         /**
          * \brief Fetch data from the detector
          *
@@ -68,7 +90,7 @@ public:
          * \brief Fetch raw data from the detector
          *
          * This is the unprocessed data as it looked when it
-         * was added to the detector.
+         * was added to the detector, after the DC and IQ correction.
          *
          * \return last data that was added to the detector
          */
@@ -84,6 +106,50 @@ public:
         void configure(DetectorType det_type,
                        std::vector<uint32_t> codes,
                        SDR_Device_Config dev_cfg);
+        /**
+         * \brief Set up parameters used in the detector
+         *
+         * The detector takes no_of_buffers buffers from the pool, each
+         * at least get_buffer_bytes large.
+         *
+         * \param[in] det_type defines what detector to use
+         * \param[in] codes a vector of cdma scrambling code numbers
+         * to search for
+         * \param[in] dev_cfg configuration paramaters
+         * \param[in] pool the pool to take the buffers from
+         */
+        void configure(DetectorType det_type,
+                       std::vector<uint32_t> codes,
+                       SDR_Device_Config dev_cfg,
+                       BufferPool &pool);
+        /**
+         * \brief Buffer size needed by the detector
+         *
+         * Large enough for all RX buffers in dev_cfg as well.
+         *
+         * \param[in] dev_cfg configuration paramaters
+         * \return the size of each buffer [bytes]
+         */
+        static size_t get_buffer_bytes(SDR_Device_Config dev_cfg);
+        /**
+         * \brief Buffer size needed by the detector
+         *
+         * \param[in] dev_cfg configuration paramaters
+         * \param[in] max_no_of_samples max number of samples added
+         * \return the size of each buffer [bytes]
+         */
+        static size_t get_buffer_bytes(const SDR_Device_Config &dev_cfg,
+                                       size_t max_no_of_samples);
+
+        static const size_t no_of_buffers = 3; //!< Buffers taken from the pool
+        /**
+         * \brief Restart the DC and IQ estimates
+         *
+         * For data that does not follow the previously added data, e.g.
+         * independent chunks or trials.
+         */
+        void reset_front_end();
+        const DcIqCorrector &get_front_end() const;
         /**
          * \brief Look for initial sync
          *
@@ -96,18 +162,97 @@ public:
          * \return index of the first detected PING, -1 if sync failed
          */
         int64_t look_for_ping(int64_t expected_ix);
+        /**
+         * \brief Look for PING bursts with a given guard
+         *
+         * \param[in] expected_ix expected index of the PING
+         * \param[in] guard guard samples around the expected index
+         * \return index of the first detected PING, -1 if sync failed
+         */
+        int64_t look_for_ping(int64_t expected_ix, int64_t guard);
         /**
          * \brief Look for PONG bursts
          *
          * \return index of the first detected PONG, -1 if sync failed
          */
         int64_t look_for_pong(int64_t expected_ix);
+        /**
+         * \brief Look for all bursts in the data
+         *
+         * Samples above the threshold closer than a burst length belong
+         * to the same burst. Used offline, where there is no expected
+         * index.
+         *
+         * \return number of found bursts, see measure_burst
+         */
+        size_t look_for_bursts();
+        /**
+         * \brief Measure a burst found by look_for_bursts
+         *
+         * Updates get_peak_position, get_peak_value and
+         * get_snr_estimate.
+         *
+         * \param[in] burst the burst, 0 to the number of bursts - 1
+         * \return index of the burst, same convention as the look_for
+         * methods
+         */
+        int64_t measure_burst(size_t burst);
         /**
          * \brief Get the correlation result
          *
          * \return a vector containing the correlation result
          */
         std::vector<float> get_corr_result();
+        /**
+         * \brief Get the correlation result in place, without a copy
+         *
+         * Valid until the next add_data.
+         *
+         * \return the correlation result, get_corr_length values
+         */
+        const float *get_corr_data() const;
+        size_t get_corr_length() const;
+        /**
+         * \brief Position of the last found burst with sub-sample precision
+         *
+         * The correlation peak of the last found initial sync, PING or
+         * PONG, refined with a parabola through the peak and its
+         * neighbours. Same index convention as the look_for methods.
+         *
+         * \return the peak position, -1 if no burst has been found
+         */
+        double get_peak_position() const;
+        /**
+         * \brief Correlation peak of the last found burst
+         *
+         * \return the magnitude of the correlation at the peak
+         */
+        double get_peak_value() const;
+        /**
+         * \brief SNR of the last found burst
+         *
+         * Estimated from how much of the energy of the data under the
+         * burst that the correlation peak explains.
+         *
+         * \return the SNR estimate [dB]
+         */
+        double get_snr_estimate() const;
+        /**
+         * \brief Get the detection threshold of the last detection
+         *
+         * \return the threshold, in the unit of get_peak_value
+         */
+        double get_threshold() const;
+        /**
+         * \brief Set the clock drift used in the initial sync
+         *
+         * The expected spacing between the PINGs is corrected for the
+         * drift, and drift_max_sync_error replaces max_sync_error.
+         *
+         * \param[in] drift_ppm the PING period in the local clock,
+         * relative to the nominal burst_period [ppm]
+         */
+        void set_clock_drift(double drift_ppm);
         /**
          * \brief Check if initial sync index was found
          *
@@ -130,25 +275,46 @@ public:
          */
         bool found_pong(int64_t ix);
 private:
-        arma::uvec detect_cdma_bursts();
-        void correlate_cdma(uint32_t code_nr);
-        arma::vec correlate(arma::vec ref, arma::vec rx_data);
-        arma::vec correlate(arma::cx_vec ref);
-        double calculate_threshold();
-        arma::uvec find_peaks(double threshold);
-        int64_t find_initial_sync_ix(arma::uvec peak_indexes);
+        friend struct DspBench; //!< Benchmarks the private kernels
+
+        size_t detect_cdma_bursts();
+        void correlate_cdma(size_t code_ix);
+        void correlate(const std::vector<float> &ref_re,
+                       const std::vector<float> &ref_im);
+        double calculate_threshold(size_t ref_length);
+        size_t find_peaks(double threshold);
+        int64_t find_initial_sync_ix(size_t no_of_peaks);
         bool spacing_ok(int64_t burst_spacing);
         bool found_ok_index(int64_t ix);
-        int64_t check_bursts_for_intial_sync_index(arma::uvec peak_indexes);
-        int64_t check_bursts_for_ping_index(arma::uvec peak_indexes);
+        int64_t check_bursts_for_intial_sync_index(size_t no_of_peaks);
+        int64_t check_bursts_for_ping_index(size_t no_of_peaks);
         int64_t reduce_buffer_data(int64_t expected_ix, int64_t guard);
+        void measure_peak(size_t corr_ix);
+        double estimate_snr(size_t corr_ix);
 
-        arma::cx_vec m_data;
-        arma::cx_vec m_raw_data;
+        std::shared_ptr<BufferPool> m_own_pool;
+        std::unique_ptr<PoolBuffer<float>> m_data_re; //!< Raw data, real
+        std::unique_ptr<PoolBuffer<float>> m_data_im; //!< Raw data, imag
+        std::unique_ptr<PoolBuffer<float>> m_corr_result;
+        DcIqCorrector m_front_end;
+        size_t m_front_end_min_samples; //!< To update the estimates
+        size_t m_raw_length;
+        size_t m_data_offset; //!< Start of the processed data in raw data
+        size_t m_data_length;
+        size_t m_corr_length;
+        std::vector<std::vector<float>> m_reference_re; //!< Per code
+        std::vector<std::vector<float>> m_reference_im; //!< Per code
+        std::vector<uint64_t> m_peaks;
+        double m_peak_position;
+        double m_peak_value;
+        double m_snr_db;
+        double m_threshold;
+        size_t m_code_ix; //!< Code of the last correlation
+        double m_drift_ppm;
+        bool m_drift_known;
         DetectorType m_det_type;
         std::vector<uint32_t> m_codes;
         SDR_Device_Config m_dev_cfg;
-        arma::vec m_corr_result;
-        arma::cx_vec m_reference;
         bool m_is_beacon;
+        bool m_avx2; //!< Use the AVX2 correlation, checked at run time
 };
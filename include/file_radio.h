@@ -0,0 +1,131 @@
+/**
+ * \file file_radio.h
+ *
+ * \brief File replay radio class
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <string>
+#include <cstdio>
+#include <atomic>
+
+#include "macros.h"
+#include "sdr_config.h"
+#include "radio.h"
+#include "sample_file.h"
+
+/**
+ * \class FileRadio
+ *
+ * \brief A radio replaying a SigMF recording
+ *
+ * RX data is read from a ci16_le SigMF recording, as written with
+ * the -r option, or from a .cs16 or .cf32 sample file. The recording is
+ * replayed in a loop, with the hw time continuing from the time of the
+ * first recorded sample. TX data is thrown away.
+ *
+ */
+class FileRadio : public Radio
+{
+public:
+        /**
+         * \brief FileRadio constructor
+         *
+         * \param[in] basename the recording, without extension, or a
+         * sample file with its extension
+         */
+        FileRadio(std::string basename);
+        ~FileRadio();
+        /**
+         * \brief Configure the radio
+         *
+         * \param[in] dev_cfg A struct carrying the configuration
+         */
+        void configure(SDR_Device_Config dev_cfg);
+        /**
+         * \brief Start the replay
+         *
+         * \return the hw ticks at start
+         */
+        int64_t start();
+        /**
+         * \brief Read recorded data
+         *
+         * \param[in] no_of_samples number of samples to read
+         * \param[out] buff_data the recorded data
+         * \return number of read samples
+         */
+        int32_t read(size_t no_of_samples,
+                     std::complex<int16_t> *buff_data);
+        /**
+         * \brief Read recorded data for a gated window
+         *
+         * The recorded samples before the window are skipped.
+         *
+         * \param[in] start_hw_ns hw time of the first sample
+         * \param[in] no_of_samples number of samples to read
+         * \param[out] buff_data the recorded data
+         * \return number of read samples, SOAPY_SDR_TIME_ERROR if the
+         * window has already passed
+         */
+        int32_t read_window(int64_t start_hw_ns, size_t no_of_samples,
+                            std::complex<int16_t> *buff_data);
+        /**
+         * \brief Transmit data
+         *
+         * The data is thrown away, see SimRadio::write.
+         *
+         * \param[in] data the data to be transmitted
+         * \param[in] no_of_samples the number of tx samples
+         * \param[in] burst_time the timestamp of transmission [ns]
+         * \return the number of transmitted samples
+         */
+        size_t write(const std::vector<void *> &data, size_t no_of_samples,
+                     long long int burst_time);
+        /**
+         * \brief Get the current replay hw time
+         *
+         * \return the hw time in ns
+         */
+        int64_t get_hardware_time();
+        /**
+         * \brief Check if burst_time has passed
+         *
+         * \param[in] burst_hw_ns the time to check
+         * \return the time left to the burst, negative if passed [ns]
+         */
+        int64_t check_burst_time(long long int burst_hw_ns);
+        /**
+         * \brief Stop the replay
+         */
+        void close();
+
+private:
+        void open_recording();
+        void read_meta();
+        int32_t read_samples(size_t no_of_samples,
+                             std::complex<int16_t> *buff_data,
+                             int64_t &time_hw_ns, int &flags);
+        double meta_value(std::string meta, std::string key,
+                          double default_value);
+        uint64_t tell_samples();
+        void seek_samples(uint64_t pos);
+
+        std::string m_basename;
+        std::FILE *m_data_file; //!< nullptr for a sample file
+        SampleFile m_sample_file;
+        uint64_t m_sample_file_pos; //!< Next sample in m_sample_file
+        SimClock m_clock;
+        double m_sample_rate;
+        int64_t m_first_hw_ns;
+        uint64_t m_sample_count;
+        uint64_t m_file_samples;
+        uint64_t m_no_of_replays;
+};
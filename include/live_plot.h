@@ -0,0 +1,163 @@
+/**
+ * \file live_plot.h
+ *
+ * \brief Live plot of the RX data and the correlation, while running
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <complex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+#include "sdr_config.h"
+
+/**
+ * \struct LivePlotFrame
+ *
+ * \brief Min/max envelopes of one correlation and its RX data
+ */
+struct LivePlotFrame
+{
+        std::vector<float> corr_min;
+        std::vector<float> corr_max;
+        std::vector<float> mag_min; //!< Of the sample magnitudes
+        std::vector<float> mag_max;
+        size_t no_of_corr_bins = 0; //!< Bins in use
+        size_t no_of_mag_bins = 0;
+        size_t corr_length = 0; //!< Decimated values
+        size_t no_of_samples = 0;
+        uint64_t frame_no = 0;
+};
+
+/**
+ * \struct LiveSpectrumFrame
+ *
+ * \brief Min/max envelope of one PSD, and of its max hold
+ */
+struct LiveSpectrumFrame
+{
+        std::vector<float> psd_min;
+        std::vector<float> psd_max;
+        std::vector<float> hold_min; //!< Of the max hold, not plotted
+        std::vector<float> hold_max;
+        size_t no_of_bins = 0; //!< Bins in use
+        size_t no_of_psd_bins = 0; //!< Decimated values
+        bool has_max_hold = false;
+        double start_hz = 0; //!< Frequency of the first PSD bin [Hz]
+        double bin_hz = 0; //!< Width of a PSD bin [Hz]
+        uint64_t frame_no = 0;
+};
+
+/**
+ * \class LivePlot
+ *
+ * \brief Plots decimated envelopes in a persistent gnuplot, in its own thread
+ *
+ * push is called from the RX or detection loop. At most live_plot_rate
+ * times per second it decimates the correlation and the magnitude of
+ * the samples to live_plot_bins min/max pairs each, and hands the frame
+ * to the plot thread without waiting. The plot thread writes the
+ * frames to a gnuplot pipe. A frame is dropped if the plot thread holds
+ * the hand-over, or if gnuplot has not drawn the previous one yet.
+ *
+ * With dev_cfg.spectrum the PSD frames of the SpectrumMonitor are
+ * shown in a third panel, handed over the same way by push_spectrum.
+ *
+ * push does not allocate, so it can be used in the alloc check.
+ *
+ */
+class LivePlot
+{
+public:
+        /**
+         * \brief LivePlot constructor, starts gnuplot and the thread
+         *
+         * Nothing is started unless dev_cfg.live_plot is set.
+         *
+         * \param[in] dev_cfg configuration parameters
+         */
+        LivePlot(const SDR_Device_Config &dev_cfg);
+        /**
+         * \brief LivePlot destructor, stops the thread and closes the pipe
+         *
+         * The last frame stays on the screen.
+         */
+        ~LivePlot();
+        LivePlot(const LivePlot &) = delete;
+        LivePlot &operator=(const LivePlot &) = delete;
+        bool is_enabled() const;
+        /**
+         * \brief Offer a correlation and its RX data for plotting
+         *
+         * Returns at once when it is not time for a new frame.
+         *
+         * \param[in] corr the correlation, e.g. Detector::get_corr_data
+         * \param[in] corr_length number of values in corr
+         * \param[in] samples the RX data
+         * \param[in] no_of_samples number of samples
+         */
+        void push(const float *corr, size_t corr_length,
+                  const std::complex<int16_t> *samples,
+                  size_t no_of_samples);
+        /**
+         * \brief Offer a PSD for plotting
+         *
+         * Returns at once when it is not time for a new frame.
+         *
+         * \param[in] psd_db the PSD, from start_hz and up
+         * \param[in] max_hold_db the max hold, nullptr if none
+         * \param[in] no_of_bins number of PSD bins
+         * \param[in] start_hz frequency of the first bin [Hz]
+         * \param[in] bin_hz width of a bin [Hz]
+         */
+        void push_spectrum(const float *psd_db, const float *max_hold_db,
+                           size_t no_of_bins, double start_hz,
+                           double bin_hz);
+        uint64_t get_no_of_frames() const;
+        uint64_t get_no_of_dropped() const;
+
+private:
+        void plot_loop();
+        bool write_frame(const LivePlotFrame &frame,
+                         const LiveSpectrumFrame &spectrum);
+
+        bool m_enabled;
+        bool m_spectrum; //!< A PSD panel
+        int64_t m_frame_period_ns;
+        int64_t m_next_frame_ns; //!< Only used by push
+        int64_t m_next_spectrum_ns; //!< Only used by push_spectrum
+        uint64_t m_frame_no;
+        uint64_t m_spectrum_no;
+        FILE *m_pipe;
+        LivePlotFrame m_fill; //!< Decimated into by push
+        LivePlotFrame m_pending; //!< Handed over, under m_mutex
+        LivePlotFrame m_plot; //!< Written by the plot thread
+        LiveSpectrumFrame m_spectrum_fill;
+        LiveSpectrumFrame m_spectrum_pending;
+        LiveSpectrumFrame m_spectrum_plot;
+        bool m_has_pending;
+        bool m_has_spectrum_pending;
+        bool m_stop;
+        std::atomic<bool> m_failed; //!< The pipe is closed
+        std::atomic<uint64_t> m_no_of_frames;
+        std::atomic<uint64_t> m_no_of_dropped;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::thread m_thread;
+};
+
+size_t decimate_min_max(const float *data, size_t length, size_t no_of_bins,
+                        float *min, float *max);
+size_t decimate_magnitude_min_max(const std::complex<int16_t> *samples,
+                                  size_t no_of_samples, size_t no_of_bins,
+                                  float *min, float *max);
@@ -0,0 +1,297 @@
+/**
+ * \file logger.h
+ *
+ * \brief Asynchronous logging from the streaming loops
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <SoapySDR/Logger.hpp>
+
+#include "macros.h"
+
+/**
+ * \struct LogArg
+ *
+ * \brief An argument of a log record, formatted by the logger thread
+ */
+struct LogArg
+{
+        char type; //!< 'i' signed, 'u' unsigned, 'd' double, 's' string
+        union {
+                int64_t i;
+                uint64_t u;
+                double d;
+                const char *s; //!< Static strings only
+        };
+};
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value &&
+                        std::is_signed<T>::value, LogArg>::type
+make_log_arg(T value)
+{
+        LogArg arg;
+        arg.type = 'i';
+        arg.i = value;
+        return arg;
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value &&
+                        std::is_unsigned<T>::value, LogArg>::type
+make_log_arg(T value)
+{
+        LogArg arg;
+        arg.type = 'u';
+        arg.u = value;
+        return arg;
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value, LogArg>::type
+make_log_arg(T value)
+{
+        LogArg arg;
+        arg.type = 'd';
+        arg.d = value;
+        return arg;
+}
+
+inline LogArg make_log_arg(const char *value)
+{
+        LogArg arg;
+        arg.type = 's';
+        arg.s = value;
+        return arg;
+}
+
+/**
+ * \struct LogRecord
+ *
+ * \brief A message as written by the logging thread
+ *
+ * The format is a static string, where each {} is replaced by the next
+ * argument. At most one string that is not static can be copied into
+ * text, and is then formatted in place of the first {} after the
+ * arguments.
+ */
+struct LogRecord
+{
+        static const size_t max_no_of_args = 8;
+        static const size_t max_text_length = 192;
+
+        const char *format;
+        int64_t time_ns; //!< Monotonic time, orders the threads
+        SoapySDRLogLevel level;
+        uint8_t no_of_args;
+        bool has_text;
+        bool raw; //!< Written as is, without a newline
+        LogArg args[max_no_of_args];
+        char text[max_text_length];
+};
+
+/**
+ * \class LogRing
+ *
+ * \brief Single producer, single consumer ring of log records
+ */
+class LogRing
+{
+public:
+        static const size_t no_of_records = 1024;
+
+        LogRing();
+        LogRing(const LogRing &) = delete;
+        LogRing &operator=(const LogRing &) = delete;
+        /**
+         * \brief Get the record to fill, producer only
+         *
+         * \return the record, nullptr if the ring is full
+         */
+        LogRecord *get_fill_record();
+        /**
+         * \brief Publish the record from get_fill_record, producer only
+         */
+        void push();
+        /**
+         * \brief Get the oldest record, consumer only
+         *
+         * \return the record, nullptr if the ring is empty
+         */
+        const LogRecord *front() const;
+        /**
+         * \brief Release the record from front, consumer only
+         */
+        void pop();
+
+private:
+        std::unique_ptr<LogRecord[]> m_records;
+        std::atomic<uint64_t> m_head; //!< Records pushed
+        std::atomic<uint64_t> m_tail; //!< Records popped
+};
+
+/**
+ * \class Logger
+ *
+ * \brief Logging that does not block the real-time threads
+ *
+ * A log call checks the level, then copies the format, which must be a
+ * string literal, and the arguments into a record in a ring owned by
+ * the calling thread. It does no formatting, no allocation and no
+ * system call. The logger thread merges the rings of all threads in
+ * time order, formats the records and writes them to std::cout once
+ * per batch.
+ *
+ * When a ring is full the record is dropped and counted, the threads
+ * are never blocked. Before start and after stop, and in threads
+ * beyond max_no_of_rings, records are formatted and written directly.
+ *
+ * The level can be changed at any time. SoapySDR messages are logged
+ * through the same rings by soapy_log_handler.
+ *
+ */
+class Logger
+{
+public:
+        static const size_t max_no_of_rings = 32;
+
+        Logger();
+        ~Logger();
+        Logger(const Logger &) = delete;
+        Logger &operator=(const Logger &) = delete;
+        /**
+         * \brief Start the logger thread
+         */
+        void start();
+        /**
+         * \brief Write all logged records and stop the logger thread
+         */
+        void stop();
+        /**
+         * \brief Set the most detailed level that is logged
+         *
+         * \param[in] level the level, e.g. SOAPY_SDR_INFO
+         */
+        void set_level(SoapySDRLogLevel level);
+        SoapySDRLogLevel get_level() const;
+        /**
+         * \brief Check if a level is logged
+         *
+         * \param[in] level the level
+         * \return true if logged
+         */
+        bool is_enabled(SoapySDRLogLevel level) const
+        {
+                return level <= m_level.load(std::memory_order_relaxed);
+        }
+        /**
+         * \brief Set up the ring of the calling thread
+         *
+         * Done by the first log call of a thread otherwise, which
+         * allocates the ring.
+         */
+        void register_thread();
+        /**
+         * \brief Log a message
+         *
+         * \param[in] level the level
+         * \param[in] format string literal with a {} for each argument
+         * \param[in] args integers, floating point values or string
+         * literals
+         */
+        template <typename... Args>
+        void log(SoapySDRLogLevel level, const char *format, Args... args)
+        {
+                if (!is_enabled(level)) {
+                        return;
+                }
+                const LogArg log_args[] = {make_log_arg(args)...};
+                static_assert(sizeof...(Args) <= LogRecord::max_no_of_args,
+                              "Too many log arguments");
+                write(level, format, log_args, sizeof...(Args), nullptr,
+                      false);
+        }
+        void log(SoapySDRLogLevel level, const char *format)
+        {
+                if (!is_enabled(level)) {
+                        return;
+                }
+                write(level, format, nullptr, 0, nullptr, false);
+        }
+        /**
+         * \brief Log a message with a copied string
+         *
+         * \param[in] level the level
+         * \param[in] format string literal with a {} for the text
+         * \param[in] text the string, truncated to max_text_length
+         */
+        void log_text(SoapySDRLogLevel level, const char *format,
+                      const char *text);
+        /**
+         * \brief Write a string literal without a newline, e.g. a spinner
+         *
+         * \param[in] level the level
+         * \param[in] text string literal
+         */
+        void write_raw(SoapySDRLogLevel level, const char *text);
+        /**
+         * \brief Wait until all logged records are written
+         *
+         * Call before writing to std::cout directly, e.g. a summary,
+         * so that the output stays in order.
+         */
+        void flush();
+        /**
+         * \brief Records dropped since start because a ring was full
+         *
+         * \return the number of records
+         */
+        uint64_t get_no_of_dropped() const;
+
+private:
+        void write(SoapySDRLogLevel level, const char *format,
+                   const LogArg *args, size_t no_of_args, const char *text,
+                   bool raw);
+        LogRing *get_ring();
+        void logger_loop();
+        bool is_drained() const;
+        size_t drain(std::string &out);
+
+        std::atomic<int> m_level;
+        std::atomic<bool> m_running;
+        std::atomic<bool> m_stop;
+        std::atomic<uint64_t> m_no_of_dropped;
+        std::atomic<uint32_t> m_no_of_rings;
+        std::unique_ptr<LogRing> m_rings[max_no_of_rings];
+        std::atomic<LogRing *> m_ring_ptrs[max_no_of_rings];
+        std::mutex m_write_mutex; //!< Serialises the writes to std::cout
+        std::thread m_thread;
+};
+
+extern Logger g_logger;
+
+/**
+ * \brief Format a record
+ *
+ * \param[in] record the record
+ * \param[out] out the formatted message is appended to out
+ */
+void format_log_record(const LogRecord &record, std::string &out);
+
+/**
+ * \brief SoapySDR log handler, logs through g_logger
+ *
+ * Install with SoapySDR::registerLogHandler.
+ */
+void soapy_log_handler(const SoapySDRLogLevel level, const char *message);
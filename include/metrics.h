@@ -0,0 +1,305 @@
+/**
+ * \file metrics.h
+ *
+ * \brief Counters and latency histograms for monitoring
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+
+/**
+ * \class Counter
+ *
+ * \brief A monotonic counter, exported as a Prometheus counter
+ */
+class Counter
+{
+public:
+        /**
+         * \brief Counter constructor
+         *
+         * \param[in] name the metric name
+         * \param[in] help the description of the metric
+         */
+        Counter(std::string name, std::string help);
+        /**
+         * \brief Count
+         *
+         * \param[in] n the increment
+         */
+        void add(uint64_t n = 1)
+        {
+                m_value.fetch_add(n, std::memory_order_relaxed);
+        }
+        /**
+         * \brief Get the count
+         *
+         * \return the count
+         */
+        uint64_t get() const;
+        std::string get_name() const;
+        std::string get_help() const;
+
+private:
+        std::string m_name;
+        std::string m_help;
+        std::atomic<uint64_t> m_value;
+};
+
+/**
+ * \struct HistogramSnapshot
+ *
+ * \brief The buckets of a Histogram, summed over the threads
+ */
+struct HistogramSnapshot
+{
+        std::vector<uint64_t> counts; //!< Count per bucket
+        uint64_t count; //!< Number of values
+        int64_t sum; //!< Sum of the values [units]
+        /**
+         * \brief Value at a quantile
+         *
+         * \param[in] q the quantile [0,1]
+         * \return the largest value of the bucket holding the quantile,
+         * bucket_upper - 1 [units]
+         */
+        uint64_t quantile(double q) const;
+        /**
+         * \brief Number of values up to a bound, as a Prometheus le
+         *
+         * Counts the buckets whose largest value is at most bound.
+         *
+         * \param[in] bound the bound, inclusive [units]
+         * \return the number of values in those buckets
+         */
+        uint64_t count_up_to(uint64_t bound) const;
+};
+
+/**
+ * \class Histogram
+ *
+ * \brief A histogram with logarithmic buckets of constant relative size
+ *
+ * Values are integers in the unit given at construction, e.g. ns. The
+ * values below 32 have a bucket each, above that every power of two is
+ * split into 16 buckets, so a bucket is at most 1/16 of its value wide,
+ * as in an HDR histogram. Negative values are counted in the first
+ * bucket, but added to the sum as they are, values above max_value in
+ * the last bucket.
+ *
+ * Each thread counts into its own preallocated shard, so recording is
+ * a few relaxed atomic adds on cache lines no other thread writes, and
+ * never allocates. A snapshot sums the shards.
+ *
+ */
+class Histogram
+{
+public:
+        /**
+         * \brief Histogram constructor
+         *
+         * \param[in] name the metric name
+         * \param[in] help the description of the metric
+         * \param[in] unit the value of one unit in the exported base
+         * unit, e.g. 1e-9 for values in ns exported in seconds
+         */
+        Histogram(std::string name, std::string help, double unit);
+        Histogram(const Histogram &) = delete;
+        Histogram &operator=(const Histogram &) = delete;
+        /**
+         * \brief Record a value
+         *
+         * \param[in] value the value [units]
+         */
+        void record(int64_t value);
+        /**
+         * \brief Sum the shards of all threads
+         *
+         * \return the snapshot
+         */
+        HistogramSnapshot snapshot() const;
+        std::string get_name() const;
+        std::string get_help() const;
+        double get_unit() const;
+        /**
+         * \brief Bucket of a value
+         *
+         * \param[in] value the value [units]
+         * \return the bucket index
+         */
+        static size_t bucket_index(uint64_t value);
+        /**
+         * \brief Upper bound of a bucket
+         *
+         * \param[in] bucket the bucket index
+         * \return the lowest value of the next bucket [units]
+         */
+        static uint64_t bucket_upper(size_t bucket);
+
+        static const size_t sub_bucket_bits = 5;
+        static const size_t max_value_bits = 40; //!< About 18 min in ns
+        static const size_t no_of_buckets =
+                (max_value_bits - sub_bucket_bits + 2) *
+                (1 << (sub_bucket_bits - 1));
+        static const size_t max_no_of_shards = 16;
+
+private:
+        struct Shard {
+                std::atomic<uint64_t> counts[no_of_buckets];
+                std::atomic<int64_t> sum;
+        };
+
+        std::string m_name;
+        std::string m_help;
+        double m_unit;
+        std::unique_ptr<Shard[]> m_shards;
+};
+
+/**
+ * \class MetricsRegistry
+ *
+ * \brief Owns the metrics and writes them in the Prometheus text format
+ *
+ * The metrics are added at start-up, after that they are only updated
+ * and read, which needs no lock.
+ *
+ */
+class MetricsRegistry
+{
+public:
+        MetricsRegistry();
+        MetricsRegistry(const MetricsRegistry &) = delete;
+        MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+        /**
+         * \brief Add a counter
+         *
+         * \param[in] name the metric name, should end with _total
+         * \param[in] help the description of the metric
+         * \return the counter, valid as long as the registry
+         */
+        Counter &add_counter(std::string name, std::string help);
+        /**
+         * \brief Add a histogram
+         *
+         * \param[in] name the metric name, with the base unit
+         * \param[in] help the description of the metric
+         * \param[in] unit the value of one recorded unit in the base unit
+         * \return the histogram, valid as long as the registry
+         */
+        Histogram &add_histogram(std::string name, std::string help,
+                                 double unit);
+        /**
+         * \brief Write all metrics in the Prometheus text format
+         *
+         * \param[in] out the stream to write to
+         */
+        void write(std::ostream &out) const;
+        /**
+         * \brief Write all metrics to a textfile collector file
+         *
+         * Written to filename.tmp and renamed, so that the collector
+         * never reads a partial file.
+         *
+         * \param[in] filename the file, should end with .prom
+         */
+        void write_textfile(std::string filename) const;
+
+private:
+        std::vector<std::unique_ptr<Counter>> m_counters;
+        std::vector<std::unique_ptr<Histogram>> m_histograms;
+};
+
+/**
+ * \struct RangingMetrics
+ *
+ * \brief The metrics of the beacon and the tag
+ */
+struct RangingMetrics
+{
+        /**
+         * \brief RangingMetrics constructor, adds the metrics
+         *
+         * \param[in] registry the registry to add them to
+         */
+        explicit RangingMetrics(MetricsRegistry &registry);
+
+        MetricsRegistry &registry;
+        Counter &overflows;
+        Counter &underflows;
+        Counter &timeouts;
+        Counter &found_pings;
+        Counter &missed_pings;
+        Counter &found_pongs;
+        Counter &missed_pongs;
+        Counter &resyncs;
+        Counter &late_bursts;
+        Histogram &detection_latency; //!< [ns]
+        Histogram &tx_slack; //!< [ns]
+        Histogram &peak_to_threshold; //!< [1/1000]
+};
+
+extern RangingMetrics g_metrics;
+
+/**
+ * \brief Count a stream error, by its SoapySDR code
+ *
+ * \param[in] ret the return code of a stream call
+ */
+void count_stream_error(int ret);
+
+/**
+ * \brief Record the TX slack of a burst, and count it if late
+ *
+ * \param[in] slack_ns burst time minus hw time at submit [ns]
+ */
+void record_tx_slack(int64_t slack_ns);
+
+/**
+ * \class MetricsWriter
+ *
+ * \brief Writes a registry to a textfile periodically, in its own thread
+ *
+ */
+class MetricsWriter
+{
+public:
+        /**
+         * \brief MetricsWriter constructor, starts the thread
+         *
+         * \param[in] registry the metrics to write
+         * \param[in] filename the file, not written if ""
+         * \param[in] period time between the writes [s]
+         */
+        MetricsWriter(const MetricsRegistry &registry, std::string filename,
+                      double period);
+        /**
+         * \brief MetricsWriter destructor, writes a last time and stops
+         */
+        ~MetricsWriter();
+        MetricsWriter(const MetricsWriter &) = delete;
+        MetricsWriter &operator=(const MetricsWriter &) = delete;
+
+private:
+        void writer_loop();
+
+        const MetricsRegistry &m_registry;
+        std::string m_filename;
+        double m_period;
+        bool m_stop;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::thread m_thread;
+};
@@ -79,6 +79,8 @@ public:
          */
         void scrap_samples(size_t no_to_scrap);
 private:
+        friend struct DspBench; //!< Benchmarks the private kernels
+
         void gen_scr_code(uint16_t code_nr, arma::cx_vec & Z);
         arma::cx_vec repvecN(arma::cx_vec vect);
         void shift_N(arma::vec & x, arma::vec & y, int32_t N_shifts);
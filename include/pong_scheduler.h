@@ -0,0 +1,94 @@
+/**
+ * \file pong_scheduler.h
+ *
+ * \brief Scheduling of the PONGs of the tag
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+
+#include "macros.h"
+#include "sdr_config.h"
+
+/**
+ * \class PongScheduler
+ *
+ * \brief Chooses the turnaround from a PING to its PONG
+ *
+ * The beacon only sees the turnaround modulo burst_period, see
+ * calculate_tof, so the tag is free to answer any whole number of burst
+ * periods earlier than pong_delay + pong_delay_processing. In low
+ * latency mode (pong_low_latency) the scheduler picks the earliest
+ * period that leaves pong_min_slack between the end of the detection
+ * and the PONG. The detection latency is measured on every PING, and
+ * its mean and standard deviation are tracked, so a slow detection
+ * now and then moves the PONG one period later before it is missed.
+ *
+ * Otherwise the configured turnaround is used, and only the slack is
+ * measured.
+ *
+ */
+class PongScheduler
+{
+public:
+        /**
+         * \brief PongScheduler constructor
+         */
+        PongScheduler();
+        /**
+         * \brief Set up the scheduler
+         *
+         * \param[in] dev_cfg configuration paramaters
+         */
+        void configure(const SDR_Device_Config &dev_cfg);
+        /**
+         * \brief Choose the turnaround of a PONG
+         *
+         * \param[in] ping_hw_ns hw time of the detected PING
+         * \param[in] now_hw_ns hw time when the detection was done
+         * \return the time from the PING to the PONG, including the
+         * slot offset [s]
+         */
+        double schedule(int64_t ping_hw_ns, int64_t now_hw_ns);
+        /**
+         * \brief Slack of the last PONG
+         *
+         * \return the time from the end of the detection to the PONG,
+         * negative if it was late [s]
+         */
+        double get_slack() const;
+        /**
+         * \brief Detection latency of the last PING
+         *
+         * \return the time from the PING to the end of its detection [s]
+         */
+        double get_latency() const;
+        /**
+         * \brief Burst periods added to the shortest turnaround
+         *
+         * \return the number of periods used for the last PONG
+         */
+        int64_t get_no_of_periods() const;
+        /**
+         * \brief Print turnaround, latency and slack statistics
+         */
+        void print_stats() const;
+
+private:
+        SDR_Device_Config m_dev_cfg;
+        double m_base; //!< Shortest turnaround with the beacon's phase [s]
+        int64_t m_max_periods; //!< Periods of the configured turnaround
+        int64_t m_periods;
+        double m_latency_mean; //!< [s]
+        double m_latency_variance; //!< [s^2]
+        double m_latency; //!< Of the last PING [s]
+        double m_slack;
+        double m_min_slack;
+        double m_slack_sum;
+        uint64_t m_no_of_pongs;
+        uint64_t m_no_of_late;
+};
@@ -0,0 +1,224 @@
+/**
+ * \file radio.h
+ *
+ * \brief Radio base class
+ *
+ * Common functionality for the radios the tag and the beacon can run on.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "macros.h"
+#include "sdr_config.h"
+#include "sigmf_writer.h"
+#include "rx_timeline.h"
+#include "burst_tracer.h"
+
+/**
+ * \class Radio
+ *
+ * \brief Base class for radios
+ *
+ * The main loops of the tag and the beacon are templates on the radio
+ * type, so that the same loop runs on hardware (SDR), on synthetic data
+ * (SimRadio) or on a recording (FileRadio), without any virtual calls
+ * in the loop. A radio type must derive from this class and implement:
+ *
+ * \li void configure(SDR_Device_Config dev_cfg)
+ * \li int64_t start(), returning the hw ticks at start
+ * \li int32_t read(size_t no_of_samples,
+ *     std::complex<int16_t> *buff_data), buff_data must hold
+ *     no_of_samples samples
+ * \li int32_t read_window(int64_t start_hw_ns, size_t no_of_samples,
+ *     std::complex<int16_t> *buff_data), receiving only
+ *     the samples from start_hw_ns on (gated RX)
+ * \li size_t write(const std::vector<void *> &data, size_t no_of_samples,
+ *     long long int burst_time)
+ * \li int64_t get_hardware_time(), returning the hw time in ns
+ * \li int64_t check_burst_time(long long int burst_hw_ns), returning the
+ *     time left to the burst in ns
+ * \li void close()
+ *
+ * This class keeps a timeline of the received RX buffers, see
+ * RxTimeline, and maps indexes in the last buffer to hw time. It also
+ * handles the SigMF recording of RX data.
+ *
+ */
+class Radio
+{
+public:
+        /**
+         * \brief Radio constructor
+         */
+        Radio();
+        /**
+         * \brief Convert an index into an absolute hw time
+         *
+         * \param[in] ix the index to convert
+         * \return the hw time in ns
+         */
+        int64_t ix_to_hw_ns(int64_t ix);
+        /**
+         * \brief Convert a hw time into an index in the last read buffer
+         *
+         * \param[in] time_hw_ns the hw time to convert
+         * \return the position of the time, see RxTimeline::locate
+         */
+        RxPosition locate(double time_hw_ns);
+        /**
+         * \brief Based on a sync time find index of next PING
+         *
+         * The PINGs are periodic in hw time, so the index is valid also
+         * if samples have been lost since the sync.
+         *
+         * \param[in] hw_time_of_sync the last sync time
+         * \return index of next expected PING
+         */
+        int64_t find_exp_ping_pos_ix(int64_t hw_time_of_sync);
+        /**
+         * \brief Based on a sync time find index of next PONG
+         *
+         * \param[in] hw_time_of_sync the last sync time
+         * \return index of next expected PONG
+         */
+        int64_t find_exp_pong_pos_ix(int64_t hw_time_of_sync);
+        /**
+         * \brief Annotate a burst in the SigMF recording
+         *
+         * Does nothing if the radio is not recording.
+         *
+         * \param[in] ix index of the burst in the last read buffer
+         * \param[in] label the annotation, e.g. PING or PONG
+         */
+        void annotate(int64_t ix, std::string label);
+        /**
+         * \brief Check if samples were lost before the last read buffer
+         *
+         * \return true if the last buffer did not follow the previous one
+         */
+        bool rx_discontinuity();
+        /**
+         * \brief Get the timeline of the received RX buffers
+         *
+         * \return the RX timeline
+         */
+        const RxTimeline &get_rx_timeline();
+
+protected:
+        /**
+         * \brief Book keeping of a received RX buffer
+         *
+         * Should be called by the radio for every successful read.
+         *
+         * \param[in] data the received samples
+         * \param[in] no_of_samples number of received samples
+         * \param[in] time_hw_ns hw time of the first sample
+         * \param[in] flags the flags returned from the stream read
+         */
+        void store_rx_block(const std::complex<int16_t> *data,
+                            int32_t no_of_samples,
+                            int64_t time_hw_ns,
+                            int flags);
+        /**
+         * \brief Book keeping of a buffer received in a gated window
+         *
+         * Like store_rx_block, but the gap since the previous buffer
+         * is not counted as a discontinuity.
+         *
+         * \param[in] data the received samples
+         * \param[in] no_of_samples number of received samples
+         * \param[in] time_hw_ns hw time of the first sample
+         */
+        void store_rx_window(const std::complex<int16_t> *data,
+                             int32_t no_of_samples,
+                             int64_t time_hw_ns);
+        /**
+         * \brief Set up the RX timeline from m_dev_cfg
+         *
+         * Should be called by the radio when configured.
+         */
+        void configure_timeline();
+        /**
+         * \brief Start a SigMF recording of the RX data
+         *
+         * \param[in] sample_rate the RX sampling rate [Hz]
+         * \param[in] frequency the RX center frequency [Hz]
+         * \param[in] rx_gain the RX gain [dB]
+         * \param[in] tx_gain the TX gain [dB]
+         * \param[in] hw description of the hardware
+         */
+        void start_recording(double sample_rate, double frequency,
+                             double rx_gain, double tx_gain,
+                             std::string hw);
+        /**
+         * \brief Close the SigMF recording, if any
+         */
+        void close_recording();
+
+        SDR_Device_Config m_dev_cfg;
+        RxTimeline m_timeline;
+
+private:
+        void record_rx_block(const std::complex<int16_t> *data,
+                             int32_t no_of_samples,
+                             int64_t time_hw_ns,
+                             bool new_capture);
+
+        std::shared_ptr<SigMFWriter> m_recorder;
+        uint64_t m_last_rx_record_ix;
+};
+
+/**
+ * \class SimClock
+ *
+ * \brief A hw clock driven by the RX sample stream
+ *
+ * Used by radios without hardware. The time is advanced when samples
+ * are read, and a TX burst is held back until the clock is close to
+ * the burst time, much like the TX buffers of a real device would.
+ *
+ */
+class SimClock
+{
+public:
+        /**
+         * \brief SimClock constructor
+         */
+        SimClock();
+        /**
+         * \brief Set the current time
+         *
+         * \param[in] time_hw_ns the new hw time [ns]
+         */
+        void set(int64_t time_hw_ns);
+        /**
+         * \brief Get the current time
+         *
+         * \return the hw time [ns]
+         */
+        int64_t now();
+        /**
+         * \brief Wait until the clock has reached a time
+         *
+         * \param[in] time_hw_ns the hw time to wait for [ns]
+         * \param[in] timeout max wall clock time to wait [s]
+         * \return false on timeout
+         */
+        bool wait_until(int64_t time_hw_ns, double timeout);
+
+private:
+        std::atomic<int64_t> m_now_hw_ns;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+};
@@ -0,0 +1,110 @@
+/**
+ * \file ranging.h
+ *
+ * \brief Range estimation from PING and PONG times
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+
+#include "macros.h"
+#include "sdr_config.h"
+
+/**
+ * \brief Calculate the time of flight
+ *
+ * The PINGs are sent on a grid of burst_period, and the tag answers a
+ * PING after a whole number of burst periods plus pong_delay and its
+ * slot offset. The round trip time is therefore taken modulo
+ * burst_period, so any PING on the grid can be given. The tag
+ * turnaround and the calibrated hardware delay are then subtracted.
+ *
+ * \param[in] dev_cfg configuration paramaters
+ * \param[in] ping_tx_hw_ns hw time of a transmitted PING
+ * \param[in] pong_rx_hw_ns hw time of the detected PONG
+ * \param[in] slot TDMA slot of the tag
+ * \return the one way time of flight [s]
+ */
+double calculate_tof(const SDR_Device_Config &dev_cfg,
+                     int64_t ping_tx_hw_ns, int64_t pong_rx_hw_ns,
+                     uint32_t slot);
+
+/**
+ * \struct RangeEstimate
+ *
+ * \brief Filtered range of one tag
+ */
+struct RangeEstimate
+{
+        int64_t time_hw_ns = -1; //!< hw time of the last PONG
+        double measured_range = 0; //!< Unfiltered range of the last PONG [m]
+        double range = 0; //!< Filtered range [m]
+        double range_rate = 0; //!< Filtered range rate [m/s]
+        double range_std = 0; //!< Standard deviation of range [m]
+        bool outlier = false; //!< The last PONG was rejected
+        bool valid = false; //!< The filter has been initialized
+};
+
+/**
+ * \class RangeTracker
+ *
+ * \brief Constant velocity Kalman filter of the range of one tag
+ *
+ * The state is the range and the range rate. Every PONG gives a range
+ * measurement, and measurements whose normalized innovation is above
+ * range_outlier_gate are rejected. After range_max_outliers rejected
+ * measurements in a row the filter restarts from the measurement, as
+ * the tag has most likely moved. An update costs the same regardless
+ * of how long the tag has been tracked.
+ *
+ */
+class RangeTracker
+{
+public:
+        /**
+         * \brief RangeTracker constructor
+         */
+        RangeTracker();
+        /**
+         * \brief Set up the filter
+         *
+         * \param[in] dev_cfg configuration paramaters
+         * \param[in] slot TDMA slot of the tag
+         */
+        void configure(const SDR_Device_Config &dev_cfg, uint32_t slot);
+        /**
+         * \brief Update the filter with a PONG
+         *
+         * \param[in] ping_tx_hw_ns hw time of a transmitted PING
+         * \param[in] pong_rx_hw_ns hw time of the detected PONG
+         * \return the new estimate
+         */
+        const RangeEstimate &update(int64_t ping_tx_hw_ns,
+                                    int64_t pong_rx_hw_ns);
+        /**
+         * \brief The last estimate
+         *
+         * \return the estimate
+         */
+        const RangeEstimate &get_estimate() const;
+        /**
+         * \brief Number of rejected measurements
+         *
+         * \return the total number of outliers
+         */
+        uint64_t get_no_of_outliers() const;
+
+private:
+        void restart(double range, int64_t time_hw_ns);
+
+        SDR_Device_Config m_dev_cfg;
+        uint32_t m_slot;
+        RangeEstimate m_estimate;
+        double m_P[2][2]; //!< State covariance
+        size_t m_no_of_consecutive_outliers;
+        uint64_t m_no_of_outliers;
+};
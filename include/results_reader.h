@@ -0,0 +1,27 @@
+/**
+ * \file results_reader.h
+ *
+ * \brief Reader of the ranging results ring
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <tclap/CmdLine.h>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <signal.h>
+#include <unistd.h>
+
+#include "sdr_config.h"
+#include "results_ring.h"
+
+void sigIntHandler(const int);
+void follow_results(std::string name);
+void print_record(uint64_t record_no, const RangingRecord &record);
+bool run_throughput_test(std::string name, double duration, double rate,
+                         size_t no_of_slots);
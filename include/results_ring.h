@@ -0,0 +1,183 @@
+/**
+ * \file results_ring.h
+ *
+ * \brief Ranging results in a shared memory ring
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <string>
+
+#include "macros.h"
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "The results ring needs lock-free 64 bit atomics");
+
+enum RecordFlags {
+        RECORD_PING = 1 << 0, /**< A PING detected by a tag */
+        RECORD_PONG = 1 << 1, /**< A PONG detected by the beacon */
+        RECORD_RANGED = 1 << 2, /**< The range fields are valid */
+        RECORD_OUTLIER = 1 << 3 /**< The range filter rejected the range */
+};
+
+/**
+ * \struct RangingRecord
+ *
+ * \brief One detected burst, as published in the results ring
+ *
+ * The layout is part of the shared memory format, see
+ * results_ring_version.
+ */
+struct RangingRecord
+{
+        int64_t burst_hw_ns; //!< hw time of the PING the burst answers
+        int64_t detected_ix; //!< Index of the peak in the RX buffer
+        double fractional_offset; //!< Sub-sample peak offset [samples]
+        double range; //!< Measured range [m]
+        double range_filtered; //!< Filtered range [m]
+        float corr_peak; //!< Magnitude of the correlation peak
+        float snr_db; //!< SNR estimate [dB]
+        uint32_t tag_id; //!< TDMA slot of the tag
+        uint32_t flags; //!< RecordFlags
+};
+
+/**
+ * \brief A record of a detected burst, without range
+ *
+ * \param[in] flags RecordFlags
+ * \param[in] tag_id TDMA slot of the tag
+ * \param[in] burst_hw_ns hw time of the PING the burst answers
+ * \param[in] peak_position sub-sample index of the peak
+ * \param[in] corr_peak magnitude of the correlation peak
+ * \param[in] snr_db SNR estimate [dB]
+ * \return the record, with NaN ranges
+ */
+RangingRecord make_ranging_record(uint32_t flags, uint32_t tag_id,
+                                  int64_t burst_hw_ns, double peak_position,
+                                  double corr_peak, double snr_db);
+
+static const uint32_t results_ring_magic = 0x52524e47; //!< "RRNG"
+static const uint32_t results_ring_version = 1;
+
+/**
+ * \struct ResultsRingHeader
+ *
+ * \brief Start of the shared memory, followed by the slots
+ */
+struct ResultsRingHeader
+{
+        uint32_t magic;
+        uint32_t version;
+        uint32_t record_bytes; //!< sizeof(RangingRecord) of the writer
+        uint32_t no_of_slots;
+        std::atomic<uint64_t> no_of_records; //!< Published so far
+        char padding[40];
+};
+
+/**
+ * \struct ResultsRingSlot
+ *
+ * \brief One record with its sequence lock
+ *
+ * The sequence is odd while the record is written, and 2 * (n + 1)
+ * when record number n is complete. The record is kept in atomic
+ * words, so a reader racing with the writer is well defined, it just
+ * sees a changed sequence and retries.
+ */
+struct ResultsRingSlot
+{
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> words[sizeof(RangingRecord) / sizeof(uint64_t)];
+};
+
+/**
+ * \class ResultsPublisher
+ *
+ * \brief Writes records into a POSIX shared memory ring
+ *
+ * There is one writer. Publishing never blocks and never allocates, a
+ * reader that falls more than a ring behind loses the oldest records.
+ * The shared memory is removed when the publisher is destroyed, readers
+ * that have it mapped keep their mapping.
+ *
+ */
+class ResultsPublisher
+{
+public:
+        /**
+         * \brief ResultsPublisher constructor
+         *
+         * \param[in] name name of the shared memory, e.g. /ranging
+         * \param[in] no_of_slots number of records in the ring
+         */
+        ResultsPublisher(std::string name, size_t no_of_slots);
+        ~ResultsPublisher();
+        ResultsPublisher(const ResultsPublisher &) = delete;
+        ResultsPublisher &operator=(const ResultsPublisher &) = delete;
+        /**
+         * \brief Publish a record
+         *
+         * \param[in] record the record
+         */
+        void publish(const RangingRecord &record);
+        /**
+         * \brief Number of published records
+         *
+         * \return the number of records published so far
+         */
+        uint64_t get_no_of_records() const;
+
+private:
+        std::string m_name;
+        size_t m_bytes;
+        ResultsRingHeader *m_header;
+        ResultsRingSlot *m_slots;
+};
+
+/**
+ * \class ResultsReader
+ *
+ * \brief Reads the records of a results ring
+ *
+ */
+class ResultsReader
+{
+public:
+        /**
+         * \brief ResultsReader constructor
+         *
+         * Starts with the oldest record still in the ring.
+         *
+         * \param[in] name name of the shared memory
+         */
+        ResultsReader(std::string name);
+        ~ResultsReader();
+        ResultsReader(const ResultsReader &) = delete;
+        ResultsReader &operator=(const ResultsReader &) = delete;
+        /**
+         * \brief Read the next record
+         *
+         * \param[out] record the record
+         * \param[out] record_no the number of the record
+         * \return false if there is no new record
+         */
+        bool read(RangingRecord &record, uint64_t &record_no);
+        /**
+         * \brief Number of records overwritten before they were read
+         *
+         * \return the number of lost records
+         */
+        uint64_t get_no_of_lost() const;
+
+private:
+        size_t m_bytes;
+        const ResultsRingHeader *m_header;
+        const ResultsRingSlot *m_slots;
+        uint64_t m_next;
+        uint64_t m_no_of_lost;
+};
@@ -0,0 +1,55 @@
+/**
+ * \file rt_thread.h
+ *
+ * \brief Real-time configuration of threads
+ *
+ * CPU affinity, SCHED_FIFO priority and memory locking for the time
+ * critical RX, TX and detection threads. Settings that are denied, e.g.
+ * for lack of CAP_SYS_NICE or RLIMIT_MEMLOCK, give a warning and the
+ * thread keeps running with the default settings.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "macros.h"
+
+/**
+ * \brief Configure the calling thread
+ *
+ * Pins the thread to a CPU and sets its SCHED_FIFO priority, and
+ * reports what was applied and what was denied.
+ *
+ * \param[in] name name of the thread in the report, e.g. RX
+ * \param[in] cpu CPU to pin the thread to, -1 to not pin it
+ * \param[in] priority SCHED_FIFO priority [1,99], 0 to keep the
+ * normal scheduling
+ * \return true if everything requested was applied
+ */
+bool configure_rt_thread(std::string name, int cpu, int priority);
+/**
+ * \brief Lock all current and future memory of the process in RAM
+ *
+ * \return true if the memory was locked
+ */
+bool lock_memory();
+/**
+ * \brief Touch every page of a buffer
+ *
+ * Makes sure the pages are mapped before the time critical loop runs.
+ *
+ * \param[in] data the buffer
+ * \param[in] bytes size of the buffer [bytes]
+ */
+void prefault(void *data, size_t bytes);
+/**
+ * \brief Touch the stack of the calling thread
+ *
+ * \param[in] bytes how much of the stack to touch [bytes]
+ */
+void prefault_stack(size_t bytes);
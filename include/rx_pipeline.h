@@ -0,0 +1,225 @@
+/**
+ * \file rx_pipeline.h
+ *
+ * \brief Handoff of RX blocks from a capture thread to a detection thread
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <complex>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "macros.h"
+#include "buffer_pool.h"
+
+/**
+ * \struct PipelineBlock
+ *
+ * \brief A block of RX samples handed to the detection thread
+ */
+struct PipelineBlock
+{
+        size_t buffer = 0; //!< Index of the buffer holding the samples
+        int32_t no_of_samples = 0;
+        int64_t time_hw_ns = 0; //!< hw time of the first sample
+        bool discontinuity = false; //!< Samples were lost before the block
+};
+
+/**
+ * \class RxPipeline
+ *
+ * \brief Bounded queue of RX blocks between two threads
+ *
+ * The capture thread fills the buffers round robin and pushes them,
+ * and the detection thread pops them in order. There are two more
+ * buffers than the depth of the queue, one being filled and one being
+ * processed, so a buffer is never written while it is read. push waits
+ * while the queue is full, which holds back the capture thread if the
+ * detection falls behind. Neither push nor pop allocates memory.
+ *
+ */
+class RxPipeline
+{
+public:
+        /**
+         * \brief RxPipeline constructor
+         *
+         * \param[in] block_samples samples per block
+         * \param[in] queue_depth max number of blocks in the queue
+         * \param[in] huge_pages back the buffers with huge pages
+         */
+        RxPipeline(size_t block_samples, size_t queue_depth,
+                   bool huge_pages);
+        RxPipeline(const RxPipeline &) = delete;
+        RxPipeline &operator=(const RxPipeline &) = delete;
+        /**
+         * \brief The buffer to fill with the next block
+         *
+         * Only to be called by the capture thread.
+         *
+         * \return a buffer of block_samples samples
+         */
+        std::complex<int16_t> *get_fill_buffer();
+        /**
+         * \brief Hand the filled buffer to the detection thread
+         *
+         * Waits while the queue is full.
+         *
+         * \param[in] no_of_samples number of samples in the buffer
+         * \param[in] time_hw_ns hw time of the first sample
+         * \param[in] discontinuity samples were lost before the block
+         * \return false if the pipeline has been closed
+         */
+        bool push(int32_t no_of_samples, int64_t time_hw_ns,
+                  bool discontinuity);
+        /**
+         * \brief Hand the filled buffer over, unless the queue is full
+         *
+         * Does not wait. A buffer that is not taken is filled again.
+         *
+         * \param[in] no_of_samples number of samples in the buffer
+         * \param[in] time_hw_ns hw time of the first sample
+         * \param[in] discontinuity samples were lost before the block
+         * \return false if the queue is full or the pipeline closed
+         */
+        bool try_push(int32_t no_of_samples, int64_t time_hw_ns,
+                      bool discontinuity);
+        /**
+         * \brief Take the oldest block from the queue
+         *
+         * Waits while the queue is empty. The samples are valid until
+         * the next call to pop.
+         *
+         * \param[out] block the block
+         * \return false if the pipeline has been closed and is empty
+         */
+        bool pop(PipelineBlock &block);
+        /**
+         * \brief The samples of a block
+         *
+         * \param[in] block a block returned by pop
+         * \return pointer to the first sample
+         */
+        const std::complex<int16_t> *get_data(const PipelineBlock &block) const;
+        /**
+         * \brief Close the pipeline and wake up both threads
+         */
+        void close();
+        /**
+         * \brief Number of times the capture thread had to wait
+         *
+         * \return the number of pushes to a full queue
+         */
+        uint64_t get_no_of_full_waits() const;
+        /**
+         * \brief Deepest queue seen
+         *
+         * \return the max number of blocks waiting for detection
+         */
+        size_t get_max_depth() const;
+
+private:
+        void enqueue(int32_t no_of_samples, int64_t time_hw_ns,
+                     bool discontinuity);
+
+        std::unique_ptr<BufferPool> m_pool;
+        std::vector<PoolBuffer<std::complex<int16_t>>> m_buffers;
+        std::vector<PipelineBlock> m_queue; //!< Ring of queue_depth blocks
+        size_t m_head; //!< Oldest block in m_queue
+        size_t m_count;
+        size_t m_fill; //!< Buffer being filled
+        bool m_closed;
+        uint64_t m_no_of_full_waits;
+        size_t m_max_depth;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_not_full;
+        std::condition_variable m_not_empty;
+};
+
+/**
+ * \class SampleHistory
+ *
+ * \brief The latest RX samples as one contiguous buffer
+ *
+ * The detection thread appends the blocks from the pipeline, so a
+ * burst spanning two blocks can be detected without waiting for a
+ * whole burst period of samples. The buffer holds capacity samples
+ * plus some slack, so the samples are moved down only now and then.
+ *
+ */
+class SampleHistory
+{
+public:
+        /**
+         * \brief SampleHistory constructor
+         *
+         * \param[in] capacity samples kept
+         * \param[in] block_samples max samples per append
+         * \param[in] sampling_rate sampling rate of the samples [Hz]
+         * \param[in] huge_pages back the buffer with huge pages
+         */
+        SampleHistory(size_t capacity, size_t block_samples,
+                      double sampling_rate, bool huge_pages);
+        SampleHistory(const SampleHistory &) = delete;
+        SampleHistory &operator=(const SampleHistory &) = delete;
+        /**
+         * \brief Append a block
+         *
+         * The history is cleared first if the block does not follow the
+         * previous one.
+         *
+         * \param[in] data the samples
+         * \param[in] no_of_samples number of samples
+         * \param[in] time_hw_ns hw time of the first sample
+         * \param[in] discontinuity samples were lost before the block
+         */
+        void append(const std::complex<int16_t> *data, size_t no_of_samples,
+                    int64_t time_hw_ns, bool discontinuity);
+        /**
+         * \brief Drop all samples
+         */
+        void clear();
+        /**
+         * \brief The samples, oldest first
+         *
+         * \return pointer to the oldest sample
+         */
+        const std::complex<int16_t> *data() const;
+        /**
+         * \brief Number of samples
+         *
+         * \return the number of samples in the history
+         */
+        size_t size() const;
+        /**
+         * \brief Convert an index into an absolute hw time
+         *
+         * \param[in] ix the index, may be fractional
+         * \return the hw time [ns]
+         */
+        double ix_to_hw_ns(double ix) const;
+        /**
+         * \brief Convert an absolute hw time into an index
+         *
+         * \param[in] hw_ns the hw time [ns]
+         * \return the index, may be outside the history
+         */
+        double hw_ns_to_ix(double hw_ns) const;
+
+private:
+        std::unique_ptr<BufferPool> m_pool;
+        std::unique_ptr<PoolBuffer<std::complex<int16_t>>> m_buffer;
+        size_t m_capacity;
+        double m_sample_ns;
+        size_t m_length;
+        int64_t m_run_hw_ns; //!< hw time of the first sample of the run
+        uint64_t m_run_ix; //!< Index in the run of the oldest sample
+        int64_t m_next_hw_ns; //!< Expected hw time of the next block
+};
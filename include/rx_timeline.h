@@ -0,0 +1,164 @@
+/**
+ * \file rx_timeline.h
+ *
+ * \brief RX timeline class
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <SoapySDR/Constants.h>
+
+#include "macros.h"
+
+/**
+ * \struct RxBlock
+ *
+ * \brief Book keeping of one received RX buffer
+ */
+struct RxBlock
+{
+        int64_t seq; //!< Block number, counting from 0
+        int64_t first_sample; //!< Number of samples received before block
+        int64_t time_hw_ns; //!< hw time of the first sample
+        int32_t no_of_samples;
+        bool discontinuous; //!< Samples were lost before this block
+};
+
+/**
+ * \struct RxPosition
+ *
+ * \brief A position in the RX sample stream
+ */
+struct RxPosition
+{
+        int64_t seq; //!< Block number
+        int64_t ix; //!< Index in the block, can be outside the block
+        bool valid; //!< False if the time is before the last gap
+};
+
+/**
+ * \class RxTimeline
+ *
+ * \brief Keeps track of the timestamps of the received RX buffers
+ *
+ * Every received block is stored with its sample count and timestamp
+ * in a ring of the latest blocks. A block whose timestamp does not
+ * follow from the previous block, or that follows an overflow or a
+ * SOAPY_SDR_END_ABRUPT, starts a new segment. Within the last segment
+ * any hw time can be mapped to a block and an index without searching
+ * the sample stream.
+ *
+ */
+class RxTimeline
+{
+public:
+        /**
+         * \brief RxTimeline constructor
+         */
+        RxTimeline();
+        /**
+         * \brief Configure the timeline
+         *
+         * \param[in] sample_rate the RX sampling rate [Hz]
+         * \param[in] capacity number of blocks to keep
+         */
+        void configure(double sample_rate, size_t capacity);
+        /**
+         * \brief Add a received block
+         *
+         * \param[in] time_hw_ns hw time of the first sample
+         * \param[in] no_of_samples number of samples in the block
+         * \param[in] flags the flags returned from the stream read
+         * \return true if samples were lost before the block
+         */
+        bool add_block(int64_t time_hw_ns, int32_t no_of_samples, int flags);
+        /**
+         * \brief Add a block received in a gated RX window
+         *
+         * The block starts a new segment, but since the gap before it
+         * was intended it is not counted as lost samples. It is only
+         * flagged as discontinuous if a window was lost to an overflow.
+         *
+         * \param[in] time_hw_ns hw time of the first sample
+         * \param[in] no_of_samples number of samples in the block
+         */
+        void add_window(int64_t time_hw_ns, int32_t no_of_samples);
+        /**
+         * \brief Note that the stream reported an overflow
+         *
+         * The next block will start a new segment.
+         */
+        void note_overflow();
+        /**
+         * \brief The last received block
+         *
+         * \return the last block
+         */
+        const RxBlock &last_block() const;
+        /**
+         * \brief Check if samples were lost before the last block
+         *
+         * \return true if the last block started a new segment
+         */
+        bool last_block_discontinuous() const;
+        /**
+         * \brief Map a hw time to an index in the last block
+         *
+         * The samples of a segment are contiguous, so the index is
+         * taken from the timestamp of the last block, without any
+         * search. A negative index is in an earlier block.
+         *
+         * \param[in] time_hw_ns the hw time to map
+         * \return the position of the time in the sample stream
+         */
+        RxPosition locate(double time_hw_ns) const;
+        /**
+         * \brief Map an index in a block to a hw time
+         *
+         * \param[in] seq the block number
+         * \param[in] ix index in the block
+         * \return the hw time of the sample [ns]
+         */
+        int64_t ix_to_hw_ns(int64_t seq, int64_t ix) const;
+        /**
+         * \brief Index in the last block of a periodic event
+         *
+         * \param[in] time_hw_ns hw time of one occurrence of the event
+         * \param[in] period_ns the period of the event [ns]
+         * \return index of the first occurrence at or after the start
+         * of the last block
+         */
+        int64_t next_periodic_ix(int64_t time_hw_ns, int64_t period_ns) const;
+        /**
+         * \brief Number of discontinuities seen
+         *
+         * \return the number of gaps and overflows
+         */
+        uint64_t get_no_of_gaps() const;
+        /**
+         * \brief Number of samples lost in gaps
+         *
+         * \return the number of lost samples, based on the timestamps
+         */
+        int64_t get_no_of_lost_samples() const;
+
+private:
+        const RxBlock *find_block(int64_t seq) const;
+        void push_block(int64_t time_hw_ns, int32_t no_of_samples,
+                        bool discontinuous);
+
+        double m_sample_rate;
+        std::vector<RxBlock> m_blocks;
+        int64_t m_no_of_blocks;
+        int64_t m_no_of_samples;
+        int64_t m_segment_first_sample;
+        int64_t m_segment_time_hw_ns;
+        bool m_overflow_pending;
+        uint64_t m_no_of_gaps;
+        int64_t m_no_of_lost_samples;
+};
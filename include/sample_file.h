@@ -0,0 +1,156 @@
+/**
+ * \file sample_file.h
+ *
+ * \brief Binary sample files with a small header
+ *
+ * Interleaved CS16 (.cs16) or CF32 (.cf32) samples after a 64 byte
+ * header with the sample rate, the center frequency and the hw time of
+ * the first sample. Written with one system call and read through a
+ * memory mapping, unlike the raw_ascii files of the Analyser.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <complex>
+#include <string>
+#include <vector>
+
+#include "macros.h"
+
+enum SampleFormat {
+        SAMPLE_FORMAT_CS16 = 1, //!< Interleaved int16 I and Q
+        SAMPLE_FORMAT_CF32 = 2  //!< Interleaved float I and Q
+};
+
+/**
+ * \struct SampleFileHeader
+ *
+ * \brief The header of a sample file, little endian as written
+ *
+ * The samples start at header_bytes, which keeps them 64 byte aligned
+ * in a mapping.
+ */
+struct SampleFileHeader
+{
+        char magic[8]; //!< sample_file_magic
+        uint32_t version;
+        uint32_t format; //!< SampleFormat
+        uint32_t header_bytes; //!< Offset of the first sample
+        uint32_t reserved;
+        double sample_rate; //!< [Hz]
+        double frequency; //!< Center frequency, 0 if not known [Hz]
+        int64_t time_hw_ns; //!< hw time of the first sample [ns]
+        uint64_t no_of_samples;
+        uint8_t padding[8];
+};
+
+static_assert(sizeof(SampleFileHeader) == 64,
+              "SampleFileHeader must be 64 bytes");
+
+extern const char sample_file_magic[8];
+const uint32_t sample_file_version = 1;
+
+/**
+ * \struct SampleFileInfo
+ *
+ * \brief The description of the samples in a sample file
+ */
+struct SampleFileInfo
+{
+        double sample_rate = 0; //!< [Hz]
+        double frequency = 0; //!< Center frequency [Hz]
+        int64_t time_hw_ns = 0; //!< hw time of the first sample [ns]
+};
+
+/**
+ * \class SampleFile
+ *
+ * \brief A memory mapped sample file, for the replay and batch tools
+ *
+ * The samples can be used in place in their own format, or converted
+ * by read. Converting CF32 to CS16 rounds and saturates.
+ *
+ */
+class SampleFile
+{
+public:
+        SampleFile();
+        ~SampleFile();
+        SampleFile(const SampleFile &) = delete;
+        SampleFile &operator=(const SampleFile &) = delete;
+        /**
+         * \brief Map a sample file
+         *
+         * \param[in] filename the file, incl extension
+         */
+        void open(std::string filename);
+        void close();
+        SampleFormat get_format() const;
+        SampleFileInfo get_info() const;
+        size_t size() const;
+        /**
+         * \brief The samples in place
+         *
+         * \return the samples, nullptr if the file is not CS16
+         */
+        const std::complex<int16_t> *get_cs16() const;
+        /**
+         * \brief The samples in place
+         *
+         * \return the samples, nullptr if the file is not CF32
+         */
+        const std::complex<float> *get_cf32() const;
+        /**
+         * \brief Copy samples, converted if needed
+         *
+         * \param[in] start_ix the first sample
+         * \param[in] no_of_samples number of samples, within the file
+         * \param[out] data the samples
+         */
+        void read(size_t start_ix, size_t no_of_samples,
+                  std::complex<int16_t> *data) const;
+        void read(size_t start_ix, size_t no_of_samples,
+                  std::complex<float> *data) const;
+
+private:
+        void check_range(size_t start_ix, size_t no_of_samples) const;
+
+        std::string m_filename;
+        const uint8_t *m_mapping;
+        size_t m_bytes; //!< Size of the mapping
+        SampleFileHeader m_header;
+};
+
+/**
+ * \brief Write a CS16 sample file, with one write
+ *
+ * \param[in] filename the file, should end with .cs16
+ * \param[in] data the samples
+ * \param[in] no_of_samples number of samples
+ * \param[in] info the sample rate, frequency and time
+ */
+void save_samples(std::string filename, const std::complex<int16_t> *data,
+                  size_t no_of_samples, const SampleFileInfo &info);
+
+/**
+ * \brief Write a CF32 sample file, with one write
+ *
+ * \param[in] filename the file, should end with .cf32
+ * \param[in] data the samples
+ * \param[in] no_of_samples number of samples
+ * \param[in] info the sample rate, frequency and time
+ */
+void save_samples(std::string filename, const std::complex<float> *data,
+                  size_t no_of_samples, const SampleFileInfo &info);
+
+/**
+ * \brief Check if a name is a sample file, by its extension
+ *
+ * \param[in] filename the name
+ * \return true for .cs16 and .cf32
+ */
+bool is_sample_file(std::string filename);
@@ -18,10 +18,32 @@
 #include <SoapySDR/Time.hpp>
 #include <SoapySDR/Modules.hpp>
 #include <unistd.h>
+#include <chrono>
+#include <ctime>
+#include <mutex>
 #include <armadillo>
 
 #include "macros.h"
 #include "sdr_config.h"
+#include "radio.h"
+#include "metrics.h"
+#include "logger.h"
+
+/**
+ * \struct RxStreamStats
+ *
+ * \brief Statistics of the RX stream, to compare the RX modes
+ */
+struct RxStreamStats
+{
+        uint64_t no_of_reads = 0; //!< Calls to readStream
+        uint64_t no_of_samples = 0;
+        uint64_t no_of_overflows = 0;
+        uint64_t no_of_timeouts = 0;
+        uint64_t no_of_discontinuities = 0; //!< Time jumps within a read
+        std::clock_t cpu_start = 0; //!< Process CPU time at RX start
+        std::chrono::steady_clock::time_point wall_start;
+};
 
 /**
  * \class SDR
@@ -30,9 +52,10 @@
  *
  * Connecting, configuring and running SDRs. The class uses
  * SoapySDR, so it should work for a number of different SDRs.
+ * This is the hardware implementation of a Radio.
  *
  */
-class SDR
+class SDR : public Radio
 {
 public:
         /**
@@ -89,18 +112,50 @@ public:
          * \param[in] burst_time the timestamp of transmission [ns]
          * \return the number of transmitted samples
          */
-        size_t write(std::vector<void *> data, size_t no_of_samples,
+        size_t write(const std::vector<void *> &data, size_t no_of_samples,
                             long long int burst_time);
         /**
          * \brief Read data from the air
          *
+         * In burst mode every read is a separate RX burst. In
+         * continuous mode (rx_continuous) the stream runs all the
+         * time and is read in MTU sized chunks, whose timestamps are
+         * checked for continuity. A time jump within a read drops the
+         * samples before it, so the returned block is contiguous.
+         *
          * \param[in] data vector of pointers to data vectors, will
          * return the sampled data
          * \param[in] no_of_samples number of samples to read
          * \return number of read samples
          */
         int32_t read(size_t no_of_samples,
-                     std::vector<std::complex<int16_t>> &buff_data);
+                     std::complex<int16_t> *buff_data);
+        /**
+         * \brief Read a gated window from the air
+         *
+         * Schedules a timed RX burst of no_of_samples samples starting
+         * at start_hw_ns, and reads it. Only available in burst mode.
+         *
+         * \param[in] start_hw_ns hw time of the first sample
+         * \param[in] no_of_samples number of samples to read
+         * \param[out] buff_data the sampled data
+         * \return number of read samples
+         */
+        int32_t read_window(int64_t start_hw_ns, size_t no_of_samples,
+                            std::complex<int16_t> *buff_data);
+        /**
+         * \brief Get the RX stream statistics
+         *
+         * \return the statistics since the RX stream was started
+         */
+        const RxStreamStats &get_rx_stream_stats();
+        /**
+         * \brief Print the RX stream statistics
+         *
+         * Reports driver calls, overflows, timeouts and the CPU load,
+         * so that the burst and continuous modes can be compared.
+         */
+        void print_rx_stream_stats();
         /**
          * \brief Close streams and disconnect device
          *
@@ -109,13 +164,15 @@ public:
         /**
          * \brief Check if a limesdr is conected
          *
-         * \return true if the first attached device is a LimeSDR
+         * The driver is looked up once, when connecting.
+         *
+         * \return true if the connected device is a LimeSDR
          */
         bool is_limesdr();
         /**
          * \brief Check if a bladerf is conected
          *
-         * \return true if the first attached device is BladeRF
+         * \return true if the connected device is BladeRF
          */
         bool is_bladerf();
         /**
@@ -132,36 +189,39 @@ public:
          * to the screen in that case.
          *
          * \param[in] burst_time the time to check
+         * \return the time left to the burst, negative if passed [ns]
          */
-        void check_burst_time(long long int burst_hw_ns);
+        int64_t check_burst_time(long long int burst_hw_ns);
         /**
-         * \brief Convert an index into an absolute hw time
+         * \brief Get the current hardware time
          *
-         * \param[in] ix the index to convert
          * \return the hw time in ns
          */
-        int64_t ix_to_hw_ns(int64_t ix);
-        /**
-         * \brief Based on a sync time find index of next PING
-         *
-         * \param[in] hw_time_of_sync the last sync time
-         * \return index of next expected PING
-         */
-        int64_t find_exp_ping_pos_ix(int64_t hw_time_of_sync);
+        int64_t get_hardware_time();
         /**
-         * \brief Based on a sync time find index of next PONG
+         * \brief Print the time spent in each startup phase
          *
-         * \param[in] hw_time_of_sync the last sync time
-         * \return index of next expected PONG
+         * The phases are connecting, configuring and starting the
+         * streams. Called at the end of start().
          */
-        int64_t find_exp_pong_pos_ix(int64_t hw_time_of_sync);
+        void print_startup_report();
 
 private:
         std::string get_device_driver();
-        void configure_tx();
-        void configure_rx();
+        bool concurrent_config_allowed();
+        void configure_tx(std::ostream &out);
+        void configure_rx(std::ostream &out);
+        bool has_sensor(int direction, size_t channel, std::string sensor);
+        void wait_for_lo_lock(int direction, size_t channel,
+                              std::ostream &out);
+        void add_startup_phase(std::string phase,
+                               std::chrono::steady_clock::time_point start);
         void start_tx();
         int64_t start_rx();
+        int32_t read_burst(size_t no_of_samples,
+                           std::complex<int16_t> *buff_data);
+        int32_t read_continuous(size_t no_of_samples,
+                                std::complex<int16_t> *buff_data);
         int32_t look_up_device_serial(SoapySDR::KwargsList result,
                                       std::string device_id);
         void connect_to_device(SoapySDR::KwargsList results,
@@ -170,11 +230,16 @@ private:
         std::string get_modules_version(std::string libname);
 
 
-        SDR_Device_Config m_dev_cfg;
         SoapySDR::Device *m_device;
+        SoapySDR::Kwargs m_device_info; //!< Enumeration result at connect
+        std::string m_driver;
+        std::chrono::steady_clock::time_point m_startup_begin;
+        std::mutex m_startup_mutex;
+        std::vector<std::pair<std::string, double>> m_startup_phases;
         SoapySDR::Stream *m_tx_stream;
         SoapySDR::Stream *m_rx_stream;
+        size_t m_rx_mtu;
+        RxStreamStats m_rx_stats;
         int64_t m_rx_start_hw_ticks;
-        int64_t m_last_rx_timestamp;
         int64_t m_time_of_next_burst;
 };
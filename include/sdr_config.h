@@ -53,6 +53,25 @@ struct SDR_Device_Config
         uint16_t Novs_rx = 2; //!< No of oversampling [2,4,8]
         double time_in_future = 1;
         double timeout = 2; //!< Read and write stream timeout
+        double lo_lock_timeout = 1; //!< Max time to wait for LO lock [s]
+        bool rx_gated = false; //!< When tracking, only receive a window around the PING
+        int64_t rx_gate_margin = 64; //!< Samples added to the guard of a gated window
+        double rx_gate_lead = 2e-3; //!< Min time from scheduling a window to its start [s]
+        bool rx_continuous = false; //!< Stream RX continuously, not one burst per read
+        int rx_cpu = -1; //!< CPU to pin the RX thread to, -1 for any
+        int tx_cpu = -1; //!< CPU to pin the TX thread to, -1 for any
+        int rx_priority = 0; //!< SCHED_FIFO priority of the RX thread, 0 for normal
+        int tx_priority = 0; //!< SCHED_FIFO priority of the TX thread, 0 for normal
+        bool rx_pipelined = false; //!< Capture and detect in separate threads (tag)
+        size_t pipeline_queue_depth = 4; //!< Max RX blocks waiting for detection
+        int detect_cpu = -1; //!< CPU to pin the detection thread to, -1 for any
+        int detect_priority = 0; //!< SCHED_FIFO priority of the detection thread, 0 for normal
+        bool memory_lock = false; //!< mlockall and prefault the buffers
+        size_t prefault_stack_size = 256 * 1024; //!< Stack to prefault [bytes]
+        bool concurrent_config = true; //!< Configure RX and TX in parallel, if the driver allows it
+        size_t buffer_pool_size = 8; //!< Number of buffers in the sample buffer pool
+        bool huge_pages = false; //!< Back the buffer pool with huge pages, if available
+        size_t alloc_check_warmup = 10; //!< PINGs to find before counting allocations
 
         double f_clk = 122.88e6; //!< SDR system clock
         short channel_tx = 0;
@@ -77,6 +96,8 @@ struct SDR_Device_Config
                 (size_t)(1 * sampling_rate_rx * burst_period); //!< Read buffer size
         size_t no_of_rx_samples_pong =
                 (size_t)(1 * sampling_rate_rx * burst_period); //!< Read buffer size
+        size_t no_of_rx_samples_block =
+                (size_t)(sampling_rate_rx * burst_period / 4); //!< Read block size when pipelined
 
         uint32_t ping_scr_code = 2;
         uint32_t pong_scr_code = 12;
@@ -84,16 +105,87 @@ struct SDR_Device_Config
         int64_t max_sync_error = 5; //!< Max diff on spacing between peaks  inital sync
         uint64_t min_peak_distance = 10; //!< Min distance between two peaks initial sync
         uint32_t threshold_factor = 8;
+        bool dc_iq_correction = true; //!< Remove DC and IQ imbalance before the correlation
+        double dc_time_constant = 1e-3; //!< Of the DC tracker, in received time [s]
+        double iq_time_constant = 10e-3; //!< Of the IQ gain and phase estimates, in received time [s]
         size_t num_of_ping_tries = 10; //!< Number of tries before initial sync
         int64_t ping_burst_guard = 2; //!< Guard samples around expected PING
         int64_t pong_burst_guard = 15; //!< Guard samples around expected PONG
+        int64_t reanchor_guard = 50; //!< Guard samples after an RX gap
+        bool ping_tracking = true; //!< Track the PING timing with a delay-locked loop
+        double dll_phase_gain = 0.5; //!< Share of the timing error corrected per PING
+        double dll_rate_gain = 0.1; //!< Share of the timing error moved to the period
+        double dll_variance_forget = 0.05; //!< Weight of a new error in the error variance
+        double dll_guard_sigmas = 4; //!< Guard in error standard deviations
+        int64_t dll_min_guard = 1; //!< Min guard samples when tracking
+        int64_t dll_max_guard = 50; //!< Max guard samples when tracking
+        double dll_miss_inflation = 4; //!< Error variance factor per missed PING
+        double drift_max_ppm = 50; //!< Max beacon-tag clock drift tracked [ppm]
+        size_t drift_min_pings = 20; //!< Tracked PINGs before the drift estimate is used
+        int64_t drift_max_sync_error = 1; //!< max_sync_error once the drift is known
+        size_t rx_timeline_blocks = 64; //!< RX blocks kept in the timeline
 
         double pong_delay = 5e-3; //!< In tag, time from ping rx to pong tx
         double pong_delay_processing = 3 * burst_period;
+        bool pong_low_latency = false; //!< Answer in the first burst period the detection allows
+        double pong_min_slack = 1e-3; //!< Min time from detection done to PONG TX [s]
+        double pong_latency_sigmas = 4; //!< Detection latency margin in standard deviations
+        double pong_latency_forget = 0.05; //!< Weight of a new latency in its mean and variance
 
         int64_t pong_pos_comp = 2257; //!< Compensate for burst sequence length
 
+        size_t no_of_tags = 0; //!< Tags ranged by the beacon in TDMA mode, 0 for one tag
+        bool one_shot = false; //!< Stop the beacon after the first PONG, with one tag
+        uint32_t tag_slot = 0; //!< TDMA slot of the tag, selects PONG code and offset
+        double tag_slot_length = 200e-6; //!< TDMA slot spacing [s]
+        size_t tdma_threads = 3; //!< PONG detection threads besides the RX thread
+
+        double range_hw_delay = (pong_pos_comp + tx_burst_length) /
+                sampling_rate_rx; //!< Round trip delay besides the turnaround and TOF, calibrate on hw [s]
+        double range_meas_std = 5.6; //!< Std of a range measurement, one sample is 19.5 m [m]
+        double range_accel_noise = 1; //!< Kalman acceleration noise density [m^2/s^3]
+        double range_speed_std = 10; //!< Initial std of the range rate [m/s]
+        double range_outlier_gate = 16; //!< Max normalized squared innovation
+        size_t range_max_outliers = 5; //!< Outliers in a row before the filter restarts
+
         bool tx_active = true;
         bool rx_active = true;
         bool is_beacon = true;
+
+        std::string results_shm = ""; //!< POSIX shm name of the results ring, not used if ""
+        size_t results_ring_size = 4096; //!< Records in the results ring
+        std::string trace_file = ""; //!< Chrome trace of the burst stages, not traced if ""
+        size_t trace_ring_size = 1 << 16; //!< Events kept for the trace
+        std::string metrics_file = ""; //!< Prometheus textfile of the metrics, not written if ""
+        double metrics_period = 10; //!< Time between writes of metrics_file [s]
+        bool live_plot = false; //!< Plot envelopes of the RX data and correlation while running
+        double live_plot_rate = 10; //!< Max frames per second of the live plot
+        size_t live_plot_bins = 800; //!< Min/max bins per trace of the live plot
+        bool spectrum = false; //!< Estimate the PSD of the RX data in the background
+        std::string spectrum_file = ""; //!< Binary file of the PSD frames, not written if ""
+        size_t spectrum_fft_size = 1024; //!< Samples per Welch segment, a power of two
+        double spectrum_overlap = 0.5; //!< Overlap of the Welch segments
+        std::string spectrum_window = "hann"; //!< hann, blackman-harris or rect
+        size_t spectrum_averages = 32; //!< Segments per PSD frame, and the time constant of the exponential average
+        bool spectrum_exponential = false; //!< Exponential instead of fixed-count averaging
+        bool spectrum_max_hold = false; //!< Keep the max of the PSD frames as well
+        double spectrum_duty_cycle = 1; //!< Fraction of the RX samples analysed
+        size_t spectrum_queue_depth = 8; //!< RX blocks waiting for the spectrum worker
+
+        std::string record_basename = ""; //!< SigMF recording, not used if ""
+        size_t record_buffer_samples = 1 << 21; //!< Samples per record buffer
+
+        bool simulate = false; //!< Run on SimRadio instead of hardware
+        std::string replay_basename = ""; //!< Run on FileRadio if not ""
+        double sim_burst_amplitude = 1000; //!< Simulated burst amplitude
+        double sim_noise_amplitude = 100; //!< Simulated noise std dev
+        double sim_dc_offset = 0; //!< Simulated DC offset of I and Q
+        double sim_iq_gain = 1; //!< Simulated Q to I amplitude ratio
+        double sim_iq_phase = 0; //!< Simulated phase error of Q [degrees]
+        double sim_overflow_period = 0; //!< Between simulated overflows [s]
+        double sim_delay = 1e-6; //!< Simulated propagation delay [s]
+        double sim_range_hw_delay = -0.7; //!< Added to range_hw_delay on SimRadio, calibrated so that sim_delay reads as the range [RX samples]
+        double sim_clock_drift_ppm = 0; //!< Simulated beacon clock drift
+        uint32_t sim_seed = 1;
+        bool sim_realtime = false; //!< Pace simulation to wall clock
 };
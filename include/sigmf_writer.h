@@ -0,0 +1,149 @@
+/**
+ * \file sigmf_writer.h
+ *
+ * \brief SigMF writer class
+ *
+ * Streams CS16 samples to a SigMF recording, i.e. a ci16_le data file
+ * and a JSON meta file, see https://github.com/gnuradio/SigMF
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <string>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "macros.h"
+
+/**
+ * \struct SigMFAnnotation
+ *
+ * \brief One annotation in the SigMF meta file
+ */
+struct SigMFAnnotation
+{
+        uint64_t sample_start; //!< Index of first sample in the recording
+        uint64_t sample_count; //!< Number of samples covered
+        std::string label; //!< For example PING or PONG
+};
+
+/**
+ * \class SigMFWriter
+ *
+ * \brief Writes RX samples as a SigMF recording
+ *
+ * The samples are copied into one of two buffers. When a buffer is
+ * full it is handed over to a writer thread, and the caller continues
+ * with the other buffer. The caller will thereby only block if the disc
+ * can not keep up with the sampling rate. The meta file is written when
+ * the recording is closed.
+ *
+ */
+class SigMFWriter
+{
+public:
+        /**
+         * \brief SigMFWriter constructor
+         *
+         * Opens <basename>.sigmf-data for writing.
+         *
+         * \param[in] basename file name without extension
+         * \param[in] buffer_samples number of samples in each of the
+         * two buffers
+         */
+        SigMFWriter(std::string basename, size_t buffer_samples);
+        ~SigMFWriter();
+        /**
+         * \brief Set the global meta data of the recording
+         *
+         * \param[in] sample_rate the RX sampling rate [Hz]
+         * \param[in] frequency the RX center frequency [Hz]
+         * \param[in] rx_gain the RX gain [dB]
+         * \param[in] tx_gain the TX gain [dB]
+         * \param[in] hw description of the hardware used
+         */
+        void set_meta(double sample_rate, double frequency,
+                      double rx_gain, double tx_gain, std::string hw);
+        /**
+         * \brief Append samples to the recording
+         *
+         * \param[in] data pointer to the samples
+         * \param[in] no_of_samples number of samples to append
+         */
+        void write(const std::complex<int16_t> *data, size_t no_of_samples);
+        /**
+         * \brief Annotate a part of the recording
+         *
+         * \param[in] sample_start index of the first sample in the
+         * recording
+         * \param[in] sample_count number of annotated samples
+         * \param[in] label the annotation label
+         */
+        void annotate(uint64_t sample_start, uint64_t sample_count,
+                      std::string label);
+        /**
+         * \brief Mark the hw time of a sample in the recording
+         *
+         * Adds a capture segment to the meta file. Should be called
+         * for the first sample and whenever the sample stream has
+         * been discontinuous.
+         *
+         * \param[in] sample_start index of the sample in the recording
+         * \param[in] time_hw_ns the hw time of the sample [ns]
+         */
+        void add_capture(uint64_t sample_start, int64_t time_hw_ns);
+        /**
+         * \brief Number of samples appended so far
+         *
+         * \return the number of samples in the recording
+         */
+        uint64_t get_sample_count();
+        /**
+         * \brief Flush the data, and write the meta file
+         */
+        void close();
+
+private:
+        struct Capture
+        {
+                uint64_t sample_start;
+                int64_t time_hw_ns;
+        };
+        void writer_loop();
+        void hand_over_active_buffer();
+        void write_meta();
+        std::string datetime_now();
+
+        std::string m_basename;
+        std::FILE *m_data_file;
+        std::vector<std::complex<int16_t>> m_buffers[2];
+        size_t m_active;
+        size_t m_fill;
+        size_t m_pending_fill;
+        int m_pending;
+        bool m_stop;
+        bool m_closed;
+        bool m_write_error;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::thread m_writer;
+        uint64_t m_sample_count;
+        uint64_t m_writer_stalls;
+        std::mutex m_meta_mutex;
+        std::vector<SigMFAnnotation> m_annotations;
+        std::vector<Capture> m_captures;
+        std::string m_datetime;
+        double m_sample_rate;
+        double m_frequency;
+        double m_rx_gain;
+        double m_tx_gain;
+        std::string m_hw;
+};
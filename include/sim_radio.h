@@ -0,0 +1,131 @@
+/**
+ * \file sim_radio.h
+ *
+ * \brief Simulated radio class
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <SoapySDR/Errors.hpp>
+
+#include "macros.h"
+#include "sdr_config.h"
+#include "radio.h"
+#include "modulator.h"
+#include "tdma.h"
+
+/**
+ * \class SimRadio
+ *
+ * \brief A radio producing synthetic RX data
+ *
+ * The RX data is white gaussian noise with CDMA bursts added once per
+ * burst period. In a tag the bursts are PINGs, in a beacon they are
+ * PONGs following the transmitted PINGs. A DC offset and an IQ
+ * imbalance of the receiver can be added to both. Used for running and
+ * profiling the tag and the beacon without any hardware attached.
+ *
+ */
+class SimRadio : public Radio
+{
+public:
+        /**
+         * \brief SimRadio constructor
+         */
+        SimRadio();
+        /**
+         * \brief Configure the simulated radio
+         *
+         * \param[in] dev_cfg A struct carrying the configuration
+         */
+        void configure(SDR_Device_Config dev_cfg);
+        /**
+         * \brief Start the simulated radio
+         *
+         * \return the hw ticks at start
+         */
+        int64_t start();
+        /**
+         * \brief Generate RX data
+         *
+         * \param[in] no_of_samples number of samples to read
+         * \param[out] buff_data the generated data
+         * \return number of read samples
+         */
+        int32_t read(size_t no_of_samples,
+                     std::complex<int16_t> *buff_data);
+        /**
+         * \brief Generate RX data for a gated window
+         *
+         * \param[in] start_hw_ns hw time of the first sample
+         * \param[in] no_of_samples number of samples to read
+         * \param[out] buff_data the generated data
+         * \return number of read samples, SOAPY_SDR_TIME_ERROR if the
+         * window has already passed
+         */
+        int32_t read_window(int64_t start_hw_ns, size_t no_of_samples,
+                            std::complex<int16_t> *buff_data);
+        /**
+         * \brief Transmit data
+         *
+         * The data is thrown away, but the call blocks until the burst
+         * time is close, to mimic the TX buffers of a real device.
+         *
+         * \param[in] data the data to be transmitted
+         * \param[in] no_of_samples the number of tx samples
+         * \param[in] burst_time the timestamp of transmission [ns]
+         * \return the number of transmitted samples
+         */
+        size_t write(const std::vector<void *> &data, size_t no_of_samples,
+                     long long int burst_time);
+        /**
+         * \brief Get the current simulated hw time
+         *
+         * \return the hw time in ns
+         */
+        int64_t get_hardware_time();
+        /**
+         * \brief Check if burst_time has passed
+         *
+         * \param[in] burst_hw_ns the time to check
+         * \return the time left to the burst, negative if passed [ns]
+         */
+        int64_t check_burst_time(long long int burst_hw_ns);
+        /**
+         * \brief Stop the simulated radio
+         */
+        void close();
+
+private:
+        int64_t generate(size_t no_of_samples,
+                         std::complex<int16_t> *buff_data);
+        void add_bursts(std::complex<int16_t> *buff_data,
+                        size_t no_of_samples, int64_t start_hw_ns);
+        void add_burst(std::complex<int16_t> *buff_data,
+                       size_t no_of_samples, int64_t start_hw_ns,
+                       int64_t anchor_hw_ns,
+                       const std::vector<std::complex<float>> &burst);
+        void add_impairments(std::complex<int16_t> *buff_data,
+                             size_t no_of_samples);
+        bool inject_overflow(size_t no_of_samples);
+        void pace(int64_t end_hw_ns);
+
+        SimClock m_clock;
+        std::vector<std::vector<std::complex<float>>> m_bursts; //!< One per tag
+        std::mt19937 m_rng;
+        std::normal_distribution<float> m_noise;
+        int64_t m_rx_next_hw_ns;
+        int64_t m_start_hw_ns;
+        int64_t m_next_overflow_hw_ns;
+        std::atomic<int64_t> m_first_tx_hw_ns;
+        std::chrono::steady_clock::time_point m_start_wall;
+};
@@ -0,0 +1,269 @@
+/**
+ * \file spectrum.h
+ *
+ * \brief Streaming Welch PSD of the RX data
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <complex>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+#include "sdr_config.h"
+#include "rx_pipeline.h"
+#include "live_plot.h"
+
+enum SpectrumWindow {
+        WINDOW_RECT = 0,
+        WINDOW_HANN = 1,
+        WINDOW_BLACKMAN_HARRIS = 2
+};
+
+/**
+ * \class FftPlan
+ *
+ * \brief In place radix-2 FFT with precomputed twiddles
+ *
+ * The bit reversal and the twiddles are computed by configure, so a
+ * transform does not allocate or call any trigonometric function. The
+ * real and imaginary parts are kept in separate arrays, which is about
+ * four times faster than butterflies on std::complex.
+ *
+ */
+class FftPlan
+{
+public:
+        FftPlan();
+        /**
+         * \brief Set up the plan
+         *
+         * \param[in] size the FFT size, a power of two
+         */
+        void configure(size_t size);
+        size_t size() const;
+        /**
+         * \brief Forward transform, unscaled
+         *
+         * \param[in,out] re real parts, size() values
+         * \param[in,out] im imaginary parts, size() values
+         */
+        void transform(float *re, float *im) const;
+
+private:
+        size_t m_size;
+        std::vector<std::pair<uint32_t, uint32_t>> m_swaps; //!< Bit reversal
+        std::vector<float> m_twiddles_re; //!< exp(-2 pi i k / size)
+        std::vector<float> m_twiddles_im;
+};
+
+/**
+ * \class WelchPsd
+ *
+ * \brief Welch PSD estimate of a stream of CS16 samples
+ *
+ * The samples are cut into windowed, overlapping segments whose power
+ * spectra are averaged. Every spectrum_averages segments the average
+ * is published as a frame. With fixed-count averaging a frame is the
+ * mean of its own segments, with exponential averaging a running mean
+ * with a time constant of spectrum_averages segments. The max hold is
+ * the max of the frames since reset.
+ *
+ * The PSD is in dBFS/Hz, full scale being an int16 amplitude of 32768,
+ * and ordered from -fs/2 to fs/2.
+ *
+ */
+class WelchPsd
+{
+public:
+        WelchPsd();
+        /**
+         * \brief Set up the estimator from the spectrum_ parameters
+         *
+         * \param[in] dev_cfg configuration parameters
+         */
+        void configure(const SDR_Device_Config &dev_cfg);
+        /**
+         * \brief Add samples, up to the end of the next frame
+         *
+         * \param[in] data the samples, following the previous ones
+         * \param[in] no_of_samples number of samples
+         * \return number of samples used, fewer than no_of_samples if a
+         * frame was completed, see is_frame_ready
+         */
+        size_t add_samples(const std::complex<int16_t> *data,
+                           size_t no_of_samples);
+        /**
+         * \brief Drop the segment being filled, e.g. after a gap
+         */
+        void restart_segment();
+        /**
+         * \brief Drop the segment, the averages and the max hold
+         */
+        void reset();
+        /**
+         * \brief Check if the last add_samples completed a frame
+         *
+         * \return true if get_psd_db holds a new frame
+         */
+        bool is_frame_ready() const;
+        const std::vector<float> &get_psd_db() const;
+        /**
+         * \brief The max hold
+         *
+         * \return the max hold [dBFS/Hz], empty if not enabled
+         */
+        const std::vector<float> &get_max_hold_db() const;
+        size_t get_fft_size() const;
+        double get_bin_hz() const;
+        uint64_t get_no_of_segments() const;
+        uint64_t get_no_of_frames() const;
+
+private:
+        void process_segment();
+        void finish_frame();
+
+        FftPlan m_plan;
+        std::vector<float> m_window;
+        size_t m_hop; //!< Samples between segment starts
+        double m_scale; //!< From |X|^2 to dBFS/Hz, linear
+        double m_sampling_rate;
+        size_t m_no_of_averages;
+        bool m_exponential;
+        bool m_max_hold;
+        std::vector<std::complex<int16_t>> m_segment; //!< Being filled
+        size_t m_fill;
+        std::vector<float> m_fft_re;
+        std::vector<float> m_fft_im;
+        std::vector<float> m_power; //!< Sum or running mean, linear
+        std::vector<float> m_psd_db;
+        std::vector<float> m_max_hold_db;
+        size_t m_frame_segments; //!< Segments in the current frame
+        uint64_t m_no_of_segments;
+        uint64_t m_no_of_frames;
+        bool m_frame_ready;
+};
+
+/**
+ * \struct SpectrumFileHeader
+ *
+ * \brief The header of a spectrum file, little endian as written
+ *
+ * Followed by the frames, each a SpectrumFrameHeader, fft_size floats
+ * of PSD [dBFS/Hz] from -fs/2 to fs/2, and with SPECTRUM_MAX_HOLD set
+ * fft_size floats of max hold.
+ */
+struct SpectrumFileHeader
+{
+        char magic[8]; //!< spectrum_file_magic
+        uint32_t version;
+        uint32_t fft_size;
+        uint32_t flags; //!< SPECTRUM_ flags
+        uint32_t no_of_averages;
+        double sample_rate; //!< [Hz]
+        double frequency; //!< Center frequency, 0 if not known [Hz]
+        double overlap;
+        uint32_t window; //!< SpectrumWindow
+        uint32_t reserved;
+        uint8_t padding[8];
+};
+
+static_assert(sizeof(SpectrumFileHeader) == 64,
+              "SpectrumFileHeader must be 64 bytes");
+
+/**
+ * \struct SpectrumFrameHeader
+ *
+ * \brief The start of a frame in a spectrum file
+ */
+struct SpectrumFrameHeader
+{
+        int64_t time_hw_ns; //!< hw time of the last sample of the frame
+        uint64_t frame_no;
+};
+
+const uint32_t SPECTRUM_MAX_HOLD = 1; //!< The frames hold a max hold
+const uint32_t SPECTRUM_EXPONENTIAL = 2; //!< Exponential averaging
+
+extern const char spectrum_file_magic[8];
+const uint32_t spectrum_file_version = 1;
+
+/**
+ * \class SpectrumMonitor
+ *
+ * \brief Welch PSD of the RX blocks, in its own thread
+ *
+ * The RX or detection loop offers every block it receives. A share of
+ * spectrum_duty_cycle of the samples is copied to a queue, in blocks
+ * of no_of_rx_samples_block, and the rest is skipped. A block is also
+ * skipped if the queue is full, offer never waits. The monitor thread
+ * runs the WelchPsd on the blocks, restarting the segment where blocks
+ * do not follow each other, and writes the frames to spectrum_file
+ * and to the live plot.
+ *
+ */
+class SpectrumMonitor
+{
+public:
+        /**
+         * \brief SpectrumMonitor constructor, starts the thread
+         *
+         * Nothing is started unless dev_cfg.spectrum is set.
+         *
+         * \param[in] dev_cfg configuration parameters
+         * \param[in] live_plot the live plot, if enabled
+         */
+        SpectrumMonitor(const SDR_Device_Config &dev_cfg,
+                        LivePlot &live_plot);
+        /**
+         * \brief SpectrumMonitor destructor, stops the thread
+         */
+        ~SpectrumMonitor();
+        SpectrumMonitor(const SpectrumMonitor &) = delete;
+        SpectrumMonitor &operator=(const SpectrumMonitor &) = delete;
+        bool is_enabled() const;
+        /**
+         * \brief Offer RX samples for the PSD
+         *
+         * \param[in] data the samples
+         * \param[in] no_of_samples number of samples
+         * \param[in] time_hw_ns hw time of the first sample
+         */
+        void offer(const std::complex<int16_t> *data, size_t no_of_samples,
+                   int64_t time_hw_ns);
+        uint64_t get_no_of_frames() const;
+        uint64_t get_no_of_dropped() const; //!< Blocks, queue full
+
+private:
+        void monitor_loop();
+        void output_frame(int64_t time_hw_ns);
+
+        bool m_enabled;
+        double m_duty_cycle;
+        double m_sampling_rate;
+        double m_frequency;
+        size_t m_block_samples;
+        uint64_t m_offered_samples; //!< Only used by offer
+        uint64_t m_accepted_samples; //!< Only used by offer
+        std::unique_ptr<RxPipeline> m_queue;
+        WelchPsd m_psd;
+        LivePlot &m_live_plot;
+        std::string m_filename;
+        std::FILE *m_file;
+        bool m_write_error;
+        std::atomic<uint64_t> m_no_of_frames;
+        std::atomic<uint64_t> m_no_of_dropped;
+        std::thread m_thread;
+};
+
+SpectrumWindow parse_spectrum_window(std::string name);
+void make_spectrum_window(SpectrumWindow window, size_t size, float *taps);
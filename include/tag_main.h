@@ -17,6 +17,9 @@
 #include <SoapySDR/Time.hpp>
 #include <unistd.h>
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <exception>
 #include <math.h>
 #include <armadillo>
 #include <signal.h>
@@ -25,8 +28,23 @@
 #include "macros.h"
 #include "sdr_config.h"
 #include "sdr.h"
+#include "sim_radio.h"
+#include "file_radio.h"
 #include "analyser.h"
 #include "detector.h"
+#include "rt_thread.h"
+#include "buffer_pool.h"
+#include "alloc_counter.h"
+#include "tdma.h"
+#include "timing_tracker.h"
+#include "rx_pipeline.h"
+#include "pong_scheduler.h"
+#include "results_ring.h"
+#include "burst_tracer.h"
+#include "metrics.h"
+#include "logger.h"
+#include "live_plot.h"
+#include "spectrum.h"
 
 /**
  * \brief enum
@@ -40,10 +58,65 @@ enum TagStateMachine {
         SEND_PONG /**< Send PONG burst */
 };
 
-void run_tag(bool plot_data, uint32_t device);
+/**
+ * \struct AllocCheck
+ *
+ * \brief Heap allocations of the steady-state PINGs
+ *
+ * The window starts after alloc_check_warmup found PINGs and lasts
+ * no_of_bursts found PINGs, the check is off if no_of_bursts is 0.
+ */
+struct AllocCheck
+{
+        AllocCheck(const SDR_Device_Config &dev_cfg, size_t no_of_bursts);
+        /**
+         * \brief Count the allocations at the edges of the window
+         *
+         * \param[in] num_of_found_pings found PINGs so far
+         * \return true at the end of the window, time to stop
+         */
+        bool found_ping(size_t num_of_found_pings);
+        /**
+         * \brief Print the allocations of the window
+         *
+         * \return true if the check is off, or done without allocations
+         */
+        bool report() const;
+
+        size_t check_start; //!< Found PINGs before the window
+        size_t no_of_bursts; //!< Found PINGs in the window
+        uint64_t start_count; //!< Allocations at the start of the window
+        uint64_t no_of_allocations; //!< In the window
+        bool done;
+};
+
+bool run_tag(bool plot_data, uint32_t device, SDR_Device_Config dev_cfg,
+             size_t alloc_check_bursts);
+template <typename RadioType>
+bool run_tag_loop(RadioType &radio, SDR_Device_Config dev_cfg,
+                  bool plot_data, size_t alloc_check_bursts);
+template <typename RadioType>
+bool run_tag_pipeline(RadioType &radio, const SDR_Device_Config &dev_cfg,
+                      size_t alloc_check_bursts);
+template <typename RadioType>
+void print_tag_summary(RadioType &radio, const SDR_Device_Config &dev_cfg,
+                       const Detector &detector,
+                       const TimingTracker &tracker,
+                       size_t num_of_found_pings,
+                       size_t tot_num_of_missed_pings,
+                       uint64_t num_of_rx_samples);
+std::vector<std::complex<float>> generate_pong(
+        const SDR_Device_Config &dev_cfg);
+long long int pong_burst_time(int64_t sync_hw_ns, double turnaround,
+                              const TimingTracker &tracker,
+                              const SDR_Device_Config &dev_cfg);
 void sigIntHandler(const int);
 void list_device_info();
 bool return_ok(int ret, size_t expected_num_samples);
 std::string state_to_string(TagStateMachine state);
 bool time_for_initial_sync(size_t num_of_missed_pings,
-                           SDR_Device_Config dev_cfg);
+                           const SDR_Device_Config &dev_cfg);
+size_t no_of_window_samples(const SDR_Device_Config &dev_cfg);
+int64_t schedule_ping_window(double sync_hw_ns, double period_ns,
+                             int64_t now_hw_ns,
+                             const SDR_Device_Config &dev_cfg);
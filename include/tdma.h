@@ -0,0 +1,183 @@
+/**
+ * \file tdma.h
+ *
+ * \brief TDMA ranging of several tags
+ *
+ * Every tag is assigned a slot. The tag in slot n answers with PONG
+ * code pong_scr_code + n, delayed n * tag_slot_length after the
+ * PONG of slot 0, so the beacon only has to look for each code in
+ * the window of its own slot.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <complex>
+#include <memory>
+#include <vector>
+
+#include "macros.h"
+#include "sdr_config.h"
+#include "buffer_pool.h"
+#include "detector.h"
+#include "worker_pool.h"
+#include "ranging.h"
+#include "results_ring.h"
+#include "metrics.h"
+#include "logger.h"
+
+/**
+ * \brief PONG code of a TDMA slot
+ *
+ * \param[in] dev_cfg configuration paramaters
+ * \param[in] slot the slot
+ * \return the scrambling code of the PONG
+ */
+uint32_t slot_pong_code(const SDR_Device_Config &dev_cfg, uint32_t slot);
+/**
+ * \brief Offset of a TDMA slot
+ *
+ * \param[in] dev_cfg configuration paramaters
+ * \param[in] slot the slot
+ * \return the delay of the PONG relative to slot 0 [s]
+ */
+double slot_offset(const SDR_Device_Config &dev_cfg, uint32_t slot);
+
+/**
+ * \struct TagStats
+ *
+ * \brief Ranging state and statistics of one tag
+ */
+struct TagStats
+{
+        uint32_t code = 0; //!< PONG code of the tag
+        int64_t slot_offset_ix = 0; //!< Slot offset [samples]
+        uint64_t no_of_found = 0; //!< Found PONGs
+        uint64_t no_of_missed = 0; //!< Missed PONGs
+        size_t no_of_consecutive_missed = 0;
+        bool tracking = false; //!< PONGs are found in the slot
+        int64_t last_pong_hw_ns = -1; //!< hw time of the last PONG
+        int64_t last_diff = 0; //!< Expected minus found index, last PONG
+};
+
+/**
+ * \class TdmaDetector
+ *
+ * \brief Looks for the PONGs of all tags in a buffer
+ *
+ * Each tag has its own detector, which only gets the samples of the
+ * tag's slot window. The tags are spread over a pool of worker
+ * threads. All buffers are set up by configure, so detect does not
+ * allocate any memory.
+ *
+ * The slot windows are shorter than a burst period, too short for the
+ * DC/IQ estimates, see Detector. With dev_cfg.dc_iq_correction one
+ * corrector runs on a copy of the whole buffer instead, before it is
+ * split into windows.
+ *
+ * Each tag costs one correlation of its window, Detector::look_for_pong
+ * in make bench, about 0.35 ms at Novs_rx 2 on a 2 GHz core with the
+ * AVX2 kernel and 2.2 ms without it. All tags have to be done within
+ * burst_period by tdma_threads + 1 cores, print_stats shows the
+ * detection time.
+ *
+ */
+class TdmaDetector
+{
+public:
+        /**
+         * \brief TdmaDetector constructor
+         */
+        TdmaDetector();
+        /**
+         * \brief Set up the tags, detectors and threads
+         *
+         * Uses no_of_tags, tag_slot_length and tdma_threads, and throws
+         * if the slots overlap or do not fit in burst_period.
+         *
+         * \param[in] dev_cfg configuration paramaters
+         */
+        void configure(const SDR_Device_Config &dev_cfg);
+        /**
+         * \brief Look for the PONGs of all tags
+         *
+         * \param[in] data the received samples
+         * \param[in] no_of_samples number of samples in data
+         * \param[in] expected_ix expected index of the PONG in slot 0
+         * \param[in] data_hw_ns hw time of the first sample
+         * \param[in] ping_tx_hw_ns hw time of a transmitted PING
+         * \return number of tags whose PONG was found
+         */
+        size_t detect(const std::complex<int16_t> *data,
+                      size_t no_of_samples, int64_t expected_ix,
+                      int64_t data_hw_ns, int64_t ping_tx_hw_ns);
+        /**
+         * \brief Number of tags
+         *
+         * \return the number of tags
+         */
+        size_t get_no_of_tags() const;
+        /**
+         * \brief Index of a tag's PONG in the last detect
+         *
+         * \param[in] tag the tag, i.e. its slot
+         * \return the index of the PONG, -1 if it was not found
+         */
+        int64_t get_pong_ix(size_t tag) const;
+        /**
+         * \brief Ranging state and statistics of a tag
+         *
+         * \param[in] tag the tag, i.e. its slot
+         * \return the statistics
+         */
+        const TagStats &get_stats(size_t tag) const;
+        /**
+         * \brief Range of a tag
+         *
+         * \param[in] tag the tag, i.e. its slot
+         * \return the filtered range
+         */
+        const RangeEstimate &get_range(size_t tag) const;
+        /**
+         * \brief Publish every found PONG
+         *
+         * \param[in] publisher the results ring, nullptr for none
+         */
+        void set_publisher(ResultsPublisher *publisher);
+        /**
+         * \brief Print the statistics of all tags and the detection time
+         */
+        void print_stats() const;
+
+private:
+        const std::complex<int16_t> *correct(
+                const std::complex<int16_t> *data, size_t no_of_samples);
+        void detect_tag(size_t tag);
+        void update_stats(size_t tag, int64_t data_hw_ns,
+                          int64_t ping_tx_hw_ns);
+
+        SDR_Device_Config m_dev_cfg;
+        std::unique_ptr<BufferPool> m_pool;
+        std::vector<std::unique_ptr<Detector>> m_detectors;
+        std::unique_ptr<WorkerPool> m_workers;
+        DcIqCorrector m_front_end; //!< Shared by all tags
+        std::vector<std::complex<int16_t>> m_corrected;
+        std::vector<TagStats> m_stats;
+        std::vector<RangeTracker> m_ranges;
+        std::vector<int64_t> m_expected_ix;
+        std::vector<int64_t> m_pong_ix;
+        std::vector<double> m_pong_position; //!< Sub-sample m_pong_ix
+        std::vector<double> m_peak_value;
+        std::vector<double> m_snr_db;
+        int64_t m_window_half_length;
+        int64_t m_period_samples;
+        const std::complex<int16_t> *m_data;
+        size_t m_no_of_samples;
+        uint64_t m_no_of_detects;
+        int64_t m_detect_time_ns; //!< Sum over all detects
+        int64_t m_max_detect_time_ns;
+        ResultsPublisher *m_publisher;
+};
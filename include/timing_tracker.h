@@ -0,0 +1,121 @@
+/**
+ * \file timing_tracker.h
+ *
+ * \brief Delay-locked tracking of periodic bursts
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+
+#include "macros.h"
+#include "sdr_config.h"
+
+/**
+ * \class TimingTracker
+ *
+ * \brief Tracks the arrival time and period of the PINGs
+ *
+ * A second order delay-locked loop: the error between a detected and
+ * a predicted burst time corrects both the burst time (dll_phase_gain)
+ * and the burst period (dll_rate_gain), so a drift between the clocks
+ * is followed without a steady state error. Times are kept as doubles
+ * to keep the sub-sample precision of the detections.
+ *
+ * The variance of the errors sets the guard around the next predicted
+ * burst, and grows for every missed burst, so the search window is
+ * small while the loop is locked and opens up when it is not.
+ *
+ * The estimated period gives the drift between the beacon and the tag
+ * clocks. Once drift_min_pings bursts have been tracked the estimate
+ * is kept over a reset, so a new sync starts from the known drift.
+ *
+ */
+class TimingTracker
+{
+public:
+        /**
+         * \brief TimingTracker constructor
+         */
+        TimingTracker();
+        /**
+         * \brief Set up the loop
+         *
+         * \param[in] dev_cfg configuration paramaters
+         */
+        void configure(const SDR_Device_Config &dev_cfg);
+        /**
+         * \brief Restart the loop from a detected burst
+         *
+         * The period is set to the nominal burst_period, unless the
+         * drift has been estimated.
+         *
+         * \param[in] burst_hw_ns hw time of the burst
+         */
+        void reset(double burst_hw_ns);
+        /**
+         * \brief Update the loop with a detected burst
+         *
+         * \param[in] burst_hw_ns hw time of the burst
+         */
+        void update(double burst_hw_ns);
+        /**
+         * \brief Note that no burst was found where it was predicted
+         */
+        void miss();
+        /**
+         * \brief Predict the next burst
+         *
+         * \param[in] after_hw_ns the prediction is at or after this time
+         * \return the predicted hw time of the burst
+         */
+        double predict(int64_t after_hw_ns) const;
+        /**
+         * \brief Guard around the predicted burst
+         *
+         * \return the guard [samples]
+         */
+        int64_t get_guard() const;
+        /**
+         * \brief Filtered time of the last burst
+         *
+         * \return the hw time of the last burst, updated or predicted
+         */
+        double get_burst_hw_ns() const;
+        /**
+         * \brief Estimated burst period
+         *
+         * \return the period in hw time [ns]
+         */
+        double get_period_ns() const;
+        /**
+         * \brief Standard deviation of the loop errors
+         *
+         * \return the standard deviation [samples]
+         */
+        double get_error_std() const;
+        /**
+         * \brief Estimated clock drift
+         *
+         * \return the burst period in the local clock, relative to the
+         * nominal burst_period [ppm]
+         */
+        double get_drift_ppm() const;
+        /**
+         * \brief Check if the drift estimate can be used
+         *
+         * \return true after drift_min_pings tracked bursts
+         */
+        bool has_drift_estimate() const;
+
+private:
+        SDR_Device_Config m_dev_cfg;
+        double m_sample_ns;
+        double m_burst_hw_ns;
+        double m_period_ns;
+        double m_error_variance; //!< [samples^2]
+        size_t m_no_of_updates; //!< Since the drift estimate was reset
+};
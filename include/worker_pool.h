@@ -0,0 +1,84 @@
+/**
+ * \file worker_pool.h
+ *
+ * \brief Pool of worker threads
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+#include "rt_thread.h"
+
+/**
+ * \class WorkerPool
+ *
+ * \brief A fixed set of threads running numbered jobs
+ *
+ * The job function is given once, at construction, and run calls it
+ * for the job numbers 0 to no_of_jobs - 1. The jobs are shared between
+ * the worker threads and the calling thread, which takes part in the
+ * work, and run returns when all jobs are done. Each thread claims the
+ * next job as soon as it is done with its previous one, so a slow job
+ * does not hold up the others. No memory is allocated by run.
+ *
+ */
+class WorkerPool
+{
+public:
+        /**
+         * \brief WorkerPool constructor
+         *
+         * \param[in] name name of the threads, see configure_rt_thread
+         * \param[in] no_of_threads number of worker threads, 0 to run
+         * all jobs in the calling thread
+         * \param[in] priority SCHED_FIFO priority of the workers, 0 for
+         * normal scheduling
+         * \param[in] job the function to run for each job number, also
+         * given the worker running it, 0 for the calling thread and 1 to
+         * no_of_threads for the worker threads
+         */
+        WorkerPool(std::string name, size_t no_of_threads, int priority,
+                   std::function<void(size_t, size_t)> job);
+        ~WorkerPool();
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+        /**
+         * \brief Run the jobs and wait for them to finish
+         *
+         * \param[in] no_of_jobs number of jobs to run
+         */
+        void run(size_t no_of_jobs);
+        /**
+         * \brief Number of worker threads
+         *
+         * \return the number of threads, not counting the caller
+         */
+        size_t get_no_of_threads() const;
+
+private:
+        void worker_loop(std::string name, int priority, size_t worker);
+        void run_jobs(size_t worker);
+
+        std::function<void(size_t, size_t)> m_job;
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        uint64_t m_generation; //!< Incremented for every run
+        size_t m_no_of_jobs;
+        std::atomic<size_t> m_next_job;
+        size_t m_no_of_busy;
+        bool m_stop;
+};
@@ -0,0 +1,65 @@
+/**
+ * \file alloc_counter.cpp
+ *
+ * \brief Heap allocation counter
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> g_no_of_allocations(0);
+
+static void *counted_malloc(std::size_t size)
+{
+        g_no_of_allocations.fetch_add(1, std::memory_order_relaxed);
+        if (size == 0) {
+                size = 1;
+        }
+        return std::malloc(size);
+}
+
+uint64_t get_no_of_allocations()
+{
+        return g_no_of_allocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(std::size_t size)
+{
+        void *memory = counted_malloc(size);
+        if (memory == nullptr) {
+                throw std::bad_alloc();
+        }
+        return memory;
+}
+
+void *operator new[](std::size_t size)
+{
+        return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+        return counted_malloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+        return counted_malloc(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+        std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+        std::free(memory);
+}
@@ -39,6 +39,17 @@ void Analyser::add_data(std::vector<std::complex<int16_t>> data)
         }
 }
 
+void Analyser::add_data(const std::complex<int16_t> *data,
+                        size_t no_of_samples)
+{
+        m_data.clear();
+        m_data.set_size(no_of_samples);
+        for (size_t n=0; n<no_of_samples; n++) {
+                m_data(n) = std::complex<double>((double)data[n].real(),
+                                                 (double)data[n].imag());
+        }
+}
+
 void Analyser::add_data(arma::cx_vec data)
 {
         m_data.clear();
@@ -90,7 +101,16 @@ void Analyser::plot(arma::vec y)
         plot(y);
 }
 
-void Analyser::save_data(std::string filename)
+void Analyser::save_data(std::string filename, const SampleFileInfo &info)
+{
+        std::vector<std::complex<float>> data(m_data.n_elem);
+        for (size_t n=0; n<data.size(); n++) {
+                data[n] = std::complex<float>(m_data(n));
+        }
+        save_samples(filename + ".cf32", data.data(), data.size(), info);
+}
+
+void Analyser::save_data_ascii(std::string filename)
 {
         std::string file;
         file = filename + "_re.arm";
@@ -634,15 +634,15 @@ void Beacon::print_vec(const std::vector<int>& vec)
 void Beacon::save(arma::vec data, std::string filename)
 {
         std::string file;
-        file = filename + ".arm";
-        data.save(file, arma::raw_ascii);
+        file = filename + ".bin";
+        data.save(file, arma::raw_binary);
 }
 
 void Beacon::save_with_header(arma::vec data, std::string filename)
 {
         std::string file;
         file = filename + ".arm";
-        data.save(file, arma::arma_ascii);
+        data.save(file, arma::arma_binary);
 }
 
 void Beacon::save(arma::vec data)
@@ -652,10 +652,11 @@ void Beacon::save(arma::vec data)
 
 void Beacon::save(arma::cx_vec data)
 {
-        arma::vec i_data(data.n_rows);
-        arma::vec q_data(data.n_rows);
-        i_data = arma::real(data);
-        q_data = arma::imag(data);
-        save(i_data, "i_data");
-        save(q_data, "q_data");
+        std::vector<std::complex<float>> iq_data(data.n_rows);
+        for (size_t n=0; n<iq_data.size(); n++) {
+                iq_data[n] = std::complex<float>(data(n));
+        }
+        SampleFileInfo info;
+        info.sample_rate = m_sample_rate_rx;
+        save_samples("iq_data.cf32", iq_data.data(), iq_data.size(), info);
 }
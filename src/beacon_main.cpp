@@ -45,16 +45,218 @@ int main(int argc, char** argv)
                                                      false, 0,
                                                      "uint32_t");
                 cmd.add(device_arg);
+                TCLAP::ValueArg<std::string> record_arg(
+                        "r", "record",
+                        "Record RX samples as SigMF to <basename>",
+                        false, "", "basename");
+                cmd.add(record_arg);
+                TCLAP::SwitchArg sim_switch("", "sim",
+                                            "Run on simulated data",
+                                            cmd, false);
+                TCLAP::ValueArg<std::string> replay_arg(
+                        "", "replay",
+                        "Run on data replayed from SigMF <basename>, or a"
+                        " .cs16 or .cf32 sample file",
+                        false, "", "basename");
+                cmd.add(replay_arg);
+                TCLAP::SwitchArg continuous_switch(
+                        "", "rx-continuous",
+                        "Stream RX continuously instead of in bursts",
+                        cmd, false);
+                TCLAP::ValueArg<int> rx_cpu_arg(
+                        "", "rx-cpu", "Pin the RX thread to <cpu>",
+                        false, -1, "cpu");
+                cmd.add(rx_cpu_arg);
+                TCLAP::ValueArg<int> tx_cpu_arg(
+                        "", "tx-cpu", "Pin the TX thread to <cpu>",
+                        false, -1, "cpu");
+                cmd.add(tx_cpu_arg);
+                TCLAP::ValueArg<int> rx_prio_arg(
+                        "", "rx-prio",
+                        "Run the RX thread SCHED_FIFO with <priority>",
+                        false, 0, "priority");
+                cmd.add(rx_prio_arg);
+                TCLAP::ValueArg<int> tx_prio_arg(
+                        "", "tx-prio",
+                        "Run the TX thread SCHED_FIFO with <priority>",
+                        false, 0, "priority");
+                cmd.add(tx_prio_arg);
+                TCLAP::SwitchArg mlock_switch("", "mlock",
+                                              "Lock and prefault memory",
+                                              cmd, false);
+                TCLAP::SwitchArg huge_pages_switch(
+                        "", "huge-pages",
+                        "Back the sample buffers with huge pages",
+                        cmd, false);
+                TCLAP::ValueArg<size_t> tags_arg(
+                        "", "tags",
+                        "Range <tags> tags in TDMA slots, 0 for one tag",
+                        false, 0, "tags");
+                cmd.add(tags_arg);
+                TCLAP::SwitchArg one_shot_switch(
+                        "", "one-shot",
+                        "Stop after the first PONG, with one tag",
+                        cmd, false);
+                TCLAP::ValueArg<size_t> tdma_threads_arg(
+                        "", "tdma-threads",
+                        "Threads for the TDMA PONG detection, besides RX",
+                        false, SDR_Device_Config().tdma_threads, "threads");
+                cmd.add(tdma_threads_arg);
+                TCLAP::ValueArg<double> pong_processing_arg(
+                        "", "pong-processing",
+                        "Time for detection in the tags before the PONG,"
+                        " must match the tags",
+                        false, SDR_Device_Config().pong_delay_processing /
+                        SDR_Device_Config().burst_period, "burst periods");
+                cmd.add(pong_processing_arg);
+                TCLAP::ValueArg<std::string> results_arg(
+                        "", "results",
+                        "Publish the ranging results to POSIX shm <name>",
+                        false, "", "name");
+                cmd.add(results_arg);
+                TCLAP::ValueArg<std::string> trace_arg(
+                        "", "trace",
+                        "Trace the stages of each burst to Chrome trace"
+                        " <file>, written at exit and on SIGUSR1",
+                        false, "", "file");
+                cmd.add(trace_arg);
+                TCLAP::ValueArg<std::string> metrics_arg(
+                        "", "metrics",
+                        "Write counters and latency histograms to"
+                        " Prometheus textfile <file>",
+                        false, "", "file");
+                cmd.add(metrics_arg);
+                TCLAP::SwitchArg live_plot_switch(
+                        "", "live-plot",
+                        "Plot the RX data and the correlation in gnuplot"
+                        " while running, single tag only",
+                        cmd, false);
+                TCLAP::SwitchArg spectrum_switch(
+                        "", "spectrum",
+                        "Estimate the PSD of the RX data in the background,"
+                        " shown in the live plot",
+                        cmd, false);
+                TCLAP::ValueArg<std::string> spectrum_file_arg(
+                        "", "spectrum-file",
+                        "Write the PSD frames to binary <file>, implies"
+                        " --spectrum",
+                        false, "", "file");
+                cmd.add(spectrum_file_arg);
+                TCLAP::ValueArg<size_t> spectrum_fft_arg(
+                        "", "spectrum-fft",
+                        "Samples per PSD segment, a power of two",
+                        false, SDR_Device_Config().spectrum_fft_size,
+                        "samples");
+                cmd.add(spectrum_fft_arg);
+                TCLAP::ValueArg<size_t> spectrum_averages_arg(
+                        "", "spectrum-averages",
+                        "Segments per PSD frame",
+                        false, SDR_Device_Config().spectrum_averages,
+                        "segments");
+                cmd.add(spectrum_averages_arg);
+                TCLAP::SwitchArg spectrum_exponential_switch(
+                        "", "spectrum-exponential",
+                        "Average the PSD exponentially over the frames",
+                        cmd, false);
+                TCLAP::SwitchArg spectrum_max_hold_switch(
+                        "", "spectrum-max-hold",
+                        "Keep the max of the PSD frames as well",
+                        cmd, false);
+                TCLAP::ValueArg<std::string> spectrum_window_arg(
+                        "", "spectrum-window",
+                        "PSD window: hann, blackman-harris or rect",
+                        false, SDR_Device_Config().spectrum_window,
+                        "window");
+                cmd.add(spectrum_window_arg);
+                TCLAP::ValueArg<double> spectrum_duty_arg(
+                        "", "spectrum-duty-cycle",
+                        "Fraction of the RX samples in the PSD",
+                        false, SDR_Device_Config().spectrum_duty_cycle,
+                        "fraction");
+                cmd.add(spectrum_duty_arg);
+                TCLAP::SwitchArg no_dc_iq_switch(
+                        "", "no-dc-iq-correction",
+                        "Do not remove the DC offset and the IQ imbalance"
+                        " before the correlation",
+                        cmd, false);
+                TCLAP::ValueArg<double> sim_dc_arg(
+                        "", "sim-dc-offset",
+                        "Simulated DC offset of I and Q",
+                        false, 0, "offset");
+                cmd.add(sim_dc_arg);
+                TCLAP::ValueArg<double> sim_iq_gain_arg(
+                        "", "sim-iq-gain",
+                        "Simulated Q to I amplitude <ratio>",
+                        false, 1, "ratio");
+                cmd.add(sim_iq_gain_arg);
+                TCLAP::ValueArg<double> sim_iq_phase_arg(
+                        "", "sim-iq-phase",
+                        "Simulated phase error of Q in <degrees>",
+                        false, 0, "degrees");
+                cmd.add(sim_iq_phase_arg);
+                TCLAP::ValueArg<double> sim_overflow_arg(
+                        "", "sim-overflow-period",
+                        "Simulate an RX overflow every <seconds>, 0 for none",
+                        false, 0, "seconds");
+                cmd.add(sim_overflow_arg);
+                TCLAP::ValueArg<int> log_level_arg(
+                        "", "log-level",
+                        "Most detailed messages logged: 3 error, 4 warning,"
+                        " 6 info, 7 debug",
+                        false, SDR_Device_Config().log_level, "level");
+                cmd.add(log_level_arg);
                 cmd.parse(argc, argv);
                 bool start_beacon = start_switch.getValue();
                 bool plot_data = plot_switch.getValue();
                 bool list_dev_info = list_switch.getValue();
                 uint32_t device = device_arg.getValue();
+                SDR_Device_Config dev_cfg;
+                dev_cfg.record_basename = record_arg.getValue();
+                dev_cfg.simulate = sim_switch.getValue();
+                dev_cfg.replay_basename = replay_arg.getValue();
+                dev_cfg.rx_continuous = continuous_switch.getValue();
+                dev_cfg.rx_cpu = rx_cpu_arg.getValue();
+                dev_cfg.tx_cpu = tx_cpu_arg.getValue();
+                dev_cfg.rx_priority = rx_prio_arg.getValue();
+                dev_cfg.tx_priority = tx_prio_arg.getValue();
+                dev_cfg.memory_lock = mlock_switch.getValue();
+                dev_cfg.huge_pages = huge_pages_switch.getValue();
+                dev_cfg.no_of_tags = tags_arg.getValue();
+                dev_cfg.one_shot = one_shot_switch.getValue();
+                dev_cfg.tdma_threads = tdma_threads_arg.getValue();
+                dev_cfg.results_shm = results_arg.getValue();
+                dev_cfg.trace_file = trace_arg.getValue();
+                dev_cfg.metrics_file = metrics_arg.getValue();
+                dev_cfg.live_plot = live_plot_switch.getValue();
+                dev_cfg.spectrum_file = spectrum_file_arg.getValue();
+                dev_cfg.spectrum = spectrum_switch.getValue() ||
+                        (dev_cfg.spectrum_file != "");
+                dev_cfg.spectrum_fft_size = spectrum_fft_arg.getValue();
+                dev_cfg.spectrum_averages = spectrum_averages_arg.getValue();
+                dev_cfg.spectrum_exponential =
+                        spectrum_exponential_switch.getValue();
+                dev_cfg.spectrum_max_hold =
+                        spectrum_max_hold_switch.getValue();
+                dev_cfg.spectrum_window = spectrum_window_arg.getValue();
+                dev_cfg.spectrum_duty_cycle = spectrum_duty_arg.getValue();
+                dev_cfg.dc_iq_correction = !no_dc_iq_switch.getValue();
+                dev_cfg.sim_dc_offset = sim_dc_arg.getValue();
+                dev_cfg.sim_iq_gain = sim_iq_gain_arg.getValue();
+                dev_cfg.sim_iq_phase = sim_iq_phase_arg.getValue();
+                dev_cfg.sim_overflow_period = sim_overflow_arg.getValue();
+                dev_cfg.log_level =
+                        (SoapySDRLogLevel)log_level_arg.getValue();
+                g_logger.set_level(dev_cfg.log_level);
+                SoapySDR::registerLogHandler(soapy_log_handler);
+                dev_cfg.pong_delay_processing =
+                        pong_processing_arg.getValue() * dev_cfg.burst_period;
                 if (list_dev_info) {
                         list_device_info();
                 }
                 if (start_beacon) {
-                        run_beacon(plot_data, device);
+                        g_logger.start();
+                        run_beacon(plot_data, device, dev_cfg);
+                        g_logger.stop();
                 }
         }
         catch (TCLAP::ArgException &e) {
@@ -71,9 +273,8 @@ void list_device_info()
         sdr.list_hw_info();
 }
 
-void run_beacon(bool plot_data, uint32_t device)
+void run_beacon(bool plot_data, uint32_t device, SDR_Device_Config dev_cfg)
 {
-        SDR_Device_Config dev_cfg;
         std::string dev_serial = "";
         switch(device) {
         case 1:
@@ -95,38 +296,95 @@ void run_beacon(bool plot_data, uint32_t device)
                 dev_cfg.tx_frequency = dev_cfg.pong_frequency;
                 dev_cfg.rx_frequency = dev_cfg.ping_frequency;
         }
+        if (dev_cfg.simulate) {
+                dev_cfg.range_hw_delay += dev_cfg.sim_range_hw_delay /
+                        dev_cfg.sampling_rate_rx;
+                SimRadio radio;
+                run_beacon_loop(radio, dev_cfg, plot_data);
+        } else if (dev_cfg.replay_basename != "") {
+                FileRadio radio(dev_cfg.replay_basename);
+                run_beacon_loop(radio, dev_cfg, plot_data);
+        } else {
+                SDR sdr;
+                SoapySDR::setLogLevel(dev_cfg.log_level);
+                sdr.connect(dev_serial);
+                run_beacon_loop(sdr, dev_cfg, plot_data);
+        }
+}
 
-        SDR sdr;
-        SoapySDR::setLogLevel(dev_cfg.log_level);
-        sdr.connect(dev_serial);
-        sdr.configure(dev_cfg);
-        int64_t now_hw_ticks = sdr.start();
+template <typename RadioType>
+void run_beacon_loop(RadioType &radio, SDR_Device_Config dev_cfg,
+                     bool plot_data)
+{
+        g_tracer.configure(dev_cfg.trace_file, dev_cfg.trace_ring_size);
+        MetricsWriter metrics_writer(g_metrics.registry, dev_cfg.metrics_file,
+                                     dev_cfg.metrics_period);
+        LivePlot live_plot(dev_cfg);
+        SpectrumMonitor spectrum(dev_cfg, live_plot);
+        // Started before RX is pinned, so the workers are not pinned
+        TdmaDetector tdma;
+        const bool multi_tag = (dev_cfg.no_of_tags > 0);
+        std::unique_ptr<ResultsPublisher> results;
+        if (dev_cfg.results_shm != "") {
+                results.reset(new ResultsPublisher(
+                                      dev_cfg.results_shm,
+                                      dev_cfg.results_ring_size));
+        }
+        if (multi_tag) {
+                tdma.configure(dev_cfg);
+                tdma.set_publisher(results.get());
+        }
+        configure_rt_thread("RX", dev_cfg.rx_cpu, dev_cfg.rx_priority);
+        if (dev_cfg.memory_lock) {
+                lock_memory();
+                prefault_stack(dev_cfg.prefault_stack_size);
+        }
+        radio.configure(dev_cfg);
+        int64_t now_hw_ticks = radio.start();
         int64_t tx_start_hw_ticks = calculate_tx_start_tick(now_hw_ticks);
 
         std::future<void> future;
-        future = std::async(std::launch::async, &transmit_ping,
-                            sdr,
+        future = std::async(std::launch::async, &transmit_ping<RadioType>,
+                            std::ref(radio),
+                            dev_cfg,
                             tx_start_hw_ticks);
         my_futures.push_back(std::move(future));
 
+        BufferPool pool(Detector::get_buffer_bytes(dev_cfg),
+                        dev_cfg.buffer_pool_size, dev_cfg.huge_pages);
+        PoolBuffer<std::complex<int16_t>> buff_data_pong(
+                pool, dev_cfg.no_of_rx_samples_pong);
+
         // TODO: Can we get rid of this?
         // A dummy read to get timestamps up to sync
-        std::vector<std::complex<int16_t>> buff_data_dummy(100);
-        sdr.read(100, buff_data_dummy);
+        radio.read(100, buff_data_pong.data());
 
         Detector detector;
-        detector.configure(CDMA, {dev_cfg.pong_scr_code}, dev_cfg);
+        detector.configure(CDMA, {dev_cfg.pong_scr_code}, dev_cfg, pool);
+        RangeTracker range;
+        range.configure(dev_cfg, 0);
 
         TimePoint time_last_spin = std::chrono::high_resolution_clock::now();
         int spin_index(0);
         std::cout << "Starting stream loop, press Ctrl+C to exit..."
                   << std::endl;
         signal(SIGINT, sigIntHandler);
+        signal(SIGUSR1, trace_signal_handler);
         while (not g_stop) {
-                int64_t pong_time_hw_ns;
-                pong_time_hw_ns = look_for_pong(sdr, detector);
-                if (pong_time_hw_ns != -1) {
-                        g_stop = true;
+                g_tracer.dump_if_requested();
+                if (multi_tag) {
+                        look_for_pongs(radio, tdma, buff_data_pong,
+                                       spectrum, dev_cfg);
+                } else {
+                        int64_t pong_time_hw_ns;
+                        pong_time_hw_ns = look_for_pong(radio, detector,
+                                                        buff_data_pong,
+                                                        range, results.get(),
+                                                        live_plot, spectrum,
+                                                        dev_cfg);
+                        if (dev_cfg.one_shot && (pong_time_hw_ns != -1)) {
+                                g_stop = true;
+                        }
                 }
                 time_last_spin = print_spin(time_last_spin, spin_index++);
                 usleep(100);
@@ -139,7 +397,12 @@ void run_beacon(bool plot_data, uint32_t device)
                 my_futures.pop_back();
         }
 
-        sdr.close();
+        radio.close();
+        g_logger.flush();
+        if (multi_tag) {
+                tdma.print_stats();
+        }
+        g_tracer.dump();
 
         if (plot_data) {
                 Analyser analyser;
@@ -149,22 +412,21 @@ void run_beacon(bool plot_data, uint32_t device)
                 analyser.plot_data();
                 arma::cx_vec raw_data = detector.get_raw_data();
                 analyser.add_data(raw_data);
-                analyser.save_data("raw_beacon_data");
+                SampleFileInfo info;
+                info.sample_rate = dev_cfg.sampling_rate_rx;
+                info.frequency = dev_cfg.pong_frequency;
+                info.time_hw_ns = radio.ix_to_hw_ns(0);
+                analyser.save_data("raw_beacon_data", info);
         }
 }
 
-void calculate_tof(int64_t tx_start_time_hw_ns, int64_t last_pong_time_hw_ns)
-{
-        /* TODO: this is just a place holder for now. Should probably be
-         * something like mod((last-tx), burst_period)/2*c
-         */
-        int64_t tof = last_pong_time_hw_ns - tx_start_time_hw_ns;
-        if (tof > 0) {}
-}
-
-int64_t look_for_pong(SDR sdr, Detector &detector)
+template <typename RadioType>
+int64_t look_for_pong(RadioType &radio, Detector &detector,
+                      PoolBuffer<std::complex<int16_t>> &buff_data_pong,
+                      RangeTracker &range, ResultsPublisher *results,
+                      LivePlot &live_plot, SpectrumMonitor &spectrum,
+                      const SDR_Device_Config &dev_cfg)
 {
-        SDR_Device_Config dev_cfg;
         const size_t no_of_samples_pong =
                 dev_cfg.no_of_rx_samples_pong;
         size_t num_pong_tries(0);
@@ -173,69 +435,144 @@ int64_t look_for_pong(SDR sdr, Detector &detector)
         size_t tot_num_of_missed_pongs(0);
         int64_t sync_ix(-1);
         int64_t sync_hw_ns(-1);
-        std::vector<std::complex<int16_t>> buff_data_pong(
-                no_of_samples_pong);
         long long last_burst_hw_ns = g_burst_hw_ns;
-        int ret = sdr.read(no_of_samples_pong, buff_data_pong);
+        int ret = radio.read(no_of_samples_pong, buff_data_pong.data());
         if (return_ok(ret, no_of_samples_pong)) {
+                spectrum.offer(buff_data_pong.data(), ret,
+                               radio.ix_to_hw_ns(0));
                 num_pong_tries++;
                 int64_t expected_pong_ix;
-                int64_t exp_pong_hw_ns =
-                        last_burst_hw_ns + dev_cfg.pong_delay * 1e9;
-                expected_pong_ix = sdr.find_exp_pong_pos_ix(exp_pong_hw_ns);
-                detector.add_data(buff_data_pong);
+                int64_t exp_pong_hw_ns = last_burst_hw_ns +
+                        (dev_cfg.pong_delay + dev_cfg.pong_delay_processing) *
+                        1e9;
+                expected_pong_ix = radio.find_exp_pong_pos_ix(exp_pong_hw_ns);
+                detector.add_data(buff_data_pong.data(), ret);
                 sync_ix = detector.look_for_pong(
                         expected_pong_ix);
+                live_plot.push(detector.get_corr_data(),
+                               detector.get_corr_length(),
+                               buff_data_pong.data(), ret);
+                trace_event(TRACE_DECISION, last_burst_hw_ns,
+                            detector.found_pong(sync_ix));
                 if (detector.found_pong(sync_ix)) {
-                        sync_hw_ns = sdr.ix_to_hw_ns(sync_ix);
+                        sync_hw_ns = radio.ix_to_hw_ns(sync_ix);
+                        radio.annotate(sync_ix, "PONG");
                         num_of_found_pongs++;
-                        std::cout << "*** Found PONG"
-                                  << " expected "
-                                  << expected_pong_ix
-                                  << " sync ix "
-                                  << sync_ix
-                                  << " diff "
-                                  << expected_pong_ix-sync_ix
-                                  << " data_length "
-                                  << buff_data_pong.size()
-                                  << " expected pong time "
-                                  << exp_pong_hw_ns
-                                  << " last burst time "
-                                  << last_burst_hw_ns
-                                  << std::endl;
+                        g_logger.log(SOAPY_SDR_INFO,
+                                     "*** Found PONG expected {} sync ix {}"
+                                     " diff {} data_length {} expected pong"
+                                     " time {} last burst time {}",
+                                     expected_pong_ix, sync_ix,
+                                     expected_pong_ix - sync_ix,
+                                     buff_data_pong.size(), exp_pong_hw_ns,
+                                     last_burst_hw_ns);
+                        // Range from the sub-sample peak
+                        int64_t pong_hw_ns = radio.ix_to_hw_ns(0) +
+                                std::llround(detector.get_peak_position() *
+                                             1e9 / dev_cfg.sampling_rate_rx);
+                        g_metrics.found_pongs.add();
+                        g_metrics.detection_latency.record(
+                                radio.get_hardware_time() - pong_hw_ns);
+                        g_metrics.peak_to_threshold.record(std::llround(
+                                1e3 * detector.get_peak_value() /
+                                detector.get_threshold()));
+                        const RangeEstimate &estimate = range.update(
+                                last_burst_hw_ns, pong_hw_ns);
+                        g_logger.log(SOAPY_SDR_INFO,
+                                     "*** Range {} m, filtered {} +- {} m",
+                                     estimate.measured_range, estimate.range,
+                                     estimate.range_std);
+                        if (results != nullptr) {
+                                RangingRecord record = make_ranging_record(
+                                        RECORD_PONG | RECORD_RANGED, 0,
+                                        last_burst_hw_ns,
+                                        detector.get_peak_position(),
+                                        detector.get_peak_value(),
+                                        detector.get_snr_estimate());
+                                record.range = estimate.measured_range;
+                                record.range_filtered = estimate.range;
+                                if (estimate.outlier) {
+                                        record.flags |= RECORD_OUTLIER;
+                                }
+                                results->publish(record);
+                        }
                 } else {
                         num_of_missed_pongs++;
                         tot_num_of_missed_pongs++;
+                        g_metrics.missed_pongs.add();
                 }
         }
         return sync_hw_ns;
 }
 
+template <typename RadioType>
+size_t look_for_pongs(RadioType &radio, TdmaDetector &tdma,
+                      PoolBuffer<std::complex<int16_t>> &buff_data_pong,
+                      SpectrumMonitor &spectrum,
+                      const SDR_Device_Config &dev_cfg)
+{
+        const size_t no_of_samples_pong =
+                dev_cfg.no_of_rx_samples_pong;
+        size_t no_of_found(0);
+        long long last_burst_hw_ns = g_burst_hw_ns;
+        int ret = radio.read(no_of_samples_pong, buff_data_pong.data());
+        if (return_ok(ret, no_of_samples_pong)) {
+                spectrum.offer(buff_data_pong.data(), ret,
+                               radio.ix_to_hw_ns(0));
+                int64_t exp_pong_hw_ns = last_burst_hw_ns +
+                        (dev_cfg.pong_delay + dev_cfg.pong_delay_processing) *
+                        1e9;
+                int64_t expected_pong_ix =
+                        radio.find_exp_pong_pos_ix(exp_pong_hw_ns);
+                no_of_found = tdma.detect(buff_data_pong.data(), ret,
+                                          expected_pong_ix,
+                                          radio.ix_to_hw_ns(0),
+                                          last_burst_hw_ns);
+                if (no_of_found > 0) {
+                        int64_t now_hw_ns = radio.get_hardware_time();
+                        for (size_t n=0; n<tdma.get_no_of_tags(); n++) {
+                                if (tdma.get_pong_ix(n) < 0) {
+                                        continue;
+                                }
+                                g_metrics.detection_latency.record(
+                                        now_hw_ns -
+                                        tdma.get_stats(n).last_pong_hw_ns);
+                        }
+                }
+        }
+        return no_of_found;
+}
+
 bool return_ok(int ret, size_t expected_num_samples)
 {
         bool data_ok(true);
+        count_stream_error(ret);
+        // No data, but the stream goes on, see the tag
         if (ret == SOAPY_SDR_TIMEOUT) {
-                std::cout << "Timeout!" << std::endl;
+                g_logger.log(SOAPY_SDR_WARNING, "Timeout!");
+                return false;
         }
         if (ret == SOAPY_SDR_OVERFLOW) {
-                std::cout << "Overflow!" << std::endl;
+                g_logger.log(SOAPY_SDR_WARNING, "Overflow!");
+                return false;
         }
         if (ret == SOAPY_SDR_UNDERFLOW) {
-                std::cout << "Underflow!" << std::endl;
+                g_logger.log(SOAPY_SDR_WARNING, "Underflow!");
         }
         if (ret < 0) {
                 std::string err = "Unexpected stream error ";
                 err += SoapySDR::errToStr(ret);
                 throw std::runtime_error(err);
-                std::cout << err << std::endl;
         }
         data_ok &= (ret == (int)expected_num_samples);
         return data_ok;
 }
 
-void transmit_ping(SDR sdr, int64_t tx_start_hw_ticks)
+template <typename RadioType>
+void transmit_ping(RadioType &radio, SDR_Device_Config dev_cfg,
+                   int64_t tx_start_hw_ticks)
 {
-        SDR_Device_Config dev_cfg;
+        configure_rt_thread("TX", dev_cfg.tx_cpu, dev_cfg.tx_priority);
         size_t buffer_size_tx = dev_cfg.tx_burst_length;
         size_t no_of_tx_samples = buffer_size_tx;
         int64_t tx_hw_ticks = tx_start_hw_ticks;
@@ -255,12 +592,17 @@ void transmit_ping(SDR sdr, int64_t tx_start_hw_ticks)
         tx_buffs_data.push_back(tx_buff_data.data());
         std::cout << "sample count per send call: "
                   << no_of_tx_samples << std::endl;
+        if (dev_cfg.memory_lock) {
+                prefault(tx_buff_data.data(),
+                         tx_buff_data.size() * sizeof(tx_buff_data[0]));
+                prefault_stack(dev_cfg.prefault_stack_size);
+        }
         while (not g_stop) {
                 g_burst_hw_ns = SoapySDR::ticksToTimeNs(
                         tx_hw_ticks,
                         dev_cfg.f_clk);
-                sdr.check_burst_time(g_burst_hw_ns);
-                sdr.write(tx_buffs_data, no_of_tx_samples, g_burst_hw_ns);
+                record_tx_slack(radio.check_burst_time(g_burst_hw_ns));
+                radio.write(tx_buffs_data, no_of_tx_samples, g_burst_hw_ns);
                 tx_hw_ticks += burst_period_rel_ticks;
         }
 }
@@ -290,9 +632,8 @@ TimePoint print_spin(TimePoint time_last_spin, int spin_index)
 {
         TimePoint now = std::chrono::high_resolution_clock::now();
         if (time_last_spin + std::chrono::milliseconds(300) < now) {
-                static const char spin[] = {"|/-\\"};
-                printf("\b%c", spin[(spin_index++)%4]);
-                fflush(stdout);
+                static const char *spin[] = {"\b|", "\b/", "\b-", "\b\\"};
+                g_logger.write_raw(SOAPY_SDR_INFO, spin[(spin_index++)%4]);
                 time_last_spin = now;
         }
         return time_last_spin;
@@ -0,0 +1,476 @@
+/**
+ * \file bench.cpp
+ *
+ * \brief Micro-benchmarks of the DSP kernels
+ *
+ * Times the detection and modulation kernels in isolation, with the
+ * sizes of SDR_Device_Config at each oversampling factor, and counts
+ * the heap allocations per call. Also times saving and loading a PING
+ * buffer as text and as a binary sample file. Built with make bench,
+ * run with -h for a list of options.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "bench.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+
+int main(int argc, char** argv)
+{
+        try {
+                bool enable_version_and_help(true);
+                TCLAP::CmdLine cmd("DSP kernel micro-benchmarks",
+                                   ' ',
+                                   PACKAGE_STRING,
+                                   enable_version_and_help);
+                TCLAP::ValueArg<std::string> filter_arg(
+                        "f", "filter",
+                        "Only run the benchmarks whose name contains <text>",
+                        false, "", "text");
+                cmd.add(filter_arg);
+                TCLAP::ValueArg<double> min_time_arg(
+                        "", "min-time", "Time to run each benchmark",
+                        false, 0.2, "seconds");
+                cmd.add(min_time_arg);
+                TCLAP::ValueArg<std::string> save_dir_arg(
+                        "", "save-dir",
+                        "Directory for the files of the save benchmarks",
+                        false, "/tmp", "dir");
+                cmd.add(save_dir_arg);
+                TCLAP::ValueArg<std::string> json_arg(
+                        "", "json", "Write the results as JSON to <file>",
+                        false, "", "file");
+                cmd.add(json_arg);
+                cmd.parse(argc, argv);
+
+                std::vector<BenchCase> cases;
+                const uint16_t novs_list[] = {2, 4, 8};
+                for (uint16_t novs : novs_list) {
+                        SDR_Device_Config dev_cfg = bench_config(novs);
+                        const size_t no_of_samples =
+                                dev_cfg.no_of_rx_samples_ping;
+                        auto data = std::make_shared<
+                                std::vector<std::complex<int16_t>>>(
+                                        bench_rx_data(dev_cfg,
+                                                      no_of_samples));
+                        auto detector = std::make_shared<Detector>();
+                        detector->configure(CDMA, {dev_cfg.ping_scr_code},
+                                            dev_cfg);
+                        const size_t corr_length = no_of_samples +
+                                DspBench::get_reference_length(*detector) -
+                                1;
+                        // Data and correlation for the later kernels
+                        detector->add_data(data->data(), data->size());
+                        DspBench::correlate(*detector);
+                        const double threshold =
+                                DspBench::calculate_threshold(*detector);
+                        cases.push_back({
+                                "Detector::add_data", novs, no_of_samples,
+                                [detector, data]() {
+                                        detector->add_data(
+                                                data->data(), data->size());
+                                }});
+                        cases.push_back({
+                                "Detector::correlate", novs, no_of_samples,
+                                [detector]() {
+                                        DspBench::correlate(*detector);
+                                }});
+                        // One tag of TdmaDetector, a window around the burst
+                        const size_t window_length =
+                                dev_cfg.tx_burst_length +
+                                2 * dev_cfg.pong_burst_guard;
+                        auto window = std::make_shared<
+                                std::vector<std::complex<int16_t>>>(
+                                        data->begin() + (no_of_samples -
+                                                         window_length) / 2,
+                                        data->begin() + (no_of_samples +
+                                                         window_length) / 2);
+                        auto tag_detector = std::make_shared<Detector>();
+                        tag_detector->configure(CDMA,
+                                                {dev_cfg.ping_scr_code},
+                                                dev_cfg);
+                        cases.push_back({
+                                "Detector::look_for_pong", novs,
+                                window->size(),
+                                [tag_detector, window]() {
+                                        tag_detector->add_data(
+                                                window->data(),
+                                                window->size());
+                                        tag_detector->look_for_pong(
+                                                window->size() / 2);
+                                }});
+                        cases.push_back({
+                                "Detector::calculate_threshold", novs,
+                                corr_length,
+                                [detector]() {
+                                        DspBench::calculate_threshold(
+                                                *detector);
+                                }});
+                        cases.push_back({
+                                "Detector::find_peaks", novs, corr_length,
+                                [detector, threshold]() {
+                                        DspBench::find_peaks(*detector,
+                                                             threshold);
+                                }});
+                        // Envelopes of the live plot
+                        const size_t no_of_bins =
+                                SDR_Device_Config().live_plot_bins;
+                        auto envelope = std::make_shared<
+                                std::vector<float>>(2 * no_of_bins);
+                        cases.push_back({
+                                "decimate_min_max", novs, corr_length,
+                                [detector, envelope, no_of_bins]() {
+                                        decimate_min_max(
+                                                detector->get_corr_data(),
+                                                detector->get_corr_length(),
+                                                no_of_bins,
+                                                envelope->data(),
+                                                envelope->data() +
+                                                no_of_bins);
+                                }});
+                        cases.push_back({
+                                "decimate_magnitude_min_max", novs,
+                                no_of_samples,
+                                [data, envelope, no_of_bins]() {
+                                        decimate_magnitude_min_max(
+                                                data->data(), data->size(),
+                                                no_of_bins,
+                                                envelope->data(),
+                                                envelope->data() +
+                                                no_of_bins);
+                                }});
+
+                        const size_t no_of_chips =
+                                dev_cfg.tx_burst_length_chip;
+                        auto modulator = std::make_shared<Modulator>(
+                                no_of_chips, 1.0, novs);
+                        modulator->generate_cdma(dev_cfg.ping_scr_code);
+                        auto code = std::make_shared<arma::cx_vec>(
+                                no_of_chips);
+                        const uint16_t code_nr = dev_cfg.ping_scr_code;
+                        cases.push_back({
+                                "Modulator::gen_scr_code", novs, no_of_chips,
+                                [modulator, code, code_nr]() {
+                                        DspBench::gen_scr_code(
+                                                *modulator, code_nr, *code);
+                                }});
+                        cases.push_back({
+                                "Modulator::generate_cdma", novs,
+                                no_of_chips * novs,
+                                [modulator, code_nr]() {
+                                        modulator->generate_cdma(code_nr);
+                                }});
+                        cases.push_back({
+                                "Modulator::filter", novs,
+                                no_of_chips * novs,
+                                [modulator]() { modulator->filter(); }});
+                }
+
+                // Saving and loading a PING buffer, text against binary
+                SDR_Device_Config save_cfg = bench_config(2);
+                const size_t no_of_save_samples =
+                        save_cfg.no_of_rx_samples_ping;
+                auto save_data = std::make_shared<
+                        std::vector<std::complex<int16_t>>>(
+                                bench_rx_data(save_cfg,
+                                              no_of_save_samples));
+                auto analyser = std::make_shared<Analyser>();
+                analyser->add_data(save_data->data(), save_data->size());
+                const std::string save_base = save_dir_arg.getValue() +
+                        "/bench_save";
+                analyser->save_data_ascii(save_base);
+                analyser->save_data(save_base);
+                auto load_data = std::make_shared<
+                        std::vector<std::complex<float>>>(
+                                no_of_save_samples);
+                cases.push_back({
+                        "Analyser::save_data_ascii", 2, no_of_save_samples,
+                        [analyser, save_base]() {
+                                analyser->save_data_ascii(save_base);
+                        }});
+                cases.push_back({
+                        "Analyser::save_data", 2, no_of_save_samples,
+                        [analyser, save_base]() {
+                                analyser->save_data(save_base);
+                        }});
+                cases.push_back({
+                        "save_samples_cs16", 2, no_of_save_samples,
+                        [save_data, save_base]() {
+                                save_samples(save_base + ".cs16",
+                                             save_data->data(),
+                                             save_data->size(),
+                                             SampleFileInfo());
+                        }});
+                cases.push_back({
+                        "load_ascii", 2, no_of_save_samples,
+                        [save_base]() {
+                                arma::vec re_data;
+                                arma::vec im_data;
+                                re_data.load(save_base + "_re.arm",
+                                             arma::raw_ascii);
+                                im_data.load(save_base + "_im.arm",
+                                             arma::raw_ascii);
+                        }});
+                cases.push_back({
+                        "SampleFile::read_cf32", 2, no_of_save_samples,
+                        [save_base, load_data]() {
+                                SampleFile file;
+                                file.open(save_base + ".cf32");
+                                file.read(0, file.size(), load_data->data());
+                        }});
+
+                // The spectrum monitor at the RX rate, one core
+                SDR_Device_Config psd_cfg = bench_config(2);
+                auto fft = std::make_shared<FftPlan>();
+                fft->configure(psd_cfg.spectrum_fft_size);
+                auto fft_data = std::make_shared<std::vector<float>>(
+                        2 * psd_cfg.spectrum_fft_size);
+                auto psd = std::make_shared<WelchPsd>();
+                psd->configure(psd_cfg);
+                cases.push_back({
+                        "FftPlan::transform", 2, psd_cfg.spectrum_fft_size,
+                        [fft, fft_data]() {
+                                fft->transform(fft_data->data(),
+                                               fft_data->data() +
+                                               fft->size());
+                        }});
+                cases.push_back({
+                        "WelchPsd::add_samples", 2, no_of_save_samples,
+                        [psd, save_data]() {
+                                size_t used(0);
+                                while (used < save_data->size()) {
+                                        used += psd->add_samples(
+                                                save_data->data() + used,
+                                                save_data->size() - used);
+                                }
+                        }});
+
+                // The front end correction, in place at the RX rate
+                auto corrector = std::make_shared<DcIqCorrector>();
+                corrector->configure(psd_cfg);
+                auto cs16_data = std::make_shared<
+                        std::vector<std::complex<int16_t>>>(*save_data);
+                auto cf32_data = std::make_shared<
+                        std::vector<std::complex<float>>>(
+                                no_of_save_samples);
+                auto split_data = std::make_shared<std::vector<float>>(
+                        2 * no_of_save_samples);
+                for (size_t n=0; n<no_of_save_samples; n++) {
+                        (*cf32_data)[n] = std::complex<float>(
+                                (*save_data)[n].real(),
+                                (*save_data)[n].imag());
+                        (*split_data)[n] = (*save_data)[n].real();
+                        (*split_data)[no_of_save_samples + n] =
+                                (*save_data)[n].imag();
+                }
+                cases.push_back({
+                        "DcIqCorrector::process_cs16", 2, no_of_save_samples,
+                        [corrector, cs16_data]() {
+                                corrector->process(cs16_data->data(),
+                                                   cs16_data->size());
+                        }});
+                cases.push_back({
+                        "DcIqCorrector::process_cf32", 2, no_of_save_samples,
+                        [corrector, cf32_data]() {
+                                corrector->process(cf32_data->data(),
+                                                   cf32_data->size());
+                        }});
+                cases.push_back({
+                        "DcIqCorrector::process_cs16_to_split", 2,
+                        no_of_save_samples,
+                        [corrector, save_data, split_data,
+                         no_of_save_samples]() {
+                                corrector->process(
+                                        save_data->data(),
+                                        no_of_save_samples,
+                                        split_data->data(),
+                                        split_data->data() +
+                                        no_of_save_samples);
+                        }});
+                cases.push_back({
+                        "DcIqCorrector::process_split", 2,
+                        no_of_save_samples,
+                        [corrector, split_data, no_of_save_samples]() {
+                                corrector->process(
+                                        split_data->data(),
+                                        split_data->data() +
+                                        no_of_save_samples,
+                                        no_of_save_samples);
+                        }});
+
+                std::vector<BenchResult> results;
+                for (size_t n=0; n<cases.size(); n++) {
+                        if (cases[n].name.find(filter_arg.getValue()) ==
+                            std::string::npos) {
+                                continue;
+                        }
+                        BenchResult result = run_bench_case(
+                                cases[n], min_time_arg.getValue());
+                        std::cout << "bench: " << result.name
+                                  << " Novs " << result.novs << ", "
+                                  << result.samples_per_call
+                                  << " samples: "
+                                  << result.ns_per_call / 1e3 << " us/call, "
+                                  << result.ns_per_sample << " ns/sample, "
+                                  << result.allocs_per_call
+                                  << " allocs/call" << std::endl;
+                        results.push_back(result);
+                }
+                const char *save_files[] = {"_re.arm", "_im.arm", ".cf32",
+                                            ".cs16"};
+                for (const char *save_file : save_files) {
+                        std::remove((save_base + save_file).c_str());
+                }
+                if (json_arg.getValue() != "") {
+                        write_bench_json(json_arg.getValue(), results);
+                }
+        }
+        catch (TCLAP::ArgException &e) {
+                std::cerr << "error: " << e.error()
+                          << " for arg " << e.argId() << std::endl;
+        }
+        catch (std::runtime_error &e) {
+                std::cerr << "error: " << e.what() << std::endl;
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
+
+void DspBench::correlate(Detector &detector)
+{
+        detector.correlate_cdma(0);
+}
+
+double DspBench::calculate_threshold(Detector &detector)
+{
+        return detector.calculate_threshold(
+                detector.m_reference_re[0].size());
+}
+
+size_t DspBench::find_peaks(Detector &detector, double threshold)
+{
+        return detector.find_peaks(threshold);
+}
+
+void DspBench::gen_scr_code(Modulator &modulator, uint16_t code_nr,
+                            arma::cx_vec &Z)
+{
+        modulator.gen_scr_code(code_nr, Z);
+}
+
+size_t DspBench::get_reference_length(const Detector &detector)
+{
+        return detector.m_reference_re.at(0).size();
+}
+
+SDR_Device_Config bench_config(uint16_t novs)
+{
+        // The sizes that depend on the oversampling, as at construction
+        SDR_Device_Config dev_cfg;
+        dev_cfg.Novs_tx = novs;
+        dev_cfg.Novs_rx = novs;
+        dev_cfg.D_tx = 32 / novs;
+        dev_cfg.D_rx = 32 / novs;
+        dev_cfg.sampling_rate_tx = dev_cfg.f_clk / dev_cfg.D_tx;
+        dev_cfg.sampling_rate_rx = dev_cfg.f_clk / dev_cfg.D_rx;
+        dev_cfg.rx_burst_period_samp = dev_cfg.burst_period *
+                dev_cfg.sampling_rate_rx;
+        dev_cfg.tx_burst_length = dev_cfg.tx_burst_length_chip * novs;
+        dev_cfg.no_of_rx_samples_initial_sync = 2 *
+                dev_cfg.sampling_rate_rx * dev_cfg.burst_period;
+        dev_cfg.no_of_rx_samples_ping = dev_cfg.sampling_rate_rx *
+                dev_cfg.burst_period;
+        dev_cfg.no_of_rx_samples_pong = dev_cfg.sampling_rate_rx *
+                dev_cfg.burst_period;
+        return dev_cfg;
+}
+
+std::vector<std::complex<int16_t>> bench_rx_data(
+        const SDR_Device_Config &dev_cfg, size_t no_of_samples)
+{
+        // Noise with one PING in the middle, as SimRadio makes it
+        Modulator modulator(dev_cfg.tx_burst_length_chip,
+                            dev_cfg.sim_burst_amplitude, dev_cfg.Novs_rx);
+        modulator.generate_cdma(dev_cfg.ping_scr_code);
+        modulator.filter();
+        std::vector<std::complex<float>> burst = modulator.get_data();
+        std::mt19937 generator(dev_cfg.sim_seed);
+        std::normal_distribution<float> noise(0,
+                                              dev_cfg.sim_noise_amplitude);
+        std::vector<std::complex<int16_t>> data(no_of_samples);
+        size_t burst_ix = (no_of_samples - burst.size()) / 2;
+        for (size_t n=0; n<no_of_samples; n++) {
+                std::complex<float> sample(noise(generator),
+                                           noise(generator));
+                if ((n >= burst_ix) && (n < burst_ix + burst.size())) {
+                        sample += burst[n - burst_ix];
+                }
+                data[n] = std::complex<int16_t>(sample.real(),
+                                                sample.imag());
+        }
+        return data;
+}
+
+BenchResult run_bench_case(const BenchCase &bench_case, double min_time)
+{
+        typedef std::chrono::steady_clock Clock;
+        // Warm up caches and any lazily sized buffers
+        bench_case.call();
+        uint64_t no_of_calls(0);
+        uint64_t start_allocations = get_no_of_allocations();
+        Clock::time_point start = Clock::now();
+        double elapsed(0);
+        while (elapsed < min_time) {
+                bench_case.call();
+                no_of_calls++;
+                elapsed = std::chrono::duration<double>(
+                        Clock::now() - start).count();
+        }
+        uint64_t no_of_allocations = get_no_of_allocations() -
+                start_allocations;
+        BenchResult result;
+        result.name = bench_case.name;
+        result.novs = bench_case.novs;
+        result.samples_per_call = bench_case.samples_per_call;
+        result.no_of_calls = no_of_calls;
+        result.ns_per_call = elapsed * 1e9 / no_of_calls;
+        result.ns_per_sample = result.ns_per_call /
+                bench_case.samples_per_call;
+        result.allocs_per_call = (double)no_of_allocations / no_of_calls;
+        return result;
+}
+
+void write_bench_json(std::string filename,
+                      const std::vector<BenchResult> &results)
+{
+        std::ofstream file(filename);
+        if (!file) {
+                throw std::runtime_error("Could not open " + filename);
+        }
+        file << "{" << std::endl;
+        file << "    \"version\": \"" << PACKAGE_VERSION << "\"," << std::endl;
+        file << "    \"benchmarks\": [" << std::endl;
+        for (size_t n=0; n<results.size(); n++) {
+                const BenchResult &result = results[n];
+                file << "        {\"name\": \"" << result.name
+                     << "\", \"novs\": " << result.novs
+                     << ", \"samples_per_call\": " << result.samples_per_call
+                     << ", \"calls\": " << result.no_of_calls
+                     << ", \"ns_per_call\": " << result.ns_per_call
+                     << ", \"ns_per_sample\": " << result.ns_per_sample
+                     << ", \"allocs_per_call\": " << result.allocs_per_call
+                     << "}" << (n + 1 < results.size() ? "," : "")
+                     << std::endl;
+        }
+        file << "    ]" << std::endl;
+        file << "}" << std::endl;
+        std::cout << "bench: Wrote " << filename << std::endl;
+}
@@ -0,0 +1,131 @@
+/**
+ * \file buffer_pool.cpp
+ *
+ * \brief Sample buffer pool
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "buffer_pool.h"
+
+#include <sys/mman.h>
+
+const size_t BufferPool::alignment;
+const uint32_t BufferPool::empty;
+
+BufferPool::BufferPool(size_t buffer_bytes, size_t no_of_buffers,
+                       bool huge_pages)
+        : m_memory(nullptr),
+          m_memory_bytes(0),
+          m_buffer_bytes(buffer_bytes),
+          m_stride(0),
+          m_no_of_buffers(no_of_buffers),
+          m_huge_pages(false),
+          m_next(new std::atomic<uint32_t>[no_of_buffers]),
+          m_head(empty),
+          m_no_of_free(0)
+{
+        if ((no_of_buffers == 0) || (no_of_buffers >= empty)) {
+                throw std::runtime_error("pool: Bad number of buffers");
+        }
+        m_stride = (buffer_bytes + alignment - 1) / alignment * alignment;
+        m_memory_bytes = m_stride * no_of_buffers;
+        void *memory = MAP_FAILED;
+        if (huge_pages) {
+                const size_t huge_page_bytes = 2 << 20;
+                size_t bytes = (m_memory_bytes + huge_page_bytes - 1) /
+                        huge_page_bytes * huge_page_bytes;
+                memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                              -1, 0);
+                if (memory != MAP_FAILED) {
+                        m_memory_bytes = bytes;
+                        m_huge_pages = true;
+                } else {
+                        std::cout << "pool: Warning, no huge pages"
+                                  << " available, using normal pages"
+                                  << std::endl;
+                }
+        }
+        if (memory == MAP_FAILED) {
+                memory = mmap(nullptr, m_memory_bytes,
+                              PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (memory == MAP_FAILED) {
+                        throw std::runtime_error(
+                                "pool: Could not allocate buffers");
+                }
+        }
+        m_memory = static_cast<char *>(memory);
+        for (size_t n=0; n<no_of_buffers; n++) {
+                release(m_memory + n * m_stride);
+        }
+}
+
+BufferPool::~BufferPool()
+{
+        if (m_no_of_free != m_no_of_buffers) {
+                std::cout << "pool: Warning, "
+                          << m_no_of_buffers - m_no_of_free
+                          << " buffers not released" << std::endl;
+        }
+        munmap(m_memory, m_memory_bytes);
+}
+
+void *BufferPool::acquire()
+{
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        while (true) {
+                uint32_t ix = (uint32_t)head;
+                if (ix == empty) {
+                        return nullptr;
+                }
+                uint64_t tag = (head >> 32) + 1;
+                uint64_t next = m_next[ix].load(std::memory_order_relaxed);
+                if (m_head.compare_exchange_weak(head, (tag << 32) | next,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire)) {
+                        m_no_of_free--;
+                        return m_memory + ix * m_stride;
+                }
+        }
+}
+
+void BufferPool::release(void *buffer)
+{
+        char *memory = static_cast<char *>(buffer);
+        size_t offset = memory - m_memory;
+        if ((memory < m_memory) || (offset % m_stride != 0) ||
+            (offset / m_stride >= m_no_of_buffers)) {
+                throw std::runtime_error("pool: Releasing unknown buffer");
+        }
+        uint32_t ix = offset / m_stride;
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        while (true) {
+                m_next[ix].store((uint32_t)head, std::memory_order_relaxed);
+                uint64_t tag = (head >> 32) + 1;
+                if (m_head.compare_exchange_weak(head, (tag << 32) | ix,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed)) {
+                        m_no_of_free++;
+                        return;
+                }
+        }
+}
+
+size_t BufferPool::get_buffer_bytes() const
+{
+        return m_buffer_bytes;
+}
+
+size_t BufferPool::get_no_of_free() const
+{
+        return m_no_of_free;
+}
+
+bool BufferPool::uses_huge_pages() const
+{
+        return m_huge_pages;
+}
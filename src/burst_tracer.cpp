@@ -0,0 +1,185 @@
+/**
+ * \file burst_tracer.cpp
+ *
+ * \brief Tracing of the processing stages of each burst
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "burst_tracer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+BurstTracer g_tracer;
+
+static thread_local int32_t t_thread_ix = -1;
+
+const char *trace_stage_name(TraceStage stage)
+{
+        static const char *names[TRACE_NO_OF_STAGES] = {
+                "read", "add_data", "correlate", "peaks", "decision",
+                "write", "write_status"
+        };
+        if (stage >= TRACE_NO_OF_STAGES) {
+                return "unknown";
+        }
+        return names[stage];
+}
+
+void trace_signal_handler(const int)
+{
+        g_tracer.request_dump();
+}
+
+BurstTracer::BurstTracer()
+        : m_mask(0),
+          m_enabled(false),
+          m_dump_requested(false),
+          m_next(0),
+          m_no_of_threads(0)
+{
+        std::memset(m_thread_names, 0, sizeof(m_thread_names));
+}
+
+void BurstTracer::configure(std::string filename, size_t capacity)
+{
+        m_enabled = false;
+        m_filename = filename;
+        if (m_filename == "") {
+                m_slots.reset();
+                return;
+        }
+        size_t no_of_slots(1);
+        while (no_of_slots < capacity) {
+                no_of_slots <<= 1;
+        }
+        m_slots.reset(new TraceSlot[no_of_slots]);
+        for (size_t n=0; n<no_of_slots; n++) {
+                m_slots[n].sequence.store(0, std::memory_order_relaxed);
+        }
+        m_mask = no_of_slots - 1;
+        m_next = 0;
+        m_enabled = true;
+        std::cout << "trace: Tracing " << no_of_slots << " events to "
+                  << m_filename << ", send SIGUSR1 to dump" << std::endl;
+}
+
+void BurstTracer::record(TraceStage stage, int64_t start_ns, int64_t end_ns,
+                         int64_t hw_ns, int64_t value)
+{
+        uint32_t thread = get_thread_ix();
+        uint64_t n = m_next.fetch_add(1, std::memory_order_relaxed);
+        TraceSlot &slot = m_slots[n & m_mask];
+        slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.start_ns.store(start_ns, std::memory_order_relaxed);
+        slot.end_ns.store(end_ns, std::memory_order_relaxed);
+        slot.hw_ns.store(hw_ns, std::memory_order_relaxed);
+        slot.value.store(value, std::memory_order_relaxed);
+        slot.stage.store(stage, std::memory_order_relaxed);
+        slot.thread.store(thread, std::memory_order_relaxed);
+        slot.sequence.store(2 * (n + 1), std::memory_order_release);
+}
+
+void BurstTracer::set_thread_name(std::string name)
+{
+        uint32_t thread = get_thread_ix();
+        std::strncpy(m_thread_names[thread], name.c_str(),
+                     max_name_length - 1);
+}
+
+void BurstTracer::request_dump()
+{
+        m_dump_requested.store(true, std::memory_order_relaxed);
+}
+
+void BurstTracer::dump_if_requested()
+{
+        if (m_dump_requested.load(std::memory_order_relaxed)) {
+                m_dump_requested = false;
+                dump();
+        }
+}
+
+void BurstTracer::dump()
+{
+        if (!is_enabled()) {
+                return;
+        }
+        std::ofstream file(m_filename);
+        if (!file) {
+                std::cout << "trace: Could not open " << m_filename
+                          << std::endl;
+                return;
+        }
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [" << std::endl;
+        uint32_t no_of_threads = std::min(
+                (size_t)m_no_of_threads.load(), max_no_of_threads);
+        for (uint32_t n=0; n<no_of_threads; n++) {
+                file << "{\"name\": \"thread_name\", \"ph\": \"M\", "
+                     << "\"pid\": 1, \"tid\": " << n
+                     << ", \"args\": {\"name\": \"" << m_thread_names[n]
+                     << "\"}}," << std::endl;
+        }
+        uint64_t end = m_next.load(std::memory_order_acquire);
+        uint64_t begin = (end > m_mask + 1) ? end - (m_mask + 1) : 0;
+        uint64_t no_of_events(0);
+        bool first(true);
+        for (uint64_t n=begin; n<end; n++) {
+                const TraceSlot &slot = m_slots[n & m_mask];
+                uint64_t expected = 2 * (n + 1);
+                uint64_t sequence =
+                        slot.sequence.load(std::memory_order_acquire);
+                int64_t start_ns = slot.start_ns.load(
+                        std::memory_order_relaxed);
+                int64_t end_ns = slot.end_ns.load(std::memory_order_relaxed);
+                int64_t hw_ns = slot.hw_ns.load(std::memory_order_relaxed);
+                int64_t value = slot.value.load(std::memory_order_relaxed);
+                uint32_t stage = slot.stage.load(std::memory_order_relaxed);
+                uint32_t thread = slot.thread.load(
+                        std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if ((sequence != expected) ||
+                    (slot.sequence.load(std::memory_order_relaxed) !=
+                     expected)) {
+                        // Being written, or already overwritten
+                        continue;
+                }
+                file << (first ? "" : ",\n")
+                     << "{\"name\": \""
+                     << trace_stage_name((TraceStage)stage)
+                     << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread
+                     << ", \"ts\": " << start_ns / 1e3
+                     << ", \"dur\": " << (end_ns - start_ns) / 1e3
+                     << ", \"args\": {\"hw_ns\": " << hw_ns
+                     << ", \"value\": " << value << "}}";
+                first = false;
+                no_of_events++;
+        }
+        file << std::endl << "]}" << std::endl;
+        std::cout << "trace: Wrote " << no_of_events << " events to "
+                  << m_filename << std::endl;
+}
+
+uint32_t BurstTracer::get_thread_ix()
+{
+        if (t_thread_ix < 0) {
+                uint32_t thread = m_no_of_threads.fetch_add(1);
+                if (thread >= max_no_of_threads) {
+                        // Extra threads share the last track
+                        thread = max_no_of_threads - 1;
+                } else {
+                        std::snprintf(m_thread_names[thread],
+                                      max_name_length, "thread %u", thread);
+                }
+                t_thread_ix = thread;
+        }
+        return t_thread_ix;
+}
@@ -0,0 +1,595 @@
+/**
+ * \file dc_iq_corrector.cpp
+ *
+ * \brief DC offset and IQ imbalance correction of the RX data
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "dc_iq_corrector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+// AVX2 kernels, chosen at run time, the build only assumes SSE2
+#define DC_IQ_AVX2
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#include <immintrin.h>
+#endif
+
+#ifdef __SSE2__
+/**
+ * \struct CorrectorLanes
+ *
+ * \brief The coefficients and the sums of a block, four samples wide
+ */
+struct CorrectorLanes
+{
+        CorrectorLanes(float offset_re, float offset_im, float c_value,
+                       float d_value)
+                : dc_re(_mm_set1_ps(offset_re)),
+                  dc_im(_mm_set1_ps(offset_im)),
+                  c(_mm_set1_ps(c_value)),
+                  d(_mm_set1_ps(d_value)),
+                  sum_i(_mm_setzero_ps()),
+                  sum_q(_mm_setzero_ps()),
+                  sum_ii(_mm_setzero_ps()),
+                  sum_qq(_mm_setzero_ps()),
+                  sum_iq(_mm_setzero_ps())
+        {}
+
+        void correct(__m128 &re, __m128 &im)
+        {
+                re = _mm_sub_ps(re, dc_re);
+                im = _mm_sub_ps(im, dc_im);
+                sum_i = _mm_add_ps(sum_i, re);
+                sum_q = _mm_add_ps(sum_q, im);
+                sum_ii = _mm_add_ps(sum_ii, _mm_mul_ps(re, re));
+                sum_qq = _mm_add_ps(sum_qq, _mm_mul_ps(im, im));
+                sum_iq = _mm_add_ps(sum_iq, _mm_mul_ps(re, im));
+                im = _mm_mul_ps(d, _mm_sub_ps(im, _mm_mul_ps(c, re)));
+        }
+
+        __m128 dc_re;
+        __m128 dc_im;
+        __m128 c;
+        __m128 d;
+        __m128 sum_i;
+        __m128 sum_q;
+        __m128 sum_ii;
+        __m128 sum_qq;
+        __m128 sum_iq;
+};
+
+static float sum_lanes(__m128 value)
+{
+        float values[4];
+        _mm_storeu_ps(values, value);
+        return (values[0] + values[1]) + (values[2] + values[3]);
+}
+#endif
+
+#ifdef DC_IQ_AVX2
+/**
+ * \struct CorrectorLanes8
+ *
+ * \brief As CorrectorLanes, eight samples wide
+ *
+ * The sums are accumulated with FMA, the correction itself is computed
+ * as in the other kernels, so a sample is corrected the same way.
+ */
+struct CorrectorLanes8
+{
+        AVX2_TARGET CorrectorLanes8(const float coefficients[4])
+                : dc_re(_mm256_set1_ps(coefficients[0])),
+                  dc_im(_mm256_set1_ps(coefficients[1])),
+                  c(_mm256_set1_ps(coefficients[2])),
+                  d(_mm256_set1_ps(coefficients[3])),
+                  sum_i(_mm256_setzero_ps()),
+                  sum_q(_mm256_setzero_ps()),
+                  sum_ii(_mm256_setzero_ps()),
+                  sum_qq(_mm256_setzero_ps()),
+                  sum_iq(_mm256_setzero_ps())
+        {}
+
+        AVX2_TARGET void correct(__m256 &re, __m256 &im)
+        {
+                re = _mm256_sub_ps(re, dc_re);
+                im = _mm256_sub_ps(im, dc_im);
+                sum_i = _mm256_add_ps(sum_i, re);
+                sum_q = _mm256_add_ps(sum_q, im);
+                sum_ii = _mm256_fmadd_ps(re, re, sum_ii);
+                sum_qq = _mm256_fmadd_ps(im, im, sum_qq);
+                sum_iq = _mm256_fmadd_ps(re, im, sum_iq);
+                im = _mm256_mul_ps(d, _mm256_sub_ps(im, _mm256_mul_ps(c, re)));
+        }
+
+        AVX2_TARGET void add_sums(float sums[5]) const
+        {
+                const __m256 *values[] = {&sum_i, &sum_q, &sum_ii, &sum_qq,
+                                          &sum_iq};
+                for (size_t n=0; n<5; n++) {
+                        __m128 half = _mm_add_ps(
+                                _mm256_castps256_ps128(*values[n]),
+                                _mm256_extractf128_ps(*values[n], 1));
+                        float lanes[4];
+                        _mm_storeu_ps(lanes, half);
+                        sums[n] += (lanes[0] + lanes[1]) +
+                                (lanes[2] + lanes[3]);
+                }
+        }
+
+        __m256 dc_re;
+        __m256 dc_im;
+        __m256 c;
+        __m256 d;
+        __m256 sum_i;
+        __m256 sum_q;
+        __m256 sum_ii;
+        __m256 sum_qq;
+        __m256 sum_iq;
+};
+
+static bool cpu_has_avx2()
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") &&
+                __builtin_cpu_supports("fma");
+}
+
+/* Each kernel corrects whole groups of eight samples, adds their sums
+ * to sums (i, q, ii, qq, iq) and returns the number corrected.
+ */
+static AVX2_TARGET size_t correct_avx2(std::complex<int16_t> *data,
+                                       size_t count,
+                                       const float coefficients[4],
+                                       float sums[5])
+{
+        CorrectorLanes8 lanes(coefficients);
+        size_t n(0);
+        for (; n+8<=count; n+=8) {
+                __m256i *samples = reinterpret_cast<__m256i *>(data + n);
+                __m256i iq = _mm256_loadu_si256(samples);
+                __m256 re = _mm256_cvtepi32_ps(
+                        _mm256_srai_epi32(_mm256_slli_epi32(iq, 16), 16));
+                __m256 im = _mm256_cvtepi32_ps(_mm256_srai_epi32(iq, 16));
+                lanes.correct(re, im);
+                // Packed and interleaved within each 128 bit half
+                __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(re),
+                                                    _mm256_cvtps_epi32(im));
+                _mm256_storeu_si256(samples, _mm256_unpacklo_epi16(
+                                            packed,
+                                            _mm256_srli_si256(packed, 8)));
+        }
+        lanes.add_sums(sums);
+        return n;
+}
+
+static AVX2_TARGET size_t correct_avx2(std::complex<float> *data,
+                                       size_t count,
+                                       const float coefficients[4],
+                                       float sums[5])
+{
+        CorrectorLanes8 lanes(coefficients);
+        size_t n(0);
+        for (; n+8<=count; n+=8) {
+                float *samples = reinterpret_cast<float *>(data + n);
+                __m256 low = _mm256_loadu_ps(samples);
+                __m256 high = _mm256_loadu_ps(samples + 8);
+                // The samples are reordered, and restored by the unpacks
+                __m256 re = _mm256_shuffle_ps(low, high,
+                                              _MM_SHUFFLE(2, 0, 2, 0));
+                __m256 im = _mm256_shuffle_ps(low, high,
+                                              _MM_SHUFFLE(3, 1, 3, 1));
+                lanes.correct(re, im);
+                _mm256_storeu_ps(samples, _mm256_unpacklo_ps(re, im));
+                _mm256_storeu_ps(samples + 8, _mm256_unpackhi_ps(re, im));
+        }
+        lanes.add_sums(sums);
+        return n;
+}
+
+static AVX2_TARGET size_t correct_avx2(float *re, float *im, size_t count,
+                                       const float coefficients[4],
+                                       float sums[5])
+{
+        CorrectorLanes8 lanes(coefficients);
+        size_t n(0);
+        for (; n+8<=count; n+=8) {
+                __m256 re8 = _mm256_loadu_ps(re + n);
+                __m256 im8 = _mm256_loadu_ps(im + n);
+                lanes.correct(re8, im8);
+                _mm256_storeu_ps(re + n, re8);
+                _mm256_storeu_ps(im + n, im8);
+        }
+        lanes.add_sums(sums);
+        return n;
+}
+
+static AVX2_TARGET size_t correct_avx2(const std::complex<int16_t> *data,
+                                       size_t count, float *re, float *im,
+                                       const float coefficients[4],
+                                       float sums[5])
+{
+        CorrectorLanes8 lanes(coefficients);
+        size_t n(0);
+        for (; n+8<=count; n+=8) {
+                __m256i iq = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i *>(data + n));
+                __m256 re8 = _mm256_cvtepi32_ps(
+                        _mm256_srai_epi32(_mm256_slli_epi32(iq, 16), 16));
+                __m256 im8 = _mm256_cvtepi32_ps(_mm256_srai_epi32(iq, 16));
+                lanes.correct(re8, im8);
+                _mm256_storeu_ps(re + n, re8);
+                _mm256_storeu_ps(im + n, im8);
+        }
+        lanes.add_sums(sums);
+        return n;
+}
+#endif
+
+static int16_t saturate(float value)
+{
+        // Rounded to nearest even, as _mm_cvtps_epi32
+        long rounded = std::lrint(value);
+        rounded = std::max(rounded,
+                           (long)std::numeric_limits<int16_t>::min());
+        rounded = std::min(rounded,
+                           (long)std::numeric_limits<int16_t>::max());
+        return (int16_t)rounded;
+}
+
+const size_t DcIqCorrector::block_length;
+
+DcIqCorrector::DcIqCorrector()
+        : m_dc_alpha(1),
+          m_iq_alpha(1),
+          m_iq_min_blocks(1),
+          m_frozen(false),
+          m_avx2(false)
+{
+#ifdef DC_IQ_AVX2
+        m_avx2 = cpu_has_avx2();
+#endif
+        reset();
+}
+
+void DcIqCorrector::configure(const SDR_Device_Config &dev_cfg)
+{
+        // The one-pole coefficient of a block of samples
+        double dc_samples = dev_cfg.dc_time_constant *
+                dev_cfg.sampling_rate_rx;
+        double iq_samples = dev_cfg.iq_time_constant *
+                dev_cfg.sampling_rate_rx;
+        m_dc_alpha = (dc_samples > block_length) ?
+                1 - std::exp(-(double)block_length / dc_samples) : 1;
+        m_iq_alpha = (iq_samples > block_length) ?
+                1 - std::exp(-(double)block_length / iq_samples) : 1;
+        m_iq_min_blocks = std::max(1.0, std::ceil(iq_samples / block_length));
+        reset();
+}
+
+void DcIqCorrector::reset()
+{
+        m_fill = 0;
+        m_no_of_blocks = 0;
+        m_sums = BlockSums();
+        m_dc_re = 0;
+        m_dc_im = 0;
+        m_power_i = 0;
+        m_power_q = 0;
+        m_cross = 0;
+        m_offset_re = 0;
+        m_offset_im = 0;
+        m_c = 0;
+        m_d = 1;
+}
+
+void DcIqCorrector::freeze(bool frozen)
+{
+        if (frozen != m_frozen) {
+                m_sums = BlockSums();
+                m_fill = 0;
+                m_frozen = frozen;
+        }
+}
+
+void DcIqCorrector::process(std::complex<int16_t> *data,
+                            size_t no_of_samples)
+{
+        size_t done(0);
+        while (done < no_of_samples) {
+                size_t count = next_count(no_of_samples - done);
+                correct(data + done, count);
+                add_count(count);
+                done += count;
+        }
+}
+
+void DcIqCorrector::process(std::complex<float> *data, size_t no_of_samples)
+{
+        size_t done(0);
+        while (done < no_of_samples) {
+                size_t count = next_count(no_of_samples - done);
+                correct(data + done, count);
+                add_count(count);
+                done += count;
+        }
+}
+
+void DcIqCorrector::process(float *re, float *im, size_t no_of_samples)
+{
+        size_t done(0);
+        while (done < no_of_samples) {
+                size_t count = next_count(no_of_samples - done);
+                correct(re + done, im + done, count);
+                add_count(count);
+                done += count;
+        }
+}
+
+void DcIqCorrector::process(const std::complex<int16_t> *data,
+                            size_t no_of_samples, float *re, float *im)
+{
+        size_t done(0);
+        while (done < no_of_samples) {
+                size_t count = next_count(no_of_samples - done);
+                correct(data + done, count, re + done, im + done);
+                add_count(count);
+                done += count;
+        }
+}
+
+std::complex<float> DcIqCorrector::get_dc() const
+{
+        return std::complex<float>(m_dc_re, m_dc_im);
+}
+
+void DcIqCorrector::get_imbalance(double &gain, double &phase_deg) const
+{
+        // The correction inverts Q = gain * (cos(phase) Q0 + sin(phase) I)
+        double q_gain = 1.0 / m_d;
+        gain = std::sqrt(q_gain * q_gain + (double)m_c * m_c);
+        phase_deg = std::atan2((double)m_c, q_gain) * 180 / M_PI;
+}
+
+void DcIqCorrector::print_stats() const
+{
+        if (m_no_of_blocks == 0) {
+                return;
+        }
+        double gain;
+        double phase_deg;
+        get_imbalance(gain, phase_deg);
+        std::cout << "front end: DC (" << m_dc_re << ", " << m_dc_im
+                  << "), IQ gain " << gain << ", phase " << phase_deg
+                  << " degrees" << std::endl;
+}
+
+size_t DcIqCorrector::next_count(size_t no_of_samples) const
+{
+        return std::min(no_of_samples, block_length - m_fill);
+}
+
+void DcIqCorrector::add_count(size_t count)
+{
+        m_fill += count;
+        if (m_fill == block_length) {
+                update();
+        }
+}
+
+void DcIqCorrector::add_sums(const float sums[5])
+{
+        m_sums.i += sums[0];
+        m_sums.q += sums[1];
+        m_sums.ii += sums[2];
+        m_sums.qq += sums[3];
+        m_sums.iq += sums[4];
+}
+
+void DcIqCorrector::correct_sample(float &re, float &im)
+{
+        re -= m_offset_re;
+        im -= m_offset_im;
+        m_sums.i += re;
+        m_sums.q += im;
+        m_sums.ii += re * re;
+        m_sums.qq += im * im;
+        m_sums.iq += re * im;
+        im = m_d * (im - m_c * re);
+}
+
+void DcIqCorrector::correct(std::complex<int16_t> *data, size_t count)
+{
+        size_t n(0);
+#ifdef DC_IQ_AVX2
+        if (m_avx2) {
+                const float coefficients[4] = {m_offset_re, m_offset_im,
+                                               m_c, m_d};
+                float sums[5] = {0, 0, 0, 0, 0};
+                n = correct_avx2(data, count, coefficients, sums);
+                add_sums(sums);
+        }
+#endif
+#ifdef __SSE2__
+        CorrectorLanes lanes(m_offset_re, m_offset_im, m_c, m_d);
+        for (; n+4<=count; n+=4) {
+                __m128i *samples = reinterpret_cast<__m128i *>(data + n);
+                // re in the low and im in the high half of each lane
+                __m128i iq = _mm_loadu_si128(samples);
+                __m128 re = _mm_cvtepi32_ps(
+                        _mm_srai_epi32(_mm_slli_epi32(iq, 16), 16));
+                __m128 im = _mm_cvtepi32_ps(_mm_srai_epi32(iq, 16));
+                lanes.correct(re, im);
+                // Saturated to re0..re3 im0..im3, then interleaved
+                __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(re),
+                                                 _mm_cvtps_epi32(im));
+                _mm_storeu_si128(samples, _mm_unpacklo_epi16(
+                                         packed,
+                                         _mm_srli_si128(packed, 8)));
+        }
+        m_sums.i += sum_lanes(lanes.sum_i);
+        m_sums.q += sum_lanes(lanes.sum_q);
+        m_sums.ii += sum_lanes(lanes.sum_ii);
+        m_sums.qq += sum_lanes(lanes.sum_qq);
+        m_sums.iq += sum_lanes(lanes.sum_iq);
+#endif
+        for (; n<count; n++) {
+                float re = data[n].real();
+                float im = data[n].imag();
+                correct_sample(re, im);
+                data[n] = std::complex<int16_t>(saturate(re), saturate(im));
+        }
+}
+
+void DcIqCorrector::correct(std::complex<float> *data, size_t count)
+{
+        size_t n(0);
+#ifdef DC_IQ_AVX2
+        if (m_avx2) {
+                const float coefficients[4] = {m_offset_re, m_offset_im,
+                                               m_c, m_d};
+                float sums[5] = {0, 0, 0, 0, 0};
+                n = correct_avx2(data, count, coefficients, sums);
+                add_sums(sums);
+        }
+#endif
+#ifdef __SSE2__
+        CorrectorLanes lanes(m_offset_re, m_offset_im, m_c, m_d);
+        for (; n+4<=count; n+=4) {
+                float *samples = reinterpret_cast<float *>(data + n);
+                __m128 low = _mm_loadu_ps(samples);
+                __m128 high = _mm_loadu_ps(samples + 4);
+                __m128 re = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+                __m128 im = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+                lanes.correct(re, im);
+                _mm_storeu_ps(samples, _mm_unpacklo_ps(re, im));
+                _mm_storeu_ps(samples + 4, _mm_unpackhi_ps(re, im));
+        }
+        m_sums.i += sum_lanes(lanes.sum_i);
+        m_sums.q += sum_lanes(lanes.sum_q);
+        m_sums.ii += sum_lanes(lanes.sum_ii);
+        m_sums.qq += sum_lanes(lanes.sum_qq);
+        m_sums.iq += sum_lanes(lanes.sum_iq);
+#endif
+        for (; n<count; n++) {
+                float re = data[n].real();
+                float im = data[n].imag();
+                correct_sample(re, im);
+                data[n] = std::complex<float>(re, im);
+        }
+}
+
+void DcIqCorrector::correct(float *re, float *im, size_t count)
+{
+        size_t n(0);
+#ifdef DC_IQ_AVX2
+        if (m_avx2) {
+                const float coefficients[4] = {m_offset_re, m_offset_im,
+                                               m_c, m_d};
+                float sums[5] = {0, 0, 0, 0, 0};
+                n = correct_avx2(re, im, count, coefficients, sums);
+                add_sums(sums);
+        }
+#endif
+#ifdef __SSE2__
+        CorrectorLanes lanes(m_offset_re, m_offset_im, m_c, m_d);
+        for (; n+4<=count; n+=4) {
+                __m128 re4 = _mm_loadu_ps(re + n);
+                __m128 im4 = _mm_loadu_ps(im + n);
+                lanes.correct(re4, im4);
+                _mm_storeu_ps(re + n, re4);
+                _mm_storeu_ps(im + n, im4);
+        }
+        m_sums.i += sum_lanes(lanes.sum_i);
+        m_sums.q += sum_lanes(lanes.sum_q);
+        m_sums.ii += sum_lanes(lanes.sum_ii);
+        m_sums.qq += sum_lanes(lanes.sum_qq);
+        m_sums.iq += sum_lanes(lanes.sum_iq);
+#endif
+        for (; n<count; n++) {
+                correct_sample(re[n], im[n]);
+        }
+}
+
+void DcIqCorrector::correct(const std::complex<int16_t> *data, size_t count,
+                            float *re, float *im)
+{
+        size_t n(0);
+#ifdef DC_IQ_AVX2
+        if (m_avx2) {
+                const float coefficients[4] = {m_offset_re, m_offset_im,
+                                               m_c, m_d};
+                float sums[5] = {0, 0, 0, 0, 0};
+                n = correct_avx2(data, count, re, im, coefficients, sums);
+                add_sums(sums);
+        }
+#endif
+#ifdef __SSE2__
+        CorrectorLanes lanes(m_offset_re, m_offset_im, m_c, m_d);
+        for (; n+4<=count; n+=4) {
+                __m128i iq = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i *>(data + n));
+                __m128 re4 = _mm_cvtepi32_ps(
+                        _mm_srai_epi32(_mm_slli_epi32(iq, 16), 16));
+                __m128 im4 = _mm_cvtepi32_ps(_mm_srai_epi32(iq, 16));
+                lanes.correct(re4, im4);
+                _mm_storeu_ps(re + n, re4);
+                _mm_storeu_ps(im + n, im4);
+        }
+        m_sums.i += sum_lanes(lanes.sum_i);
+        m_sums.q += sum_lanes(lanes.sum_q);
+        m_sums.ii += sum_lanes(lanes.sum_ii);
+        m_sums.qq += sum_lanes(lanes.sum_qq);
+        m_sums.iq += sum_lanes(lanes.sum_iq);
+#endif
+        for (; n<count; n++) {
+                re[n] = data[n].real();
+                im[n] = data[n].imag();
+                correct_sample(re[n], im[n]);
+        }
+}
+
+void DcIqCorrector::update()
+{
+        if (m_frozen) {
+                m_sums = BlockSums();
+                m_fill = 0;
+                return;
+        }
+        m_no_of_blocks++;
+        // Plain means until the time constants are reached
+        const double dc_alpha = std::max(m_dc_alpha, 1.0 / m_no_of_blocks);
+        const double iq_alpha = std::max(m_iq_alpha, 1.0 / m_no_of_blocks);
+        // The sums are of the samples with the DC estimate removed
+        const double mean_i = m_sums.i / block_length;
+        const double mean_q = m_sums.q / block_length;
+        m_dc_re += dc_alpha * mean_i;
+        m_dc_im += dc_alpha * mean_q;
+        const double power_i = m_sums.ii / block_length - mean_i * mean_i;
+        const double power_q = m_sums.qq / block_length - mean_q * mean_q;
+        const double cross = m_sums.iq / block_length - mean_i * mean_q;
+        m_power_i += iq_alpha * (power_i - m_power_i);
+        m_power_q += iq_alpha * (power_q - m_power_q);
+        m_cross += iq_alpha * (cross - m_cross);
+        // Q - c I is uncorrelated with I, d gives it the power of I
+        if ((m_no_of_blocks >= m_iq_min_blocks) && (m_power_i > 0)) {
+                double c = m_cross / m_power_i;
+                double residual = m_power_q - c * m_cross;
+                if (residual > 0) {
+                        m_c = c;
+                        m_d = std::sqrt(m_power_i / residual);
+                }
+        }
+        m_offset_re = m_dc_re;
+        m_offset_im = m_dc_im;
+        m_sums = BlockSums();
+        m_fill = 0;
+}
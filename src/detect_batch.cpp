@@ -0,0 +1,382 @@
+/**
+ * \file detect_batch.cpp
+ *
+ * \brief Offline detection over recorded captures
+ *
+ * Runs the Detector over SigMF recordings, as written with the -r
+ * option of the beacon and the tag, or .cs16 and .cf32 sample files,
+ * to tune the detection parameters without hardware. The recordings
+ * are memory mapped and split into chunks of whole burst periods,
+ * which are detected on all cores.
+ * Run from the commandline with -h for a list of options.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "detect_batch.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main(int argc, char** argv)
+{
+        try {
+                bool enable_version_and_help(true);
+                TCLAP::CmdLine cmd("Offline batch detector",
+                                   ' ',
+                                   PACKAGE_STRING,
+                                   enable_version_and_help);
+                SDR_Device_Config dev_cfg;
+                TCLAP::UnlabeledMultiArg<std::string> captures_arg(
+                        "basename",
+                        "SigMF recordings, or sample files, to detect in",
+                        true, "basename");
+                cmd.add(captures_arg);
+                TCLAP::SwitchArg pong_switch("", "pong",
+                                             "Look for PONGs, not PINGs",
+                                             cmd, false);
+                TCLAP::ValueArg<uint32_t> code_arg(
+                        "", "code", "Look for scrambling code <code>",
+                        false, 0, "code");
+                cmd.add(code_arg);
+                TCLAP::ValueArg<uint32_t> threshold_arg(
+                        "", "threshold",
+                        "Threshold in standard deviations above the mean"
+                        " correlation",
+                        false, dev_cfg.threshold_factor, "factor");
+                cmd.add(threshold_arg);
+                TCLAP::ValueArg<double> chunk_arg(
+                        "", "chunk", "Length of each job",
+                        false, 4, "burst periods");
+                cmd.add(chunk_arg);
+                TCLAP::ValueArg<size_t> threads_arg(
+                        "", "threads", "Detection threads, 0 for all cores",
+                        false, 0, "threads");
+                cmd.add(threads_arg);
+                TCLAP::ValueArg<std::string> output_arg(
+                        "o", "output", "Write the detections to <file>",
+                        false, "detections.csv", "file");
+                cmd.add(output_arg);
+                TCLAP::SwitchArg binary_switch(
+                        "", "binary",
+                        "Write BatchDetection records instead of CSV",
+                        cmd, false);
+                cmd.parse(argc, argv);
+
+                dev_cfg.threshold_factor = threshold_arg.getValue();
+                dev_cfg.is_beacon = pong_switch.getValue();
+                uint32_t code = dev_cfg.is_beacon ?
+                        dev_cfg.pong_scr_code : dev_cfg.ping_scr_code;
+                if (code_arg.isSet()) {
+                        code = code_arg.getValue();
+                }
+                size_t no_of_threads = threads_arg.getValue();
+                if (no_of_threads == 0) {
+                        no_of_threads = std::max(
+                                1u, std::thread::hardware_concurrency());
+                }
+                const double fs = dev_cfg.sampling_rate_rx;
+                size_t chunk_samples = std::max(
+                        1.0, std::round(chunk_arg.getValue() *
+                                        dev_cfg.burst_period * fs));
+                // A whole burst, with margin for the peak search
+                size_t overlap = 2 * dev_cfg.tx_burst_length;
+
+                std::vector<Capture> captures(
+                        captures_arg.getValue().size());
+                std::vector<Chunk> chunks;
+                uint64_t no_of_samples(0);
+                for (size_t n=0; n<captures.size(); n++) {
+                        captures[n].basename = captures_arg.getValue()[n];
+                        map_capture(captures[n], dev_cfg);
+                        std::vector<Chunk> capture_chunks = split_capture(
+                                captures[n], n, chunk_samples, overlap,
+                                dev_cfg.tx_burst_length);
+                        chunks.insert(chunks.end(), capture_chunks.begin(),
+                                      capture_chunks.end());
+                        no_of_samples += captures[n].no_of_samples;
+                }
+
+                // One detector and result list per thread
+                std::vector<std::unique_ptr<BufferPool>> pools;
+                std::vector<std::unique_ptr<Detector>> detectors;
+                std::vector<std::vector<BatchDetection>> detections(
+                        no_of_threads);
+                for (size_t n=0; n<no_of_threads; n++) {
+                        pools.push_back(std::unique_ptr<BufferPool>(
+                                                new BufferPool(
+                                                Detector::get_buffer_bytes(
+                                                        dev_cfg,
+                                                        chunk_samples +
+                                                        overlap),
+                                                Detector::no_of_buffers,
+                                                false)));
+                        detectors.push_back(std::unique_ptr<Detector>(
+                                                    new Detector()));
+                        detectors[n]->configure(CDMA, {code}, dev_cfg,
+                                                *pools[n]);
+                }
+                auto detect_chunk = [&](size_t job, size_t worker) {
+                        const Chunk &chunk = chunks[job];
+                        Detector &detector = *detectors[worker];
+                        // Chunks run on any thread, in any order
+                        detector.reset_front_end();
+                        detector.add_data(captures[chunk.capture].data +
+                                          chunk.start_ix,
+                                          chunk.no_of_samples);
+                        size_t no_of_bursts = detector.look_for_bursts();
+                        for (size_t m=0; m<no_of_bursts; m++) {
+                                int64_t ix = detector.measure_burst(m);
+                                if (ix < chunk.owned_begin) {
+                                        continue;
+                                }
+                                if (ix >= chunk.owned_end) {
+                                        break;
+                                }
+                                double position =
+                                        detector.get_peak_position();
+                                BatchDetection detection;
+                                detection.sample_ix = chunk.start_ix +
+                                        std::llround(position);
+                                detection.fractional_offset = position -
+                                        std::llround(position);
+                                detection.corr_peak =
+                                        detector.get_peak_value();
+                                detection.snr_db =
+                                        detector.get_snr_estimate();
+                                detection.capture = chunk.capture;
+                                detections[worker].push_back(detection);
+                        }
+                };
+                WorkerPool workers("batch", no_of_threads - 1, 0,
+                                   detect_chunk);
+                std::cout << "batch: " << captures.size() << " captures, "
+                          << no_of_samples << " samples in "
+                          << chunks.size() << " chunks, code " << code
+                          << ", " << no_of_threads << " threads"
+                          << std::endl;
+
+                auto start = std::chrono::steady_clock::now();
+                workers.run(chunks.size());
+                double elapsed = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+
+                std::vector<BatchDetection> all_detections;
+                for (size_t n=0; n<no_of_threads; n++) {
+                        all_detections.insert(all_detections.end(),
+                                              detections[n].begin(),
+                                              detections[n].end());
+                }
+                std::sort(all_detections.begin(), all_detections.end(),
+                          [](const BatchDetection &a,
+                             const BatchDetection &b) {
+                                  return (a.capture < b.capture) ||
+                                          ((a.capture == b.capture) &&
+                                           (a.sample_ix < b.sample_ix));
+                          });
+                write_detections(output_arg.getValue(),
+                                 binary_switch.getValue(), captures,
+                                 all_detections);
+                std::cout << "batch: " << all_detections.size()
+                          << " bursts in " << elapsed << " s, "
+                          << no_of_samples / elapsed / 1e6
+                          << " Msamples/s, "
+                          << no_of_samples / elapsed / 1e6 / no_of_threads
+                          << " Msamples/s/core" << std::endl;
+                for (size_t n=0; n<captures.size(); n++) {
+                        unmap_capture(captures[n]);
+                }
+        }
+        catch (TCLAP::ArgException &e) {
+                std::cerr << "error: " << e.error()
+                          << " for arg " << e.argId() << std::endl;
+        }
+        catch (std::runtime_error &e) {
+                std::cerr << "error: " << e.what() << std::endl;
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
+
+void map_capture(Capture &capture, const SDR_Device_Config &dev_cfg)
+{
+        if (is_sample_file(capture.basename)) {
+                map_sample_file(capture, dev_cfg);
+                return;
+        }
+        std::string file = capture.basename + ".sigmf-data";
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0) {
+                throw std::runtime_error("Could not open recording: " +
+                                         file + ": " + strerror(errno));
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Could not stat recording: " +
+                                         file);
+        }
+        capture.bytes = file_stat.st_size;
+        capture.no_of_samples = capture.bytes /
+                sizeof(std::complex<int16_t>);
+        capture.sample_rate = read_sample_rate(capture.basename,
+                                               dev_cfg.sampling_rate_rx);
+        if (capture.sample_rate != dev_cfg.sampling_rate_rx) {
+                std::cout << "batch: Sample rate " << capture.sample_rate
+                          << " of " << capture.basename
+                          << " differs from RX rate "
+                          << dev_cfg.sampling_rate_rx << std::endl;
+        }
+        if (capture.no_of_samples == 0) {
+                ::close(fd);
+                return;
+        }
+        void *data = mmap(nullptr, capture.bytes, PROT_READ, MAP_PRIVATE,
+                          fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+                throw std::runtime_error("Could not map recording: " +
+                                         file + ": " + strerror(errno));
+        }
+        // The chunks are read in about file order, start reading ahead
+        madvise(data, capture.bytes, MADV_WILLNEED);
+        capture.data = static_cast<const std::complex<int16_t> *>(data);
+}
+
+void map_sample_file(Capture &capture, const SDR_Device_Config &dev_cfg)
+{
+        capture.sample_file = std::make_shared<SampleFile>();
+        SampleFile &file = *capture.sample_file;
+        file.open(capture.basename);
+        capture.no_of_samples = file.size();
+        capture.sample_rate = file.get_info().sample_rate;
+        if (capture.sample_rate <= 0) {
+                capture.sample_rate = dev_cfg.sampling_rate_rx;
+        }
+        if (capture.sample_rate != dev_cfg.sampling_rate_rx) {
+                std::cout << "batch: Sample rate " << capture.sample_rate
+                          << " of " << capture.basename
+                          << " differs from RX rate "
+                          << dev_cfg.sampling_rate_rx << std::endl;
+        }
+        capture.data = file.get_cs16();
+        if (capture.data == nullptr) {
+                capture.converted.resize(capture.no_of_samples);
+                file.read(0, capture.no_of_samples,
+                          capture.converted.data());
+                capture.data = capture.converted.data();
+                file.close();
+        }
+}
+
+void unmap_capture(Capture &capture)
+{
+        if (capture.sample_file) {
+                capture.sample_file.reset();
+                capture.converted.clear();
+                capture.data = nullptr;
+                return;
+        }
+        if (capture.data != nullptr) {
+                munmap(const_cast<std::complex<int16_t> *>(capture.data),
+                       capture.bytes);
+                capture.data = nullptr;
+        }
+}
+
+double read_sample_rate(std::string basename, double default_rate)
+{
+        std::ifstream meta_file(basename + ".sigmf-meta");
+        if (!meta_file) {
+                return default_rate;
+        }
+        std::stringstream meta;
+        meta << meta_file.rdbuf();
+        std::string key = "\"core:sample_rate\"";
+        std::size_t found = meta.str().find(key);
+        if (found == std::string::npos) {
+                return default_rate;
+        }
+        found = meta.str().find(':', found + key.size());
+        if (found == std::string::npos) {
+                return default_rate;
+        }
+        return std::stod(meta.str().substr(found + 1));
+}
+
+std::vector<Chunk> split_capture(const Capture &capture, uint32_t capture_ix,
+                                 size_t chunk_samples, size_t overlap,
+                                 size_t burst_length)
+{
+        std::vector<Chunk> chunks;
+        for (size_t start=0; start<capture.no_of_samples;
+             start+=chunk_samples) {
+                Chunk chunk;
+                chunk.capture = capture_ix;
+                chunk.start_ix = start;
+                chunk.no_of_samples = std::min(chunk_samples + overlap,
+                                               capture.no_of_samples -
+                                               start);
+                // Bursts ending in the step, as seen from the first chunk
+                chunk.owned_begin = (start == 0) ? 0 : burst_length - 1;
+                chunk.owned_end = chunk_samples + burst_length - 1;
+                if (start + chunk_samples >= capture.no_of_samples) {
+                        chunk.owned_end = chunk.no_of_samples +
+                                burst_length;
+                }
+                chunks.push_back(chunk);
+        }
+        return chunks;
+}
+
+void write_detections(std::string filename, bool binary,
+                      const std::vector<Capture> &captures,
+                      const std::vector<BatchDetection> &detections)
+{
+        if (binary) {
+                std::FILE *file = std::fopen(filename.c_str(), "wb");
+                if (file == nullptr) {
+                        throw std::runtime_error("Could not open " +
+                                                 filename);
+                }
+                size_t written = std::fwrite(detections.data(),
+                                             sizeof(BatchDetection),
+                                             detections.size(), file);
+                std::fclose(file);
+                if (written != detections.size()) {
+                        throw std::runtime_error("Could not write " +
+                                                 filename);
+                }
+                return;
+        }
+        std::ofstream file(filename);
+        if (!file) {
+                throw std::runtime_error("Could not open " + filename);
+        }
+        file << "capture,sample_ix,fractional_offset,time_s,corr_peak,"
+             << "snr_db" << std::endl;
+        file.precision(12);
+        for (size_t n=0; n<detections.size(); n++) {
+                const BatchDetection &detection = detections[n];
+                const Capture &capture = captures[detection.capture];
+                file << capture.basename << ","
+                     << detection.sample_ix << ","
+                     << detection.fractional_offset << ","
+                     << (detection.sample_ix +
+                         detection.fractional_offset) /
+                        capture.sample_rate << ","
+                     << detection.corr_peak << ","
+                     << detection.snr_db << "\n";
+        }
+}
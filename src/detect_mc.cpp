@@ -0,0 +1,470 @@
+/**
+ * \file detect_mc.cpp
+ *
+ * \brief Monte Carlo detection performance of the Detector
+ *
+ * Estimates the detection probability, the false alarm probability and
+ * the timing error of the Detector over a grid of SNRs, with simulated
+ * PING or PONG bursts in noise, CFO and timing offsets. The trials run
+ * on all cores and give the same results for the same seed with any
+ * number of threads, so the CSV output of two detector versions can be
+ * compared directly. The trial rate is printed as a benchmark. Run from
+ * the commandline with -h for a list of options.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "detect_mc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+int main(int argc, char** argv)
+{
+        try {
+                bool enable_version_and_help(true);
+                TCLAP::CmdLine cmd("Monte Carlo detection performance",
+                                   ' ',
+                                   PACKAGE_STRING,
+                                   enable_version_and_help);
+                SDR_Device_Config dev_cfg;
+                McSettings settings;
+                TCLAP::SwitchArg pong_switch("", "pong",
+                                             "Simulate PONGs, not PINGs",
+                                             cmd, false);
+                TCLAP::ValueArg<uint32_t> code_arg(
+                        "", "code", "Simulate scrambling code <code>",
+                        false, 0, "code");
+                cmd.add(code_arg);
+                TCLAP::ValueArg<uint32_t> threshold_arg(
+                        "", "threshold",
+                        "Threshold in standard deviations above the mean"
+                        " correlation",
+                        false, dev_cfg.threshold_factor, "factor");
+                cmd.add(threshold_arg);
+                TCLAP::ValueArg<double> snr_min_arg(
+                        "", "snr-min", "Lowest SNR per sample",
+                        false, -20, "dB");
+                cmd.add(snr_min_arg);
+                TCLAP::ValueArg<double> snr_max_arg(
+                        "", "snr-max", "Highest SNR per sample",
+                        false, 0, "dB");
+                cmd.add(snr_max_arg);
+                TCLAP::ValueArg<double> snr_step_arg(
+                        "", "snr-step", "Step of the SNR grid",
+                        false, 1, "dB");
+                cmd.add(snr_step_arg);
+                TCLAP::ValueArg<uint64_t> trials_arg(
+                        "n", "trials", "Trials per SNR",
+                        false, 2000, "trials");
+                cmd.add(trials_arg);
+                TCLAP::ValueArg<uint64_t> noise_trials_arg(
+                        "", "noise-trials",
+                        "Noise only trials for the false alarm rate,"
+                        " default as --trials",
+                        false, 0, "trials");
+                cmd.add(noise_trials_arg);
+                TCLAP::ValueArg<double> cfo_arg(
+                        "", "cfo", "CFOs uniform in +-<cfo>",
+                        false, settings.cfo_max, "Hz");
+                cmd.add(cfo_arg);
+                TCLAP::ValueArg<double> offset_arg(
+                        "", "timing-offset",
+                        "Burst offsets from the expected index uniform in"
+                        " +-<offset>",
+                        false, settings.timing_offset, "samples");
+                cmd.add(offset_arg);
+                TCLAP::ValueArg<double> tolerance_arg(
+                        "", "tolerance",
+                        "Max timing error of a detection, others are"
+                        " misplaced",
+                        false, settings.tolerance, "samples");
+                cmd.add(tolerance_arg);
+                TCLAP::ValueArg<int64_t> guard_arg(
+                        "", "guard",
+                        "Search guard, default the PING or PONG guard",
+                        false, 0, "samples");
+                cmd.add(guard_arg);
+                TCLAP::ValueArg<uint64_t> seed_arg(
+                        "", "seed", "Seed of the random numbers",
+                        false, settings.seed, "seed");
+                cmd.add(seed_arg);
+                TCLAP::ValueArg<size_t> block_arg(
+                        "", "block", "Trials per job",
+                        false, 256, "trials");
+                cmd.add(block_arg);
+                TCLAP::ValueArg<size_t> threads_arg(
+                        "", "threads", "Trial threads, 0 for all cores",
+                        false, 0, "threads");
+                cmd.add(threads_arg);
+                TCLAP::ValueArg<std::string> output_arg(
+                        "o", "output", "Write the results to <file>",
+                        false, "detect_mc.csv", "file");
+                cmd.add(output_arg);
+                cmd.parse(argc, argv);
+
+                dev_cfg.threshold_factor = threshold_arg.getValue();
+                dev_cfg.is_beacon = pong_switch.getValue();
+                /* The trials are short, independent windows of an ideal
+                 * receiver, there is no DC or IQ imbalance to track
+                 */
+                dev_cfg.dc_iq_correction = false;
+                uint32_t code = dev_cfg.is_beacon ?
+                        dev_cfg.pong_scr_code : dev_cfg.ping_scr_code;
+                if (code_arg.isSet()) {
+                        code = code_arg.getValue();
+                }
+                settings.noise_amplitude = dev_cfg.sim_noise_amplitude;
+                settings.cfo_max = cfo_arg.getValue();
+                settings.timing_offset = std::fabs(offset_arg.getValue());
+                settings.tolerance = tolerance_arg.getValue();
+                settings.guard = dev_cfg.is_beacon ?
+                        dev_cfg.pong_burst_guard : dev_cfg.ping_burst_guard;
+                if (guard_arg.isSet()) {
+                        settings.guard = guard_arg.getValue();
+                }
+                settings.seed = seed_arg.getValue();
+                uint64_t no_of_trials = trials_arg.getValue();
+                uint64_t no_of_noise_trials = noise_trials_arg.isSet() ?
+                        noise_trials_arg.getValue() : no_of_trials;
+                size_t trials_per_job = std::max((size_t)1,
+                                                 block_arg.getValue());
+                size_t no_of_threads = threads_arg.getValue();
+                if (no_of_threads == 0) {
+                        no_of_threads = std::max(
+                                1u, std::thread::hardware_concurrency());
+                }
+                if (snr_step_arg.getValue() <= 0) {
+                        throw std::runtime_error("SNR step must be > 0");
+                }
+
+                // The SNR grid, and the noise only point last
+                std::vector<McPoint> points;
+                for (double snr_db=snr_min_arg.getValue();
+                     snr_db<=snr_max_arg.getValue() + 1e-9;
+                     snr_db+=snr_step_arg.getValue()) {
+                        McPoint point;
+                        point.snr_db = snr_db;
+                        points.push_back(point);
+                }
+                McPoint noise_point;
+                noise_point.noise_only = true;
+                points.push_back(noise_point);
+                std::vector<McJob> jobs = split_trials(points, no_of_trials,
+                                                       no_of_noise_trials,
+                                                       trials_per_job);
+
+                // One runner per thread, one result per job
+                std::vector<std::unique_ptr<McTrialRunner>> runners;
+                for (size_t n=0; n<no_of_threads; n++) {
+                        runners.push_back(std::unique_ptr<McTrialRunner>(
+                                                  new McTrialRunner(
+                                                          dev_cfg, code,
+                                                          settings)));
+                }
+                std::vector<McPoint> job_results(jobs.size());
+                for (size_t n=0; n<jobs.size(); n++) {
+                        job_results[n] = points[jobs[n].point];
+                }
+                auto run_job = [&](size_t job, size_t worker) {
+                        runners[worker]->run(jobs[job], job_results[job]);
+                };
+                WorkerPool workers("mc", no_of_threads - 1, 0, run_job);
+                std::cout << "mc: " << points.size() - 1 << " SNRs from "
+                          << snr_min_arg.getValue() << " dB, "
+                          << no_of_trials << " trials each, "
+                          << no_of_noise_trials << " noise trials, code "
+                          << code << ", threshold "
+                          << dev_cfg.threshold_factor << ", "
+                          << runners[0]->get_no_of_samples()
+                          << " samples per trial, " << no_of_threads
+                          << " threads" << std::endl;
+
+                auto start = std::chrono::steady_clock::now();
+                workers.run(jobs.size());
+                double elapsed = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+
+                // Summed in job order, the same for any no of threads
+                for (size_t n=0; n<jobs.size(); n++) {
+                        points[jobs[n].point].add(job_results[n]);
+                }
+                write_mc_results(output_arg.getValue(), points);
+                const McPoint &noise = points.back();
+                for (size_t n=0; n+1<points.size(); n++) {
+                        const McPoint &point = points[n];
+                        double pd = (double)point.no_of_detections /
+                                std::max((uint64_t)1, point.no_of_trials);
+                        double rmse = std::sqrt(
+                                point.sum_squared_error /
+                                std::max((uint64_t)1,
+                                         point.no_of_detections));
+                        std::cout << "mc: SNR " << point.snr_db
+                                  << " dB, Pd " << pd << ", misplaced "
+                                  << point.no_of_misplaced
+                                  << ", timing RMSE " << rmse
+                                  << " samples" << std::endl;
+                }
+                std::cout << "mc: Pfa "
+                          << (double)noise.no_of_misplaced /
+                        std::max((uint64_t)1, noise.no_of_trials)
+                          << " (" << noise.no_of_misplaced << " of "
+                          << noise.no_of_trials << ")" << std::endl;
+                uint64_t total_trials(0);
+                for (size_t n=0; n<points.size(); n++) {
+                        total_trials += points[n].no_of_trials;
+                }
+                std::cout << "mc: " << total_trials << " trials in "
+                          << elapsed << " s, " << total_trials / elapsed
+                          << " trials/s, "
+                          << total_trials / elapsed / no_of_threads
+                          << " trials/s/core" << std::endl;
+        }
+        catch (TCLAP::ArgException &e) {
+                std::cerr << "error: " << e.error()
+                          << " for arg " << e.argId() << std::endl;
+        }
+        catch (std::runtime_error &e) {
+                std::cerr << "error: " << e.what() << std::endl;
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
+
+void McPoint::add(const McPoint &other)
+{
+        no_of_trials += other.no_of_trials;
+        no_of_detections += other.no_of_detections;
+        no_of_misplaced += other.no_of_misplaced;
+        sum_error += other.sum_error;
+        sum_squared_error += other.sum_squared_error;
+}
+
+const size_t McTrialRunner::no_of_delay_taps;
+
+McTrialRunner::McTrialRunner(const SDR_Device_Config &dev_cfg, uint32_t code,
+                             const McSettings &settings)
+        : m_dev_cfg(dev_cfg),
+          m_settings(settings),
+          m_burst(make_mc_burst(dev_cfg, code)),
+          m_burst_power(0),
+          m_no_of_samples(0),
+          m_expected_ix(0),
+          m_noise(0, settings.noise_amplitude),
+          m_uniform(0, 1)
+{
+        for (size_t n=0; n<m_burst.size(); n++) {
+                m_burst_power += std::norm(m_burst[n]);
+        }
+        m_burst_power /= std::max((size_t)1, m_burst.size());
+        if (m_burst_power <= 0) {
+                throw std::runtime_error("mc: Empty burst");
+        }
+        /* Room for the whole delayed burst at the largest offsets, and
+         * for the window that Detector::look_for_ping searches.
+         */
+        const int64_t half_taps = no_of_delay_taps / 2;
+        const int64_t max_offset =
+                (int64_t)std::ceil(m_settings.timing_offset) + 1;
+        const int64_t window_half_length = m_dev_cfg.tx_burst_length / 2 +
+                m_settings.guard;
+        m_expected_ix = std::max((int64_t)m_burst.size() + max_offset +
+                                 half_taps, window_half_length + 1);
+        m_no_of_samples = m_expected_ix + 1 +
+                std::max(max_offset + half_taps, window_half_length);
+        m_samples.resize(m_no_of_samples);
+        m_buffer.resize(m_no_of_samples);
+        m_pool.reset(new BufferPool(
+                             Detector::get_buffer_bytes(m_dev_cfg,
+                                                        m_no_of_samples),
+                             Detector::no_of_buffers, false));
+        m_detector.configure(CDMA, {code}, m_dev_cfg, *m_pool);
+}
+
+void McTrialRunner::run(const McJob &job, McPoint &point)
+{
+        std::seed_seq seed{(uint32_t)m_settings.seed,
+                        (uint32_t)(m_settings.seed >> 32),
+                        (uint32_t)job.point,
+                        (uint32_t)job.block,
+                        (uint32_t)(job.block >> 32)};
+        m_rng.seed(seed);
+        m_noise.reset();
+        m_uniform.reset();
+        const double noise_power = 2 * m_settings.noise_amplitude *
+                m_settings.noise_amplitude;
+        const double amplitude = point.noise_only ? 0 :
+                std::sqrt(std::pow(10, point.snr_db / 10) * noise_power /
+                          m_burst_power);
+        for (size_t n=0; n<job.no_of_trials; n++) {
+                double delay = m_settings.timing_offset *
+                        (2 * m_uniform(m_rng) - 1);
+                synthesize(!point.noise_only, amplitude, delay);
+                m_detector.add_data(m_buffer.data(), m_buffer.size());
+                int64_t ix = m_detector.look_for_ping(m_expected_ix,
+                                                      m_settings.guard);
+                point.no_of_trials++;
+                if (!m_detector.found_ping(ix)) {
+                        continue;
+                }
+                if (point.noise_only) {
+                        point.no_of_misplaced++;
+                        continue;
+                }
+                double error = m_detector.get_peak_position() -
+                        (m_expected_ix + delay);
+                if (std::fabs(error) > m_settings.tolerance) {
+                        point.no_of_misplaced++;
+                        continue;
+                }
+                point.no_of_detections++;
+                point.sum_error += error;
+                point.sum_squared_error += error * error;
+        }
+}
+
+size_t McTrialRunner::get_no_of_samples() const
+{
+        return m_no_of_samples;
+}
+
+void McTrialRunner::synthesize(bool with_burst, double amplitude,
+                               double delay)
+{
+        for (size_t n=0; n<m_no_of_samples; n++) {
+                float re = m_noise(m_rng);
+                float im = m_noise(m_rng);
+                m_samples[n] = std::complex<float>(re, im);
+        }
+        if (with_burst) {
+                // The correlation peak is at the last sample of the burst
+                double start = m_expected_ix + delay - (m_burst.size() - 1);
+                int64_t start_ix = (int64_t)std::floor(start);
+                design_fractional_delay(start - start_ix, m_taps,
+                                        no_of_delay_taps);
+                double cfo = m_settings.cfo_max *
+                        (2 * m_uniform(m_rng) - 1);
+                double phase = 2 * M_PI * m_uniform(m_rng);
+                std::complex<double> rotation = std::polar(amplitude, phase);
+                const std::complex<double> step = std::polar(
+                        1.0, 2 * M_PI * cfo / m_dev_cfg.sampling_rate_rx);
+                // Tap t is the sample t - no_of_delay_taps / 2 + 1 later
+                std::complex<float> *samples = m_samples.data() + start_ix -
+                        no_of_delay_taps / 2 + 1;
+                for (size_t n=0; n<m_burst.size(); n++) {
+                        std::complex<float> value = m_burst[n] *
+                                std::complex<float>(rotation);
+                        rotation *= step;
+                        for (size_t t=0; t<no_of_delay_taps; t++) {
+                                samples[n + t] += value * m_taps[t];
+                        }
+                }
+        }
+        const float max_value = std::numeric_limits<int16_t>::max();
+        for (size_t n=0; n<m_no_of_samples; n++) {
+                float re = std::max(-max_value, std::min(
+                                            max_value,
+                                            std::round(m_samples[n].real())));
+                float im = std::max(-max_value, std::min(
+                                            max_value,
+                                            std::round(m_samples[n].imag())));
+                m_buffer[n] = std::complex<int16_t>((int16_t)re,
+                                                    (int16_t)im);
+        }
+}
+
+std::vector<std::complex<float>> make_mc_burst(
+        const SDR_Device_Config &dev_cfg, uint32_t code)
+{
+        // As SimRadio makes its bursts
+        double scale_factor(1.0);
+        double extra_samples_for_filter = dev_cfg.extra_samples_filter;
+        size_t mod_length = dev_cfg.tx_burst_length_chip;
+        mod_length = mod_length * (1 + extra_samples_for_filter);
+        Modulator modulator(mod_length, scale_factor, dev_cfg.Novs_rx);
+        modulator.generate_cdma(code);
+        modulator.filter();
+        modulator.scrap_samples(mod_length * extra_samples_for_filter);
+        return modulator.get_data();
+}
+
+void design_fractional_delay(double fraction, float *taps, size_t no_of_taps)
+{
+        /* Hann windowed sinc, tap t delays by t - no_of_taps / 2 + 1
+         * samples, minus the fraction.
+         */
+        const double half_length = no_of_taps / 2;
+        for (size_t t=0; t<no_of_taps; t++) {
+                double x = (double)t - half_length + 1 - fraction;
+                double sinc = (x == 0) ? 1 :
+                        std::sin(M_PI * x) / (M_PI * x);
+                double window = 0.5 * (1 + std::cos(M_PI * x /
+                                                    half_length));
+                taps[t] = sinc * window;
+        }
+}
+
+std::vector<McJob> split_trials(const std::vector<McPoint> &points,
+                                uint64_t no_of_trials,
+                                uint64_t no_of_noise_trials,
+                                size_t trials_per_job)
+{
+        std::vector<McJob> jobs;
+        for (size_t n=0; n<points.size(); n++) {
+                uint64_t point_trials = points[n].noise_only ?
+                        no_of_noise_trials : no_of_trials;
+                for (uint64_t first=0; first<point_trials;
+                     first+=trials_per_job) {
+                        McJob job;
+                        job.point = n;
+                        job.block = first / trials_per_job;
+                        job.no_of_trials = std::min((uint64_t)trials_per_job,
+                                                    point_trials - first);
+                        jobs.push_back(job);
+                }
+        }
+        return jobs;
+}
+
+void write_mc_results(std::string filename,
+                      const std::vector<McPoint> &points)
+{
+        std::ofstream file(filename);
+        if (!file) {
+                throw std::runtime_error("Could not open " + filename);
+        }
+        // The false alarm rate does not depend on the SNR
+        double pfa(0);
+        for (size_t n=0; n<points.size(); n++) {
+                if (points[n].noise_only && (points[n].no_of_trials > 0)) {
+                        pfa = (double)points[n].no_of_misplaced /
+                                points[n].no_of_trials;
+                }
+        }
+        file << "snr_db,trials,detections,misplaced,pd,p_misplaced,pfa,"
+             << "timing_rmse,timing_bias" << std::endl;
+        file.precision(9);
+        for (size_t n=0; n<points.size(); n++) {
+                const McPoint &point = points[n];
+                if (point.noise_only) {
+                        continue;
+                }
+                double trials = std::max((uint64_t)1, point.no_of_trials);
+                double detections = std::max((uint64_t)1,
+                                             point.no_of_detections);
+                file << point.snr_db << ","
+                     << point.no_of_trials << ","
+                     << point.no_of_detections << ","
+                     << point.no_of_misplaced << ","
+                     << point.no_of_detections / trials << ","
+                     << point.no_of_misplaced / trials << ","
+                     << pfa << ","
+                     << std::sqrt(point.sum_squared_error / detections) << ","
+                     << point.sum_error / detections << "\n";
+        }
+}
@@ -10,57 +10,321 @@
 
 #include "detector.h"
 
+#if defined(__GNUC__) && defined(__x86_64__)
+// AVX2 correlation, chosen at run time, the build only assumes SSE2
+#define DETECTOR_AVX2
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#include <immintrin.h>
+
+static bool cpu_has_avx2()
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") &&
+                __builtin_cpu_supports("fma");
+}
+
+/* The same correlation as the scalar loop in Detector::correlate, for
+ * eight lags at a time, one lag per lane. Each reference sample is
+ * broadcast and multiplied with eight consecutive data samples, even and
+ * odd reference samples use separate accumulators. The lanes of a block
+ * overlap the data over slightly different reference ranges, the loop
+ * covers the range common to all of them and the rest of each lane is
+ * added one sample at a time.
+ */
+static AVX2_TARGET void correlate_avx2(const float *r_re, const float *r_im,
+                                       int64_t ref_length,
+                                       const float *data_re,
+                                       const float *data_im,
+                                       int64_t data_length,
+                                       float *corr_result,
+                                       int64_t corr_length)
+{
+        const int64_t lanes = 8;
+        int64_t i = 0;
+        for (; i+lanes<=corr_length; i+=lanes) {
+                // Reference sample k meets data sample k + lag
+                const int64_t lag = i - (ref_length - 1);
+                const int64_t k_start = std::max((int64_t)0, -lag);
+                const int64_t k_end = std::min(ref_length, data_length -
+                                               lag - (lanes - 1));
+                __m256 re_re0 = _mm256_setzero_ps();
+                __m256 im_im0 = _mm256_setzero_ps();
+                __m256 re_im0 = _mm256_setzero_ps();
+                __m256 im_re0 = _mm256_setzero_ps();
+                __m256 re_re1 = _mm256_setzero_ps();
+                __m256 im_im1 = _mm256_setzero_ps();
+                __m256 re_im1 = _mm256_setzero_ps();
+                __m256 im_re1 = _mm256_setzero_ps();
+                int64_t k = k_start;
+                for (; k+2<=k_end; k+=2) {
+                        __m256 ref_re = _mm256_broadcast_ss(r_re + k);
+                        __m256 ref_im = _mm256_broadcast_ss(r_im + k);
+                        __m256 d_re = _mm256_loadu_ps(data_re + k + lag);
+                        __m256 d_im = _mm256_loadu_ps(data_im + k + lag);
+                        re_re0 = _mm256_fmadd_ps(ref_re, d_re, re_re0);
+                        im_im0 = _mm256_fmadd_ps(ref_im, d_im, im_im0);
+                        re_im0 = _mm256_fmadd_ps(ref_re, d_im, re_im0);
+                        im_re0 = _mm256_fmadd_ps(ref_im, d_re, im_re0);
+                        ref_re = _mm256_broadcast_ss(r_re + k + 1);
+                        ref_im = _mm256_broadcast_ss(r_im + k + 1);
+                        d_re = _mm256_loadu_ps(data_re + k + 1 + lag);
+                        d_im = _mm256_loadu_ps(data_im + k + 1 + lag);
+                        re_re1 = _mm256_fmadd_ps(ref_re, d_re, re_re1);
+                        im_im1 = _mm256_fmadd_ps(ref_im, d_im, im_im1);
+                        re_im1 = _mm256_fmadd_ps(ref_re, d_im, re_im1);
+                        im_re1 = _mm256_fmadd_ps(ref_im, d_re, im_re1);
+                }
+                float sum_re[lanes];
+                float sum_im[lanes];
+                _mm256_storeu_ps(sum_re, _mm256_add_ps(
+                                         _mm256_add_ps(re_re0, im_im0),
+                                         _mm256_add_ps(re_re1, im_im1)));
+                _mm256_storeu_ps(sum_im, _mm256_sub_ps(
+                                         _mm256_add_ps(re_im0, re_im1),
+                                         _mm256_add_ps(im_re0, im_re1)));
+                const int64_t k_loop_end = std::max(k, k_start);
+                for (int64_t j=0; j<lanes; j++) {
+                        const int64_t lane_lag = lag + j;
+                        const float *d_re = data_re + lane_lag;
+                        const float *d_im = data_im + lane_lag;
+                        int64_t lane_start = std::max((int64_t)0,
+                                                      -lane_lag);
+                        int64_t lane_end = std::min(ref_length,
+                                                    data_length - lane_lag);
+                        for (int64_t m=lane_start; m<lane_end; m++) {
+                                if (m == k_start) {
+                                        m = std::max(m, k_loop_end);
+                                        if (m >= lane_end) {
+                                                break;
+                                        }
+                                }
+                                sum_re[j] += r_re[m] * d_re[m] +
+                                        r_im[m] * d_im[m];
+                                sum_im[j] += r_re[m] * d_im[m] -
+                                        r_im[m] * d_re[m];
+                        }
+                }
+                __m256 re = _mm256_loadu_ps(sum_re);
+                __m256 im = _mm256_loadu_ps(sum_im);
+                _mm256_storeu_ps(corr_result + i, _mm256_sqrt_ps(
+                                         _mm256_fmadd_ps(re, re,
+                                                         _mm256_mul_ps(
+                                                                 im, im))));
+        }
+        for (; i<corr_length; i++) {
+                int64_t lag = i - (ref_length - 1);
+                int64_t k_start = std::max((int64_t)0, -lag);
+                int64_t k_end = std::min(ref_length, data_length - lag);
+                float sum_re(0);
+                float sum_im(0);
+                for (int64_t k=k_start; k<k_end; k++) {
+                        float d_re = data_re[k + lag];
+                        float d_im = data_im[k + lag];
+                        sum_re += r_re[k] * d_re + r_im[k] * d_im;
+                        sum_im += r_re[k] * d_im - r_im[k] * d_re;
+                }
+                corr_result[i] = std::sqrt(sum_re * sum_re +
+                                           sum_im * sum_im);
+        }
+}
+#endif
+
 Detector::Detector()
-{}
+        : m_front_end_min_samples(0),
+          m_raw_length(0),
+          m_data_offset(0),
+          m_data_length(0),
+          m_corr_length(0),
+          m_peak_position(-1),
+          m_peak_value(0),
+          m_snr_db(0),
+          m_threshold(0),
+          m_code_ix(0),
+          m_drift_ppm(0),
+          m_drift_known(false),
+          m_det_type(CDMA),
+          m_is_beacon(false),
+          m_avx2(false)
+{
+#ifdef DETECTOR_AVX2
+        m_avx2 = cpu_has_avx2();
+#endif
+}
+
+const size_t Detector::no_of_buffers;
+
+size_t Detector::get_buffer_bytes(SDR_Device_Config dev_cfg)
+{
+        size_t max_samples = std::max(dev_cfg.no_of_rx_samples_initial_sync,
+                                      dev_cfg.no_of_rx_samples_ping);
+        max_samples = std::max(max_samples, dev_cfg.no_of_rx_samples_pong);
+        return get_buffer_bytes(dev_cfg, max_samples);
+}
+
+size_t Detector::get_buffer_bytes(const SDR_Device_Config &dev_cfg,
+                                  size_t max_no_of_samples)
+{
+        return (max_no_of_samples + dev_cfg.tx_burst_length) * sizeof(float);
+}
 
 void Detector::configure(DetectorType det_type,
                          std::vector<uint32_t> codes,
                          SDR_Device_Config dev_cfg)
+{
+        m_data_re.reset();
+        m_data_im.reset();
+        m_corr_result.reset();
+        m_own_pool = std::make_shared<BufferPool>(get_buffer_bytes(dev_cfg),
+                                                  no_of_buffers, false);
+        configure(det_type, codes, dev_cfg, *m_own_pool);
+}
+
+void Detector::configure(DetectorType det_type,
+                         std::vector<uint32_t> codes,
+                         SDR_Device_Config dev_cfg,
+                         BufferPool &pool)
 {
         m_det_type = det_type;
         m_codes = codes;
         m_dev_cfg = dev_cfg;
         m_is_beacon = m_dev_cfg.is_beacon;
+        m_front_end.configure(m_dev_cfg);
+        m_front_end_min_samples = std::llround(m_dev_cfg.burst_period *
+                                               m_dev_cfg.sampling_rate_rx);
+        size_t capacity = pool.get_buffer_bytes() / sizeof(float);
+        m_data_re.reset();
+        m_data_im.reset();
+        m_corr_result.reset();
+        m_data_re.reset(new PoolBuffer<float>(pool, capacity));
+        m_data_im.reset(new PoolBuffer<float>(pool, capacity));
+        m_corr_result.reset(new PoolBuffer<float>(pool, capacity));
+        m_raw_length = 0;
+        m_data_offset = 0;
+        m_data_length = 0;
+        m_corr_length = 0;
+        m_peaks.clear();
+        m_peaks.reserve(capacity);
+        m_reference_re.clear();
+        m_reference_im.clear();
+        for (size_t n=0; n<m_codes.size(); n++) {
+                double scale_factor(1.0);
+                uint16_t Novs = m_dev_cfg.Novs_rx;
+                double extra_samples_for_filter =
+                        m_dev_cfg.extra_samples_filter;
+                size_t mod_length = m_dev_cfg.tx_burst_length_chip;
+                mod_length = mod_length * (1 + extra_samples_for_filter);
+                Modulator modulator(mod_length, scale_factor, Novs);
+                modulator.generate_cdma(m_codes[n]);
+                modulator.filter();
+                modulator.scrap_samples(mod_length *
+                                        extra_samples_for_filter);
+                std::vector<std::complex<float>> tx_pulse =
+                        modulator.get_data();
+                if (tx_pulse.size() > m_dev_cfg.tx_burst_length) {
+                        throw std::runtime_error(
+                                "detector: Reference longer than burst");
+                }
+                std::vector<float> ref_re(tx_pulse.size());
+                std::vector<float> ref_im(tx_pulse.size());
+                for (size_t m=0; m<tx_pulse.size(); m++) {
+                        ref_re[m] = tx_pulse[m].real();
+                        ref_im[m] = tx_pulse[m].imag();
+                }
+                m_reference_re.push_back(ref_re);
+                m_reference_im.push_back(ref_im);
+        }
 }
 
-void Detector::add_data(std::vector<std::complex<float>> data)
+void Detector::add_data(const std::vector<std::complex<float>> &data)
 {
-        m_data.clear();
-        m_data.set_size(data.size());
-        m_data = arma::conv_to<arma::cx_vec>::from(data);
-        m_raw_data = m_data;
+        size_t capacity = m_data_re->size();
+        if (data.size() + m_dev_cfg.tx_burst_length > capacity) {
+                throw std::runtime_error("detector: Too much data");
+        }
+        float *data_re = m_data_re->data();
+        float *data_im = m_data_im->data();
+        for (size_t n=0; n<data.size(); n++) {
+                data_re[n] = data[n].real();
+                data_im[n] = data[n].imag();
+        }
+        if (m_dev_cfg.dc_iq_correction) {
+                m_front_end.freeze(data.size() < m_front_end_min_samples);
+                m_front_end.process(data_re, data_im, data.size());
+        }
+        m_raw_length = data.size();
+        m_data_offset = 0;
+        m_data_length = m_raw_length;
 }
 
-void Detector::add_data(std::vector<std::complex<int16_t>> data)
+void Detector::add_data(const std::vector<std::complex<int16_t>> &data)
 {
-        m_data.clear();
-        m_data.set_size(data.size());
-        for (size_t n=0; n<data.size()-1; n++) {
-                int16_t re = std::real(data[n]);
-                int16_t im = std::imag(data[n]);
-                m_data(n) = std::complex<double>((double)re, (double)im);
+        add_data(data.data(), data.size());
+}
+
+void Detector::add_data(const std::complex<int16_t> *data,
+                        size_t no_of_samples)
+{
+        TraceSpan span(TRACE_ADD_DATA);
+        span.set_value(no_of_samples);
+        size_t capacity = m_data_re->size();
+        if (no_of_samples + m_dev_cfg.tx_burst_length > capacity) {
+                throw std::runtime_error("detector: Too much data");
+        }
+        float *data_re = m_data_re->data();
+        float *data_im = m_data_im->data();
+        if (m_dev_cfg.dc_iq_correction) {
+                m_front_end.freeze(no_of_samples < m_front_end_min_samples);
+                m_front_end.process(data, no_of_samples, data_re, data_im);
+        } else {
+                for (size_t n=0; n<no_of_samples; n++) {
+                        data_re[n] = data[n].real();
+                        data_im[n] = data[n].imag();
+                }
         }
-        m_raw_data = m_data;
+        m_raw_length = no_of_samples;
+        m_data_offset = 0;
+        m_data_length = m_raw_length;
+}
+
+void Detector::reset_front_end()
+{
+        m_front_end.reset();
+}
+
+const DcIqCorrector &Detector::get_front_end() const
+{
+        return m_front_end;
 }
 
 arma::cx_vec Detector::get_data()
 {
-        return m_data;
+        arma::cx_vec data(m_data_length);
+        for (size_t n=0; n<m_data_length; n++) {
+                data(n) = std::complex<double>(
+                        (*m_data_re)[m_data_offset + n],
+                        (*m_data_im)[m_data_offset + n]);
+        }
+        return data;
 }
 
 arma::cx_vec Detector::get_raw_data()
 {
-        return m_raw_data;
+        arma::cx_vec data(m_raw_length);
+        for (size_t n=0; n<m_raw_length; n++) {
+                data(n) = std::complex<double>((*m_data_re)[n],
+                                               (*m_data_im)[n]);
+        }
+        return data;
 }
 
 int64_t Detector::look_for_initial_sync()
 {
         int64_t index_of_sync(-1);
-        arma::uvec found_bursts;
+        size_t no_of_peaks(0);
         if (m_det_type == CDMA) {
-                found_bursts = detect_cdma_bursts();
+                no_of_peaks = detect_cdma_bursts();
         }
-        index_of_sync = check_bursts_for_intial_sync_index(found_bursts);
+        index_of_sync = check_bursts_for_intial_sync_index(no_of_peaks);
         return index_of_sync;
 }
 
@@ -69,23 +333,51 @@ int64_t Detector::look_for_pong(int64_t expected_ix)
         return look_for_ping(expected_ix);
 }
 
+size_t Detector::look_for_bursts()
+{
+        size_t no_of_peaks(0);
+        if (m_det_type == CDMA) {
+                no_of_peaks = detect_cdma_bursts();
+        }
+        // Keep the first index of each burst, in place
+        size_t no_of_bursts(0);
+        for (size_t n=0; n<no_of_peaks; n++) {
+                if ((no_of_bursts == 0) ||
+                    (m_peaks[n] - m_peaks[no_of_bursts - 1] >=
+                     m_dev_cfg.tx_burst_length)) {
+                        m_peaks[no_of_bursts++] = m_peaks[n];
+                }
+        }
+        m_peaks.resize(no_of_bursts);
+        return no_of_bursts;
+}
+
+int64_t Detector::measure_burst(size_t burst)
+{
+        measure_peak(m_peaks.at(burst));
+        return m_peaks[burst];
+}
+
 int64_t Detector::look_for_ping(int64_t expected_ix)
 {
-        int64_t index_of_sync(-1);
-        int64_t adjust_ix;
         if (m_is_beacon) {
-                adjust_ix = reduce_buffer_data(expected_ix,
-                                               m_dev_cfg.pong_burst_guard);
-        } else {
-                adjust_ix = reduce_buffer_data(expected_ix,
-                                               m_dev_cfg.ping_burst_guard);
+                return look_for_ping(expected_ix, m_dev_cfg.pong_burst_guard);
         }
-        arma::uvec found_bursts;
+        return look_for_ping(expected_ix, m_dev_cfg.ping_burst_guard);
+}
+
+int64_t Detector::look_for_ping(int64_t expected_ix, int64_t guard)
+{
+        int64_t index_of_sync(-1);
+        int64_t adjust_ix = reduce_buffer_data(expected_ix, guard);
+        size_t no_of_peaks(0);
         if (m_det_type == CDMA) {
-                found_bursts = detect_cdma_bursts();
+                no_of_peaks = detect_cdma_bursts();
         }
-        index_of_sync = check_bursts_for_ping_index(found_bursts);
+        index_of_sync = check_bursts_for_ping_index(no_of_peaks);
         if (index_of_sync > 0) {
+                measure_peak(index_of_sync);
+                m_peak_position += adjust_ix;
                 index_of_sync += adjust_ix;
         }
         return index_of_sync;
@@ -104,15 +396,18 @@ int64_t Detector::reduce_buffer_data(int64_t expected_ix, int64_t guard)
         }
         uint64_t end_pos = (uint64_t)expected_ix + data_length / 2;
         uint64_t end_ix;
-        if (end_pos >= m_data.n_rows) {
-                end_ix = m_data.n_rows - 1;
+        if (end_pos >= m_data_length) {
+                end_ix = m_data_length - 1;
         } else {
                 end_ix = (uint64_t)end_pos;
         }
-        data_length = end_ix - start_ix + 1;
-        arma::cx_vec tmp = m_data;
-        m_data.set_size(data_length);
-        m_data = tmp.rows(start_ix, end_ix);
+        // Only the view of the raw data is changed, nothing is copied
+        if ((m_data_length == 0) || (start_ix > end_ix)) {
+                m_data_length = 0;
+        } else {
+                m_data_offset += start_ix;
+                m_data_length = end_ix - start_ix + 1;
+        }
         return start_ix;
 }
 
@@ -138,85 +433,117 @@ bool Detector::found_ok_index(int64_t ix)
 
 std::vector<float> Detector::get_corr_result()
 {
-        std::vector<float> data;
-        data = arma::conv_to<std::vector<float>>::from(m_corr_result);
-        return data;
+        const float *corr_result = m_corr_result->data();
+        return std::vector<float>(corr_result, corr_result + m_corr_length);
+}
+
+const float *Detector::get_corr_data() const
+{
+        return m_corr_result ? m_corr_result->data() : nullptr;
 }
 
-arma::uvec Detector::detect_cdma_bursts()
+size_t Detector::get_corr_length() const
 {
-        arma::uvec peak_indexes;
+        return m_corr_length;
+}
+
+size_t Detector::detect_cdma_bursts()
+{
+        size_t no_of_peaks(0);
         for (size_t n=0; n<m_codes.size(); n++) {
-                correlate_cdma(m_codes[n]);
-                double threshold = calculate_threshold();
-                peak_indexes = find_peaks(threshold);
-                if (peak_indexes.n_rows > 0) {
+                correlate_cdma(n);
+                TraceSpan span(TRACE_PEAKS);
+                double threshold = calculate_threshold(
+                        m_reference_re[n].size());
+                m_threshold = threshold;
+                no_of_peaks = find_peaks(threshold);
+                span.set_value(no_of_peaks);
+                if (no_of_peaks > 0) {
                         break;
                 }
         }
-        return peak_indexes;
+        return no_of_peaks;
 }
 
-int64_t Detector::check_bursts_for_intial_sync_index(arma::uvec peak_indexes)
+int64_t Detector::check_bursts_for_intial_sync_index(size_t no_of_peaks)
 {
         int64_t ix(-1);
-        if (peak_indexes.n_rows > 0) {
-                ix = find_initial_sync_ix(peak_indexes);
+        if (no_of_peaks > 0) {
+                ix = find_initial_sync_ix(no_of_peaks);
         }
         return ix;
 }
 
-int64_t Detector::check_bursts_for_ping_index(arma::uvec peak_indexes)
+int64_t Detector::check_bursts_for_ping_index(size_t no_of_peaks)
 {
         int64_t ix(-1);
-        if (peak_indexes.n_rows > 0) {
-                ix = peak_indexes(0);
+        if (no_of_peaks > 0) {
+                ix = m_peaks[0];
         }
         return ix;
 }
 
-void Detector::correlate_cdma(uint32_t code_nr)
+void Detector::correlate_cdma(size_t code_ix)
 {
-        double scale_factor(1.0);
-        uint16_t Novs = m_dev_cfg.Novs_rx;
-        double extra_samples_for_filter = m_dev_cfg.extra_samples_filter;
-        size_t mod_length = m_dev_cfg.tx_burst_length_chip;
-        mod_length = mod_length * (1 + extra_samples_for_filter);
-        Modulator modulator(mod_length, scale_factor, Novs);
-        modulator.generate_cdma(code_nr);
-        modulator.filter();
-        modulator.scrap_samples(mod_length * extra_samples_for_filter);
-        std::vector<std::complex<float>> tx_pulse = modulator.get_data();
-        m_reference = arma::conv_to<arma::cx_vec>::from(tx_pulse);
-        m_corr_result = correlate(m_reference);
+        TraceSpan span(TRACE_CORRELATE);
+        span.set_value(m_codes[code_ix]);
+        m_code_ix = code_ix;
+        correlate(m_reference_re[code_ix], m_reference_im[code_ix]);
 }
 
-arma::vec Detector::correlate(arma::vec ref, arma::vec rx_data)
+void Detector::correlate(const std::vector<float> &ref_re,
+                         const std::vector<float> &ref_im)
 {
-        return arma::conv(ref, arma::flipud(rx_data));
-}
-
-arma::vec Detector::correlate(arma::cx_vec ref)
-{
-        arma::vec c_re = correlate(arma::real(ref), arma::real(m_data));
-        arma::vec c_im = correlate(arma::imag(ref), arma::imag(m_data));
-        arma::vec c_mix_1 = correlate(arma::real(ref), arma::imag(m_data));
-        arma::vec c_mix_2 = correlate(arma::imag(ref), arma::real(m_data));
-        size_t length = c_re.n_rows;
-        arma::cx_vec complex_corr(length);
-        for (size_t n=0; n<length; n++)
-        {
-                complex_corr(n) = std::complex<double>(
-                        c_re(n) + c_im(n),
-                        -c_mix_1(n) + c_mix_2(n));
+        /* Full cross correlation, as a convolution with the flipped
+         * data, i.e. corr(i) = |sum_k conj(ref(k)) * data(k + i - Lr + 1)|,
+         * with the peak at the last sample of a burst.
+         */
+        const int64_t ref_length = ref_re.size();
+        const int64_t data_length = m_data_length;
+        m_corr_length = 0;
+        if ((ref_length == 0) || (data_length == 0)) {
+                return;
+        }
+        const float *data_re = m_data_re->data() + m_data_offset;
+        const float *data_im = m_data_im->data() + m_data_offset;
+        const float *r_re = ref_re.data();
+        const float *r_im = ref_im.data();
+        float *corr_result = m_corr_result->data();
+        m_corr_length = ref_length + data_length - 1;
+#ifdef DETECTOR_AVX2
+        if (m_avx2) {
+                correlate_avx2(r_re, r_im, ref_length, data_re, data_im,
+                               data_length, corr_result, m_corr_length);
+                return;
+        }
+#endif
+        for (int64_t i=0; i<(int64_t)m_corr_length; i++) {
+                int64_t lag = i - (ref_length - 1);
+                int64_t k_start = std::max((int64_t)0, -lag);
+                int64_t k_end = std::min(ref_length, data_length - lag);
+                float sum_re(0);
+                float sum_im(0);
+                for (int64_t k=k_start; k<k_end; k++) {
+                        float d_re = data_re[k + lag];
+                        float d_im = data_im[k + lag];
+                        sum_re += r_re[k] * d_re + r_im[k] * d_im;
+                        sum_im += r_re[k] * d_im - r_im[k] * d_re;
+                }
+                corr_result[i] = std::sqrt(sum_re * sum_re +
+                                           sum_im * sum_im);
         }
-        return arma::abs(arma::flipud(complex_corr));
 }
 
-double Detector::calculate_threshold()
+double Detector::calculate_threshold(size_t ref_length)
 {
-        size_t length = m_reference.n_rows;
-        size_t max_ix = m_corr_result.index_max();
+        const float *corr_result = m_corr_result->data();
+        size_t length = ref_length;
+        size_t max_ix(0);
+        for (size_t n=1; n<m_corr_length; n++) {
+                if (corr_result[n] > corr_result[max_ix]) {
+                        max_ix = n;
+                }
+        }
         int64_t start_candidate = max_ix - length / 2;
         uint64_t start_ix;
         if (start_candidate < 0) {
@@ -225,34 +552,136 @@ double Detector::calculate_threshold()
                 start_ix = (uint64_t)(start_candidate);
         }
         uint64_t end_ix = (uint64_t)(max_ix + length / 2);
-        if (end_ix >= m_corr_result.n_rows) {
-                end_ix = m_corr_result.n_rows - 1;
+        if (end_ix >= m_corr_length) {
+                end_ix = m_corr_length - 1;
+        }
+        size_t no_of_values = end_ix - start_ix + 1;
+        double sum(0);
+        for (uint64_t n=start_ix; n<=end_ix; n++) {
+                sum += corr_result[n];
+        }
+        double mean = sum / no_of_values;
+        double sum_of_squares(0);
+        for (uint64_t n=start_ix; n<=end_ix; n++) {
+                double diff = corr_result[n] - mean;
+                sum_of_squares += diff * diff;
+        }
+        double standard_dev(0);
+        if (no_of_values > 1) {
+                standard_dev = std::sqrt(sum_of_squares /
+                                         (no_of_values - 1));
         }
-        arma::vec corr_data = m_corr_result.rows(start_ix, end_ix);
-        double mean = arma::mean(corr_data);
-        double standard_dev = arma::stddev(corr_data);
         double threshold = mean + m_dev_cfg.threshold_factor * standard_dev;
         //std::cout << "Threshold " << threshold << std::endl;
         return threshold;
 }
 
-arma::uvec Detector::find_peaks(double threshold)
+void Detector::measure_peak(size_t corr_ix)
 {
-        arma::uvec peaks = arma::find(m_corr_result > threshold);
-        return arma::sort(peaks, "ascend");
+        /* The first index above the threshold might be on the rising
+         * edge, climb to the top before fitting the parabola.
+         */
+        const float *corr_result = m_corr_result->data();
+        size_t ix = corr_ix;
+        while ((ix + 1 < m_corr_length) &&
+               (corr_result[ix + 1] > corr_result[ix])) {
+                ix++;
+        }
+        m_peak_value = corr_result[ix];
+        m_snr_db = estimate_snr(ix);
+        m_peak_position = ix;
+        if ((ix == 0) || (ix + 1 >= m_corr_length)) {
+                return;
+        }
+        double y_prev = corr_result[ix - 1];
+        double y_peak = corr_result[ix];
+        double y_next = corr_result[ix + 1];
+        double curvature = y_prev - 2 * y_peak + y_next;
+        if (curvature < 0) {
+                m_peak_position += 0.5 * (y_prev - y_next) / curvature;
+        }
+}
+
+double Detector::estimate_snr(size_t corr_ix)
+{
+        /* The share of the data energy under the burst that the matched
+         * filter explains, rho = |corr|^2 / (E_ref * E_data), is
+         * S / (S + N), so SNR = rho / (1 - rho).
+         */
+        const std::vector<float> &r_re = m_reference_re[m_code_ix];
+        const std::vector<float> &r_im = m_reference_im[m_code_ix];
+        const int64_t ref_length = r_re.size();
+        const float *data_re = m_data_re->data() + m_data_offset;
+        const float *data_im = m_data_im->data() + m_data_offset;
+        int64_t lag = corr_ix - (ref_length - 1);
+        int64_t k_start = std::max((int64_t)0, -lag);
+        int64_t k_end = std::min(ref_length, (int64_t)m_data_length - lag);
+        double ref_energy(0);
+        double data_energy(0);
+        for (int64_t k=k_start; k<k_end; k++) {
+                ref_energy += r_re[k] * r_re[k] + r_im[k] * r_im[k];
+                data_energy += data_re[k + lag] * data_re[k + lag] +
+                        data_im[k + lag] * data_im[k + lag];
+        }
+        if ((ref_energy <= 0) || (data_energy <= 0)) {
+                return 0;
+        }
+        double peak = m_corr_result->data()[corr_ix];
+        double rho = peak * peak / (ref_energy * data_energy);
+        rho = std::min(rho, 1 - 1e-9);
+        return 10 * std::log10(rho / (1 - rho));
 }
 
-int64_t Detector::find_initial_sync_ix(arma::uvec peak_indexes)
+double Detector::get_peak_position() const
+{
+        return m_peak_position;
+}
+
+double Detector::get_peak_value() const
+{
+        return m_peak_value;
+}
+
+double Detector::get_snr_estimate() const
+{
+        return m_snr_db;
+}
+
+double Detector::get_threshold() const
+{
+        return m_threshold;
+}
+
+void Detector::set_clock_drift(double drift_ppm)
+{
+        m_drift_ppm = drift_ppm;
+        m_drift_known = true;
+}
+
+size_t Detector::find_peaks(double threshold)
+{
+        const float *corr_result = m_corr_result->data();
+        m_peaks.clear();
+        for (size_t n=0; n<m_corr_length; n++) {
+                if (corr_result[n] > threshold) {
+                        m_peaks.push_back(n);
+                }
+        }
+        return m_peaks.size();
+}
+
+int64_t Detector::find_initial_sync_ix(size_t no_of_peaks)
 {
         int64_t sync_index(-1);
-        size_t num_peaks = peak_indexes.n_rows;
+        size_t num_peaks = no_of_peaks;
         if (num_peaks < 20) {
                 for (size_t n=0; n<num_peaks-1; n++) {
                         for (size_t m=n+1; m<num_peaks; m++) {
                                 uint64_t spacing =
-                                        peak_indexes(m) - peak_indexes(n);
+                                        m_peaks[m] - m_peaks[n];
                                 if (spacing_ok(spacing)) {
-                                        sync_index = peak_indexes(m);
+                                        sync_index = m_peaks[m];
+                                        measure_peak(m_peaks[m]);
                                         break;
                                 }
                         }
@@ -267,9 +696,13 @@ int64_t Detector::find_initial_sync_ix(arma::uvec peak_indexes)
 bool Detector::spacing_ok(int64_t burst_spacing)
 {
         bool ok;
-        int64_t burst_period =
-                m_dev_cfg.burst_period * m_dev_cfg.sampling_rate_rx;
+        int64_t burst_period = std::llround(
+                m_dev_cfg.burst_period * m_dev_cfg.sampling_rate_rx *
+                (1 + m_drift_ppm * 1e-6));
         int64_t max_diff = m_dev_cfg.max_sync_error;
+        if (m_drift_known) {
+                max_diff = m_dev_cfg.drift_max_sync_error;
+        }
         ok = burst_spacing <= (burst_period + max_diff);
         ok = ok && (burst_spacing >= (burst_period - max_diff));
         return ok;
@@ -0,0 +1,262 @@
+/**
+ * \file file_radio.cpp
+ *
+ * \brief File replay radio class
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "file_radio.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <SoapySDR/Errors.hpp>
+#include <SoapySDR/Time.hpp>
+
+FileRadio::FileRadio(std::string basename)
+        : m_basename(basename),
+          m_data_file(nullptr),
+          m_sample_file_pos(0),
+          m_sample_rate(0),
+          m_first_hw_ns(0),
+          m_sample_count(0),
+          m_file_samples(0),
+          m_no_of_replays(0)
+{}
+
+FileRadio::~FileRadio()
+{
+        if (m_data_file != nullptr) {
+                std::fclose(m_data_file);
+        }
+}
+
+void FileRadio::configure(SDR_Device_Config dev_cfg)
+{
+        m_dev_cfg = dev_cfg;
+        configure_timeline();
+        if (is_sample_file(m_basename)) {
+                m_sample_file.open(m_basename);
+                SampleFileInfo info = m_sample_file.get_info();
+                m_sample_rate = (info.sample_rate > 0) ?
+                        info.sample_rate : m_dev_cfg.sampling_rate_rx;
+                m_first_hw_ns = info.time_hw_ns;
+                m_file_samples = m_sample_file.size();
+                m_sample_file_pos = 0;
+        } else {
+                open_recording();
+        }
+        if (m_sample_rate != m_dev_cfg.sampling_rate_rx) {
+                std::cout << "file: Warning, recording sample rate "
+                          << m_sample_rate << " differs from RX rate "
+                          << m_dev_cfg.sampling_rate_rx << std::endl;
+        }
+        std::cout << "file: Replaying " << m_basename << std::endl;
+}
+
+void FileRadio::open_recording()
+{
+        std::string file = m_basename + ".sigmf-data";
+        m_data_file = std::fopen(file.c_str(), "rb");
+        if (m_data_file == nullptr) {
+                std::string err = "Could not open recording: ";
+                err += file;
+                throw std::runtime_error(err);
+        }
+        read_meta();
+        std::fseek(m_data_file, 0, SEEK_END);
+        m_file_samples = std::ftell(m_data_file) /
+                sizeof(std::complex<int16_t>);
+        std::rewind(m_data_file);
+}
+
+void FileRadio::read_meta()
+{
+        m_sample_rate = m_dev_cfg.sampling_rate_rx;
+        std::ifstream meta_file(m_basename + ".sigmf-meta");
+        if (!meta_file) {
+                std::cout << "file: No meta file, assuming RX rate"
+                          << std::endl;
+                return;
+        }
+        std::stringstream meta;
+        meta << meta_file.rdbuf();
+        m_sample_rate = meta_value(meta.str(), "core:sample_rate",
+                                   m_sample_rate);
+        m_first_hw_ns = meta_value(meta.str(), "wittra:hw_ns", 0);
+}
+
+double FileRadio::meta_value(std::string meta, std::string key,
+                             double default_value)
+{
+        std::string quoted_key = "\"" + key + "\"";
+        std::size_t found = meta.find(quoted_key);
+        if (found == std::string::npos) {
+                return default_value;
+        }
+        found = meta.find(':', found + quoted_key.size());
+        if (found == std::string::npos) {
+                return default_value;
+        }
+        return std::stod(meta.substr(found + 1));
+}
+
+int64_t FileRadio::start()
+{
+        m_clock.set(m_first_hw_ns);
+        return SoapySDR::timeNsToTicks(m_first_hw_ns, m_dev_cfg.f_clk);
+}
+
+int32_t FileRadio::read(size_t no_of_samples,
+                        std::complex<int16_t> *buff_data)
+{
+        TraceSpan span(TRACE_READ);
+        int64_t time_hw_ns(0);
+        int flags(0);
+        int32_t ret = read_samples(no_of_samples, buff_data, time_hw_ns,
+                                   flags);
+        if (ret > 0) {
+                store_rx_block(buff_data, ret, time_hw_ns, flags);
+                span.set_hw_ns(time_hw_ns);
+        }
+        span.set_value(ret);
+        return ret;
+}
+
+int32_t FileRadio::read_window(int64_t start_hw_ns, size_t no_of_samples,
+                               std::complex<int16_t> *buff_data)
+{
+        TraceSpan span(TRACE_READ, start_hw_ns);
+        int64_t skip = std::llround((start_hw_ns - m_first_hw_ns) *
+                                    m_sample_rate / 1e9) -
+                (int64_t)m_sample_count;
+        if ((skip < 0) || (m_file_samples == 0)) {
+                return SOAPY_SDR_TIME_ERROR;
+        }
+        uint64_t pos = tell_samples();
+        pos += skip;
+        m_no_of_replays += pos / m_file_samples;
+        pos %= m_file_samples;
+        seek_samples(pos);
+        m_sample_count += skip;
+        int64_t time_hw_ns(0);
+        int flags(0);
+        int32_t ret = read_samples(no_of_samples, buff_data, time_hw_ns,
+                                   flags);
+        if (ret > 0) {
+                store_rx_window(buff_data, ret, time_hw_ns);
+        }
+        span.set_value(ret);
+        return ret;
+}
+
+int32_t FileRadio::read_samples(size_t no_of_samples,
+                                std::complex<int16_t> *buff_data,
+                                int64_t &time_hw_ns, int &flags)
+{
+        size_t no_of_read_samples(0);
+        while ((m_data_file == nullptr) &&
+               (no_of_read_samples < no_of_samples)) {
+                if (m_file_samples == 0) {
+                        return SOAPY_SDR_TIMEOUT;
+                }
+                if (m_sample_file_pos == m_file_samples) {
+                        m_sample_file_pos = 0;
+                        m_no_of_replays++;
+                        flags |= SOAPY_SDR_END_ABRUPT;
+                }
+                size_t no_to_read = std::min(
+                        no_of_samples - no_of_read_samples,
+                        (size_t)(m_file_samples - m_sample_file_pos));
+                m_sample_file.read(m_sample_file_pos, no_to_read,
+                                   buff_data + no_of_read_samples);
+                m_sample_file_pos += no_to_read;
+                no_of_read_samples += no_to_read;
+        }
+        while (no_of_read_samples < no_of_samples) {
+                size_t ret = std::fread(buff_data + no_of_read_samples,
+                                        sizeof(std::complex<int16_t>),
+                                        no_of_samples - no_of_read_samples,
+                                        m_data_file);
+                no_of_read_samples += ret;
+                if (ret == 0) {
+                        if (std::ftell(m_data_file) == 0) {
+                                return SOAPY_SDR_TIMEOUT;
+                        }
+                        std::rewind(m_data_file);
+                        m_no_of_replays++;
+                        // The data jumps back, even if the time does not
+                        flags |= SOAPY_SDR_END_ABRUPT;
+                }
+        }
+        time_hw_ns = m_first_hw_ns +
+                (int64_t)(m_sample_count * 1e9 / m_sample_rate);
+        m_sample_count += no_of_samples;
+        m_clock.set(m_first_hw_ns +
+                    (int64_t)(m_sample_count * 1e9 / m_sample_rate));
+        return no_of_samples;
+}
+
+uint64_t FileRadio::tell_samples()
+{
+        if (m_data_file == nullptr) {
+                return m_sample_file_pos;
+        }
+        return std::ftell(m_data_file) / sizeof(std::complex<int16_t>);
+}
+
+void FileRadio::seek_samples(uint64_t pos)
+{
+        if (m_data_file == nullptr) {
+                m_sample_file_pos = pos;
+                return;
+        }
+        std::fseek(m_data_file, pos * sizeof(std::complex<int16_t>),
+                   SEEK_SET);
+}
+
+size_t FileRadio::write(const std::vector<void *> &data, size_t no_of_samples,
+                        long long int burst_time)
+{
+        (void)data;
+        int64_t tx_lead_rel_ns = (m_dev_cfg.time_in_future +
+                                  2 * m_dev_cfg.burst_period) * 1e9;
+        TraceSpan span(TRACE_WRITE, burst_time);
+        if (!m_clock.wait_until(burst_time - tx_lead_rel_ns,
+                                m_dev_cfg.timeout)) {
+                span.set_value(SOAPY_SDR_TIMEOUT);
+                return SOAPY_SDR_TIMEOUT;
+        }
+        span.set_value(no_of_samples);
+        return no_of_samples;
+}
+
+int64_t FileRadio::get_hardware_time()
+{
+        return m_clock.now();
+}
+
+int64_t FileRadio::check_burst_time(long long int burst_hw_ns)
+{
+        int64_t current_hw_ns = get_hardware_time();
+        if ((burst_hw_ns - current_hw_ns) < 0) {
+                std::cout << "burst_hw_ns: " << burst_hw_ns
+                          << " current time:  " << current_hw_ns
+                          << " diff: " << burst_hw_ns - current_hw_ns
+                          << std::endl;
+        }
+        return burst_hw_ns - current_hw_ns;
+}
+
+void FileRadio::close()
+{
+        std::cout << "file: Replayed " << m_sample_count << " samples, "
+                  << "rewound " << m_no_of_replays << " times"
+                  << std::endl;
+        close_recording();
+}
@@ -0,0 +1,408 @@
+/**
+ * \file live_plot.cpp
+ *
+ * \brief Live plot of the RX data and the correlation, while running
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "live_plot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <signal.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static int64_t monotonic_ns()
+{
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void min_max_bin(const float *data, size_t count, float &min,
+                        float &max)
+{
+        size_t n(0);
+        float lo = data[0];
+        float hi = data[0];
+#ifdef __SSE2__
+        if (count >= 4) {
+                __m128 lo4 = _mm_loadu_ps(data);
+                __m128 hi4 = lo4;
+                for (n=4; n+4<=count; n+=4) {
+                        __m128 value = _mm_loadu_ps(data + n);
+                        lo4 = _mm_min_ps(lo4, value);
+                        hi4 = _mm_max_ps(hi4, value);
+                }
+                float lo_values[4];
+                float hi_values[4];
+                _mm_storeu_ps(lo_values, lo4);
+                _mm_storeu_ps(hi_values, hi4);
+                for (size_t k=0; k<4; k++) {
+                        lo = std::min(lo, lo_values[k]);
+                        hi = std::max(hi, hi_values[k]);
+                }
+        }
+#endif
+        for (; n<count; n++) {
+                lo = std::min(lo, data[n]);
+                hi = std::max(hi, data[n]);
+        }
+        min = lo;
+        max = hi;
+}
+
+static float squared_magnitude(std::complex<int16_t> sample)
+{
+        float re = sample.real();
+        float im = sample.imag();
+        return re * re + im * im;
+}
+
+static void magnitude_min_max_bin(const std::complex<int16_t> *samples,
+                                  size_t count, float &min, float &max)
+{
+        // Squared magnitudes, the root is only taken of the extremes
+        size_t n(0);
+        float lo = squared_magnitude(samples[0]);
+        float hi = lo;
+#ifdef __SSE2__
+        if (count >= 4) {
+                const __m128 sign = _mm_set1_ps(-0.0f);
+                __m128 lo4 = _mm_set1_ps(lo);
+                __m128 hi4 = lo4;
+                for (; n+4<=count; n+=4) {
+                        __m128i iq = _mm_loadu_si128(
+                                reinterpret_cast<const __m128i *>(
+                                        samples + n));
+                        /* re * re + im * im per sample. Only a sample
+                         * of two -32768 wraps, to the sign bit, which
+                         * the abs turns into the right 2^31.
+                         */
+                        __m128 power = _mm_andnot_ps(
+                                sign, _mm_cvtepi32_ps(
+                                        _mm_madd_epi16(iq, iq)));
+                        lo4 = _mm_min_ps(lo4, power);
+                        hi4 = _mm_max_ps(hi4, power);
+                }
+                float lo_values[4];
+                float hi_values[4];
+                _mm_storeu_ps(lo_values, lo4);
+                _mm_storeu_ps(hi_values, hi4);
+                for (size_t k=0; k<4; k++) {
+                        lo = std::min(lo, lo_values[k]);
+                        hi = std::max(hi, hi_values[k]);
+                }
+        }
+#endif
+        for (; n<count; n++) {
+                float power = squared_magnitude(samples[n]);
+                lo = std::min(lo, power);
+                hi = std::max(hi, power);
+        }
+        min = std::sqrt(lo);
+        max = std::sqrt(hi);
+}
+
+size_t decimate_min_max(const float *data, size_t length, size_t no_of_bins,
+                        float *min, float *max)
+{
+        no_of_bins = std::min(no_of_bins, length);
+        for (size_t bin=0; bin<no_of_bins; bin++) {
+                size_t start = bin * length / no_of_bins;
+                size_t end = (bin + 1) * length / no_of_bins;
+                min_max_bin(data + start, end - start, min[bin], max[bin]);
+        }
+        return no_of_bins;
+}
+
+size_t decimate_magnitude_min_max(const std::complex<int16_t> *samples,
+                                  size_t no_of_samples, size_t no_of_bins,
+                                  float *min, float *max)
+{
+        no_of_bins = std::min(no_of_bins, no_of_samples);
+        for (size_t bin=0; bin<no_of_bins; bin++) {
+                size_t start = bin * no_of_samples / no_of_bins;
+                size_t end = (bin + 1) * no_of_samples / no_of_bins;
+                magnitude_min_max_bin(samples + start, end - start,
+                                      min[bin], max[bin]);
+        }
+        return no_of_bins;
+}
+
+static void resize_frame(LivePlotFrame &frame, size_t no_of_bins)
+{
+        frame.corr_min.resize(no_of_bins);
+        frame.corr_max.resize(no_of_bins);
+        frame.mag_min.resize(no_of_bins);
+        frame.mag_max.resize(no_of_bins);
+}
+
+static void resize_frame(LiveSpectrumFrame &frame, size_t no_of_bins)
+{
+        frame.psd_min.resize(no_of_bins);
+        frame.psd_max.resize(no_of_bins);
+        frame.hold_min.resize(no_of_bins);
+        frame.hold_max.resize(no_of_bins);
+}
+
+LivePlot::LivePlot(const SDR_Device_Config &dev_cfg)
+        : m_enabled(false),
+          m_spectrum(dev_cfg.spectrum),
+          m_frame_period_ns(std::llround(1e9 / dev_cfg.live_plot_rate)),
+          m_next_frame_ns(0),
+          m_next_spectrum_ns(0),
+          m_frame_no(0),
+          m_spectrum_no(0),
+          m_pipe(nullptr),
+          m_has_pending(false),
+          m_has_spectrum_pending(false),
+          m_stop(false),
+          m_failed(false),
+          m_no_of_frames(0),
+          m_no_of_dropped(0)
+{
+        if (!dev_cfg.live_plot) {
+                return;
+        }
+        resize_frame(m_fill, dev_cfg.live_plot_bins);
+        resize_frame(m_pending, dev_cfg.live_plot_bins);
+        resize_frame(m_plot, dev_cfg.live_plot_bins);
+        if (m_spectrum) {
+                resize_frame(m_spectrum_fill, dev_cfg.live_plot_bins);
+                resize_frame(m_spectrum_pending, dev_cfg.live_plot_bins);
+                resize_frame(m_spectrum_plot, dev_cfg.live_plot_bins);
+        }
+        // A closed plot window should fail the writes, not kill the run
+        signal(SIGPIPE, SIG_IGN);
+        m_pipe = popen("gnuplot -persist", "w");
+        if (m_pipe == nullptr) {
+                std::cout << "plot: Could not start gnuplot, no live plot"
+                          << std::endl;
+                return;
+        }
+        std::fprintf(m_pipe, "set style fill solid 0.5 noborder\n");
+        std::cout << "plot: Live plot of " << dev_cfg.live_plot_bins
+                  << " bins at up to " << dev_cfg.live_plot_rate
+                  << " frames/s" << std::endl;
+        m_enabled = true;
+        m_thread = std::thread(&LivePlot::plot_loop, this);
+}
+
+LivePlot::~LivePlot()
+{
+        if (!m_thread.joinable()) {
+                return;
+        }
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+        pclose(m_pipe);
+        std::cout << "plot: " << m_no_of_frames.load() << " frames plotted, "
+                  << m_no_of_dropped.load() << " dropped" << std::endl;
+}
+
+bool LivePlot::is_enabled() const
+{
+        return m_enabled;
+}
+
+void LivePlot::push(const float *corr, size_t corr_length,
+                    const std::complex<int16_t> *samples,
+                    size_t no_of_samples)
+{
+        if (!m_enabled || m_failed.load(std::memory_order_relaxed)) {
+                return;
+        }
+        int64_t now_ns = monotonic_ns();
+        if (now_ns < m_next_frame_ns) {
+                return;
+        }
+        m_next_frame_ns = now_ns + m_frame_period_ns;
+        m_fill.no_of_corr_bins = decimate_min_max(
+                corr, corr_length, m_fill.corr_min.size(),
+                m_fill.corr_min.data(), m_fill.corr_max.data());
+        m_fill.no_of_mag_bins = decimate_magnitude_min_max(
+                samples, no_of_samples, m_fill.mag_min.size(),
+                m_fill.mag_min.data(), m_fill.mag_max.data());
+        m_fill.corr_length = corr_length;
+        m_fill.no_of_samples = no_of_samples;
+        m_fill.frame_no = m_frame_no++;
+        // Never wait for the plot thread, drop the frame instead
+        std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+                m_no_of_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+        }
+        if (m_has_pending) {
+                // Not drawn yet, replaced by the newer frame
+                m_no_of_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::swap(m_fill, m_pending);
+        m_has_pending = true;
+        lock.unlock();
+        m_wake.notify_one();
+}
+
+void LivePlot::push_spectrum(const float *psd_db, const float *max_hold_db,
+                             size_t no_of_bins, double start_hz,
+                             double bin_hz)
+{
+        if (!m_enabled || !m_spectrum ||
+            m_failed.load(std::memory_order_relaxed)) {
+                return;
+        }
+        int64_t now_ns = monotonic_ns();
+        if (now_ns < m_next_spectrum_ns) {
+                return;
+        }
+        m_next_spectrum_ns = now_ns + m_frame_period_ns;
+        LiveSpectrumFrame &frame = m_spectrum_fill;
+        frame.no_of_bins = decimate_min_max(
+                psd_db, no_of_bins, frame.psd_min.size(),
+                frame.psd_min.data(), frame.psd_max.data());
+        frame.has_max_hold = (max_hold_db != nullptr);
+        if (frame.has_max_hold) {
+                decimate_min_max(max_hold_db, no_of_bins,
+                                 frame.hold_max.size(),
+                                 frame.hold_min.data(),
+                                 frame.hold_max.data());
+        }
+        frame.no_of_psd_bins = no_of_bins;
+        frame.start_hz = start_hz;
+        frame.bin_hz = bin_hz;
+        frame.frame_no = m_spectrum_no++;
+        std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+                m_no_of_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+        }
+        if (m_has_spectrum_pending) {
+                m_no_of_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::swap(m_spectrum_fill, m_spectrum_pending);
+        m_has_spectrum_pending = true;
+        lock.unlock();
+        m_wake.notify_one();
+}
+
+uint64_t LivePlot::get_no_of_frames() const
+{
+        return m_no_of_frames.load(std::memory_order_relaxed);
+}
+
+uint64_t LivePlot::get_no_of_dropped() const
+{
+        return m_no_of_dropped.load(std::memory_order_relaxed);
+}
+
+void LivePlot::plot_loop()
+{
+        while (true) {
+                {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_wake.wait(lock, [this] {
+                                        return m_stop || m_has_pending ||
+                                                m_has_spectrum_pending;
+                                });
+                        if (m_stop) {
+                                return;
+                        }
+                        // The latest of each, the other one is redrawn
+                        if (m_has_pending) {
+                                std::swap(m_plot, m_pending);
+                                m_has_pending = false;
+                        }
+                        if (m_has_spectrum_pending) {
+                                std::swap(m_spectrum_plot,
+                                          m_spectrum_pending);
+                                m_has_spectrum_pending = false;
+                        }
+                }
+                // Blocks while gnuplot is behind, push drops meanwhile
+                if (!write_frame(m_plot, m_spectrum_plot)) {
+                        m_failed = true;
+                        std::cout << "plot: Could not write to gnuplot,"
+                                  << " live plot stopped" << std::endl;
+                        return;
+                }
+                m_no_of_frames.fetch_add(1, std::memory_order_relaxed);
+        }
+}
+
+bool LivePlot::write_frame(const LivePlotFrame &frame,
+                           const LiveSpectrumFrame &spectrum)
+{
+        std::fprintf(m_pipe, "set multiplot layout %d,1\n"
+                     "set xlabel \"sample\"\n",
+                     m_spectrum ? 3 : 2);
+        if (frame.no_of_corr_bins > 0) {
+                std::fprintf(m_pipe,
+                             "set title \"Correlation, frame %llu\"\n"
+                             "plot '-' using 1:2:3 with filledcurves"
+                             " notitle\n",
+                             (unsigned long long)frame.frame_no);
+                for (size_t bin=0; bin<frame.no_of_corr_bins; bin++) {
+                        std::fprintf(m_pipe, "%zu %g %g\n",
+                                     bin * frame.corr_length /
+                                     frame.no_of_corr_bins,
+                                     frame.corr_min[bin],
+                                     frame.corr_max[bin]);
+                }
+                std::fprintf(m_pipe, "e\n"
+                             "set title \"RX magnitude\"\n"
+                             "plot '-' using 1:2:3 with filledcurves"
+                             " notitle\n");
+                for (size_t bin=0; bin<frame.no_of_mag_bins; bin++) {
+                        std::fprintf(m_pipe, "%zu %g %g\n",
+                                     bin * frame.no_of_samples /
+                                     frame.no_of_mag_bins,
+                                     frame.mag_min[bin],
+                                     frame.mag_max[bin]);
+                }
+                std::fprintf(m_pipe, "e\n");
+        }
+        if (spectrum.no_of_bins > 0) {
+                std::fprintf(m_pipe,
+                             "set title \"PSD [dBFS/Hz], frame %llu\"\n"
+                             "set xlabel \"MHz\"\n"
+                             "plot '-' using 1:2:3 with filledcurves"
+                             " notitle%s\n",
+                             (unsigned long long)spectrum.frame_no,
+                             spectrum.has_max_hold ?
+                             ", '-' using 1:2 with lines title"
+                             " \"max hold\"" : "");
+                for (size_t bin=0; bin<spectrum.no_of_bins; bin++) {
+                        std::fprintf(m_pipe, "%g %g %g\n",
+                                     (spectrum.start_hz +
+                                      bin * spectrum.no_of_psd_bins /
+                                      spectrum.no_of_bins *
+                                      spectrum.bin_hz) / 1e6,
+                                     spectrum.psd_min[bin],
+                                     spectrum.psd_max[bin]);
+                }
+                std::fprintf(m_pipe, "e\n");
+                for (size_t bin=0; spectrum.has_max_hold &&
+                             (bin<spectrum.no_of_bins); bin++) {
+                        std::fprintf(m_pipe, "%g %g\n",
+                                     (spectrum.start_hz +
+                                      bin * spectrum.no_of_psd_bins /
+                                      spectrum.no_of_bins *
+                                      spectrum.bin_hz) / 1e6,
+                                     spectrum.hold_max[bin]);
+                }
+                if (spectrum.has_max_hold) {
+                        std::fprintf(m_pipe, "e\n");
+                }
+        }
+        std::fprintf(m_pipe, "unset multiplot\n");
+        return (std::fflush(m_pipe) == 0) && !std::ferror(m_pipe);
+}
@@ -0,0 +1,353 @@
+/**
+ * \file logger.cpp
+ *
+ * \brief Asynchronous logging from the streaming loops
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "logger.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+Logger g_logger;
+
+static thread_local LogRing *t_ring = nullptr;
+static thread_local bool t_no_ring = false;
+
+static int64_t monotonic_ns()
+{
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const size_t LogRecord::max_no_of_args;
+const size_t LogRecord::max_text_length;
+const size_t LogRing::no_of_records;
+const size_t Logger::max_no_of_rings;
+
+LogRing::LogRing()
+        : m_records(new LogRecord[no_of_records]),
+          m_head(0),
+          m_tail(0)
+{}
+
+LogRecord *LogRing::get_fill_record()
+{
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= no_of_records) {
+                return nullptr;
+        }
+        return &m_records[head % no_of_records];
+}
+
+void LogRing::push()
+{
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+}
+
+const LogRecord *LogRing::front() const
+{
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+                return nullptr;
+        }
+        return &m_records[tail % no_of_records];
+}
+
+void LogRing::pop()
+{
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+}
+
+Logger::Logger()
+        : m_level(SOAPY_SDR_INFO),
+          m_running(false),
+          m_stop(false),
+          m_no_of_dropped(0),
+          m_no_of_rings(0)
+{
+        for (size_t n=0; n<max_no_of_rings; n++) {
+                m_ring_ptrs[n].store(nullptr, std::memory_order_relaxed);
+        }
+}
+
+Logger::~Logger()
+{
+        stop();
+}
+
+void Logger::start()
+{
+        if (m_running) {
+                return;
+        }
+        m_stop = false;
+        m_no_of_dropped = 0;
+        m_thread = std::thread(&Logger::logger_loop, this);
+        m_running = true;
+}
+
+void Logger::stop()
+{
+        if (!m_running) {
+                return;
+        }
+        m_stop = true;
+        m_thread.join();
+        m_running = false;
+        // Whatever was pushed while the logger thread finished
+        std::string out;
+        while (drain(out) > 0) {
+                std::cout << out << std::flush;
+                out.clear();
+        }
+        uint64_t no_of_dropped = m_no_of_dropped.load();
+        if (no_of_dropped > 0) {
+                std::cout << "log: " << no_of_dropped
+                          << " messages dropped, log rings full"
+                          << std::endl;
+        }
+}
+
+void Logger::set_level(SoapySDRLogLevel level)
+{
+        m_level.store(level, std::memory_order_relaxed);
+}
+
+SoapySDRLogLevel Logger::get_level() const
+{
+        return (SoapySDRLogLevel)m_level.load(std::memory_order_relaxed);
+}
+
+void Logger::register_thread()
+{
+        get_ring();
+}
+
+void Logger::log_text(SoapySDRLogLevel level, const char *format,
+                      const char *text)
+{
+        if (!is_enabled(level)) {
+                return;
+        }
+        write(level, format, nullptr, 0, text, false);
+}
+
+void Logger::write_raw(SoapySDRLogLevel level, const char *text)
+{
+        if (!is_enabled(level)) {
+                return;
+        }
+        write(level, text, nullptr, 0, nullptr, true);
+}
+
+void Logger::flush()
+{
+        if (!m_running) {
+                return;
+        }
+        while (!is_drained()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // The logger thread writes a drained batch under the lock
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+}
+
+uint64_t Logger::get_no_of_dropped() const
+{
+        return m_no_of_dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::write(SoapySDRLogLevel level, const char *format,
+                   const LogArg *args, size_t no_of_args, const char *text,
+                   bool raw)
+{
+        LogRecord local;
+        LogRing *ring = m_running.load(std::memory_order_acquire) ?
+                get_ring() : nullptr;
+        LogRecord *record = &local;
+        if (ring != nullptr) {
+                record = ring->get_fill_record();
+                if (record == nullptr) {
+                        m_no_of_dropped.fetch_add(
+                                1, std::memory_order_relaxed);
+                        return;
+                }
+        }
+        record->format = format;
+        record->time_ns = monotonic_ns();
+        record->level = level;
+        record->no_of_args = no_of_args;
+        record->raw = raw;
+        for (size_t n=0; n<no_of_args; n++) {
+                record->args[n] = args[n];
+        }
+        record->has_text = (text != nullptr);
+        if (record->has_text) {
+                std::strncpy(record->text, text,
+                             LogRecord::max_text_length - 1);
+                record->text[LogRecord::max_text_length - 1] = '\0';
+        }
+        if (ring != nullptr) {
+                ring->push();
+                return;
+        }
+        std::string out;
+        format_log_record(*record, out);
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        std::cout << out << std::flush;
+}
+
+LogRing *Logger::get_ring()
+{
+        if ((t_ring != nullptr) || t_no_ring) {
+                return t_ring;
+        }
+        uint32_t ring_ix = m_no_of_rings.fetch_add(1);
+        if (ring_ix >= max_no_of_rings) {
+                t_no_ring = true;
+                return nullptr;
+        }
+        m_rings[ring_ix].reset(new LogRing());
+        t_ring = m_rings[ring_ix].get();
+        m_ring_ptrs[ring_ix].store(t_ring, std::memory_order_release);
+        return t_ring;
+}
+
+void Logger::logger_loop()
+{
+        std::string out;
+        out.reserve(LogRing::no_of_records * 128);
+        while (true) {
+                bool stop = m_stop.load();
+                out.clear();
+                size_t no_of_records(0);
+                {
+                        std::lock_guard<std::mutex> lock(m_write_mutex);
+                        no_of_records = drain(out);
+                        if (no_of_records > 0) {
+                                std::cout << out << std::flush;
+                        }
+                }
+                if (no_of_records > 0) {
+                        continue;
+                } else if (stop) {
+                        return;
+                } else {
+                        std::this_thread::sleep_for(
+                                std::chrono::milliseconds(2));
+                }
+        }
+}
+
+bool Logger::is_drained() const
+{
+        for (size_t n=0; n<max_no_of_rings; n++) {
+                const LogRing *ring = m_ring_ptrs[n].load(
+                        std::memory_order_acquire);
+                if ((ring != nullptr) && (ring->front() != nullptr)) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+size_t Logger::drain(std::string &out)
+{
+        size_t no_of_records(0);
+        // Bounded, so that busy threads do not hold the output back
+        while (no_of_records < LogRing::no_of_records) {
+                // The oldest record of all threads
+                LogRing *oldest_ring(nullptr);
+                const LogRecord *oldest(nullptr);
+                for (size_t n=0; n<max_no_of_rings; n++) {
+                        LogRing *ring = m_ring_ptrs[n].load(
+                                std::memory_order_acquire);
+                        if (ring == nullptr) {
+                                continue;
+                        }
+                        const LogRecord *record = ring->front();
+                        if ((record != nullptr) &&
+                            ((oldest == nullptr) ||
+                             (record->time_ns < oldest->time_ns))) {
+                                oldest = record;
+                                oldest_ring = ring;
+                        }
+                }
+                if (oldest == nullptr) {
+                        return no_of_records;
+                }
+                format_log_record(*oldest, out);
+                oldest_ring->pop();
+                no_of_records++;
+        }
+        return no_of_records;
+}
+
+void format_log_record(const LogRecord &record, std::string &out)
+{
+        if (record.raw) {
+                out += record.format;
+                return;
+        }
+        // No streams, the logger thread should not allocate either
+        char value[32];
+        size_t arg_ix(0);
+        bool text_done(!record.has_text);
+        for (const char *c=record.format; *c != '\0'; c++) {
+                if ((c[0] != '{') || (c[1] != '}')) {
+                        out += *c;
+                        continue;
+                }
+                c++;
+                if (arg_ix < record.no_of_args) {
+                        const LogArg &arg = record.args[arg_ix++];
+                        switch (arg.type) {
+                        case 'i':
+                                std::snprintf(value, sizeof(value), "%lld",
+                                              (long long)arg.i);
+                                out += value;
+                                break;
+                        case 'u':
+                                std::snprintf(value, sizeof(value), "%llu",
+                                              (unsigned long long)arg.u);
+                                out += value;
+                                break;
+                        case 'd':
+                                std::snprintf(value, sizeof(value), "%g",
+                                              arg.d);
+                                out += value;
+                                break;
+                        case 's':
+                                out += arg.s;
+                                break;
+                        default:
+                                break;
+                        }
+                } else if (!text_done) {
+                        out += record.text;
+                        text_done = true;
+                }
+        }
+        out += '\n';
+}
+
+void soapy_log_handler(const SoapySDRLogLevel level, const char *message)
+{
+        static const char *formats[] = {
+                "{}", "[FATAL] {}", "[CRITICAL] {}", "[ERROR] {}",
+                "[WARNING] {}", "[NOTICE] {}", "[INFO] {}", "[DEBUG] {}",
+                "[TRACE] {}", "[SSI] {}"
+        };
+        const char *format = ((level >= SOAPY_SDR_FATAL) &&
+                              (level <= SOAPY_SDR_SSI)) ?
+                formats[level] : formats[0];
+        g_logger.log_text(level, format, message);
+}
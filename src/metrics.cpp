@@ -0,0 +1,378 @@
+/**
+ * \file metrics.cpp
+ *
+ * \brief Counters and latency histograms for monitoring
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <SoapySDR/Errors.hpp>
+
+static MetricsRegistry g_registry;
+RangingMetrics g_metrics(g_registry);
+
+static std::atomic<uint32_t> g_no_of_shards(0);
+static thread_local int32_t t_shard_ix = -1;
+
+static size_t get_shard_ix()
+{
+        if (t_shard_ix < 0) {
+                // Extra threads share the last shard, the adds are atomic
+                t_shard_ix = std::min(g_no_of_shards.fetch_add(1),
+                                      (uint32_t)Histogram::max_no_of_shards -
+                                      1);
+        }
+        return t_shard_ix;
+}
+
+Counter::Counter(std::string name, std::string help)
+        : m_name(name),
+          m_help(help),
+          m_value(0)
+{}
+
+uint64_t Counter::get() const
+{
+        return m_value.load(std::memory_order_relaxed);
+}
+
+std::string Counter::get_name() const
+{
+        return m_name;
+}
+
+std::string Counter::get_help() const
+{
+        return m_help;
+}
+
+uint64_t HistogramSnapshot::quantile(double q) const
+{
+        if (count == 0) {
+                return 0;
+        }
+        uint64_t target = std::max((uint64_t)1,
+                                   (uint64_t)std::ceil(q * count));
+        uint64_t cumulative(0);
+        for (size_t n=0; n<counts.size(); n++) {
+                cumulative += counts[n];
+                if (cumulative >= target) {
+                        return Histogram::bucket_upper(n) - 1;
+                }
+        }
+        return Histogram::bucket_upper(counts.size() - 1) - 1;
+}
+
+uint64_t HistogramSnapshot::count_up_to(uint64_t bound) const
+{
+        // Values are integers, the largest in a bucket is its upper - 1
+        uint64_t cumulative(0);
+        for (size_t n=0; n<counts.size(); n++) {
+                if (Histogram::bucket_upper(n) - 1 > bound) {
+                        break;
+                }
+                cumulative += counts[n];
+        }
+        return cumulative;
+}
+
+const size_t Histogram::sub_bucket_bits;
+const size_t Histogram::max_value_bits;
+const size_t Histogram::no_of_buckets;
+const size_t Histogram::max_no_of_shards;
+
+Histogram::Histogram(std::string name, std::string help, double unit)
+        : m_name(name),
+          m_help(help),
+          m_unit(unit),
+          m_shards(new Shard[max_no_of_shards])
+{
+        for (size_t n=0; n<max_no_of_shards; n++) {
+                for (size_t m=0; m<no_of_buckets; m++) {
+                        m_shards[n].counts[m].store(
+                                0, std::memory_order_relaxed);
+                }
+                m_shards[n].sum.store(0, std::memory_order_relaxed);
+        }
+}
+
+void Histogram::record(int64_t value)
+{
+        Shard &shard = m_shards[get_shard_ix()];
+        size_t bucket = bucket_index(value < 0 ? 0 : value);
+        shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+HistogramSnapshot Histogram::snapshot() const
+{
+        HistogramSnapshot snapshot;
+        snapshot.counts.assign(no_of_buckets, 0);
+        snapshot.count = 0;
+        snapshot.sum = 0;
+        for (size_t n=0; n<max_no_of_shards; n++) {
+                for (size_t m=0; m<no_of_buckets; m++) {
+                        uint64_t count = m_shards[n].counts[m].load(
+                                std::memory_order_relaxed);
+                        snapshot.counts[m] += count;
+                        snapshot.count += count;
+                }
+                snapshot.sum += m_shards[n].sum.load(
+                        std::memory_order_relaxed);
+        }
+        return snapshot;
+}
+
+std::string Histogram::get_name() const
+{
+        return m_name;
+}
+
+std::string Histogram::get_help() const
+{
+        return m_help;
+}
+
+double Histogram::get_unit() const
+{
+        return m_unit;
+}
+
+size_t Histogram::bucket_index(uint64_t value)
+{
+        const uint64_t sub_buckets = 1 << sub_bucket_bits;
+        if (value < sub_buckets) {
+                return value;
+        }
+        // The top sub_bucket_bits bits of the value select the bucket
+        size_t msb = 63 - __builtin_clzll(value);
+        size_t shift = msb - sub_bucket_bits + 1;
+        size_t bucket = shift * (sub_buckets / 2) + (value >> shift);
+        return std::min(bucket, no_of_buckets - 1);
+}
+
+uint64_t Histogram::bucket_upper(size_t bucket)
+{
+        const size_t sub_buckets = 1 << sub_bucket_bits;
+        if (bucket < sub_buckets) {
+                return bucket + 1;
+        }
+        size_t shift = bucket / (sub_buckets / 2) - 1;
+        uint64_t top = bucket % (sub_buckets / 2) + sub_buckets / 2;
+        return (top + 1) << shift;
+}
+
+MetricsRegistry::MetricsRegistry()
+{}
+
+Counter &MetricsRegistry::add_counter(std::string name, std::string help)
+{
+        m_counters.push_back(std::unique_ptr<Counter>(
+                                     new Counter(name, help)));
+        return *m_counters.back();
+}
+
+Histogram &MetricsRegistry::add_histogram(std::string name, std::string help,
+                                          double unit)
+{
+        m_histograms.push_back(std::unique_ptr<Histogram>(
+                                       new Histogram(name, help, unit)));
+        return *m_histograms.back();
+}
+
+void MetricsRegistry::write(std::ostream &out) const
+{
+        out << std::setprecision(9);
+        for (size_t n=0; n<m_counters.size(); n++) {
+                const Counter &counter = *m_counters[n];
+                out << "# HELP " << counter.get_name() << " "
+                    << counter.get_help() << "\n";
+                out << "# TYPE " << counter.get_name() << " counter\n";
+                out << counter.get_name() << " " << counter.get() << "\n";
+        }
+        const double quantiles[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+        for (size_t n=0; n<m_histograms.size(); n++) {
+                const Histogram &histogram = *m_histograms[n];
+                const std::string name = histogram.get_name();
+                const double unit = histogram.get_unit();
+                HistogramSnapshot snapshot = histogram.snapshot();
+                out << "# HELP " << name << " " << histogram.get_help()
+                    << "\n";
+                out << "# TYPE " << name << " histogram\n";
+                /* Powers of two are bucket boundaries at all sizes, the
+                 * largest value below each is an exact le.
+                 */
+                for (size_t k=0; k<=Histogram::max_value_bits; k++) {
+                        uint64_t bound = ((uint64_t)1 << k) - 1;
+                        out << name << "_bucket{le=\"" << bound * unit
+                            << "\"} " << snapshot.count_up_to(bound) << "\n";
+                }
+                out << name << "_bucket{le=\"+Inf\"} " << snapshot.count
+                    << "\n";
+                out << name << "_sum " << snapshot.sum * unit << "\n";
+                out << name << "_count " << snapshot.count << "\n";
+                out << "# HELP " << name << "_quantile "
+                    << histogram.get_help() << ", largest value of the bucket\n";
+                out << "# TYPE " << name << "_quantile gauge\n";
+                for (double q : quantiles) {
+                        out << name << "_quantile{quantile=\"" << q
+                            << "\"} " << snapshot.quantile(q) * unit
+                            << "\n";
+                }
+        }
+}
+
+void MetricsRegistry::write_textfile(std::string filename) const
+{
+        std::string tmp_filename = filename + ".tmp";
+        {
+                std::ofstream file(tmp_filename);
+                if (!file) {
+                        throw std::runtime_error("Could not open " +
+                                                 tmp_filename);
+                }
+                write(file);
+                if (!file) {
+                        throw std::runtime_error("Could not write " +
+                                                 tmp_filename);
+                }
+        }
+        if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+                throw std::runtime_error("Could not rename " +
+                                         tmp_filename);
+        }
+}
+
+RangingMetrics::RangingMetrics(MetricsRegistry &registry)
+        : registry(registry),
+          overflows(registry.add_counter(
+                            "limesdr_overflows_total",
+                            "Stream overflows, samples were lost")),
+          underflows(registry.add_counter(
+                             "limesdr_underflows_total",
+                             "Stream underflows, a burst was not sent in"
+                             " time")),
+          timeouts(registry.add_counter(
+                           "limesdr_timeouts_total",
+                           "Stream calls that timed out")),
+          found_pings(registry.add_counter(
+                              "limesdr_found_pings_total",
+                              "PINGs detected by the tag")),
+          missed_pings(registry.add_counter(
+                               "limesdr_missed_pings_total",
+                               "PINGs the tag looked for but missed")),
+          found_pongs(registry.add_counter(
+                              "limesdr_found_pongs_total",
+                              "PONGs detected by the beacon, all tags")),
+          missed_pongs(registry.add_counter(
+                               "limesdr_missed_pongs_total",
+                               "PONGs the beacon looked for but missed,"
+                               " all tags")),
+          resyncs(registry.add_counter(
+                          "limesdr_resyncs_total",
+                          "Initial syncs restarted after missed PINGs")),
+          late_bursts(registry.add_counter(
+                              "limesdr_late_bursts_total",
+                              "Bursts submitted after their burst time")),
+          detection_latency(registry.add_histogram(
+                                    "limesdr_detection_latency_seconds",
+                                    "hw time from a detected burst to the"
+                                    " end of its detection", 1e-9)),
+          tx_slack(registry.add_histogram(
+                           "limesdr_tx_slack_seconds",
+                           "Burst time minus hw time when the burst is"
+                           " submitted, late bursts in the first bucket",
+                           1e-9)),
+          peak_to_threshold(registry.add_histogram(
+                                    "limesdr_peak_to_threshold_ratio",
+                                    "Correlation peak over the detection"
+                                    " threshold of detected bursts", 1e-3))
+{}
+
+void count_stream_error(int ret)
+{
+        switch (ret) {
+        case SOAPY_SDR_OVERFLOW:
+                g_metrics.overflows.add();
+                break;
+        case SOAPY_SDR_UNDERFLOW:
+                g_metrics.underflows.add();
+                break;
+        case SOAPY_SDR_TIMEOUT:
+                g_metrics.timeouts.add();
+                break;
+        default:
+                break;
+        }
+}
+
+void record_tx_slack(int64_t slack_ns)
+{
+        g_metrics.tx_slack.record(slack_ns);
+        if (slack_ns < 0) {
+                g_metrics.late_bursts.add();
+        }
+}
+
+MetricsWriter::MetricsWriter(const MetricsRegistry &registry,
+                             std::string filename, double period)
+        : m_registry(registry),
+          m_filename(filename),
+          m_period(period),
+          m_stop(false)
+{
+        if (m_filename == "") {
+                return;
+        }
+        std::cout << "metrics: Writing " << m_filename << " every "
+                  << m_period << " s" << std::endl;
+        m_thread = std::thread(&MetricsWriter::writer_loop, this);
+}
+
+MetricsWriter::~MetricsWriter()
+{
+        if (!m_thread.joinable()) {
+                return;
+        }
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+}
+
+void MetricsWriter::writer_loop()
+{
+        const auto period = std::chrono::duration_cast<
+                std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(m_period));
+        auto next = std::chrono::steady_clock::now() + period;
+        bool stop(false);
+        while (!stop) {
+                {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_wake.wait_until(lock, next,
+                                          [this] { return m_stop; });
+                        stop = m_stop;
+                }
+                next += period;
+                try {
+                        m_registry.write_textfile(m_filename);
+                }
+                catch (std::runtime_error &e) {
+                        std::cout << "metrics: " << e.what() << std::endl;
+                }
+        }
+}
@@ -0,0 +1,116 @@
+/**
+ * \file pong_scheduler.cpp
+ *
+ * \brief Scheduling of the PONGs of the tag
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "pong_scheduler.h"
+#include "tdma.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+PongScheduler::PongScheduler()
+        : m_base(0),
+          m_max_periods(0),
+          m_periods(0),
+          m_latency_mean(0),
+          m_latency_variance(0),
+          m_latency(0),
+          m_slack(0),
+          m_min_slack(std::numeric_limits<double>::max()),
+          m_slack_sum(0),
+          m_no_of_pongs(0),
+          m_no_of_late(0)
+{}
+
+void PongScheduler::configure(const SDR_Device_Config &dev_cfg)
+{
+        m_dev_cfg = dev_cfg;
+        const double period = m_dev_cfg.burst_period;
+        double turnaround = m_dev_cfg.pong_delay +
+                m_dev_cfg.pong_delay_processing +
+                slot_offset(m_dev_cfg, m_dev_cfg.tag_slot);
+        m_base = std::fmod(turnaround, period);
+        m_max_periods = std::llround((turnaround - m_base) / period);
+        m_periods = m_max_periods;
+        m_latency_mean = 0;
+        m_latency_variance = 0;
+        m_latency = 0;
+        m_slack = 0;
+        m_min_slack = std::numeric_limits<double>::max();
+        m_slack_sum = 0;
+        m_no_of_pongs = 0;
+        m_no_of_late = 0;
+}
+
+double PongScheduler::schedule(int64_t ping_hw_ns, int64_t now_hw_ns)
+{
+        const double period = m_dev_cfg.burst_period;
+        double latency = (now_hw_ns - ping_hw_ns) * 1e-9;
+        m_latency = latency;
+        if (m_no_of_pongs == 0) {
+                m_latency_mean = latency;
+        }
+        double error = latency - m_latency_mean;
+        m_latency_mean += m_dev_cfg.pong_latency_forget * error;
+        m_latency_variance += m_dev_cfg.pong_latency_forget *
+                (error * error - m_latency_variance);
+        if (m_dev_cfg.pong_low_latency) {
+                // Covers both the typical and this latency
+                double needed = std::max(latency, m_latency_mean +
+                                         m_dev_cfg.pong_latency_sigmas *
+                                         std::sqrt(m_latency_variance));
+                needed += m_dev_cfg.pong_min_slack;
+                int64_t periods = std::ceil((needed - m_base) / period);
+                m_periods = std::max((int64_t)0,
+                                     std::min(m_max_periods, periods));
+        }
+        double turnaround = m_base + m_periods * period;
+        m_slack = turnaround - latency;
+        m_min_slack = std::min(m_min_slack, m_slack);
+        m_slack_sum += m_slack;
+        m_no_of_pongs++;
+        if (m_slack < 0) {
+                m_no_of_late++;
+        }
+        return turnaround;
+}
+
+double PongScheduler::get_slack() const
+{
+        return m_slack;
+}
+
+double PongScheduler::get_latency() const
+{
+        return m_latency;
+}
+
+int64_t PongScheduler::get_no_of_periods() const
+{
+        return m_periods;
+}
+
+void PongScheduler::print_stats() const
+{
+        if (m_no_of_pongs == 0) {
+                return;
+        }
+        std::cout << "pong: Turnaround "
+                  << (m_base + m_periods * m_dev_cfg.burst_period) * 1e3
+                  << " ms (" << m_periods << " of max " << m_max_periods
+                  << " extra periods), detection latency "
+                  << m_latency_mean * 1e3 << " +- "
+                  << std::sqrt(m_latency_variance) * 1e3
+                  << " ms" << std::endl;
+        std::cout << "pong: Slack min " << m_min_slack * 1e3
+                  << " ms, mean " << m_slack_sum / m_no_of_pongs * 1e3
+                  << " ms, " << m_no_of_late << " late of "
+                  << m_no_of_pongs << " PONGs" << std::endl;
+}
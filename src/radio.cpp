@@ -0,0 +1,156 @@
+/**
+ * \file radio.cpp
+ *
+ * \brief Radio base class
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "radio.h"
+#include "logger.h"
+
+#include <chrono>
+
+Radio::Radio()
+        : m_last_rx_record_ix(0)
+{}
+
+void Radio::configure_timeline()
+{
+        m_timeline.configure(m_dev_cfg.sampling_rate_rx,
+                             m_dev_cfg.rx_timeline_blocks);
+}
+
+void Radio::store_rx_block(const std::complex<int16_t> *data,
+                           int32_t no_of_samples,
+                           int64_t time_hw_ns,
+                           int flags)
+{
+        int64_t lost_samples = m_timeline.get_no_of_lost_samples();
+        bool gap = m_timeline.add_block(time_hw_ns, no_of_samples, flags);
+        if (gap) {
+                g_logger.log(SOAPY_SDR_WARNING,
+                             "radio: RX gap before hw time {}, {} samples lost",
+                             time_hw_ns,
+                             m_timeline.get_no_of_lost_samples() -
+                             lost_samples);
+        }
+        record_rx_block(data, no_of_samples, time_hw_ns, gap);
+}
+
+void Radio::store_rx_window(const std::complex<int16_t> *data,
+                            int32_t no_of_samples,
+                            int64_t time_hw_ns)
+{
+        m_timeline.add_window(time_hw_ns, no_of_samples);
+        record_rx_block(data, no_of_samples, time_hw_ns, true);
+}
+
+void Radio::record_rx_block(const std::complex<int16_t> *data,
+                            int32_t no_of_samples,
+                            int64_t time_hw_ns,
+                            bool new_capture)
+{
+        if (m_recorder && (no_of_samples > 0)) {
+                m_last_rx_record_ix = m_recorder->get_sample_count();
+                if ((m_last_rx_record_ix == 0) || new_capture) {
+                        m_recorder->add_capture(m_last_rx_record_ix,
+                                                time_hw_ns);
+                }
+                m_recorder->write(data, no_of_samples);
+        }
+}
+
+void Radio::start_recording(double sample_rate, double frequency,
+                            double rx_gain, double tx_gain,
+                            std::string hw)
+{
+        m_recorder = std::make_shared<SigMFWriter>(
+                m_dev_cfg.record_basename,
+                m_dev_cfg.record_buffer_samples);
+        m_recorder->set_meta(sample_rate, frequency, rx_gain, tx_gain, hw);
+        std::cout << "radio: Recording RX samples to "
+                  << m_dev_cfg.record_basename << ".sigmf-data"
+                  << std::endl;
+}
+
+void Radio::close_recording()
+{
+        if (m_recorder) {
+                m_recorder->close();
+        }
+}
+
+void Radio::annotate(int64_t ix, std::string label)
+{
+        if (m_recorder) {
+                m_recorder->annotate(m_last_rx_record_ix + ix,
+                                     m_dev_cfg.tx_burst_length,
+                                     label);
+        }
+}
+
+bool Radio::rx_discontinuity()
+{
+        return m_timeline.last_block_discontinuous();
+}
+
+const RxTimeline &Radio::get_rx_timeline()
+{
+        return m_timeline;
+}
+
+int64_t Radio::ix_to_hw_ns(int64_t ix)
+{
+        return m_timeline.ix_to_hw_ns(m_timeline.last_block().seq, ix);
+}
+
+RxPosition Radio::locate(double time_hw_ns)
+{
+        return m_timeline.locate(time_hw_ns);
+}
+
+int64_t Radio::find_exp_pong_pos_ix(int64_t hw_time_of_sync)
+{
+        int64_t expected_pong_pos_ix = find_exp_ping_pos_ix(hw_time_of_sync);
+        expected_pong_pos_ix += m_dev_cfg.pong_pos_comp;
+        if (expected_pong_pos_ix >= (int64_t)m_dev_cfg.no_of_rx_samples_pong) {
+                expected_pong_pos_ix -= m_dev_cfg.no_of_rx_samples_pong;
+        }
+        return expected_pong_pos_ix;
+}
+
+int64_t Radio::find_exp_ping_pos_ix(int64_t hw_time_of_sync)
+{
+        int64_t burst_period_ns = m_dev_cfg.burst_period * 1e9;
+        return m_timeline.next_periodic_ix(hw_time_of_sync, burst_period_ns);
+}
+
+SimClock::SimClock()
+        : m_now_hw_ns(0)
+{}
+
+void SimClock::set(int64_t time_hw_ns)
+{
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_now_hw_ns = time_hw_ns;
+        }
+        m_cond.notify_all();
+}
+
+int64_t SimClock::now()
+{
+        return m_now_hw_ns;
+}
+
+bool SimClock::wait_until(int64_t time_hw_ns, double timeout)
+{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_cond.wait_for(
+                lock,
+                std::chrono::microseconds((int64_t)(timeout * 1e6)),
+                [this, time_hw_ns]{ return m_now_hw_ns >= time_hw_ns; });
+}
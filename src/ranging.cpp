@@ -0,0 +1,132 @@
+/**
+ * \file ranging.cpp
+ *
+ * \brief Range estimation from PING and PONG times
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "ranging.h"
+#include "tdma.h"
+
+#include <cmath>
+
+static const double speed_of_light = 299792458.0; // [m/s]
+
+double calculate_tof(const SDR_Device_Config &dev_cfg,
+                     int64_t ping_tx_hw_ns, int64_t pong_rx_hw_ns,
+                     uint32_t slot)
+{
+        const double burst_period_ns = dev_cfg.burst_period * 1e9;
+        double rtt_ns = std::fmod((double)(pong_rx_hw_ns - ping_tx_hw_ns),
+                                  burst_period_ns);
+        double turnaround_ns = (dev_cfg.pong_delay +
+                                dev_cfg.pong_delay_processing +
+                                slot_offset(dev_cfg, slot) +
+                                dev_cfg.range_hw_delay) * 1e9;
+        // What is left is small, but can end up on either side of zero
+        double tof_ns = std::remainder(rtt_ns - turnaround_ns,
+                                       burst_period_ns) / 2;
+        return tof_ns * 1e-9;
+}
+
+RangeTracker::RangeTracker()
+        : m_slot(0),
+          m_no_of_consecutive_outliers(0),
+          m_no_of_outliers(0)
+{
+        m_P[0][0] = m_P[0][1] = m_P[1][0] = m_P[1][1] = 0;
+}
+
+void RangeTracker::configure(const SDR_Device_Config &dev_cfg,
+                             uint32_t slot)
+{
+        m_dev_cfg = dev_cfg;
+        m_slot = slot;
+        m_estimate = RangeEstimate();
+        m_P[0][0] = m_P[0][1] = m_P[1][0] = m_P[1][1] = 0;
+        m_no_of_consecutive_outliers = 0;
+        m_no_of_outliers = 0;
+}
+
+const RangeEstimate &RangeTracker::update(int64_t ping_tx_hw_ns,
+                                          int64_t pong_rx_hw_ns)
+{
+        double measured_range = speed_of_light *
+                calculate_tof(m_dev_cfg, ping_tx_hw_ns, pong_rx_hw_ns,
+                              m_slot);
+        m_estimate.measured_range = measured_range;
+        if (!m_estimate.valid) {
+                restart(measured_range, pong_rx_hw_ns);
+                return m_estimate;
+        }
+        // Predict
+        double dt = (pong_rx_hw_ns - m_estimate.time_hw_ns) * 1e-9;
+        const double q = m_dev_cfg.range_accel_noise;
+        m_estimate.range += m_estimate.range_rate * dt;
+        double P00 = m_P[0][0] + dt * (m_P[1][0] + m_P[0][1]) +
+                dt * dt * m_P[1][1] + q * dt * dt * dt / 3;
+        double P01 = m_P[0][1] + dt * m_P[1][1] + q * dt * dt / 2;
+        double P10 = m_P[1][0] + dt * m_P[1][1] + q * dt * dt / 2;
+        double P11 = m_P[1][1] + q * dt;
+        m_P[0][0] = P00;
+        m_P[0][1] = P01;
+        m_P[1][0] = P10;
+        m_P[1][1] = P11;
+        m_estimate.time_hw_ns = pong_rx_hw_ns;
+        // Gate
+        const double R = m_dev_cfg.range_meas_std * m_dev_cfg.range_meas_std;
+        double innovation = measured_range - m_estimate.range;
+        double S = m_P[0][0] + R;
+        m_estimate.outlier =
+                (innovation * innovation / S > m_dev_cfg.range_outlier_gate);
+        if (m_estimate.outlier) {
+                m_no_of_outliers++;
+                m_no_of_consecutive_outliers++;
+                if (m_no_of_consecutive_outliers >
+                    m_dev_cfg.range_max_outliers) {
+                        restart(measured_range, pong_rx_hw_ns);
+                }
+                m_estimate.range_std = std::sqrt(m_P[0][0]);
+                return m_estimate;
+        }
+        m_no_of_consecutive_outliers = 0;
+        // Update
+        double K0 = m_P[0][0] / S;
+        double K1 = m_P[1][0] / S;
+        m_estimate.range += K0 * innovation;
+        m_estimate.range_rate += K1 * innovation;
+        m_P[1][0] -= K1 * m_P[0][0];
+        m_P[1][1] -= K1 * m_P[0][1];
+        m_P[0][0] -= K0 * m_P[0][0];
+        m_P[0][1] -= K0 * m_P[0][1];
+        m_estimate.range_std = std::sqrt(m_P[0][0]);
+        return m_estimate;
+}
+
+void RangeTracker::restart(double range, int64_t time_hw_ns)
+{
+        m_estimate.time_hw_ns = time_hw_ns;
+        m_estimate.range = range;
+        m_estimate.range_rate = 0;
+        m_estimate.outlier = false;
+        m_estimate.valid = true;
+        m_P[0][0] = m_dev_cfg.range_meas_std * m_dev_cfg.range_meas_std;
+        m_P[0][1] = 0;
+        m_P[1][0] = 0;
+        m_P[1][1] = m_dev_cfg.range_speed_std * m_dev_cfg.range_speed_std;
+        m_estimate.range_std = m_dev_cfg.range_meas_std;
+        m_no_of_consecutive_outliers = 0;
+}
+
+const RangeEstimate &RangeTracker::get_estimate() const
+{
+        return m_estimate;
+}
+
+uint64_t RangeTracker::get_no_of_outliers() const
+{
+        return m_no_of_outliers;
+}
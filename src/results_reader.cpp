@@ -0,0 +1,189 @@
+/**
+ * \file results_reader.cpp
+ *
+ * \brief Reader of the ranging results ring
+ *
+ * Prints the records that a beacon or tag started with --results
+ * publishes, or measures the throughput of the ring.
+ * Run from the commandline with -h for a list of options.
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "results_reader.h"
+
+static std::atomic<bool> g_stop(false);
+void sigIntHandler(const int)
+{
+        g_stop = true;
+}
+
+int main(int argc, char** argv)
+{
+        try {
+                bool enable_version_and_help(true);
+                TCLAP::CmdLine cmd("Ranging results reader",
+                                   ' ',
+                                   PACKAGE_STRING,
+                                   enable_version_and_help);
+                TCLAP::ValueArg<std::string> name_arg(
+                        "n", "name", "POSIX shm name of the results ring",
+                        false, "/ranging", "name");
+                cmd.add(name_arg);
+                TCLAP::ValueArg<double> throughput_arg(
+                        "", "throughput",
+                        "Publish and read records for <seconds> in this"
+                        " process and report the throughput",
+                        false, 0, "seconds");
+                cmd.add(throughput_arg);
+                TCLAP::ValueArg<double> rate_arg(
+                        "", "rate",
+                        "Records per second of the throughput test",
+                        false, 100000, "records/s");
+                cmd.add(rate_arg);
+                TCLAP::ValueArg<size_t> slots_arg(
+                        "", "slots",
+                        "Records in the ring of the throughput test",
+                        false, SDR_Device_Config().results_ring_size,
+                        "records");
+                cmd.add(slots_arg);
+                cmd.parse(argc, argv);
+                signal(SIGINT, sigIntHandler);
+                if (throughput_arg.getValue() > 0) {
+                        if (!run_throughput_test(name_arg.getValue(),
+                                                 throughput_arg.getValue(),
+                                                 rate_arg.getValue(),
+                                                 slots_arg.getValue())) {
+                                return EXIT_FAILURE;
+                        }
+                } else {
+                        follow_results(name_arg.getValue());
+                }
+        }
+        catch (TCLAP::ArgException &e) {
+                std::cerr << "error: " << e.error()
+                          << " for arg " << e.argId() << std::endl;
+        }
+        catch (std::runtime_error &e) {
+                std::cerr << "error: " << e.what() << std::endl;
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
+
+void follow_results(std::string name)
+{
+        ResultsReader reader(name);
+        RangingRecord record;
+        uint64_t record_no;
+        std::cout << "Reading " << name << ", press Ctrl+C to exit..."
+                  << std::endl;
+        while (not g_stop) {
+                if (!reader.read(record, record_no)) {
+                        usleep(1000);
+                        continue;
+                }
+                print_record(record_no, record);
+        }
+        std::cout << "results: " << reader.get_no_of_lost()
+                  << " records lost" << std::endl;
+}
+
+void print_record(uint64_t record_no, const RangingRecord &record)
+{
+        std::cout << record_no
+                  << ((record.flags & RECORD_PONG) ? " PONG" : " PING")
+                  << " tag " << record.tag_id
+                  << " burst " << record.burst_hw_ns
+                  << " ix " << record.detected_ix
+                  << " " << record.fractional_offset
+                  << " peak " << record.corr_peak
+                  << " snr " << record.snr_db << " dB";
+        if (record.flags & RECORD_RANGED) {
+                std::cout << " range " << record.range
+                          << " m, filtered " << record.range_filtered
+                          << " m";
+                if (record.flags & RECORD_OUTLIER) {
+                        std::cout << " (outlier)";
+                }
+        }
+        std::cout << std::endl;
+}
+
+bool run_throughput_test(std::string name, double duration, double rate,
+                         size_t no_of_slots)
+{
+        typedef std::chrono::steady_clock Clock;
+        ResultsPublisher publisher(name, no_of_slots);
+        ResultsReader reader(name);
+        std::atomic<bool> writer_done(false);
+        int64_t publish_ns(0);
+        uint64_t no_of_written(0);
+
+        // Paced writer, records are released in 1 ms batches
+        std::thread writer([&]() {
+                const Clock::time_point start = Clock::now();
+                RangingRecord record = make_ranging_record(
+                        RECORD_PONG | RECORD_RANGED, 0, 0, 1000.25,
+                        1e6, 20);
+                while ((not g_stop) &&
+                       (Clock::now() - start <
+                        std::chrono::duration<double>(duration))) {
+                        double elapsed = std::chrono::duration<double>(
+                                Clock::now() - start).count();
+                        uint64_t target = elapsed * rate;
+                        Clock::time_point batch_start = Clock::now();
+                        for (; no_of_written<target; no_of_written++) {
+                                record.burst_hw_ns = no_of_written;
+                                record.range = no_of_written;
+                                publisher.publish(record);
+                        }
+                        publish_ns += std::chrono::duration_cast<
+                                std::chrono::nanoseconds>(
+                                        Clock::now() - batch_start).count();
+                        std::this_thread::sleep_for(
+                                std::chrono::milliseconds(1));
+                }
+                writer_done = true;
+        });
+
+        uint64_t no_of_read(0);
+        uint64_t no_of_corrupt(0);
+        RangingRecord record;
+        uint64_t record_no;
+        const Clock::time_point start = Clock::now();
+        while (true) {
+                bool done = writer_done;
+                while (reader.read(record, record_no)) {
+                        no_of_read++;
+                        if ((record.burst_hw_ns != (int64_t)record_no) ||
+                            (record.range != record_no)) {
+                                no_of_corrupt++;
+                        }
+                }
+                if (done) {
+                        break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        writer.join();
+        double elapsed = std::chrono::duration<double>(
+                Clock::now() - start).count();
+
+        std::cout << "results: Published " << no_of_written << " records in "
+                  << elapsed << " s, " << no_of_written / elapsed
+                  << " records/s, " << (no_of_written > 0 ?
+                                        publish_ns / no_of_written : 0)
+                  << " ns/record" << std::endl;
+        std::cout << "results: Read " << no_of_read << ", lost "
+                  << reader.get_no_of_lost() << ", corrupt "
+                  << no_of_corrupt << std::endl;
+        bool ok = (no_of_corrupt == 0) &&
+                (no_of_read + reader.get_no_of_lost() == no_of_written) &&
+                (no_of_written / elapsed >= 0.95 * rate);
+        std::cout << "results: Throughput test "
+                  << (ok ? "passed" : "FAILED") << std::endl;
+        return ok;
+}
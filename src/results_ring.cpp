@@ -0,0 +1,211 @@
+/**
+ * \file results_ring.cpp
+ *
+ * \brief Ranging results in a shared memory ring
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "results_ring.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(RangingRecord) % sizeof(uint64_t) == 0,
+              "RangingRecord must be whole words");
+static_assert(sizeof(ResultsRingHeader) == 64,
+              "ResultsRingHeader must be one cache line");
+
+static const size_t no_of_words =
+        sizeof(RangingRecord) / sizeof(uint64_t);
+
+RangingRecord make_ranging_record(uint32_t flags, uint32_t tag_id,
+                                  int64_t burst_hw_ns, double peak_position,
+                                  double corr_peak, double snr_db)
+{
+        RangingRecord record;
+        record.burst_hw_ns = burst_hw_ns;
+        record.detected_ix = std::llround(peak_position);
+        record.fractional_offset = peak_position - record.detected_ix;
+        record.range = NAN;
+        record.range_filtered = NAN;
+        record.corr_peak = corr_peak;
+        record.snr_db = snr_db;
+        record.tag_id = tag_id;
+        record.flags = flags;
+        return record;
+}
+
+ResultsPublisher::ResultsPublisher(std::string name, size_t no_of_slots)
+        : m_name(name),
+          m_bytes(sizeof(ResultsRingHeader) +
+                  no_of_slots * sizeof(ResultsRingSlot)),
+          m_header(nullptr),
+          m_slots(nullptr)
+{
+        if (no_of_slots == 0) {
+                throw std::runtime_error("results: Empty ring");
+        }
+        int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+                throw std::runtime_error("results: shm_open " + m_name +
+                                         " failed: " + strerror(errno));
+        }
+        if (ftruncate(fd, m_bytes) != 0) {
+                ::close(fd);
+                throw std::runtime_error("results: ftruncate failed: " +
+                                         std::string(strerror(errno)));
+        }
+        void *memory = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+                throw std::runtime_error("results: mmap failed: " +
+                                         std::string(strerror(errno)));
+        }
+        std::memset(memory, 0, m_bytes);
+        m_header = new (memory) ResultsRingHeader();
+        m_slots = reinterpret_cast<ResultsRingSlot *>(m_header + 1);
+        for (size_t n=0; n<no_of_slots; n++) {
+                new (&m_slots[n]) ResultsRingSlot();
+                m_slots[n].sequence.store(0, std::memory_order_relaxed);
+        }
+        m_header->no_of_records.store(0, std::memory_order_relaxed);
+        m_header->record_bytes = sizeof(RangingRecord);
+        m_header->no_of_slots = no_of_slots;
+        m_header->version = results_ring_version;
+        // Readers check the magic last
+        std::atomic_thread_fence(std::memory_order_release);
+        m_header->magic = results_ring_magic;
+        std::cout << "results: Publishing to shm " << m_name << ", "
+                  << no_of_slots << " records" << std::endl;
+}
+
+ResultsPublisher::~ResultsPublisher()
+{
+        munmap(m_header, m_bytes);
+        shm_unlink(m_name.c_str());
+}
+
+void ResultsPublisher::publish(const RangingRecord &record)
+{
+        uint64_t n = m_header->no_of_records.load(std::memory_order_relaxed);
+        ResultsRingSlot &slot = m_slots[n % m_header->no_of_slots];
+        uint64_t words[no_of_words];
+        std::memcpy(words, &record, sizeof(record));
+        slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t m=0; m<no_of_words; m++) {
+                slot.words[m].store(words[m], std::memory_order_relaxed);
+        }
+        slot.sequence.store(2 * (n + 1), std::memory_order_release);
+        m_header->no_of_records.store(n + 1, std::memory_order_release);
+}
+
+uint64_t ResultsPublisher::get_no_of_records() const
+{
+        return m_header->no_of_records.load(std::memory_order_relaxed);
+}
+
+ResultsReader::ResultsReader(std::string name)
+        : m_bytes(0),
+          m_header(nullptr),
+          m_slots(nullptr),
+          m_next(0),
+          m_no_of_lost(0)
+{
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+                throw std::runtime_error("results: shm_open " + name +
+                                         " failed: " + strerror(errno));
+        }
+        struct stat shm_stat;
+        if ((fstat(fd, &shm_stat) != 0) ||
+            (shm_stat.st_size < (off_t)sizeof(ResultsRingHeader))) {
+                ::close(fd);
+                throw std::runtime_error("results: " + name +
+                                         " is not a results ring");
+        }
+        m_bytes = shm_stat.st_size;
+        void *memory = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+                throw std::runtime_error("results: mmap failed: " +
+                                         std::string(strerror(errno)));
+        }
+        m_header = static_cast<const ResultsRingHeader *>(memory);
+        bool ok = (m_header->magic == results_ring_magic);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        ok = ok && (m_header->version == results_ring_version) &&
+                (m_header->record_bytes == sizeof(RangingRecord)) &&
+                (m_bytes >= sizeof(ResultsRingHeader) +
+                 m_header->no_of_slots * sizeof(ResultsRingSlot));
+        if (!ok) {
+                munmap(memory, m_bytes);
+                throw std::runtime_error("results: " + name +
+                                         " has an unknown format");
+        }
+        m_slots = reinterpret_cast<const ResultsRingSlot *>(m_header + 1);
+        uint64_t no_of_records =
+                m_header->no_of_records.load(std::memory_order_acquire);
+        if (no_of_records > m_header->no_of_slots) {
+                m_next = no_of_records - m_header->no_of_slots;
+        }
+}
+
+ResultsReader::~ResultsReader()
+{
+        munmap(const_cast<ResultsRingHeader *>(m_header), m_bytes);
+}
+
+bool ResultsReader::read(RangingRecord &record, uint64_t &record_no)
+{
+        const uint64_t no_of_slots = m_header->no_of_slots;
+        while (true) {
+                uint64_t no_of_records = m_header->no_of_records.load(
+                        std::memory_order_acquire);
+                if (m_next >= no_of_records) {
+                        return false;
+                }
+                if (no_of_records - m_next > no_of_slots) {
+                        m_no_of_lost += no_of_records - no_of_slots - m_next;
+                        m_next = no_of_records - no_of_slots;
+                }
+                const ResultsRingSlot &slot = m_slots[m_next % no_of_slots];
+                uint64_t expected = 2 * (m_next + 1);
+                uint64_t sequence =
+                        slot.sequence.load(std::memory_order_acquire);
+                uint64_t words[no_of_words];
+                for (size_t m=0; m<no_of_words; m++) {
+                        words[m] = slot.words[m].load(
+                                std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if ((sequence != expected) ||
+                    (slot.sequence.load(std::memory_order_relaxed) !=
+                     expected)) {
+                        // Overwritten by the writer, a lap ahead
+                        m_no_of_lost++;
+                        m_next++;
+                        continue;
+                }
+                std::memcpy(&record, words, sizeof(record));
+                record_no = m_next;
+                m_next++;
+                return true;
+        }
+}
+
+uint64_t ResultsReader::get_no_of_lost() const
+{
+        return m_no_of_lost;
+}
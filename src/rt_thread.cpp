@@ -0,0 +1,97 @@
+/**
+ * \file rt_thread.cpp
+ *
+ * \brief Real-time configuration of threads
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "rt_thread.h"
+#include "burst_tracer.h"
+#include "logger.h"
+
+#include <alloca.h>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+bool configure_rt_thread(std::string name, int cpu, int priority)
+{
+        bool applied(true);
+        g_tracer.set_thread_name(name);
+        g_logger.register_thread();
+        if (cpu >= 0) {
+                cpu_set_t cpu_set;
+                CPU_ZERO(&cpu_set);
+                CPU_SET(cpu, &cpu_set);
+                int ret = pthread_setaffinity_np(pthread_self(),
+                                                 sizeof(cpu_set), &cpu_set);
+                if (ret == 0) {
+                        std::cout << "rt: " << name
+                                  << " thread pinned to CPU " << cpu
+                                  << std::endl;
+                } else {
+                        std::cout << "rt: Warning, could not pin " << name
+                                  << " thread to CPU " << cpu << ": "
+                                  << std::strerror(ret) << std::endl;
+                        applied = false;
+                }
+        }
+        if (priority > 0) {
+                struct sched_param param;
+                std::memset(&param, 0, sizeof(param));
+                param.sched_priority = priority;
+                int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO,
+                                                &param);
+                if (ret == 0) {
+                        std::cout << "rt: " << name
+                                  << " thread running SCHED_FIFO priority "
+                                  << priority << std::endl;
+                } else {
+                        std::cout << "rt: Warning, could not set SCHED_FIFO"
+                                  << " priority " << priority << " for "
+                                  << name << " thread: "
+                                  << std::strerror(ret) << std::endl;
+                        applied = false;
+                }
+        }
+        return applied;
+}
+
+bool lock_memory()
+{
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+                std::cout << "rt: Warning, could not lock memory: "
+                          << std::strerror(errno) << std::endl;
+                return false;
+        }
+        std::cout << "rt: Memory locked" << std::endl;
+        return true;
+}
+
+void prefault(void *data, size_t bytes)
+{
+        volatile char *bytes_data = static_cast<volatile char *>(data);
+        const size_t page_size = sysconf(_SC_PAGESIZE);
+        for (size_t n=0; n<bytes; n+=page_size) {
+                bytes_data[n] = bytes_data[n];
+        }
+}
+
+void prefault_stack(size_t bytes)
+{
+        const size_t max_bytes = 1 << 20;
+        if (bytes > max_bytes) {
+                bytes = max_bytes;
+        }
+        volatile char *stack = static_cast<volatile char *>(alloca(bytes));
+        const size_t page_size = sysconf(_SC_PAGESIZE);
+        for (size_t n=0; n<bytes; n+=page_size) {
+                stack[n] = 0;
+        }
+}
@@ -0,0 +1,211 @@
+/**
+ * \file rx_pipeline.cpp
+ *
+ * \brief Handoff of RX blocks from a capture thread to a detection thread
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "rx_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+RxPipeline::RxPipeline(size_t block_samples, size_t queue_depth,
+                       bool huge_pages)
+        : m_head(0),
+          m_count(0),
+          m_fill(0),
+          m_closed(false),
+          m_no_of_full_waits(0),
+          m_max_depth(0)
+{
+        if ((block_samples == 0) || (queue_depth == 0)) {
+                throw std::runtime_error(
+                        "pipeline: Empty blocks or queue");
+        }
+        const size_t no_of_buffers = queue_depth + 2;
+        m_pool.reset(new BufferPool(
+                             block_samples * sizeof(std::complex<int16_t>),
+                             no_of_buffers, huge_pages));
+        m_buffers.reserve(no_of_buffers);
+        for (size_t n=0; n<no_of_buffers; n++) {
+                m_buffers.emplace_back(*m_pool, block_samples);
+        }
+        m_queue.resize(queue_depth);
+}
+
+std::complex<int16_t> *RxPipeline::get_fill_buffer()
+{
+        return m_buffers[m_fill].data();
+}
+
+bool RxPipeline::push(int32_t no_of_samples, int64_t time_hw_ns,
+                      bool discontinuity)
+{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_closed && (m_count == m_queue.size())) {
+                m_no_of_full_waits++;
+                m_not_full.wait(lock, [this] {
+                                return m_closed ||
+                                        (m_count < m_queue.size());
+                        });
+        }
+        if (m_closed) {
+                return false;
+        }
+        enqueue(no_of_samples, time_hw_ns, discontinuity);
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+}
+
+bool RxPipeline::try_push(int32_t no_of_samples, int64_t time_hw_ns,
+                          bool discontinuity)
+{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_closed || (m_count == m_queue.size())) {
+                return false;
+        }
+        enqueue(no_of_samples, time_hw_ns, discontinuity);
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+}
+
+void RxPipeline::enqueue(int32_t no_of_samples, int64_t time_hw_ns,
+                         bool discontinuity)
+{
+        PipelineBlock &block = m_queue[(m_head + m_count) % m_queue.size()];
+        block.buffer = m_fill;
+        block.no_of_samples = no_of_samples;
+        block.time_hw_ns = time_hw_ns;
+        block.discontinuity = discontinuity;
+        m_count++;
+        m_max_depth = std::max(m_max_depth, m_count);
+        m_fill = (m_fill + 1) % m_buffers.size();
+}
+
+bool RxPipeline::pop(PipelineBlock &block)
+{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return m_closed || (m_count > 0); });
+        if (m_count == 0) {
+                return false;
+        }
+        block = m_queue[m_head];
+        m_head = (m_head + 1) % m_queue.size();
+        m_count--;
+        lock.unlock();
+        m_not_full.notify_one();
+        return true;
+}
+
+const std::complex<int16_t> *RxPipeline::get_data(const PipelineBlock &block) const
+{
+        return m_buffers[block.buffer].data();
+}
+
+void RxPipeline::close()
+{
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_closed = true;
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+}
+
+uint64_t RxPipeline::get_no_of_full_waits() const
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_no_of_full_waits;
+}
+
+size_t RxPipeline::get_max_depth() const
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_max_depth;
+}
+
+SampleHistory::SampleHistory(size_t capacity, size_t block_samples,
+                             double sampling_rate, bool huge_pages)
+        : m_capacity(capacity),
+          m_sample_ns(1e9 / sampling_rate),
+          m_length(0),
+          m_run_hw_ns(0),
+          m_run_ix(0),
+          m_next_hw_ns(0)
+{
+        // Slack for a few blocks between the moves
+        const size_t buffer_samples = capacity + 4 * block_samples;
+        m_pool.reset(new BufferPool(
+                             buffer_samples * sizeof(std::complex<int16_t>),
+                             1, huge_pages));
+        m_buffer.reset(new PoolBuffer<std::complex<int16_t>>(
+                               *m_pool, buffer_samples));
+}
+
+void SampleHistory::append(const std::complex<int16_t> *data,
+                           size_t no_of_samples, int64_t time_hw_ns,
+                           bool discontinuity)
+{
+        if (no_of_samples > m_buffer->size()) {
+                throw std::runtime_error("pipeline: Block too large");
+        }
+        // Half a sample of jitter is rounding of the hw time
+        if (discontinuity ||
+            (std::llabs(time_hw_ns - m_next_hw_ns) > m_sample_ns / 2)) {
+                clear();
+        }
+        if (m_length == 0) {
+                m_run_hw_ns = time_hw_ns;
+                m_run_ix = 0;
+        }
+        if (m_length + no_of_samples > m_buffer->size()) {
+                size_t keep = std::min(m_length,
+                                       m_capacity - std::min(m_capacity,
+                                                             no_of_samples));
+                size_t drop = m_length - keep;
+                std::memmove(m_buffer->data(),
+                             m_buffer->data() + drop,
+                             keep * sizeof(std::complex<int16_t>));
+                m_run_ix += drop;
+                m_length = keep;
+        }
+        std::memcpy(m_buffer->data() + m_length, data,
+                    no_of_samples * sizeof(std::complex<int16_t>));
+        m_length += no_of_samples;
+        m_next_hw_ns = std::llround(ix_to_hw_ns(m_length));
+}
+
+void SampleHistory::clear()
+{
+        m_length = 0;
+        m_run_ix = 0;
+}
+
+const std::complex<int16_t> *SampleHistory::data() const
+{
+        return m_buffer->data();
+}
+
+size_t SampleHistory::size() const
+{
+        return m_length;
+}
+
+double SampleHistory::ix_to_hw_ns(double ix) const
+{
+        return m_run_hw_ns + (m_run_ix + ix) * m_sample_ns;
+}
+
+double SampleHistory::hw_ns_to_ix(double hw_ns) const
+{
+        return (hw_ns - m_run_hw_ns) / m_sample_ns - m_run_ix;
+}
@@ -0,0 +1,163 @@
+/**
+ * \file rx_timeline.cpp
+ *
+ * \brief RX timeline class
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "rx_timeline.h"
+
+#include <cmath>
+#include <cstdlib>
+
+RxTimeline::RxTimeline()
+        : m_sample_rate(1),
+          m_no_of_blocks(0),
+          m_no_of_samples(0),
+          m_segment_first_sample(0),
+          m_segment_time_hw_ns(0),
+          m_overflow_pending(false),
+          m_no_of_gaps(0),
+          m_no_of_lost_samples(0)
+{
+        m_blocks.resize(1);
+}
+
+void RxTimeline::configure(double sample_rate, size_t capacity)
+{
+        m_sample_rate = sample_rate;
+        m_blocks.clear();
+        m_blocks.resize(capacity > 0 ? capacity : 1);
+        m_no_of_blocks = 0;
+        m_no_of_samples = 0;
+        m_overflow_pending = false;
+        m_no_of_gaps = 0;
+        m_no_of_lost_samples = 0;
+}
+
+bool RxTimeline::add_block(int64_t time_hw_ns, int32_t no_of_samples,
+                           int flags)
+{
+        bool discontinuous(false);
+        if (m_no_of_blocks > 0) {
+                int64_t expected_hw_ns = m_segment_time_hw_ns +
+                        std::llround((m_no_of_samples -
+                                      m_segment_first_sample) *
+                                     1e9 / m_sample_rate);
+                int64_t diff_ns = time_hw_ns - expected_hw_ns;
+                double tolerance_ns = 1e9 / m_sample_rate;
+                discontinuous = std::abs(diff_ns) > tolerance_ns;
+                discontinuous |= m_overflow_pending;
+                discontinuous |= ((flags & SOAPY_SDR_END_ABRUPT) != 0);
+                if (discontinuous) {
+                        m_no_of_gaps++;
+                        if (diff_ns > 0) {
+                                m_no_of_lost_samples += std::llround(
+                                        diff_ns * m_sample_rate / 1e9);
+                        }
+                }
+        }
+        if ((m_no_of_blocks == 0) || discontinuous) {
+                m_segment_first_sample = m_no_of_samples;
+                m_segment_time_hw_ns = time_hw_ns;
+        }
+        push_block(time_hw_ns, no_of_samples, discontinuous);
+        return discontinuous;
+}
+
+void RxTimeline::add_window(int64_t time_hw_ns, int32_t no_of_samples)
+{
+        bool discontinuous = m_overflow_pending;
+        if (discontinuous) {
+                m_no_of_gaps++;
+        }
+        m_segment_first_sample = m_no_of_samples;
+        m_segment_time_hw_ns = time_hw_ns;
+        push_block(time_hw_ns, no_of_samples, discontinuous);
+}
+
+void RxTimeline::push_block(int64_t time_hw_ns, int32_t no_of_samples,
+                            bool discontinuous)
+{
+        RxBlock &block = m_blocks[m_no_of_blocks % m_blocks.size()];
+        block.seq = m_no_of_blocks;
+        block.first_sample = m_no_of_samples;
+        block.time_hw_ns = time_hw_ns;
+        block.no_of_samples = no_of_samples;
+        block.discontinuous = discontinuous;
+        m_no_of_blocks++;
+        m_no_of_samples += no_of_samples;
+        m_overflow_pending = false;
+}
+
+void RxTimeline::note_overflow()
+{
+        m_overflow_pending = true;
+}
+
+const RxBlock &RxTimeline::last_block() const
+{
+        int64_t seq = (m_no_of_blocks > 0) ? m_no_of_blocks - 1 : 0;
+        return m_blocks[seq % m_blocks.size()];
+}
+
+bool RxTimeline::last_block_discontinuous() const
+{
+        return (m_no_of_blocks > 0) && last_block().discontinuous;
+}
+
+const RxBlock *RxTimeline::find_block(int64_t seq) const
+{
+        int64_t capacity = m_blocks.size();
+        if ((seq < 0) || (seq >= m_no_of_blocks) ||
+            (seq < m_no_of_blocks - capacity)) {
+                return nullptr;
+        }
+        return &m_blocks[seq % capacity];
+}
+
+RxPosition RxTimeline::locate(double time_hw_ns) const
+{
+        RxPosition pos = {0, 0, false};
+        if (m_no_of_blocks == 0) {
+                return pos;
+        }
+        const RxBlock &last = last_block();
+        pos.seq = last.seq;
+        pos.ix = std::llround((time_hw_ns - last.time_hw_ns) *
+                              m_sample_rate / 1e9);
+        pos.valid = (time_hw_ns >= m_segment_time_hw_ns);
+        return pos;
+}
+
+int64_t RxTimeline::ix_to_hw_ns(int64_t seq, int64_t ix) const
+{
+        const RxBlock *block = find_block(seq);
+        if (block == nullptr) {
+                block = &last_block();
+        }
+        return block->time_hw_ns + std::llround(ix * 1e9 / m_sample_rate);
+}
+
+int64_t RxTimeline::next_periodic_ix(int64_t time_hw_ns,
+                                     int64_t period_ns) const
+{
+        int64_t rel_ns = (time_hw_ns - last_block().time_hw_ns) % period_ns;
+        if (rel_ns < 0) {
+                rel_ns += period_ns;
+        }
+        return (int64_t)((rel_ns * m_sample_rate) / 1e9);
+}
+
+uint64_t RxTimeline::get_no_of_gaps() const
+{
+        return m_no_of_gaps;
+}
+
+int64_t RxTimeline::get_no_of_lost_samples() const
+{
+        return m_no_of_lost_samples;
+}
@@ -0,0 +1,277 @@
+/**
+ * \file sample_file.cpp
+ *
+ * \brief Binary sample files with a small header
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "sample_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+const char sample_file_magic[8] = {'W', 'T', 'R', 'S', 'A', 'M', 'P', 0};
+
+static size_t sample_bytes(uint32_t format)
+{
+        if (format == SAMPLE_FORMAT_CS16) {
+                return sizeof(std::complex<int16_t>);
+        }
+        return sizeof(std::complex<float>);
+}
+
+static void write_sample_file(std::string filename, SampleFormat format,
+                              const void *data, size_t no_of_samples,
+                              const SampleFileInfo &info)
+{
+        SampleFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, sample_file_magic, sizeof(header.magic));
+        header.version = sample_file_version;
+        header.format = format;
+        header.header_bytes = sizeof(header);
+        header.sample_rate = info.sample_rate;
+        header.frequency = info.frequency;
+        header.time_hw_ns = info.time_hw_ns;
+        header.no_of_samples = no_of_samples;
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                throw std::runtime_error("Could not open " + filename + ": " +
+                                         strerror(errno));
+        }
+        // Header and samples in one call, continued if it is cut short
+        struct iovec parts[2];
+        parts[0].iov_base = &header;
+        parts[0].iov_len = sizeof(header);
+        parts[1].iov_base = const_cast<void *>(data);
+        parts[1].iov_len = no_of_samples * sample_bytes(format);
+        struct iovec *part = parts;
+        int no_of_parts(2);
+        while (no_of_parts > 0) {
+                ssize_t ret = ::writev(fd, part, no_of_parts);
+                if ((ret < 0) && (errno == EINTR)) {
+                        continue;
+                }
+                if (ret < 0) {
+                        int error = errno;
+                        ::close(fd);
+                        throw std::runtime_error("Could not write " +
+                                                 filename + ": " +
+                                                 strerror(error));
+                }
+                size_t written = ret;
+                while ((no_of_parts > 0) && (written >= part->iov_len)) {
+                        written -= part->iov_len;
+                        part++;
+                        no_of_parts--;
+                }
+                if (no_of_parts > 0) {
+                        part->iov_base = static_cast<uint8_t *>(
+                                part->iov_base) + written;
+                        part->iov_len -= written;
+                }
+        }
+        if (::close(fd) != 0) {
+                throw std::runtime_error("Could not write " + filename);
+        }
+}
+
+void save_samples(std::string filename, const std::complex<int16_t> *data,
+                  size_t no_of_samples, const SampleFileInfo &info)
+{
+        write_sample_file(filename, SAMPLE_FORMAT_CS16, data, no_of_samples,
+                          info);
+}
+
+void save_samples(std::string filename, const std::complex<float> *data,
+                  size_t no_of_samples, const SampleFileInfo &info)
+{
+        write_sample_file(filename, SAMPLE_FORMAT_CF32, data, no_of_samples,
+                          info);
+}
+
+bool is_sample_file(std::string filename)
+{
+        const std::string extensions[] = {".cs16", ".cf32"};
+        for (const std::string &extension : extensions) {
+                if ((filename.size() > extension.size()) &&
+                    (filename.compare(filename.size() - extension.size(),
+                                      extension.size(), extension) == 0)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+SampleFile::SampleFile()
+        : m_mapping(nullptr),
+          m_bytes(0)
+{
+        std::memset(&m_header, 0, sizeof(m_header));
+}
+
+SampleFile::~SampleFile()
+{
+        close();
+}
+
+void SampleFile::open(std::string filename)
+{
+        close();
+        m_filename = filename;
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+                throw std::runtime_error("Could not open sample file: " +
+                                         filename + ": " + strerror(errno));
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Could not stat sample file: " +
+                                         filename);
+        }
+        size_t bytes = file_stat.st_size;
+        SampleFileHeader header;
+        if ((bytes < sizeof(header)) ||
+            (::pread(fd, &header, sizeof(header), 0) !=
+             (ssize_t)sizeof(header)) ||
+            (std::memcmp(header.magic, sample_file_magic,
+                         sizeof(header.magic)) != 0)) {
+                ::close(fd);
+                throw std::runtime_error("Not a sample file: " + filename);
+        }
+        if ((header.version != sample_file_version) ||
+            ((header.format != SAMPLE_FORMAT_CS16) &&
+             (header.format != SAMPLE_FORMAT_CF32)) ||
+            (header.header_bytes < sizeof(header)) ||
+            (header.header_bytes > bytes)) {
+                ::close(fd);
+                throw std::runtime_error("Unsupported sample file: " +
+                                         filename);
+        }
+        // A file cut short, e.g. at a crash, keeps its whole samples
+        size_t file_samples = (bytes - header.header_bytes) /
+                sample_bytes(header.format);
+        header.no_of_samples = std::min((uint64_t)file_samples,
+                                        header.no_of_samples);
+        void *mapping = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+                throw std::runtime_error("Could not map sample file: " +
+                                         filename + ": " + strerror(errno));
+        }
+        madvise(mapping, bytes, MADV_SEQUENTIAL);
+        m_mapping = static_cast<const uint8_t *>(mapping);
+        m_bytes = bytes;
+        m_header = header;
+}
+
+void SampleFile::close()
+{
+        if (m_mapping != nullptr) {
+                munmap(const_cast<uint8_t *>(m_mapping), m_bytes);
+                m_mapping = nullptr;
+        }
+        m_bytes = 0;
+        std::memset(&m_header, 0, sizeof(m_header));
+}
+
+SampleFormat SampleFile::get_format() const
+{
+        return (SampleFormat)m_header.format;
+}
+
+SampleFileInfo SampleFile::get_info() const
+{
+        SampleFileInfo info;
+        info.sample_rate = m_header.sample_rate;
+        info.frequency = m_header.frequency;
+        info.time_hw_ns = m_header.time_hw_ns;
+        return info;
+}
+
+size_t SampleFile::size() const
+{
+        return m_header.no_of_samples;
+}
+
+const std::complex<int16_t> *SampleFile::get_cs16() const
+{
+        if ((m_mapping == nullptr) ||
+            (m_header.format != SAMPLE_FORMAT_CS16)) {
+                return nullptr;
+        }
+        return reinterpret_cast<const std::complex<int16_t> *>(
+                m_mapping + m_header.header_bytes);
+}
+
+const std::complex<float> *SampleFile::get_cf32() const
+{
+        if ((m_mapping == nullptr) ||
+            (m_header.format != SAMPLE_FORMAT_CF32)) {
+                return nullptr;
+        }
+        return reinterpret_cast<const std::complex<float> *>(
+                m_mapping + m_header.header_bytes);
+}
+
+void SampleFile::read(size_t start_ix, size_t no_of_samples,
+                      std::complex<int16_t> *data) const
+{
+        check_range(start_ix, no_of_samples);
+        const std::complex<int16_t> *cs16 = get_cs16();
+        if (cs16 != nullptr) {
+                std::memcpy(data, cs16 + start_ix,
+                            no_of_samples * sizeof(*data));
+                return;
+        }
+        const float max_value = std::numeric_limits<int16_t>::max();
+        const float min_value = std::numeric_limits<int16_t>::min();
+        const std::complex<float> *cf32 = get_cf32() + start_ix;
+        for (size_t n=0; n<no_of_samples; n++) {
+                float re = std::max(min_value, std::min(
+                                            max_value,
+                                            std::round(cf32[n].real())));
+                float im = std::max(min_value, std::min(
+                                            max_value,
+                                            std::round(cf32[n].imag())));
+                data[n] = std::complex<int16_t>((int16_t)re, (int16_t)im);
+        }
+}
+
+void SampleFile::read(size_t start_ix, size_t no_of_samples,
+                      std::complex<float> *data) const
+{
+        check_range(start_ix, no_of_samples);
+        const std::complex<float> *cf32 = get_cf32();
+        if (cf32 != nullptr) {
+                std::memcpy(data, cf32 + start_ix,
+                            no_of_samples * sizeof(*data));
+                return;
+        }
+        const std::complex<int16_t> *cs16 = get_cs16() + start_ix;
+        for (size_t n=0; n<no_of_samples; n++) {
+                data[n] = std::complex<float>(cs16[n].real(),
+                                              cs16[n].imag());
+        }
+}
+
+void SampleFile::check_range(size_t start_ix, size_t no_of_samples) const
+{
+        if ((start_ix > size()) || (no_of_samples > size() - start_ix)) {
+                throw std::runtime_error("Read outside sample file: " +
+                                         m_filename);
+        }
+}
@@ -10,13 +10,26 @@
 
 #include "sdr.h"
 
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <iomanip>
+#include <sstream>
+
 SDR::SDR()
+        : m_device(nullptr),
+          m_tx_stream(nullptr),
+          m_rx_stream(nullptr),
+          m_rx_mtu(0),
+          m_rx_start_hw_ticks(0),
+          m_time_of_next_burst(0)
 {}
 
 void SDR::connect()
 {
-
+        m_startup_begin = std::chrono::steady_clock::now();
         SoapySDR::KwargsList results = SoapySDR::Device::enumerate();
+        add_startup_phase("enumerate", m_startup_begin);
         if (results.size() > 0) {
                 std::cout << "Found Device!" << std::endl;
         } else {
@@ -27,7 +40,9 @@ void SDR::connect()
 
 void SDR::connect(std::string device_serial)
 {
+        m_startup_begin = std::chrono::steady_clock::now();
         SoapySDR::KwargsList results = SoapySDR::Device::enumerate();
+        add_startup_phase("enumerate", m_startup_begin);
         if (results.size() > 0) {
                 std::cout << "Found Device!" << std::endl;
         } else {
@@ -45,10 +60,15 @@ void SDR::connect(std::string device_serial)
 
 void SDR::connect_to_device(SoapySDR::KwargsList results, int32_t device_num)
 {
-        m_device = SoapySDR::Device::make(results[device_num]);
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+        m_device_info = results[device_num];
+        m_driver = m_device_info["driver"];
+        m_device = SoapySDR::Device::make(m_device_info);
         if (m_device == nullptr) {
                 throw std::runtime_error("Could not open device!");
         }
+        add_startup_phase("open device", start);
         if (!m_device->hasHardwareTime()) {
                 std::string err = "This device does not support";
                 err +=  " timed streaming!";
@@ -67,6 +87,7 @@ SoapySDR::Device *SDR::get_device()
 void SDR::configure(SDR_Device_Config dev_cfg)
 {
         m_dev_cfg = dev_cfg;
+        configure_timeline();
         if (m_dev_cfg.clock_source != "") {
                 m_device->setClockSource(m_dev_cfg.clock_source);
         }
@@ -74,24 +95,63 @@ void SDR::configure(SDR_Device_Config dev_cfg)
                 m_device->setTimeSource(m_dev_cfg.time_source);
         }
         m_device->setMasterClockRate(m_dev_cfg.f_clk);
-        if (m_dev_cfg.rx_active) {
-                configure_rx();
+        if (m_dev_cfg.rx_active && m_dev_cfg.tx_active &&
+            concurrent_config_allowed()) {
+                // Printed when both are done, not interleaved
+                std::ostringstream tx_out;
+                std::ostringstream rx_out;
+                std::future<void> tx_config = std::async(
+                        std::launch::async, &SDR::configure_tx, this,
+                        std::ref(tx_out));
+                configure_rx(rx_out);
+                tx_config.get();
+                std::cout << rx_out.str() << tx_out.str();
+        } else {
+                if (m_dev_cfg.rx_active) {
+                        configure_rx(std::cout);
+                }
+                if (m_dev_cfg.tx_active) {
+                        configure_tx(std::cout);
+                }
         }
-        if (m_dev_cfg.tx_active) {
-                configure_tx();
+        if (m_dev_cfg.rx_active && (m_dev_cfg.record_basename != "")) {
+                double tx_gain(0);
+                if (m_dev_cfg.tx_active) {
+                        tx_gain = m_device->getGain(SOAPY_SDR_TX,
+                                                    m_dev_cfg.channel_tx);
+                }
+                start_recording(
+                        m_device->getSampleRate(SOAPY_SDR_RX,
+                                                m_dev_cfg.channel_rx),
+                        m_device->getFrequency(SOAPY_SDR_RX,
+                                               m_dev_cfg.channel_rx),
+                        m_device->getGain(SOAPY_SDR_RX,
+                                          m_dev_cfg.channel_rx),
+                        tx_gain,
+                        m_device->getHardwareKey());
         }
 }
 
-void SDR::configure_tx()
+bool SDR::concurrent_config_allowed()
 {
+        /* SoapyLMS7 serializes all device access internally, so the
+         * RX setup can run while the TX LO is locking.
+         */
+        return m_dev_cfg.concurrent_config && is_limesdr();
+}
+
+void SDR::configure_tx(std::ostream &out)
+{
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
         m_device->setSampleRate(SOAPY_SDR_TX, m_dev_cfg.channel_tx,
                                 m_dev_cfg.sampling_rate_tx);
         double act_sample_rate = m_device->getSampleRate(
                 SOAPY_SDR_TX,
                 m_dev_cfg.channel_tx);
-        std::cout << "Actual TX rate: "
-                  << act_sample_rate
-                  << " Msps" << std::endl;
+        out << "Actual TX rate: "
+            << act_sample_rate
+            << " Msps" << std::endl;
         if (m_dev_cfg.tx_bw != -1) {
                 m_device->setBandwidth(SOAPY_SDR_TX, m_dev_cfg.channel_tx,
                                        m_dev_cfg.tx_bw);
@@ -99,45 +159,33 @@ void SDR::configure_tx()
         m_device->setGain(SOAPY_SDR_TX, m_dev_cfg.channel_tx,
                           m_dev_cfg.tx_gain);
         double gain = m_device->getGain(SOAPY_SDR_TX, m_dev_cfg.channel_tx);
-        std::cout << "TX gain " << gain << std::endl;
+        out << "TX gain " << gain << std::endl;
         m_device->setAntenna(SOAPY_SDR_TX, m_dev_cfg.channel_tx,
                              m_dev_cfg.antenna_tx);
         m_device->setFrequency(SOAPY_SDR_TX, m_dev_cfg.channel_tx,
                                m_dev_cfg.tx_frequency);
-        if (is_limesdr()) {
-                bool tx_lo_locked = false;
-                while (not tx_lo_locked) {
-                        std::string tx_locked = m_device->readSensor(
-                                SOAPY_SDR_TX,
-                                m_dev_cfg.channel_tx,
-                                "lo_locked");
-                        if (tx_locked == "true") {
-                                tx_lo_locked = true;
-                        }
-                        usleep(100);
-                }
-                std::cout << "sdr: TX LO lock detected on channel "
-                          << std::to_string(m_dev_cfg.channel_tx)
-                          << std::endl;
-        }
-        std::cout << "sdr: Actual TX frequency on channel "
-                  << std::to_string(m_dev_cfg.channel_tx) << ": "
-                  << std::to_string(m_device->getFrequency(
-                                            SOAPY_SDR_TX,
-                                            m_dev_cfg.channel_tx)/1e6)
-                  << " [MHz]" << std::endl;
+        wait_for_lo_lock(SOAPY_SDR_TX, m_dev_cfg.channel_tx, out);
+        out << "sdr: Actual TX frequency on channel "
+            << std::to_string(m_dev_cfg.channel_tx) << ": "
+            << std::to_string(m_device->getFrequency(
+                                      SOAPY_SDR_TX,
+                                      m_dev_cfg.channel_tx)/1e6)
+            << " [MHz]" << std::endl;
+        add_startup_phase("configure TX", start);
 }
 
-void SDR::configure_rx()
+void SDR::configure_rx(std::ostream &out)
 {
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
         m_device->setSampleRate(SOAPY_SDR_RX, m_dev_cfg.channel_rx,
                                 m_dev_cfg.sampling_rate_rx);
         double act_sample_rate = m_device->getSampleRate(
                 SOAPY_SDR_RX,
                 m_dev_cfg.channel_rx);
-        std::cout << "Actual RX rate: "
-                  << act_sample_rate
-                  << " Msps" << std::endl;
+        out << "Actual RX rate: "
+            << act_sample_rate
+            << " Msps" << std::endl;
         if (m_dev_cfg.rx_bw != -1) {
                 m_device->setBandwidth(SOAPY_SDR_RX, m_dev_cfg.channel_rx,
                                        m_dev_cfg.rx_bw);
@@ -146,17 +194,64 @@ void SDR::configure_rx()
         m_device->setGain(SOAPY_SDR_RX, m_dev_cfg.channel_rx,
                           m_dev_cfg.rx_gain);
         bool gain_mode = m_device->getGainMode(SOAPY_SDR_RX, m_dev_cfg.channel_rx);
-        std::cout << "Gain mode " << gain_mode << std::endl;
+        out << "Gain mode " << gain_mode << std::endl;
         m_device->setAntenna(SOAPY_SDR_RX, m_dev_cfg.channel_rx,
                              m_dev_cfg.antenna_rx);
         m_device->setFrequency(SOAPY_SDR_RX, m_dev_cfg.channel_rx,
                                m_dev_cfg.rx_frequency);
-        std::cout << "sdr: Actual RX frequency on channel "
-                  << std::to_string(m_dev_cfg.channel_rx) << ": "
-                  << std::to_string(m_device->getFrequency(
-                                            SOAPY_SDR_RX,
-                                            m_dev_cfg.channel_rx)/1e6)
-                  << " [MHz]" << std::endl;
+        wait_for_lo_lock(SOAPY_SDR_RX, m_dev_cfg.channel_rx, out);
+        out << "sdr: Actual RX frequency on channel "
+            << std::to_string(m_dev_cfg.channel_rx) << ": "
+            << std::to_string(m_device->getFrequency(
+                                      SOAPY_SDR_RX,
+                                      m_dev_cfg.channel_rx)/1e6)
+            << " [MHz]" << std::endl;
+        add_startup_phase("configure RX", start);
+}
+
+bool SDR::has_sensor(int direction, size_t channel, std::string sensor)
+{
+        std::vector<std::string> sensors = m_device->listSensors(direction,
+                                                                 channel);
+        for (size_t n=0; n<sensors.size(); n++) {
+                if (sensors[n] == sensor) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+void SDR::wait_for_lo_lock(int direction, size_t channel,
+                           std::ostream &out)
+{
+        if (!has_sensor(direction, channel, "lo_locked")) {
+                return;
+        }
+        std::string dir = (direction == SOAPY_SDR_TX) ? "TX" : "RX";
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point deadline = start +
+                std::chrono::microseconds(
+                        (int64_t)(m_dev_cfg.lo_lock_timeout * 1e6));
+        useconds_t backoff_us(10);
+        const useconds_t max_backoff_us(5000);
+        while (m_device->readSensor(direction, channel,
+                                    "lo_locked") != "true") {
+                if (std::chrono::steady_clock::now() > deadline) {
+                        std::string err = "sdr: No " + dir;
+                        err += " LO lock on channel ";
+                        err += std::to_string(channel);
+                        throw std::runtime_error(err);
+                }
+                usleep(backoff_us);
+                backoff_us = std::min(2 * backoff_us, max_backoff_us);
+        }
+        std::chrono::duration<double, std::milli> lock_time =
+                std::chrono::steady_clock::now() - start;
+        out << "sdr: " << dir << " LO lock detected on channel "
+            << std::to_string(channel)
+            << " after " << lock_time.count() << " ms"
+            << std::endl;
 }
 
 int64_t SDR::start()
@@ -177,11 +272,44 @@ int64_t SDR::start()
                   << " [Sa], mtu_rx="
                   << std::to_string(mtu_rx) + " [Sa]"
                   << std::endl;
+        print_startup_report();
         return now_hw_ticks;
 }
 
+void SDR::add_startup_phase(std::string phase,
+                            std::chrono::steady_clock::time_point start)
+{
+        std::chrono::duration<double, std::milli> duration =
+                std::chrono::steady_clock::now() - start;
+        std::lock_guard<std::mutex> lock(m_startup_mutex);
+        m_startup_phases.push_back(std::make_pair(phase, duration.count()));
+}
+
+void SDR::print_startup_report()
+{
+        std::chrono::duration<double, std::milli> total =
+                std::chrono::steady_clock::now() - m_startup_begin;
+        std::lock_guard<std::mutex> lock(m_startup_mutex);
+        std::ios_base::fmtflags flags = std::cout.flags();
+        std::cout << "sdr: Startup timing [ms]" << std::endl;
+        for (size_t n=0; n<m_startup_phases.size(); n++) {
+                std::cout << "sdr:   " << std::left << std::setw(16)
+                          << m_startup_phases[n].first << std::right
+                          << std::fixed << std::setprecision(1)
+                          << std::setw(10) << m_startup_phases[n].second
+                          << std::endl;
+        }
+        std::cout << "sdr:   " << std::left << std::setw(16) << "total"
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << total.count() << std::endl;
+        std::cout.flags(flags);
+        std::cout.precision(6);
+}
+
 void SDR::start_tx()
 {
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
         SoapySDR::Kwargs args;
         if (m_dev_cfg.is_beacon) {
                 args["beacon"] = 1;
@@ -207,10 +335,13 @@ void SDR::start_tx()
                 std::cout << "sdr: TX stream has been successfully activated!"
                           << std::endl;
         }
+        add_startup_phase("start TX", start);
 }
 
 int64_t SDR::start_rx()
 {
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
         SoapySDR::Kwargs args;
         if (m_dev_cfg.is_beacon) {
                 args["beacon"] = 1;
@@ -238,21 +369,32 @@ int64_t SDR::start_rx()
                                                        m_dev_cfg.f_clk);
         int64_t burst_time = SoapySDR::ticksToTimeNs(m_rx_start_hw_ticks,
                                                      m_dev_cfg.f_clk);
+        m_rx_mtu = m_device->getStreamMTU(m_rx_stream);
         int rx_flags = SOAPY_SDR_HAS_TIME;
-        rx_flags |= SOAPY_SDR_END_BURST;
-        rx_flags |= SOAPY_SDR_ONE_PACKET;
+        if (!m_dev_cfg.rx_continuous) {
+                rx_flags |= SOAPY_SDR_END_BURST;
+                rx_flags |= SOAPY_SDR_ONE_PACKET;
+        }
+        // No burst length, the stream runs until deactivated
         int ret = m_device->activateStream(m_rx_stream,
                                            rx_flags,
-                                           burst_time);
+                                           burst_time,
+                                           0);
         if (ret != 0) {
                 std::string err = "sdr: Following problem occurred while";
                 err += " activating RX stream: ";
                 err += SoapySDR::errToStr(ret);
                 throw std::runtime_error(err);
         } else {
-                std::cout << "sdr: RX stream has been successfully activated!"
+                std::cout << "sdr: RX stream has been successfully activated"
+                          << (m_dev_cfg.rx_continuous ?
+                              " in continuous mode!" : "!")
                           << std::endl;
         }
+        m_rx_stats = RxStreamStats();
+        m_rx_stats.cpu_start = std::clock();
+        m_rx_stats.wall_start = std::chrono::steady_clock::now();
+        add_startup_phase("start RX", start);
         return now_hw_ticks;
 }
 
@@ -262,9 +404,34 @@ SoapySDR::Stream *SDR::get_rx_stream()
 }
 
 
-size_t SDR::write(std::vector<void *> data, size_t no_of_samples,
+static const char *stream_error_name(int ret)
+{
+        switch (ret) {
+        case SOAPY_SDR_TIMEOUT:
+                return "SOAPY_SDR_TIMEOUT";
+        case SOAPY_SDR_STREAM_ERROR:
+                return "SOAPY_SDR_STREAM_ERROR";
+        case SOAPY_SDR_CORRUPTION:
+                return "SOAPY_SDR_CORRUPTION";
+        case SOAPY_SDR_OVERFLOW:
+                return "SOAPY_SDR_OVERFLOW";
+        case SOAPY_SDR_NOT_SUPPORTED:
+                return "SOAPY_SDR_NOT_SUPPORTED";
+        case SOAPY_SDR_END_BURST:
+                return "SOAPY_SDR_END_BURST";
+        case SOAPY_SDR_TIME_ERROR:
+                return "SOAPY_SDR_TIME_ERROR";
+        case SOAPY_SDR_UNDERFLOW:
+                return "SOAPY_SDR_UNDERFLOW";
+        default:
+                return nullptr;
+        }
+}
+
+size_t SDR::write(const std::vector<void *> &data, size_t no_of_samples,
                     long long int burst_time)
 {
+        TraceSpan span(TRACE_WRITE, burst_time);
         int tx_flags = SOAPY_SDR_HAS_TIME;
         tx_flags |= SOAPY_SDR_END_BURST | SOAPY_SDR_ONE_PACKET;
         size_t no_of_transmitted_samples = m_device->writeStream(
@@ -275,89 +442,60 @@ size_t SDR::write(std::vector<void *> data, size_t no_of_samples,
                 burst_time,
                 1e6*m_dev_cfg.timeout);
         if (no_of_transmitted_samples != no_of_samples) {
-                std::string tx_verbose_msg = "Transmit failed: ";
-                switch (no_of_transmitted_samples) {
-                case SOAPY_SDR_TIMEOUT:
-                        tx_verbose_msg += "SOAPY_SDR_TIMEOUT";
-                        break;
-                case SOAPY_SDR_STREAM_ERROR:
-                        tx_verbose_msg += "SOAPY_SDR_STREAM_ERROR";
-                        break;
-                case SOAPY_SDR_CORRUPTION:
-                        tx_verbose_msg += "SOAPY_SDR_CORRUPTION";
-                        break;
-                case SOAPY_SDR_OVERFLOW:
-                        tx_verbose_msg += "SOAPY_SDR_OVERFLOW";
-                        break;
-                case SOAPY_SDR_NOT_SUPPORTED:
-                        tx_verbose_msg += "SOAPY_SDR_NOT_SUPPORTED";
-                        break;
-                case SOAPY_SDR_END_BURST:
-                        tx_verbose_msg += "SOAPY_SDR_END_BURST";
-                        break;
-                case SOAPY_SDR_TIME_ERROR:
-                        tx_verbose_msg += "SOAPY_SDR_TIME_ERROR";
-                        break;
-                case SOAPY_SDR_UNDERFLOW:
-                        tx_verbose_msg += "SOAPY_SDR_UNDERFLOW";
-                        break;
-                default:
-                        tx_verbose_msg += "Num of transmitted samps: ";
-                        tx_verbose_msg += std::to_string(no_of_transmitted_samples);
+                int ret = (int)no_of_transmitted_samples;
+                const char *error_name = stream_error_name(ret);
+                if (error_name != nullptr) {
+                        g_logger.log(SOAPY_SDR_ERROR, "Transmit failed: {}",
+                                     error_name);
+                } else {
+                        g_logger.log(SOAPY_SDR_ERROR,
+                                     "Transmit failed: Num of transmitted"
+                                     " samps: {}", ret);
                 }
-                std::cout << tx_verbose_msg << std::endl;
+                count_stream_error(ret);
         } else {
                 size_t chan_mask = 0;
+                TraceSpan status_span(TRACE_WRITE_STATUS, burst_time);
                 int stream_status = m_device->readStreamStatus(
                         m_tx_stream,
                         chan_mask,
                         tx_flags,
                         burst_time,
                         1e6*m_dev_cfg.timeout);
-                std::string tx_verbose_msg = "";
-                switch(stream_status) {
-                case SOAPY_SDR_TIMEOUT:
-                        tx_verbose_msg += "SOAPY_SDR_TIMEOUT";
-                        break;
-                case SOAPY_SDR_STREAM_ERROR:
-                        tx_verbose_msg += "SOAPY_SDR_STREAM_ERROR";
-                        break;
-                case SOAPY_SDR_CORRUPTION:
-                        tx_verbose_msg += "SOAPY_SDR_CORRUPTION";
-                        break;
-                case SOAPY_SDR_OVERFLOW:
-                        tx_verbose_msg += "SOAPY_SDR_OVERFLOW";
-                        break;
-                case SOAPY_SDR_NOT_SUPPORTED:
-                        tx_verbose_msg += "SOAPY_SDR_NOT_SUPPORTED";
-                        break;
-                case SOAPY_SDR_END_BURST:
-                        tx_verbose_msg += "SOAPY_SDR_END_BURST";
-                        break;
-                case SOAPY_SDR_TIME_ERROR:
-                        tx_verbose_msg += "SOAPY_SDR_TIME_ERROR";
-                        break;
-                case SOAPY_SDR_UNDERFLOW:
-                        tx_verbose_msg += "SOAPY_SDR_UNDERFLOW";
-                        break;
-                default:
-                        // No ERROR
-                        break;
-                }
-                if (tx_verbose_msg != "") {
-                        std::cout << "Stream status: "
-                                  << tx_verbose_msg
-                                  << std::endl;
+                status_span.set_value(stream_status);
+                count_stream_error(stream_status);
+                const char *status_name = stream_error_name(stream_status);
+                if (status_name != nullptr) {
+                        g_logger.log(SOAPY_SDR_WARNING, "Stream status: {}",
+                                     status_name);
                 }
         }
 
 
+        span.set_value((int)no_of_transmitted_samples);
         return no_of_transmitted_samples;
 
 }
 
 int32_t SDR::read(size_t no_of_samples,
-                  std::vector<std::complex<int16_t>> &buff_data)
+                  std::complex<int16_t> *buff_data)
+{
+        TraceSpan span(TRACE_READ);
+        int32_t ret;
+        if (m_dev_cfg.rx_continuous) {
+                ret = read_continuous(no_of_samples, buff_data);
+        } else {
+                ret = read_burst(no_of_samples, buff_data);
+        }
+        if (ret > 0) {
+                span.set_hw_ns(ix_to_hw_ns(0));
+        }
+        span.set_value(ret);
+        return ret;
+}
+
+int32_t SDR::read_burst(size_t no_of_samples,
+                        std::complex<int16_t> *buff_data)
 {
         int32_t no_of_received_samples(0);
         //int flags(0);
@@ -365,64 +503,153 @@ int32_t SDR::read(size_t no_of_samples,
         flags |= SOAPY_SDR_END_BURST;
         //flags |= SOAPY_SDR_ONE_PACKET;
         long long int time_ns(0);
-        buff_data.resize(no_of_samples);
-        std::vector<void *> buffs_data;
-        buffs_data.push_back(buff_data.data());
+        void *buffs_data[] = {buff_data};
         no_of_received_samples = m_device->readStream(m_rx_stream,
-                                                      buffs_data.data(),
+                                                      buffs_data,
                                                       no_of_samples,
                                                       flags,
                                                       time_ns);
-        m_last_rx_timestamp = (int64_t)time_ns;
+        m_rx_stats.no_of_reads++;
+        if (no_of_received_samples == SOAPY_SDR_OVERFLOW) {
+                m_rx_stats.no_of_overflows++;
+                m_timeline.note_overflow();
+        }
+        if (no_of_received_samples == SOAPY_SDR_TIMEOUT) {
+                m_rx_stats.no_of_timeouts++;
+        }
+        if (no_of_received_samples > 0) {
+                m_rx_stats.no_of_samples += no_of_received_samples;
+                store_rx_block(buff_data, no_of_received_samples,
+                               (int64_t)time_ns, flags);
+        }
         return no_of_received_samples;
 }
 
-int64_t SDR::ix_to_hw_ns(int64_t ix)
+int32_t SDR::read_continuous(size_t no_of_samples,
+                             std::complex<int16_t> *buff_data)
 {
-        int64_t time_hw_ns;
-        int64_t fs = m_dev_cfg.sampling_rate_rx;
-        time_hw_ns = m_last_rx_timestamp + (ix * 1e9) / fs;
-        return time_hw_ns;
+        const double fs = m_dev_cfg.sampling_rate_rx;
+        const double sample_ns = 1e9 / fs;
+        size_t no_of_received_samples(0);
+        int64_t first_hw_ns(0);
+        int block_flags(0);
+        while (no_of_received_samples < no_of_samples) {
+                size_t chunk = std::min(m_rx_mtu,
+                                        no_of_samples -
+                                        no_of_received_samples);
+                void *buffs_data[] = {
+                        buff_data + no_of_received_samples};
+                int flags(0);
+                long long int time_ns(0);
+                int ret = m_device->readStream(m_rx_stream,
+                                               buffs_data,
+                                               chunk,
+                                               flags,
+                                               time_ns,
+                                               1e6 * m_dev_cfg.timeout);
+                m_rx_stats.no_of_reads++;
+                if (ret == SOAPY_SDR_OVERFLOW) {
+                        // Start over, the block must be contiguous
+                        m_rx_stats.no_of_overflows++;
+                        m_timeline.note_overflow();
+                        no_of_received_samples = 0;
+                        continue;
+                }
+                if (ret == SOAPY_SDR_TIMEOUT) {
+                        m_rx_stats.no_of_timeouts++;
+                }
+                if (ret < 0) {
+                        return ret;
+                }
+                if (no_of_received_samples == 0) {
+                        first_hw_ns = time_ns;
+                } else if ((flags & SOAPY_SDR_HAS_TIME) != 0) {
+                        int64_t expected_hw_ns = first_hw_ns +
+                                std::llround(no_of_received_samples *
+                                             sample_ns);
+                        if (std::abs(time_ns - expected_hw_ns) > sample_ns) {
+                                m_rx_stats.no_of_discontinuities++;
+                                std::memmove(buff_data,
+                                             buff_data +
+                                             no_of_received_samples,
+                                             ret * sizeof(buff_data[0]));
+                                no_of_received_samples = 0;
+                                first_hw_ns = time_ns;
+                                block_flags |= SOAPY_SDR_END_ABRUPT;
+                        }
+                }
+                no_of_received_samples += ret;
+                m_rx_stats.no_of_samples += ret;
+        }
+        store_rx_block(buff_data, no_of_received_samples,
+                       first_hw_ns, block_flags);
+        return no_of_received_samples;
 }
 
-int64_t SDR::find_exp_pong_pos_ix(int64_t hw_time_of_sync)
+int32_t SDR::read_window(int64_t start_hw_ns, size_t no_of_samples,
+                         std::complex<int16_t> *buff_data)
 {
-        int64_t expected_pong_pos_ix = find_exp_ping_pos_ix(hw_time_of_sync);
-        expected_pong_pos_ix += m_dev_cfg.pong_pos_comp;
-        if (expected_pong_pos_ix >= (int64_t)m_dev_cfg.no_of_rx_samples_pong) {
-                expected_pong_pos_ix -= m_dev_cfg.no_of_rx_samples_pong;
+        if (m_dev_cfg.rx_continuous) {
+                throw std::runtime_error("sdr: Gated RX needs burst mode");
         }
-        return expected_pong_pos_ix;
+        TraceSpan span(TRACE_READ, start_hw_ns);
+        int rx_flags = SOAPY_SDR_HAS_TIME | SOAPY_SDR_END_BURST;
+        int ret = m_device->activateStream(m_rx_stream,
+                                           rx_flags,
+                                           start_hw_ns,
+                                           no_of_samples);
+        if (ret != 0) {
+                return ret;
+        }
+        void *buffs_data[] = {buff_data};
+        int flags(0);
+        long long int time_ns(0);
+        int32_t no_of_received_samples = m_device->readStream(
+                m_rx_stream,
+                buffs_data,
+                no_of_samples,
+                flags,
+                time_ns,
+                1e6 * m_dev_cfg.timeout);
+        m_rx_stats.no_of_reads++;
+        if (no_of_received_samples == SOAPY_SDR_OVERFLOW) {
+                m_rx_stats.no_of_overflows++;
+                m_timeline.note_overflow();
+        }
+        if (no_of_received_samples == SOAPY_SDR_TIMEOUT) {
+                m_rx_stats.no_of_timeouts++;
+        }
+        if (no_of_received_samples > 0) {
+                m_rx_stats.no_of_samples += no_of_received_samples;
+                store_rx_window(buff_data, no_of_received_samples,
+                                (int64_t)time_ns);
+        }
+        span.set_value(no_of_received_samples);
+        return no_of_received_samples;
 }
 
-int64_t SDR::find_exp_ping_pos_ix(int64_t hw_time_of_sync)
+const RxStreamStats &SDR::get_rx_stream_stats()
 {
-        int64_t exp_hw_time = hw_time_of_sync;
-        int64_t burst_period_ns = m_dev_cfg.burst_period * 1e9;
-        /* If the diff is too large there is something spoky
-         * with the timestamps, and we skip this and try to
-         * sample some new data, by setting the stamps equal.
-         */
-        uint64_t diff = std::abs(exp_hw_time - m_last_rx_timestamp);
-        if (diff > 2e9) {
-                std::cout << "Warning: strange timestamps,"
-                          << " last timestamp on rx buffer: "
-                          << m_last_rx_timestamp
-                          << " expected timestamp: "
-                          << exp_hw_time
-                          << std::endl;
-                exp_hw_time = m_last_rx_timestamp;
-        }
-        while (exp_hw_time < m_last_rx_timestamp) {
-                exp_hw_time += burst_period_ns;
-        }
-        int64_t rx_burst_length = m_last_rx_timestamp + burst_period_ns;
-        while (exp_hw_time > rx_burst_length) {
-                exp_hw_time -= burst_period_ns;
-        }
-        int64_t fs = m_dev_cfg.sampling_rate_rx;
-        int64_t ix = ((exp_hw_time - m_last_rx_timestamp) * fs) / 1e9;
-        return ix;
+        return m_rx_stats;
+}
+
+void SDR::print_rx_stream_stats()
+{
+        double cpu_s = (double)(std::clock() - m_rx_stats.cpu_start) /
+                CLOCKS_PER_SEC;
+        std::chrono::duration<double> wall =
+                std::chrono::steady_clock::now() - m_rx_stats.wall_start;
+        std::cout << "sdr: RX "
+                  << (m_dev_cfg.rx_continuous ? "continuous" : "burst")
+                  << " mode, reads: " << m_rx_stats.no_of_reads
+                  << " samples: " << m_rx_stats.no_of_samples
+                  << " overflows: " << m_rx_stats.no_of_overflows
+                  << " timeouts: " << m_rx_stats.no_of_timeouts
+                  << " time jumps: " << m_rx_stats.no_of_discontinuities
+                  << std::endl;
+        std::cout << "sdr: Process CPU time " << cpu_s << " s over "
+                  << wall.count() << " s ("
+                  << 100.0 * cpu_s / wall.count() << " %)" << std::endl;
 }
 
 void SDR::close()
@@ -432,21 +659,29 @@ void SDR::close()
                 m_device->closeStream(m_tx_stream);
         }
         if (m_dev_cfg.rx_active) {
+                print_rx_stream_stats();
                 m_device->deactivateStream(m_rx_stream);
                 m_device->closeStream(m_rx_stream);
         }
         SoapySDR::Device::unmake(m_device);
+        close_recording();
 }
 
-void SDR::check_burst_time(long long int burst_hw_ns)
+int64_t SDR::get_hardware_time()
+{
+        return m_device->getHardwareTime();
+}
+
+int64_t SDR::check_burst_time(long long int burst_hw_ns)
 {
         int64_t current_hw_ns = m_device->getHardwareTime();
         if ((burst_hw_ns - current_hw_ns) < 0) {
-                std::cout << "burst_hw_ns: " << burst_hw_ns
-                          << " current time:  " << current_hw_ns
-                          << " diff: " << burst_hw_ns - current_hw_ns
-                          << std::endl;
+                g_logger.log(SOAPY_SDR_WARNING,
+                             "burst_hw_ns: {} current time: {} diff: {}",
+                             (int64_t)burst_hw_ns, current_hw_ns,
+                             burst_hw_ns - current_hw_ns);
         }
+        return burst_hw_ns - current_hw_ns;
 }
 
 bool SDR::is_limesdr()
@@ -503,8 +738,7 @@ std::string SDR::get_modules_version(std::string libname)
 
 std::string SDR::get_device_driver()
 {
-        SoapySDR::KwargsList result = m_device-> enumerate();
-        return result[0]["driver"];
+        return m_driver;
 }
 
 int32_t SDR::look_up_device_serial(SoapySDR::KwargsList result,
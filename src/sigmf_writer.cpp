@@ -0,0 +1,264 @@
+/**
+ * \file sigmf_writer.cpp
+ *
+ * \brief SigMF writer class
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "sigmf_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+// Escapes quotes, backslashes and control characters for a JSON string
+static std::string json_escape(const std::string &text)
+{
+        std::string escaped;
+        escaped.reserve(text.size());
+        for (size_t n=0; n<text.size(); n++) {
+                unsigned char c = text[n];
+                if ((c == '"') || (c == '\\')) {
+                        escaped += '\\';
+                        escaped += c;
+                } else if (c < 0x20) {
+                        char buf[8];
+                        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        escaped += buf;
+                } else {
+                        escaped += c;
+                }
+        }
+        return escaped;
+}
+
+SigMFWriter::SigMFWriter(std::string basename, size_t buffer_samples)
+{
+        m_basename = basename;
+        std::string file = m_basename + ".sigmf-data";
+        m_data_file = std::fopen(file.c_str(), "wb");
+        if (m_data_file == nullptr) {
+                std::string err = "Could not open recording: ";
+                err += file;
+                throw std::runtime_error(err);
+        }
+        m_buffers[0].resize(buffer_samples);
+        m_buffers[1].resize(buffer_samples);
+        m_active = 0;
+        m_fill = 0;
+        m_pending_fill = 0;
+        m_pending = -1;
+        m_stop = false;
+        m_closed = false;
+        m_write_error = false;
+        m_sample_count = 0;
+        m_writer_stalls = 0;
+        m_datetime = datetime_now();
+        m_sample_rate = 0;
+        m_frequency = 0;
+        m_rx_gain = 0;
+        m_tx_gain = 0;
+        m_hw = "";
+        m_writer = std::thread(&SigMFWriter::writer_loop, this);
+}
+
+SigMFWriter::~SigMFWriter()
+{
+        close();
+}
+
+void SigMFWriter::set_meta(double sample_rate, double frequency,
+                           double rx_gain, double tx_gain, std::string hw)
+{
+        std::lock_guard<std::mutex> lock(m_meta_mutex);
+        m_sample_rate = sample_rate;
+        m_frequency = frequency;
+        m_rx_gain = rx_gain;
+        m_tx_gain = tx_gain;
+        m_hw = hw;
+}
+
+void SigMFWriter::write(const std::complex<int16_t> *data,
+                        size_t no_of_samples)
+{
+        size_t buffer_samples = m_buffers[0].size();
+        while (no_of_samples > 0) {
+                size_t to_copy = std::min(no_of_samples,
+                                          buffer_samples - m_fill);
+                std::memcpy(m_buffers[m_active].data() + m_fill, data,
+                            to_copy * sizeof(std::complex<int16_t>));
+                m_fill += to_copy;
+                data += to_copy;
+                no_of_samples -= to_copy;
+                m_sample_count += to_copy;
+                if (m_fill == buffer_samples) {
+                        hand_over_active_buffer();
+                }
+        }
+}
+
+void SigMFWriter::hand_over_active_buffer()
+{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_pending != -1) {
+                m_writer_stalls++;
+                m_cond.wait(lock, [this]{ return m_pending == -1; });
+        }
+        m_pending = (int)m_active;
+        m_pending_fill = m_fill;
+        lock.unlock();
+        m_cond.notify_all();
+        m_active ^= 1;
+        m_fill = 0;
+}
+
+void SigMFWriter::writer_loop()
+{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+                m_cond.wait(lock, [this]{ return m_stop || m_pending != -1; });
+                if (m_pending == -1) {
+                        break;
+                }
+                std::vector<std::complex<int16_t>> &buff =
+                        m_buffers[m_pending];
+                size_t no_of_samples = m_pending_fill;
+                lock.unlock();
+                size_t written = std::fwrite(buff.data(),
+                                             sizeof(std::complex<int16_t>),
+                                             no_of_samples,
+                                             m_data_file);
+                lock.lock();
+                if (written != no_of_samples) {
+                        m_write_error = true;
+                }
+                m_pending = -1;
+                m_cond.notify_all();
+        }
+}
+
+void SigMFWriter::annotate(uint64_t sample_start, uint64_t sample_count,
+                           std::string label)
+{
+        std::lock_guard<std::mutex> lock(m_meta_mutex);
+        m_annotations.push_back({sample_start, sample_count, label});
+}
+
+void SigMFWriter::add_capture(uint64_t sample_start, int64_t time_hw_ns)
+{
+        std::lock_guard<std::mutex> lock(m_meta_mutex);
+        m_captures.push_back({sample_start, time_hw_ns});
+}
+
+uint64_t SigMFWriter::get_sample_count()
+{
+        return m_sample_count;
+}
+
+void SigMFWriter::close()
+{
+        if (m_closed) {
+                return;
+        }
+        if (m_fill > 0) {
+                hand_over_active_buffer();
+        }
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+        }
+        m_cond.notify_all();
+        m_writer.join();
+        std::fclose(m_data_file);
+        m_closed = true;
+        write_meta();
+        std::cout << "sigmf: Recorded " << m_sample_count
+                  << " samples to " << m_basename << ".sigmf-data"
+                  << ", writer stalls " << m_writer_stalls
+                  << std::endl;
+        if (m_write_error) {
+                std::cout << "sigmf: Warning, not all samples were written!"
+                          << std::endl;
+        }
+}
+
+void SigMFWriter::write_meta()
+{
+        std::lock_guard<std::mutex> lock(m_meta_mutex);
+        std::string file = m_basename + ".sigmf-meta";
+        std::ofstream meta(file);
+        if (!meta) {
+                std::cout << "sigmf: Could not open meta file: "
+                          << file << std::endl;
+                return;
+        }
+        meta << std::setprecision(15);
+        meta << "{" << std::endl;
+        meta << "    \"global\": {" << std::endl;
+        meta << "        \"core:datatype\": \"ci16_le\"," << std::endl;
+        meta << "        \"core:sample_rate\": " << m_sample_rate << ","
+             << std::endl;
+        meta << "        \"core:version\": \"1.0.0\"," << std::endl;
+        meta << "        \"core:hw\": \"" << json_escape(m_hw) << "\","
+             << std::endl;
+        meta << "        \"core:recorder\": \"limesdr\"," << std::endl;
+        meta << "        \"core:extensions\": [{\"name\": \"wittra\","
+             << " \"version\": \"0.0.1\", \"optional\": true}],"
+             << std::endl;
+        meta << "        \"wittra:rx_gain\": " << m_rx_gain << ","
+             << std::endl;
+        meta << "        \"wittra:tx_gain\": " << m_tx_gain << std::endl;
+        meta << "    }," << std::endl;
+        meta << "    \"captures\": [";
+        if (m_captures.empty()) {
+                m_captures.push_back({0, 0});
+        }
+        for (size_t n=0; n<m_captures.size(); n++) {
+                meta << (n == 0 ? "" : ",") << std::endl;
+                meta << "        {\"core:sample_start\": "
+                     << m_captures[n].sample_start
+                     << ", \"core:frequency\": " << m_frequency;
+                if (n == 0) {
+                        meta << ", \"core:datetime\": \"" << m_datetime
+                             << "\"";
+                }
+                meta << ", \"wittra:hw_ns\": " << m_captures[n].time_hw_ns
+                     << "}";
+        }
+        meta << std::endl << "    ]," << std::endl;
+        meta << "    \"annotations\": [";
+        std::sort(m_annotations.begin(), m_annotations.end(),
+                  [](const SigMFAnnotation &a, const SigMFAnnotation &b) {
+                          return a.sample_start < b.sample_start;
+                  });
+        for (size_t n=0; n<m_annotations.size(); n++) {
+                meta << (n == 0 ? "" : ",") << std::endl;
+                meta << "        {\"core:sample_start\": "
+                     << m_annotations[n].sample_start
+                     << ", \"core:sample_count\": "
+                     << m_annotations[n].sample_count
+                     << ", \"core:label\": \""
+                     << json_escape(m_annotations[n].label) << "\"}";
+        }
+        meta << std::endl << "    ]" << std::endl;
+        meta << "}" << std::endl;
+}
+
+std::string SigMFWriter::datetime_now()
+{
+        std::time_t now = std::chrono::system_clock::to_time_t(
+                std::chrono::system_clock::now());
+        std::tm utc;
+        gmtime_r(&now, &utc);
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        return std::string(buf);
+}
@@ -0,0 +1,298 @@
+/**
+ * \file sim_radio.cpp
+ *
+ * \brief Simulated radio class
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "sim_radio.h"
+#include "logger.h"
+
+#include <cmath>
+#include <thread>
+
+SimRadio::SimRadio()
+        : m_rx_next_hw_ns(0),
+          m_start_hw_ns(0),
+          m_next_overflow_hw_ns(-1),
+          m_first_tx_hw_ns(-1)
+{}
+
+void SimRadio::configure(SDR_Device_Config dev_cfg)
+{
+        m_dev_cfg = dev_cfg;
+        configure_timeline();
+        // The beacon hears the PONGs of all tags, each in its own slot
+        uint32_t code_nr = m_dev_cfg.ping_scr_code;
+        size_t no_of_tags(1);
+        if (m_dev_cfg.is_beacon) {
+                code_nr = m_dev_cfg.pong_scr_code;
+                no_of_tags = std::max((size_t)1, m_dev_cfg.no_of_tags);
+        }
+        double scale_factor(1.0);
+        double extra_samples_for_filter = m_dev_cfg.extra_samples_filter;
+        size_t mod_length = m_dev_cfg.tx_burst_length_chip;
+        mod_length = mod_length * (1 + extra_samples_for_filter);
+        m_bursts.clear();
+        for (size_t tag=0; tag<no_of_tags; tag++) {
+                Modulator modulator(mod_length, scale_factor,
+                                    m_dev_cfg.Novs_rx);
+                modulator.generate_cdma(code_nr + tag);
+                modulator.filter();
+                modulator.scrap_samples(mod_length *
+                                        extra_samples_for_filter);
+                std::vector<std::complex<float>> burst =
+                        modulator.get_data();
+                for (size_t n=0; n<burst.size(); n++) {
+                        burst[n] *= (float)m_dev_cfg.sim_burst_amplitude;
+                }
+                m_bursts.push_back(burst);
+        }
+        m_rng.seed(m_dev_cfg.sim_seed);
+        m_noise = std::normal_distribution<float>(
+                0, m_dev_cfg.sim_noise_amplitude);
+        std::cout << "sim: Simulating code " << code_nr;
+        if (no_of_tags > 1) {
+                std::cout << " to " << code_nr + no_of_tags - 1;
+        }
+        std::cout << ", clock drift " << m_dev_cfg.sim_clock_drift_ppm
+                  << " ppm" << std::endl;
+        if (m_dev_cfg.rx_active && (m_dev_cfg.record_basename != "")) {
+                start_recording(m_dev_cfg.sampling_rate_rx,
+                                m_dev_cfg.rx_frequency,
+                                m_dev_cfg.rx_gain,
+                                m_dev_cfg.tx_gain,
+                                "simulated");
+        }
+}
+
+int64_t SimRadio::start()
+{
+        m_start_hw_ns = 0;
+        m_clock.set(m_start_hw_ns);
+        m_start_wall = std::chrono::steady_clock::now();
+        int64_t rx_future_rel_ns =
+                (m_dev_cfg.time_in_future + m_dev_cfg.burst_period) * 1e9;
+        m_rx_next_hw_ns = m_start_hw_ns + rx_future_rel_ns;
+        m_next_overflow_hw_ns = -1;
+        if (m_dev_cfg.sim_overflow_period > 0) {
+                m_next_overflow_hw_ns = m_rx_next_hw_ns +
+                        (int64_t)(m_dev_cfg.sim_overflow_period * 1e9);
+        }
+        return 0;
+}
+
+int32_t SimRadio::read(size_t no_of_samples,
+                       std::complex<int16_t> *buff_data)
+{
+        if (inject_overflow(no_of_samples)) {
+                return SOAPY_SDR_OVERFLOW;
+        }
+        TraceSpan span(TRACE_READ);
+        int64_t time_hw_ns = generate(no_of_samples, buff_data);
+        store_rx_block(buff_data, no_of_samples, time_hw_ns, 0);
+        span.set_hw_ns(time_hw_ns);
+        span.set_value(no_of_samples);
+        return no_of_samples;
+}
+
+int32_t SimRadio::read_window(int64_t start_hw_ns, size_t no_of_samples,
+                              std::complex<int16_t> *buff_data)
+{
+        if (start_hw_ns < m_rx_next_hw_ns) {
+                return SOAPY_SDR_TIME_ERROR;
+        }
+        m_rx_next_hw_ns = start_hw_ns;
+        if (inject_overflow(no_of_samples)) {
+                return SOAPY_SDR_OVERFLOW;
+        }
+        TraceSpan span(TRACE_READ, start_hw_ns);
+        generate(no_of_samples, buff_data);
+        store_rx_window(buff_data, no_of_samples, start_hw_ns);
+        span.set_value(no_of_samples);
+        return no_of_samples;
+}
+
+int64_t SimRadio::generate(size_t no_of_samples,
+                           std::complex<int16_t> *buff_data)
+{
+        for (size_t n=0; n<no_of_samples; n++) {
+                float re = m_noise(m_rng);
+                float im = m_noise(m_rng);
+                buff_data[n] = std::complex<int16_t>((int16_t)re,
+                                                     (int16_t)im);
+        }
+        int64_t time_hw_ns = m_rx_next_hw_ns;
+        add_bursts(buff_data, no_of_samples, time_hw_ns);
+        add_impairments(buff_data, no_of_samples);
+        m_rx_next_hw_ns += (int64_t)(no_of_samples * 1e9 /
+                                     m_dev_cfg.sampling_rate_rx);
+        pace(m_rx_next_hw_ns);
+        m_clock.set(m_rx_next_hw_ns);
+        return time_hw_ns;
+}
+
+void SimRadio::add_bursts(std::complex<int16_t> *buff_data,
+                          size_t no_of_samples, int64_t start_hw_ns)
+{
+        int64_t anchor_hw_ns;
+        if (m_dev_cfg.is_beacon) {
+                anchor_hw_ns = m_first_tx_hw_ns;
+                if (anchor_hw_ns < 0) {
+                        return;
+                }
+                anchor_hw_ns += (m_dev_cfg.pong_delay +
+                                 m_dev_cfg.pong_delay_processing) * 1e9;
+                // Offset the PONGs like a real tag does
+                anchor_hw_ns += m_dev_cfg.pong_pos_comp * 1e9 /
+                        m_dev_cfg.sampling_rate_rx;
+        } else {
+                anchor_hw_ns = m_start_hw_ns;
+        }
+        anchor_hw_ns += m_dev_cfg.sim_delay * 1e9;
+        for (size_t tag=0; tag<m_bursts.size(); tag++) {
+                int64_t slot_hw_ns = anchor_hw_ns +
+                        std::llround(slot_offset(m_dev_cfg, tag) * 1e9);
+                add_burst(buff_data, no_of_samples, start_hw_ns,
+                          slot_hw_ns, m_bursts[tag]);
+        }
+}
+
+void SimRadio::add_burst(std::complex<int16_t> *buff_data,
+                         size_t no_of_samples, int64_t start_hw_ns,
+                         int64_t anchor_hw_ns,
+                         const std::vector<std::complex<float>> &burst)
+{
+        const double fs = m_dev_cfg.sampling_rate_rx;
+        const double period_ns = m_dev_cfg.burst_period * 1e9 *
+                (1 + m_dev_cfg.sim_clock_drift_ppm * 1e-6);
+        const double burst_ns = burst.size() * 1e9 / fs;
+        const int64_t end_hw_ns = start_hw_ns +
+                (int64_t)(no_of_samples * 1e9 / fs);
+        int64_t k = (int64_t)std::ceil(
+                (start_hw_ns - burst_ns - anchor_hw_ns) / period_ns);
+        if (k < 0) {
+                k = 0;
+        }
+        while (true) {
+                double burst_hw_ns = anchor_hw_ns + k * period_ns;
+                if (burst_hw_ns >= end_hw_ns) {
+                        break;
+                }
+                int64_t ix = std::llround((burst_hw_ns - start_hw_ns) *
+                                          fs / 1e9);
+                for (size_t m=0; m<burst.size(); m++) {
+                        int64_t pos = ix + m;
+                        if ((pos < 0) || (pos >= (int64_t)no_of_samples)) {
+                                continue;
+                        }
+                        float re = buff_data[pos].real() + burst[m].real();
+                        float im = buff_data[pos].imag() + burst[m].imag();
+                        re = std::max(-32768.0f, std::min(32767.0f, re));
+                        im = std::max(-32768.0f, std::min(32767.0f, im));
+                        buff_data[pos] = std::complex<int16_t>((int16_t)re,
+                                                               (int16_t)im);
+                }
+                k++;
+        }
+}
+
+void SimRadio::add_impairments(std::complex<int16_t> *buff_data,
+                               size_t no_of_samples)
+{
+        if ((m_dev_cfg.sim_dc_offset == 0) && (m_dev_cfg.sim_iq_gain == 1) &&
+            (m_dev_cfg.sim_iq_phase == 0)) {
+                return;
+        }
+        // Q = gain * (cos(phase) Q + sin(phase) I), then the DC
+        const double phase = m_dev_cfg.sim_iq_phase * M_PI / 180;
+        const float q_from_q = m_dev_cfg.sim_iq_gain * std::cos(phase);
+        const float q_from_i = m_dev_cfg.sim_iq_gain * std::sin(phase);
+        const float dc = m_dev_cfg.sim_dc_offset;
+        for (size_t n=0; n<no_of_samples; n++) {
+                float re = buff_data[n].real() + dc;
+                float im = q_from_q * buff_data[n].imag() +
+                        q_from_i * buff_data[n].real() + dc;
+                re = std::max(-32768.0f, std::min(32767.0f, re));
+                im = std::max(-32768.0f, std::min(32767.0f, im));
+                buff_data[n] = std::complex<int16_t>((int16_t)re,
+                                                     (int16_t)im);
+        }
+}
+
+bool SimRadio::inject_overflow(size_t no_of_samples)
+{
+        if ((m_next_overflow_hw_ns < 0) ||
+            (m_rx_next_hw_ns < m_next_overflow_hw_ns)) {
+                return false;
+        }
+        m_next_overflow_hw_ns += (int64_t)(m_dev_cfg.sim_overflow_period *
+                                           1e9);
+        // Half a read is lost, so the next block starts off the grid
+        m_rx_next_hw_ns += (int64_t)((no_of_samples / 2) * 1e9 /
+                                     m_dev_cfg.sampling_rate_rx);
+        pace(m_rx_next_hw_ns);
+        m_clock.set(m_rx_next_hw_ns);
+        m_timeline.note_overflow();
+        return true;
+}
+
+void SimRadio::pace(int64_t end_hw_ns)
+{
+        if (m_dev_cfg.sim_realtime) {
+                std::this_thread::sleep_until(
+                        m_start_wall +
+                        std::chrono::nanoseconds(end_hw_ns - m_start_hw_ns));
+        }
+}
+
+size_t SimRadio::write(const std::vector<void *> &data, size_t no_of_samples,
+                       long long int burst_time)
+{
+        (void)data;
+        int64_t no_tx_yet(-1);
+        m_first_tx_hw_ns.compare_exchange_strong(no_tx_yet, burst_time);
+        int64_t tx_lead_rel_ns = (m_dev_cfg.time_in_future +
+                                  2 * m_dev_cfg.burst_period) * 1e9;
+        TraceSpan span(TRACE_WRITE, burst_time);
+        if (!m_clock.wait_until(burst_time - tx_lead_rel_ns,
+                                m_dev_cfg.timeout)) {
+                span.set_value(SOAPY_SDR_TIMEOUT);
+                return SOAPY_SDR_TIMEOUT;
+        }
+        span.set_value(no_of_samples);
+        return no_of_samples;
+}
+
+int64_t SimRadio::get_hardware_time()
+{
+        if (m_dev_cfg.sim_realtime) {
+                // The clock runs on between the reads, like on hardware
+                int64_t elapsed_ns =
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() -
+                                m_start_wall).count();
+                return std::max(m_clock.now(), m_start_hw_ns + elapsed_ns);
+        }
+        return m_clock.now();
+}
+
+int64_t SimRadio::check_burst_time(long long int burst_hw_ns)
+{
+        int64_t current_hw_ns = get_hardware_time();
+        if ((burst_hw_ns - current_hw_ns) < 0) {
+                g_logger.log(SOAPY_SDR_WARNING,
+                             "burst_hw_ns: {} current time: {} diff: {}",
+                             (int64_t)burst_hw_ns, current_hw_ns,
+                             burst_hw_ns - current_hw_ns);
+        }
+        return burst_hw_ns - current_hw_ns;
+}
+
+void SimRadio::close()
+{
+        close_recording();
+}
@@ -0,0 +1,488 @@
+/**
+ * \file spectrum.cpp
+ *
+ * \brief Streaming Welch PSD of the RX data
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "spectrum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+const char spectrum_file_magic[8] = {'W', 'T', 'R', 'P', 'S', 'D', 0, 0};
+
+SpectrumWindow parse_spectrum_window(std::string name)
+{
+        if (name == "rect") {
+                return WINDOW_RECT;
+        } else if (name == "hann") {
+                return WINDOW_HANN;
+        } else if (name == "blackman-harris") {
+                return WINDOW_BLACKMAN_HARRIS;
+        }
+        throw std::runtime_error("Unknown spectrum window: " + name);
+}
+
+void make_spectrum_window(SpectrumWindow window, size_t size, float *taps)
+{
+        // Periodic windows, as for spectral analysis
+        for (size_t n=0; n<size; n++) {
+                double x = 2 * M_PI * n / size;
+                switch (window) {
+                case WINDOW_HANN:
+                        taps[n] = 0.5 - 0.5 * std::cos(x);
+                        break;
+                case WINDOW_BLACKMAN_HARRIS:
+                        taps[n] = 0.35875 - 0.48829 * std::cos(x) +
+                                0.14128 * std::cos(2 * x) -
+                                0.01168 * std::cos(3 * x);
+                        break;
+                default:
+                        taps[n] = 1;
+                        break;
+                }
+        }
+}
+
+FftPlan::FftPlan()
+        : m_size(0)
+{}
+
+void FftPlan::configure(size_t size)
+{
+        if ((size < 2) || ((size & (size - 1)) != 0)) {
+                throw std::runtime_error(
+                        "spectrum: FFT size must be a power of two");
+        }
+        m_size = size;
+        size_t no_of_bits(0);
+        while (((size_t)1 << no_of_bits) < size) {
+                no_of_bits++;
+        }
+        m_swaps.clear();
+        for (size_t n=0; n<size; n++) {
+                size_t reversed(0);
+                for (size_t bit=0; bit<no_of_bits; bit++) {
+                        reversed |= ((n >> bit) & 1) << (no_of_bits - 1 - bit);
+                }
+                if (n < reversed) {
+                        m_swaps.push_back(std::make_pair((uint32_t)n,
+                                                         (uint32_t)reversed));
+                }
+        }
+        m_twiddles_re.resize(size / 2);
+        m_twiddles_im.resize(size / 2);
+        for (size_t k=0; k<size/2; k++) {
+                double phase = -2 * M_PI * k / size;
+                m_twiddles_re[k] = std::cos(phase);
+                m_twiddles_im[k] = std::sin(phase);
+        }
+}
+
+size_t FftPlan::size() const
+{
+        return m_size;
+}
+
+void FftPlan::transform(float *re, float *im) const
+{
+        for (const std::pair<uint32_t, uint32_t> &swap : m_swaps) {
+                std::swap(re[swap.first], re[swap.second]);
+                std::swap(im[swap.first], im[swap.second]);
+        }
+        // The twiddles of the first stage are all 1
+        for (size_t start=0; start<m_size; start+=2) {
+                float re_b = re[start + 1];
+                float im_b = im[start + 1];
+                re[start + 1] = re[start] - re_b;
+                im[start + 1] = im[start] - im_b;
+                re[start] += re_b;
+                im[start] += im_b;
+        }
+        for (size_t length=4; length<=m_size; length*=2) {
+                const size_t half = length / 2;
+                const size_t step = m_size / length;
+                for (size_t start=0; start<m_size; start+=length) {
+                        float *re_a = re + start;
+                        float *im_a = im + start;
+                        float *re_b = re_a + half;
+                        float *im_b = im_a + half;
+                        for (size_t k=0; k<half; k++) {
+                                const float w_re = m_twiddles_re[k * step];
+                                const float w_im = m_twiddles_im[k * step];
+                                float t_re = w_re * re_b[k] - w_im * im_b[k];
+                                float t_im = w_re * im_b[k] + w_im * re_b[k];
+                                re_b[k] = re_a[k] - t_re;
+                                im_b[k] = im_a[k] - t_im;
+                                re_a[k] += t_re;
+                                im_a[k] += t_im;
+                        }
+                }
+        }
+}
+
+WelchPsd::WelchPsd()
+        : m_hop(0),
+          m_scale(0),
+          m_sampling_rate(0),
+          m_no_of_averages(1),
+          m_exponential(false),
+          m_max_hold(false),
+          m_fill(0),
+          m_frame_segments(0),
+          m_no_of_segments(0),
+          m_no_of_frames(0),
+          m_frame_ready(false)
+{}
+
+void WelchPsd::configure(const SDR_Device_Config &dev_cfg)
+{
+        if ((dev_cfg.spectrum_overlap < 0) ||
+            (dev_cfg.spectrum_overlap >= 1) ||
+            (dev_cfg.spectrum_averages == 0)) {
+                throw std::runtime_error(
+                        "spectrum: Bad overlap or number of averages");
+        }
+        const size_t fft_size = dev_cfg.spectrum_fft_size;
+        m_plan.configure(fft_size);
+        m_window.resize(fft_size);
+        make_spectrum_window(
+                parse_spectrum_window(dev_cfg.spectrum_window), fft_size,
+                m_window.data());
+        m_hop = std::max((size_t)1, (size_t)std::llround(
+                                 fft_size * (1 - dev_cfg.spectrum_overlap)));
+        m_sampling_rate = dev_cfg.sampling_rate_rx;
+        double window_power(0);
+        for (float tap : m_window) {
+                window_power += tap * tap;
+        }
+        const double full_scale = 32768;
+        m_scale = 1 / (m_sampling_rate * window_power *
+                       full_scale * full_scale);
+        m_no_of_averages = dev_cfg.spectrum_averages;
+        m_exponential = dev_cfg.spectrum_exponential;
+        m_max_hold = dev_cfg.spectrum_max_hold;
+        m_segment.resize(fft_size);
+        m_fft_re.resize(fft_size);
+        m_fft_im.resize(fft_size);
+        m_power.resize(fft_size);
+        m_psd_db.resize(fft_size);
+        m_max_hold_db.resize(m_max_hold ? fft_size : 0);
+        reset();
+}
+
+size_t WelchPsd::add_samples(const std::complex<int16_t> *data,
+                             size_t no_of_samples)
+{
+        m_frame_ready = false;
+        const size_t fft_size = m_plan.size();
+        size_t used(0);
+        while (used < no_of_samples) {
+                size_t count = std::min(no_of_samples - used,
+                                        fft_size - m_fill);
+                std::copy(data + used, data + used + count,
+                          m_segment.begin() + m_fill);
+                m_fill += count;
+                used += count;
+                if (m_fill < fft_size) {
+                        break;
+                }
+                process_segment();
+                // The overlap starts the next segment
+                std::copy(m_segment.begin() + m_hop, m_segment.end(),
+                          m_segment.begin());
+                m_fill = fft_size - m_hop;
+                if (m_frame_ready) {
+                        break;
+                }
+        }
+        return used;
+}
+
+void WelchPsd::restart_segment()
+{
+        m_fill = 0;
+}
+
+void WelchPsd::reset()
+{
+        m_fill = 0;
+        m_frame_segments = 0;
+        m_no_of_segments = 0;
+        m_no_of_frames = 0;
+        m_frame_ready = false;
+        std::fill(m_power.begin(), m_power.end(), 0);
+}
+
+bool WelchPsd::is_frame_ready() const
+{
+        return m_frame_ready;
+}
+
+const std::vector<float> &WelchPsd::get_psd_db() const
+{
+        return m_psd_db;
+}
+
+const std::vector<float> &WelchPsd::get_max_hold_db() const
+{
+        return m_max_hold_db;
+}
+
+size_t WelchPsd::get_fft_size() const
+{
+        return m_plan.size();
+}
+
+double WelchPsd::get_bin_hz() const
+{
+        return m_sampling_rate / m_plan.size();
+}
+
+uint64_t WelchPsd::get_no_of_segments() const
+{
+        return m_no_of_segments;
+}
+
+uint64_t WelchPsd::get_no_of_frames() const
+{
+        return m_no_of_frames;
+}
+
+void WelchPsd::process_segment()
+{
+        const size_t fft_size = m_plan.size();
+        float *re = m_fft_re.data();
+        float *im = m_fft_im.data();
+        for (size_t n=0; n<fft_size; n++) {
+                re[n] = m_segment[n].real() * m_window[n];
+                im[n] = m_segment[n].imag() * m_window[n];
+        }
+        m_plan.transform(re, im);
+        if (m_exponential) {
+                // A plain mean until there are no_of_averages segments
+                const float alpha = 1.0 / std::min(m_no_of_segments + 1,
+                                                   (uint64_t)m_no_of_averages);
+                for (size_t k=0; k<fft_size; k++) {
+                        float power = re[k] * re[k] + im[k] * im[k];
+                        m_power[k] += alpha * (power - m_power[k]);
+                }
+        } else {
+                for (size_t k=0; k<fft_size; k++) {
+                        m_power[k] += re[k] * re[k] + im[k] * im[k];
+                }
+        }
+        m_no_of_segments++;
+        m_frame_segments++;
+        if (m_frame_segments == m_no_of_averages) {
+                finish_frame();
+        }
+}
+
+void WelchPsd::finish_frame()
+{
+        const size_t fft_size = m_plan.size();
+        const double scale = m_exponential ? m_scale :
+                m_scale / m_frame_segments;
+        for (size_t n=0; n<fft_size; n++) {
+                // From -fs/2
+                size_t k = (n + fft_size / 2) % fft_size;
+                float psd_db = 10 * std::log10(
+                        std::max(m_power[k] * scale, 1e-30));
+                m_psd_db[n] = psd_db;
+                if (m_max_hold) {
+                        m_max_hold_db[n] = (m_no_of_frames == 0) ? psd_db :
+                                std::max(m_max_hold_db[n], psd_db);
+                }
+        }
+        if (!m_exponential) {
+                std::fill(m_power.begin(), m_power.end(), 0);
+        }
+        m_frame_segments = 0;
+        m_no_of_frames++;
+        m_frame_ready = true;
+}
+
+SpectrumMonitor::SpectrumMonitor(const SDR_Device_Config &dev_cfg,
+                                 LivePlot &live_plot)
+        : m_enabled(false),
+          m_duty_cycle(dev_cfg.spectrum_duty_cycle),
+          m_sampling_rate(dev_cfg.sampling_rate_rx),
+          m_frequency(dev_cfg.rx_frequency),
+          m_block_samples(dev_cfg.no_of_rx_samples_block),
+          m_offered_samples(0),
+          m_accepted_samples(0),
+          m_live_plot(live_plot),
+          m_filename(dev_cfg.spectrum_file),
+          m_file(nullptr),
+          m_write_error(false),
+          m_no_of_frames(0),
+          m_no_of_dropped(0)
+{
+        if (!dev_cfg.spectrum) {
+                return;
+        }
+        m_psd.configure(dev_cfg);
+        m_queue.reset(new RxPipeline(m_block_samples,
+                                     dev_cfg.spectrum_queue_depth, false));
+        if (m_filename != "") {
+                m_file = std::fopen(m_filename.c_str(), "wb");
+                if (m_file == nullptr) {
+                        throw std::runtime_error(
+                                "Could not open spectrum file: " +
+                                m_filename);
+                }
+                SpectrumFileHeader header;
+                std::memset(&header, 0, sizeof(header));
+                std::memcpy(header.magic, spectrum_file_magic,
+                            sizeof(header.magic));
+                header.version = spectrum_file_version;
+                header.fft_size = m_psd.get_fft_size();
+                header.flags =
+                        (dev_cfg.spectrum_max_hold ? SPECTRUM_MAX_HOLD : 0) |
+                        (dev_cfg.spectrum_exponential ?
+                         SPECTRUM_EXPONENTIAL : 0);
+                header.no_of_averages = dev_cfg.spectrum_averages;
+                header.sample_rate = m_sampling_rate;
+                header.frequency = m_frequency;
+                header.overlap = dev_cfg.spectrum_overlap;
+                header.window = parse_spectrum_window(
+                        dev_cfg.spectrum_window);
+                if (std::fwrite(&header, sizeof(header), 1, m_file) != 1) {
+                        std::fclose(m_file);
+                        throw std::runtime_error(
+                                "Could not write spectrum file: " +
+                                m_filename);
+                }
+        }
+        std::cout << "spectrum: Welch PSD of " << m_psd.get_fft_size()
+                  << " sample segments, " << dev_cfg.spectrum_averages
+                  << " per frame, " << m_duty_cycle * 100
+                  << " % of the RX samples" << std::endl;
+        m_enabled = true;
+        m_thread = std::thread(&SpectrumMonitor::monitor_loop, this);
+}
+
+SpectrumMonitor::~SpectrumMonitor()
+{
+        if (!m_thread.joinable()) {
+                return;
+        }
+        m_queue->close();
+        m_thread.join();
+        if (m_file != nullptr) {
+                std::fclose(m_file);
+        }
+        std::cout << "spectrum: " << m_no_of_frames.load() << " frames of "
+                  << m_psd.get_no_of_segments() << " segments, "
+                  << m_no_of_dropped.load() << " blocks dropped"
+                  << std::endl;
+}
+
+bool SpectrumMonitor::is_enabled() const
+{
+        return m_enabled;
+}
+
+void SpectrumMonitor::offer(const std::complex<int16_t> *data,
+                            size_t no_of_samples, int64_t time_hw_ns)
+{
+        if (!m_enabled) {
+                return;
+        }
+        for (size_t start=0; start<no_of_samples; start+=m_block_samples) {
+                size_t count = std::min(m_block_samples,
+                                        no_of_samples - start);
+                m_offered_samples += count;
+                if (m_accepted_samples + count >
+                    m_duty_cycle * m_offered_samples) {
+                        continue;
+                }
+                std::memcpy(m_queue->get_fill_buffer(), data + start,
+                            count * sizeof(*data));
+                int64_t block_hw_ns = time_hw_ns + std::llround(
+                        start * 1e9 / m_sampling_rate);
+                // Skipped rather than holding up the RX loop
+                if (!m_queue->try_push(count, block_hw_ns, false)) {
+                        m_no_of_dropped.fetch_add(
+                                1, std::memory_order_relaxed);
+                        continue;
+                }
+                m_accepted_samples += count;
+        }
+}
+
+uint64_t SpectrumMonitor::get_no_of_frames() const
+{
+        return m_no_of_frames.load(std::memory_order_relaxed);
+}
+
+uint64_t SpectrumMonitor::get_no_of_dropped() const
+{
+        return m_no_of_dropped.load(std::memory_order_relaxed);
+}
+
+void SpectrumMonitor::monitor_loop()
+{
+        const double ns_per_sample = 1e9 / m_sampling_rate;
+        int64_t next_hw_ns(0);
+        PipelineBlock block;
+        while (m_queue->pop(block)) {
+                // Segments do not span gaps or skipped blocks
+                if (std::abs(block.time_hw_ns - next_hw_ns) >
+                    ns_per_sample / 2) {
+                        m_psd.restart_segment();
+                }
+                next_hw_ns = block.time_hw_ns + std::llround(
+                        block.no_of_samples * ns_per_sample);
+                const std::complex<int16_t> *data = m_queue->get_data(block);
+                const size_t no_of_samples = block.no_of_samples;
+                size_t used(0);
+                while (used < no_of_samples) {
+                        used += m_psd.add_samples(data + used,
+                                                  no_of_samples - used);
+                        if (m_psd.is_frame_ready()) {
+                                output_frame(block.time_hw_ns + std::llround(
+                                                     (used - 1) *
+                                                     ns_per_sample));
+                        }
+                }
+        }
+}
+
+void SpectrumMonitor::output_frame(int64_t time_hw_ns)
+{
+        const std::vector<float> &psd_db = m_psd.get_psd_db();
+        const std::vector<float> &max_hold_db = m_psd.get_max_hold_db();
+        if ((m_file != nullptr) && !m_write_error) {
+                SpectrumFrameHeader header;
+                header.time_hw_ns = time_hw_ns;
+                header.frame_no = m_psd.get_no_of_frames() - 1;
+                bool ok = (std::fwrite(&header, sizeof(header), 1,
+                                       m_file) == 1) &&
+                        (std::fwrite(psd_db.data(), sizeof(float),
+                                     psd_db.size(), m_file) ==
+                         psd_db.size()) &&
+                        (std::fwrite(max_hold_db.data(), sizeof(float),
+                                     max_hold_db.size(), m_file) ==
+                         max_hold_db.size());
+                if (!ok) {
+                        m_write_error = true;
+                        std::cout << "spectrum: Could not write "
+                                  << m_filename << std::endl;
+                }
+        }
+        m_live_plot.push_spectrum(
+                psd_db.data(),
+                max_hold_db.empty() ? nullptr : max_hold_db.data(),
+                psd_db.size(), m_frequency - m_sampling_rate / 2,
+                m_psd.get_bin_hz());
+        m_no_of_frames.fetch_add(1, std::memory_order_relaxed);
+}
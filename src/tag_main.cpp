@@ -15,7 +15,8 @@
 
 SoapySDR::Device *device(nullptr);
 
-static sig_atomic_t g_stop = false;
+// Read by the capture thread as well when pipelined
+static std::atomic<bool> g_stop(false);
 void sigIntHandler(const int)
 {
     g_stop = true;
@@ -43,16 +44,267 @@ int main(int argc, char** argv)
                                                      false, 0,
                                                      "uint32_t");
                 cmd.add(device_arg);
+                TCLAP::ValueArg<std::string> record_arg(
+                        "r", "record",
+                        "Record RX samples as SigMF to <basename>",
+                        false, "", "basename");
+                cmd.add(record_arg);
+                TCLAP::SwitchArg sim_switch("", "sim",
+                                            "Run on simulated data",
+                                            cmd, false);
+                TCLAP::ValueArg<std::string> replay_arg(
+                        "", "replay",
+                        "Run on data replayed from SigMF <basename>, or a"
+                        " .cs16 or .cf32 sample file",
+                        false, "", "basename");
+                cmd.add(replay_arg);
+                TCLAP::SwitchArg gated_switch(
+                        "", "rx-gated",
+                        "Only receive a window around the expected PING",
+                        cmd, false);
+                TCLAP::SwitchArg continuous_switch(
+                        "", "rx-continuous",
+                        "Stream RX continuously instead of in bursts",
+                        cmd, false);
+                TCLAP::ValueArg<int> rx_cpu_arg(
+                        "", "rx-cpu", "Pin the RX thread to <cpu>",
+                        false, -1, "cpu");
+                cmd.add(rx_cpu_arg);
+                TCLAP::ValueArg<int> tx_cpu_arg(
+                        "", "tx-cpu", "Pin the TX thread to <cpu>",
+                        false, -1, "cpu");
+                cmd.add(tx_cpu_arg);
+                TCLAP::ValueArg<int> rx_prio_arg(
+                        "", "rx-prio",
+                        "Run the RX thread SCHED_FIFO with <priority>",
+                        false, 0, "priority");
+                cmd.add(rx_prio_arg);
+                TCLAP::ValueArg<int> tx_prio_arg(
+                        "", "tx-prio",
+                        "Run the TX thread SCHED_FIFO with <priority>",
+                        false, 0, "priority");
+                cmd.add(tx_prio_arg);
+                TCLAP::SwitchArg mlock_switch("", "mlock",
+                                              "Lock and prefault memory",
+                                              cmd, false);
+                TCLAP::SwitchArg huge_pages_switch(
+                        "", "huge-pages",
+                        "Back the sample buffers with huge pages",
+                        cmd, false);
+                TCLAP::ValueArg<size_t> alloc_check_arg(
+                        "", "alloc-check",
+                        "Count heap allocations in <bursts> PING bursts"
+                        " after warm-up, then stop (tag_alloc_check)",
+                        false, 0, "bursts");
+                cmd.add(alloc_check_arg);
+                TCLAP::ValueArg<uint32_t> slot_arg(
+                        "", "slot",
+                        "TDMA slot, selects the PONG code and delay",
+                        false, 0, "slot");
+                cmd.add(slot_arg);
+                TCLAP::ValueArg<double> sim_drift_arg(
+                        "", "sim-drift",
+                        "Simulated beacon clock drift in <ppm>",
+                        false, 0, "ppm");
+                cmd.add(sim_drift_arg);
+                TCLAP::SwitchArg sim_realtime_switch(
+                        "", "sim-realtime",
+                        "Pace the simulated radio to the wall clock",
+                        cmd, false);
+                TCLAP::SwitchArg pipelined_switch(
+                        "", "pipelined",
+                        "Capture and detect in separate threads",
+                        cmd, false);
+                TCLAP::ValueArg<int> detect_cpu_arg(
+                        "", "detect-cpu",
+                        "Pin the detection thread to <cpu> when pipelined",
+                        false, -1, "cpu");
+                cmd.add(detect_cpu_arg);
+                TCLAP::ValueArg<int> detect_prio_arg(
+                        "", "detect-prio",
+                        "Run the detection thread SCHED_FIFO with"
+                        " <priority> when pipelined",
+                        false, 0, "priority");
+                cmd.add(detect_prio_arg);
+                TCLAP::ValueArg<double> pong_processing_arg(
+                        "", "pong-processing",
+                        "Time for detection before the PONG, must match"
+                        " the beacon",
+                        false, SDR_Device_Config().pong_delay_processing /
+                        SDR_Device_Config().burst_period, "burst periods");
+                cmd.add(pong_processing_arg);
+                TCLAP::SwitchArg low_latency_switch(
+                        "", "low-latency",
+                        "Detect the PING in a gated window and answer in"
+                        " the first burst period the detection allows",
+                        cmd, false);
+                TCLAP::ValueArg<std::string> results_arg(
+                        "", "results",
+                        "Publish the detected PINGs to POSIX shm <name>",
+                        false, "", "name");
+                cmd.add(results_arg);
+                TCLAP::ValueArg<std::string> trace_arg(
+                        "", "trace",
+                        "Trace the stages of each burst to Chrome trace"
+                        " <file>, written at exit and on SIGUSR1",
+                        false, "", "file");
+                cmd.add(trace_arg);
+                TCLAP::ValueArg<std::string> metrics_arg(
+                        "", "metrics",
+                        "Write counters and latency histograms to"
+                        " Prometheus textfile <file>",
+                        false, "", "file");
+                cmd.add(metrics_arg);
+                TCLAP::SwitchArg live_plot_switch(
+                        "", "live-plot",
+                        "Plot the RX data and the correlation in gnuplot"
+                        " while running",
+                        cmd, false);
+                TCLAP::SwitchArg spectrum_switch(
+                        "", "spectrum",
+                        "Estimate the PSD of the RX data in the background,"
+                        " shown in the live plot",
+                        cmd, false);
+                TCLAP::ValueArg<std::string> spectrum_file_arg(
+                        "", "spectrum-file",
+                        "Write the PSD frames to binary <file>, implies"
+                        " --spectrum",
+                        false, "", "file");
+                cmd.add(spectrum_file_arg);
+                TCLAP::ValueArg<size_t> spectrum_fft_arg(
+                        "", "spectrum-fft",
+                        "Samples per PSD segment, a power of two",
+                        false, SDR_Device_Config().spectrum_fft_size,
+                        "samples");
+                cmd.add(spectrum_fft_arg);
+                TCLAP::ValueArg<size_t> spectrum_averages_arg(
+                        "", "spectrum-averages",
+                        "Segments per PSD frame",
+                        false, SDR_Device_Config().spectrum_averages,
+                        "segments");
+                cmd.add(spectrum_averages_arg);
+                TCLAP::SwitchArg spectrum_exponential_switch(
+                        "", "spectrum-exponential",
+                        "Average the PSD exponentially over the frames",
+                        cmd, false);
+                TCLAP::SwitchArg spectrum_max_hold_switch(
+                        "", "spectrum-max-hold",
+                        "Keep the max of the PSD frames as well",
+                        cmd, false);
+                TCLAP::ValueArg<std::string> spectrum_window_arg(
+                        "", "spectrum-window",
+                        "PSD window: hann, blackman-harris or rect",
+                        false, SDR_Device_Config().spectrum_window,
+                        "window");
+                cmd.add(spectrum_window_arg);
+                TCLAP::ValueArg<double> spectrum_duty_arg(
+                        "", "spectrum-duty-cycle",
+                        "Fraction of the RX samples in the PSD",
+                        false, SDR_Device_Config().spectrum_duty_cycle,
+                        "fraction");
+                cmd.add(spectrum_duty_arg);
+                TCLAP::SwitchArg no_dc_iq_switch(
+                        "", "no-dc-iq-correction",
+                        "Do not remove the DC offset and the IQ imbalance"
+                        " before the correlation",
+                        cmd, false);
+                TCLAP::ValueArg<double> sim_dc_arg(
+                        "", "sim-dc-offset",
+                        "Simulated DC offset of I and Q",
+                        false, 0, "offset");
+                cmd.add(sim_dc_arg);
+                TCLAP::ValueArg<double> sim_iq_gain_arg(
+                        "", "sim-iq-gain",
+                        "Simulated Q to I amplitude <ratio>",
+                        false, 1, "ratio");
+                cmd.add(sim_iq_gain_arg);
+                TCLAP::ValueArg<double> sim_iq_phase_arg(
+                        "", "sim-iq-phase",
+                        "Simulated phase error of Q in <degrees>",
+                        false, 0, "degrees");
+                cmd.add(sim_iq_phase_arg);
+                TCLAP::ValueArg<double> sim_overflow_arg(
+                        "", "sim-overflow-period",
+                        "Simulate an RX overflow every <seconds>, 0 for none",
+                        false, 0, "seconds");
+                cmd.add(sim_overflow_arg);
+                TCLAP::ValueArg<int> log_level_arg(
+                        "", "log-level",
+                        "Most detailed messages logged: 3 error, 4 warning,"
+                        " 6 info, 7 debug",
+                        false, SDR_Device_Config().log_level, "level");
+                cmd.add(log_level_arg);
                 cmd.parse(argc, argv);
                 bool start_tag = start_switch.getValue();
                 bool plot_data = plot_switch.getValue();
                 bool list_dev_info = list_switch.getValue();
                 uint32_t device = device_arg.getValue();
+                SDR_Device_Config dev_cfg;
+                dev_cfg.record_basename = record_arg.getValue();
+                dev_cfg.simulate = sim_switch.getValue();
+                dev_cfg.replay_basename = replay_arg.getValue();
+                dev_cfg.rx_continuous = continuous_switch.getValue();
+                dev_cfg.rx_cpu = rx_cpu_arg.getValue();
+                dev_cfg.tx_cpu = tx_cpu_arg.getValue();
+                dev_cfg.rx_priority = rx_prio_arg.getValue();
+                dev_cfg.tx_priority = tx_prio_arg.getValue();
+                dev_cfg.memory_lock = mlock_switch.getValue();
+                dev_cfg.rx_gated = gated_switch.getValue();
+                dev_cfg.huge_pages = huge_pages_switch.getValue();
+                dev_cfg.tag_slot = slot_arg.getValue();
+                dev_cfg.sim_clock_drift_ppm = sim_drift_arg.getValue();
+                dev_cfg.sim_realtime = sim_realtime_switch.getValue();
+                dev_cfg.rx_pipelined = pipelined_switch.getValue();
+                dev_cfg.pong_low_latency = low_latency_switch.getValue();
+                dev_cfg.results_shm = results_arg.getValue();
+                dev_cfg.trace_file = trace_arg.getValue();
+                dev_cfg.metrics_file = metrics_arg.getValue();
+                dev_cfg.live_plot = live_plot_switch.getValue();
+                dev_cfg.spectrum_file = spectrum_file_arg.getValue();
+                dev_cfg.spectrum = spectrum_switch.getValue() ||
+                        (dev_cfg.spectrum_file != "");
+                dev_cfg.spectrum_fft_size = spectrum_fft_arg.getValue();
+                dev_cfg.spectrum_averages = spectrum_averages_arg.getValue();
+                dev_cfg.spectrum_exponential =
+                        spectrum_exponential_switch.getValue();
+                dev_cfg.spectrum_max_hold =
+                        spectrum_max_hold_switch.getValue();
+                dev_cfg.spectrum_window = spectrum_window_arg.getValue();
+                dev_cfg.spectrum_duty_cycle = spectrum_duty_arg.getValue();
+                dev_cfg.dc_iq_correction = !no_dc_iq_switch.getValue();
+                dev_cfg.sim_dc_offset = sim_dc_arg.getValue();
+                dev_cfg.sim_iq_gain = sim_iq_gain_arg.getValue();
+                dev_cfg.sim_iq_phase = sim_iq_phase_arg.getValue();
+                dev_cfg.sim_overflow_period = sim_overflow_arg.getValue();
+                dev_cfg.log_level =
+                        (SoapySDRLogLevel)log_level_arg.getValue();
+                g_logger.set_level(dev_cfg.log_level);
+                SoapySDR::registerLogHandler(soapy_log_handler);
+                dev_cfg.rx_gated |= dev_cfg.pong_low_latency;
+                // The capture thread streams, gaps would break the history
+                dev_cfg.rx_continuous |= dev_cfg.rx_pipelined;
+                dev_cfg.detect_cpu = detect_cpu_arg.getValue();
+                dev_cfg.detect_priority = detect_prio_arg.getValue();
+                dev_cfg.pong_delay_processing =
+                        pong_processing_arg.getValue() * dev_cfg.burst_period;
+                size_t alloc_check_bursts = alloc_check_arg.getValue();
+                if ((alloc_check_bursts > 0) && !has_alloc_counter()) {
+                        std::cerr << "error: This build does not count heap"
+                                  << " allocations, use tag_alloc_check"
+                                  << std::endl;
+                        return EXIT_FAILURE;
+                }
                 if (list_dev_info) {
                         list_device_info();
                 }
                 if (start_tag) {
-                        run_tag(plot_data, device);
+                        g_logger.start();
+                        bool tag_ok = run_tag(plot_data, device, dev_cfg,
+                                              alloc_check_bursts);
+                        g_logger.stop();
+                        if (!tag_ok) {
+                                return EXIT_FAILURE;
+                        }
                 }
 
         }
@@ -70,9 +322,9 @@ void list_device_info()
         sdr.list_hw_info();
 }
 
-void run_tag(bool plot_data, uint32_t device)
+bool run_tag(bool plot_data, uint32_t device, SDR_Device_Config dev_cfg,
+             size_t alloc_check_bursts)
 {
-        SDR_Device_Config dev_cfg;
         std::string dev_serial = "";
         switch(device) {
         case 1:
@@ -95,141 +347,328 @@ void run_tag(bool plot_data, uint32_t device)
                 dev_cfg.tx_frequency = dev_cfg.pong_frequency;
                 dev_cfg.rx_frequency = dev_cfg.ping_frequency;
         }
+        if (dev_cfg.simulate) {
+                SimRadio radio;
+                return run_tag_loop(radio, dev_cfg, plot_data,
+                                    alloc_check_bursts);
+        } else if (dev_cfg.replay_basename != "") {
+                FileRadio radio(dev_cfg.replay_basename);
+                return run_tag_loop(radio, dev_cfg, plot_data,
+                                    alloc_check_bursts);
+        }
+        SDR sdr;
+        SoapySDR::setLogLevel(dev_cfg.log_level);
+        sdr.connect(dev_serial);
+        return run_tag_loop(sdr, dev_cfg, plot_data, alloc_check_bursts);
+}
+
+template <typename RadioType>
+bool run_tag_loop(RadioType &radio, SDR_Device_Config dev_cfg,
+                  bool plot_data, size_t alloc_check_bursts)
+{
+        if (dev_cfg.rx_pipelined) {
+                return run_tag_pipeline(radio, dev_cfg, alloc_check_bursts);
+        }
         const size_t no_of_samples_initial_sync =
                 dev_cfg.no_of_rx_samples_initial_sync;
         const size_t no_of_samples_ping =
                 dev_cfg.no_of_rx_samples_ping;
+        const size_t no_of_samples_window = no_of_window_samples(dev_cfg);
+        const bool gated = dev_cfg.rx_gated && !dev_cfg.rx_continuous;
+        // The guard of a gated read can not go beyond the window
+        const int64_t max_window_guard = dev_cfg.ping_burst_guard +
+                dev_cfg.rx_gate_margin;
 
         std::cout << "No of samples to read in initial sync: "
                   << no_of_samples_initial_sync << std::endl;
 
-        SDR sdr;
-        SoapySDR::setLogLevel(dev_cfg.log_level);
-        sdr.connect(dev_serial);
-        sdr.configure(dev_cfg);
-        sdr.start();
+        radio.configure(dev_cfg);
+        radio.start();
 
-        std::vector<std::complex<int16_t>> buff_data_initial(
-                no_of_samples_initial_sync);
-        std::vector<std::complex<int16_t>> buff_data_ping(
-                no_of_samples_ping);
+        /* All sample buffers of the loop, including the ones of the
+         * detector, are taken from the pool, so the heap is not
+         * touched once the loop is running.
+         */
+        BufferPool pool(Detector::get_buffer_bytes(dev_cfg),
+                        dev_cfg.buffer_pool_size, dev_cfg.huge_pages);
+        PoolBuffer<std::complex<int16_t>> buff_data_initial(
+                pool, no_of_samples_initial_sync);
+        PoolBuffer<std::complex<int16_t>> buff_data_ping(
+                pool, no_of_samples_ping);
+        PoolBuffer<std::complex<int16_t>> buff_data_window(
+                pool, no_of_samples_window);
+        if (gated) {
+                std::cout << "Gated RX, window of "
+                          << no_of_samples_window << " samples"
+                          << std::endl;
+        }
         Detector detector;
-        detector.configure(CDMA, {dev_cfg.ping_scr_code}, dev_cfg);
+        detector.configure(CDMA, {dev_cfg.ping_scr_code}, dev_cfg, pool);
+        TimingTracker tracker;
+        tracker.configure(dev_cfg);
+        PongScheduler scheduler;
+        scheduler.configure(dev_cfg);
+        g_tracer.configure(dev_cfg.trace_file, dev_cfg.trace_ring_size);
+        MetricsWriter metrics_writer(g_metrics.registry, dev_cfg.metrics_file,
+                                     dev_cfg.metrics_period);
+        LivePlot live_plot(dev_cfg);
+        SpectrumMonitor spectrum(dev_cfg, live_plot);
+        std::unique_ptr<ResultsPublisher> results;
+        if (dev_cfg.results_shm != "") {
+                results.reset(new ResultsPublisher(
+                                      dev_cfg.results_shm,
+                                      dev_cfg.results_ring_size));
+        }
+        const double fs_rx = dev_cfg.sampling_rate_rx;
+        // RX, detection and TX all run in this thread
+        configure_rt_thread("RX", dev_cfg.rx_cpu, dev_cfg.rx_priority);
 
         size_t buffer_size_tx = dev_cfg.tx_burst_length;
         size_t no_of_tx_samples = buffer_size_tx;
-        double scale_factor(1.0);
-        uint16_t Novs = dev_cfg.Novs_tx;
-        double extra_samples_for_filter = dev_cfg.extra_samples_filter;
-        size_t mod_length = dev_cfg.tx_burst_length_chip;
-        mod_length = mod_length * (1 + extra_samples_for_filter);
-        Modulator modulator(mod_length, scale_factor, Novs);
-        modulator.generate_cdma(dev_cfg.pong_scr_code);
-        modulator.filter();
-        modulator.scrap_samples(mod_length * extra_samples_for_filter);
-        std::vector<std::complex<float>> tx_buff_data = modulator.get_data();
+        std::vector<std::complex<float>> tx_buff_data =
+                generate_pong(dev_cfg);
         std::vector<void *> tx_buffs_data;
         tx_buffs_data.push_back(tx_buff_data.data());
         std::cout << "sample count per send call: "
                   << no_of_tx_samples << std::endl;
+        if (dev_cfg.memory_lock) {
+                lock_memory();
+                prefault(buff_data_initial.data(),
+                         buff_data_initial.size() *
+                         sizeof(buff_data_initial[0]));
+                prefault(buff_data_ping.data(),
+                         buff_data_ping.size() * sizeof(buff_data_ping[0]));
+                prefault(buff_data_window.data(),
+                         buff_data_window.size() *
+                         sizeof(buff_data_window[0]));
+                prefault_stack(dev_cfg.prefault_stack_size);
+        }
 
         size_t num_of_found_pings(0);
         size_t num_of_missed_pings(0);
         size_t tot_num_of_missed_pings(0);
         size_t num_ping_tries(0);
+        uint64_t num_of_rx_samples(0);
         int64_t sync_ix(-1);
         int64_t sync_hw_ns(0);
+        bool reanchor(false);
         TagStateMachine current_state(INITIAL_SYNC);
         std::cout << "**********************" << std::endl;
         std::cout << "Starting stream loop, press Ctrl+C to exit..."
                   << std::endl;
         std::cout << "Looking for inital sync" << std::endl;
         signal(SIGINT, sigIntHandler);
+        signal(SIGUSR1, trace_signal_handler);
         size_t num_syncs(0);
+        AllocCheck alloc_check(dev_cfg, alloc_check_bursts);
         //int64_t old_hw_time(0);
         //size_t num_packets(0);
         while (not g_stop) {
+                g_tracer.dump_if_requested();
                 switch(current_state) {
                 case INITIAL_SYNC: {
-                        int ret = sdr.read(no_of_samples_initial_sync,
-                                           buff_data_initial);
+                        int ret = radio.read(no_of_samples_initial_sync,
+                                             buff_data_initial.data());
                         if (return_ok(ret, no_of_samples_initial_sync)) {
-                                detector.add_data(buff_data_initial);
+                                num_of_rx_samples += ret;
+                                spectrum.offer(buff_data_initial.data(), ret,
+                                               radio.ix_to_hw_ns(0));
+                                detector.add_data(buff_data_initial.data(),
+                                                  ret);
                                 sync_ix = detector.look_for_initial_sync();
+                                live_plot.push(detector.get_corr_data(),
+                                               detector.get_corr_length(),
+                                               buff_data_initial.data(),
+                                               ret);
                                 if (detector.found_initial_sync(sync_ix)) {
                                         num_syncs++;
-                                        sync_hw_ns = sdr.ix_to_hw_ns(
+                                        sync_hw_ns = radio.ix_to_hw_ns(
                                                 sync_ix);
-                                        std::cout << "**** Found inital sync"
-                                                  << " at hw time "
-                                                  << sync_hw_ns
-                                                  << " index "
-                                                  << sync_ix
-                                                  << std::endl;
+                                        tracker.reset(
+                                                radio.ix_to_hw_ns(0) +
+                                                detector.get_peak_position() *
+                                                1e9 / fs_rx);
+                                        radio.annotate(sync_ix, "PING");
+                                        g_logger.log(
+                                                SOAPY_SDR_INFO,
+                                                "**** Found inital sync at"
+                                                " hw time {} index {}",
+                                                sync_hw_ns, sync_ix);
                                         current_state = SEARCH_FOR_PING;
                                 }
                         }
                         break;
                 }
                 case SEARCH_FOR_PING: {
-                        int ret = sdr.read(no_of_samples_ping,
-                                           buff_data_ping);
-                        if (return_ok(ret, no_of_samples_ping)) {
+                        /* When tracking, only the window around the
+                         * next PING is received. A full burst period
+                         * is read when re-anchoring.
+                         */
+                        bool gated_read = gated && !reanchor;
+                        PoolBuffer<std::complex<int16_t>> &buff_data =
+                                gated_read ? buff_data_window :
+                                buff_data_ping;
+                        size_t no_of_samples = buff_data.size();
+                        int ret;
+                        if (gated_read) {
+                                int64_t window_hw_ns = schedule_ping_window(
+                                        tracker.get_burst_hw_ns(),
+                                        tracker.get_period_ns(),
+                                        radio.get_hardware_time(),
+                                        dev_cfg);
+                                ret = radio.read_window(window_hw_ns,
+                                                        no_of_samples,
+                                                        buff_data.data());
+                        } else {
+                                ret = radio.read(no_of_samples,
+                                                 buff_data.data());
+                        }
+                        if (return_ok(ret, no_of_samples)) {
+                                num_of_rx_samples += ret;
                                 num_ping_tries++;
+                                spectrum.offer(buff_data.data(), ret,
+                                               radio.ix_to_hw_ns(0));
+                                /* Samples were lost, but the hw time
+                                 * is still valid. Re-anchor on the
+                                 * predicted PING with a wider guard
+                                 * instead of a new initial sync.
+                                 */
+                                if (radio.rx_discontinuity()) {
+                                        g_logger.log(
+                                                SOAPY_SDR_INFO,
+                                                "Re-anchoring after RX gap");
+                                        reanchor = true;
+                                }
+                                int64_t guard = dev_cfg.ping_burst_guard;
                                 int64_t expected_ping_ix;
-                                expected_ping_ix = sdr.find_exp_ping_pos_ix(
-                                        sync_hw_ns);
-                                detector.add_data(buff_data_ping);
+                                RxPosition ping_pos = {0, 0, false};
+                                if (dev_cfg.ping_tracking) {
+                                        double ping_hw_ns = tracker.predict(
+                                                radio.ix_to_hw_ns(0));
+                                        ping_pos = radio.locate(ping_hw_ns);
+                                }
+                                if (ping_pos.valid) {
+                                        expected_ping_ix = ping_pos.ix;
+                                        guard = tracker.get_guard();
+                                        if (gated_read) {
+                                                guard = std::min(
+                                                        guard,
+                                                        max_window_guard);
+                                        }
+                                } else {
+                                        /* The predicted PING is before
+                                         * the samples of this segment,
+                                         * re-anchor on the PING period
+                                         */
+                                        if (dev_cfg.ping_tracking &&
+                                            !reanchor) {
+                                                g_logger.log(
+                                                SOAPY_SDR_INFO,
+                                                "Predicted PING not in the"
+                                                " RX segment, re-anchoring");
+                                                reanchor = true;
+                                        }
+                                        expected_ping_ix =
+                                                radio.find_exp_ping_pos_ix(
+                                                        sync_hw_ns);
+                                }
+                                if (reanchor) {
+                                        guard = dev_cfg.reanchor_guard;
+                                }
+                                detector.add_data(buff_data.data(), ret);
                                 sync_ix = detector.look_for_ping(
-                                        expected_ping_ix);
+                                        expected_ping_ix, guard);
+                                live_plot.push(detector.get_corr_data(),
+                                               detector.get_corr_length(),
+                                               buff_data.data(), ret);
+                                trace_event(TRACE_DECISION,
+                                            radio.ix_to_hw_ns(
+                                                    expected_ping_ix),
+                                            detector.found_ping(sync_ix));
                                 if (detector.found_ping(sync_ix)) {
-                                        sync_hw_ns = sdr.ix_to_hw_ns(
+                                        reanchor = false;
+                                        sync_hw_ns = radio.ix_to_hw_ns(
                                                 sync_ix);
+                                        if (dev_cfg.ping_tracking) {
+                                                tracker.update(
+                                                radio.ix_to_hw_ns(0) +
+                                                detector.get_peak_position() *
+                                                1e9 / fs_rx);
+                                                sync_hw_ns = std::llround(
+                                                tracker.get_burst_hw_ns());
+                                        }
+                                        // Tightens the next initial sync
+                                        if (tracker.has_drift_estimate()) {
+                                                detector.set_clock_drift(
+                                                tracker.get_drift_ppm());
+                                        }
+                                        radio.annotate(sync_ix, "PING");
+                                        g_metrics.found_pings.add();
+                                        g_metrics.peak_to_threshold.record(
+                                                std::llround(
+                                                1e3 *
+                                                detector.get_peak_value() /
+                                                detector.get_threshold()));
+                                        if (results) {
+                                                results->publish(
+                                                make_ranging_record(
+                                                RECORD_PING,
+                                                dev_cfg.tag_slot,
+                                                sync_hw_ns,
+                                                detector.get_peak_position(),
+                                                detector.get_peak_value(),
+                                                detector.get_snr_estimate()));
+                                        }
                                         num_of_found_pings++;
                                         num_of_missed_pings = 0;
-                                        std::cout << "Found PING"
-                                                  << " expected "
-                                                  << expected_ping_ix
-                                                  << " sync ix "
-                                                  << sync_ix
-                                                  << " diff "
-                                                  << expected_ping_ix-sync_ix
-                                                  << " data_length "
-                                                  << buff_data_ping.size()
-                                                  << std::endl;
+                                        g_logger.log(
+                                                SOAPY_SDR_INFO,
+                                                "Found PING expected {}"
+                                                " sync ix {} diff {}"
+                                                " data_length {} guard {}"
+                                                " drift {} ppm",
+                                                expected_ping_ix, sync_ix,
+                                                expected_ping_ix - sync_ix,
+                                                buff_data.size(), guard,
+                                                tracker.get_drift_ppm());
                                         current_state = SEND_PONG;
+                                        if (alloc_check.found_ping(
+                                                    num_of_found_pings)) {
+                                                g_stop = true;
+                                        }
                                 } else {
                                         num_of_missed_pings++;
                                         tot_num_of_missed_pings++;
+                                        g_metrics.missed_pings.add();
+                                        tracker.miss();
                                 }
                                 if (time_for_initial_sync(num_of_missed_pings,
                                                           dev_cfg)) {
+                                        g_metrics.resyncs.add();
                                         num_of_missed_pings = 0;
-                                        std::cout << "Faild PING detect"
-                                                  << std::endl;
-                                        std::cout << "Starting initial sync"
-                                                  << std::endl;
+                                        reanchor = false;
+                                        g_logger.log(SOAPY_SDR_INFO,
+                                                     "Faild PING detect");
+                                        g_logger.log(SOAPY_SDR_INFO,
+                                                     "Starting initial sync");
                                         current_state = INITIAL_SYNC;
                                 }
                         }
                         break;
                 }
                 case SEND_PONG: {
-                        std::cout << "Sending PONG" << std::endl;
-                        const double fs_tx = dev_cfg.sampling_rate_tx;
-                        double pong_delay_rel_ns = dev_cfg.pong_delay;
-                        pong_delay_rel_ns += dev_cfg.pong_delay_processing;
-                        int64_t pong_delay_rel_ticks =
-                                dev_cfg.D_tx * pong_delay_rel_ns * fs_tx;
-                        int64_t tx_hw_ticks = SoapySDR::timeNsToTicks(
-                                sync_hw_ns, dev_cfg.f_clk) +
-                                pong_delay_rel_ticks;
-                        long long int burst_hw_ns = SoapySDR::ticksToTimeNs(
-                                tx_hw_ticks,
-                                dev_cfg.f_clk);
-                        sdr.check_burst_time(burst_hw_ns);
-                        sdr.write(tx_buffs_data, no_of_tx_samples,
-                                  burst_hw_ns);
+                        double turnaround = scheduler.schedule(
+                                sync_hw_ns, radio.get_hardware_time());
+                        long long int burst_hw_ns = pong_burst_time(
+                                sync_hw_ns, turnaround, tracker, dev_cfg);
+                        g_logger.log(SOAPY_SDR_INFO,
+                                     "Sending PONG, slack {} ms",
+                                     scheduler.get_slack() * 1e3);
+                        g_metrics.detection_latency.record(std::llround(
+                                scheduler.get_latency() * 1e9));
+                        record_tx_slack(radio.check_burst_time(burst_hw_ns));
+                        radio.write(tx_buffs_data, no_of_tx_samples,
+                                    burst_hw_ns);
                         current_state = SEARCH_FOR_PING;
                         break;
                 }
@@ -237,18 +676,22 @@ void run_tag(bool plot_data, uint32_t device)
                         throw std::runtime_error("Unknown state tag!");
                 }
         }
-        sdr.close();
-        std::cout << "Number of found PINGS: "
-                  << num_of_found_pings
-                  << " Number of missed PINGS: "
-                  << tot_num_of_missed_pings
-                  << std::endl;
+        radio.close();
+        g_logger.flush();
+        g_tracer.dump();
+        print_tag_summary(radio, dev_cfg, detector, tracker,
+                          num_of_found_pings, tot_num_of_missed_pings,
+                          num_of_rx_samples);
+        scheduler.print_stats();
+        bool alloc_check_ok = alloc_check.report();
         if (plot_data) {
                 Analyser analyser;
-                //analyser.add_data(buff_data_initial);
+                //analyser.add_data(buff_data_initial.data(),
+                //                  buff_data_initial.size());
                 //analyser.plot_imag_data();
                 //analyser.save_data("initial_buff_20ms");
-                //analyser.add_data(buff_data_ping);
+                //analyser.add_data(buff_data_ping.data(),
+                //                  buff_data_ping.size());
                 //analyser.plot_imag_data();
                 //analyser.save_data("ping_buff_10ms");
                 std::vector<float> corr;
@@ -256,25 +699,435 @@ void run_tag(bool plot_data, uint32_t device)
                 analyser.add_data(corr);
                 analyser.plot_data();
         }
+        return alloc_check_ok;
+}
+
+template <typename RadioType>
+bool run_tag_pipeline(RadioType &radio, const SDR_Device_Config &dev_cfg,
+                      size_t alloc_check_bursts)
+{
+        const size_t no_of_samples_initial_sync =
+                dev_cfg.no_of_rx_samples_initial_sync;
+        const size_t no_of_samples_block = dev_cfg.no_of_rx_samples_block;
+        const double fs_rx = dev_cfg.sampling_rate_rx;
+
+        std::cout << "Pipelined RX, blocks of " << no_of_samples_block
+                  << " samples, queue depth "
+                  << dev_cfg.pipeline_queue_depth << std::endl;
+        radio.configure(dev_cfg);
+        radio.start();
+
+        /* The capture thread only reads, the detection thread, this
+         * one, assembles the blocks and detects and sends the PONGs.
+         * The history holds enough for an initial sync.
+         */
+        RxPipeline pipeline(no_of_samples_block,
+                            dev_cfg.pipeline_queue_depth,
+                            dev_cfg.huge_pages);
+        SampleHistory history(no_of_samples_initial_sync,
+                              no_of_samples_block, fs_rx,
+                              dev_cfg.huge_pages);
+        BufferPool pool(Detector::get_buffer_bytes(dev_cfg),
+                        Detector::no_of_buffers, dev_cfg.huge_pages);
+        Detector detector;
+        detector.configure(CDMA, {dev_cfg.ping_scr_code}, dev_cfg, pool);
+        TimingTracker tracker;
+        tracker.configure(dev_cfg);
+        PongScheduler scheduler;
+        scheduler.configure(dev_cfg);
+        g_tracer.configure(dev_cfg.trace_file, dev_cfg.trace_ring_size);
+        MetricsWriter metrics_writer(g_metrics.registry, dev_cfg.metrics_file,
+                                     dev_cfg.metrics_period);
+        LivePlot live_plot(dev_cfg);
+        SpectrumMonitor spectrum(dev_cfg, live_plot);
+        std::unique_ptr<ResultsPublisher> results;
+        if (dev_cfg.results_shm != "") {
+                results.reset(new ResultsPublisher(
+                                      dev_cfg.results_shm,
+                                      dev_cfg.results_ring_size));
+        }
+
+        const size_t no_of_tx_samples = dev_cfg.tx_burst_length;
+        std::vector<std::complex<float>> tx_buff_data =
+                generate_pong(dev_cfg);
+        std::vector<void *> tx_buffs_data;
+        tx_buffs_data.push_back(tx_buff_data.data());
+        if (dev_cfg.memory_lock) {
+                // The pool buffers are written when acquired
+                lock_memory();
+                prefault_stack(dev_cfg.prefault_stack_size);
+        }
+
+        size_t num_of_found_pings(0);
+        size_t num_of_missed_pings(0);
+        size_t tot_num_of_missed_pings(0);
+        uint64_t num_of_rx_samples(0);
+        double next_ping_hw_ns(0);
+        bool reanchor(false);
+        TagStateMachine current_state(INITIAL_SYNC);
+        AllocCheck alloc_check(dev_cfg, alloc_check_bursts);
+        std::cout << "**********************" << std::endl;
+        std::cout << "Starting stream loop, press Ctrl+C to exit..."
+                  << std::endl;
+        std::cout << "Looking for inital sync" << std::endl;
+        signal(SIGINT, sigIntHandler);
+        signal(SIGUSR1, trace_signal_handler);
+
+        /* A fatal stream error is passed on to this thread, which
+         * rethrows it once the capture thread has been joined
+         */
+        std::exception_ptr capture_error;
+        std::thread capture([&radio, &pipeline, &dev_cfg, &capture_error,
+                             no_of_samples_block]() {
+                configure_rt_thread("RX", dev_cfg.rx_cpu,
+                                    dev_cfg.rx_priority);
+                bool lost_block(false);
+                try {
+                        while (not g_stop) {
+                                std::complex<int16_t> *buff_data =
+                                        pipeline.get_fill_buffer();
+                                int ret = radio.read(no_of_samples_block,
+                                                     buff_data);
+                                // Counted by return_ok, the next block
+                                // does not follow the previous one
+                                if (!return_ok(ret, no_of_samples_block)) {
+                                        lost_block = true;
+                                        continue;
+                                }
+                                if (!pipeline.push(
+                                            ret, radio.ix_to_hw_ns(0),
+                                            radio.rx_discontinuity() ||
+                                            lost_block)) {
+                                        break;
+                                }
+                                lost_block = false;
+                        }
+                } catch (...) {
+                        capture_error = std::current_exception();
+                }
+                pipeline.close();
+        });
+        configure_rt_thread("detect", dev_cfg.detect_cpu,
+                            dev_cfg.detect_priority);
+
+        PipelineBlock block;
+        while ((not g_stop) && pipeline.pop(block)) {
+                g_tracer.dump_if_requested();
+                num_of_rx_samples += block.no_of_samples;
+                spectrum.offer(pipeline.get_data(block), block.no_of_samples,
+                               block.time_hw_ns);
+                if (block.discontinuity && (current_state != INITIAL_SYNC)) {
+                        g_logger.log(SOAPY_SDR_INFO,
+                                     "Re-anchoring after RX gap");
+                        reanchor = true;
+                }
+                history.append(pipeline.get_data(block),
+                               block.no_of_samples, block.time_hw_ns,
+                               block.discontinuity);
+                if (current_state == INITIAL_SYNC) {
+                        if (history.size() < no_of_samples_initial_sync) {
+                                continue;
+                        }
+                        detector.add_data(history.data() + history.size() -
+                                          no_of_samples_initial_sync,
+                                          no_of_samples_initial_sync);
+                        int64_t offset_ix = history.size() -
+                                no_of_samples_initial_sync;
+                        int64_t sync_ix = detector.look_for_initial_sync();
+                        live_plot.push(detector.get_corr_data(),
+                                       detector.get_corr_length(),
+                                       history.data() + offset_ix,
+                                       no_of_samples_initial_sync);
+                        if (!detector.found_initial_sync(sync_ix)) {
+                                history.clear();
+                                continue;
+                        }
+                        tracker.reset(history.ix_to_hw_ns(
+                                              offset_ix +
+                                              detector.get_peak_position()));
+                        next_ping_hw_ns = tracker.get_burst_hw_ns() +
+                                tracker.get_period_ns();
+                        g_logger.log(SOAPY_SDR_INFO,
+                                     "**** Found inital sync at hw time {}",
+                                     std::llround(
+                                             tracker.get_burst_hw_ns()));
+                        num_of_missed_pings = 0;
+                        current_state = SEARCH_FOR_PING;
+                }
+                /* Search for every PING whose window is complete, as
+                 * soon as it is
+                 */
+                while (current_state == SEARCH_FOR_PING) {
+                        int64_t guard = reanchor ? dev_cfg.reanchor_guard :
+                                tracker.get_guard();
+                        int64_t half_window = dev_cfg.tx_burst_length / 2 +
+                                guard + 1;
+                        int64_t ping_ix = std::llround(
+                                history.hw_ns_to_ix(next_ping_hw_ns));
+                        if (ping_ix + half_window >= (int64_t)history.size()) {
+                                break;
+                        }
+                        int64_t start_ix = ping_ix - half_window;
+                        bool found(false);
+                        if (start_ix >= 0) {
+                                detector.add_data(history.data() + start_ix,
+                                                  2 * half_window + 1);
+                                int64_t sync_ix = detector.look_for_ping(
+                                        ping_ix - start_ix, guard);
+                                live_plot.push(
+                                        detector.get_corr_data(),
+                                        detector.get_corr_length(),
+                                        history.data() + start_ix,
+                                        2 * half_window + 1);
+                                found = detector.found_ping(sync_ix);
+                        }
+                        trace_event(TRACE_DECISION,
+                                    std::llround(next_ping_hw_ns), found);
+                        if (found) {
+                                reanchor = false;
+                                tracker.update(history.ix_to_hw_ns(
+                                                       start_ix +
+                                                       detector.
+                                                       get_peak_position()));
+                                if (tracker.has_drift_estimate()) {
+                                        detector.set_clock_drift(
+                                                tracker.get_drift_ppm());
+                                }
+                                num_of_found_pings++;
+                                num_of_missed_pings = 0;
+                                g_metrics.found_pings.add();
+                                g_metrics.peak_to_threshold.record(
+                                        std::llround(
+                                                1e3 *
+                                                detector.get_peak_value() /
+                                                detector.get_threshold()));
+                                int64_t sync_hw_ns = std::llround(
+                                        tracker.get_burst_hw_ns());
+                                if (results) {
+                                        results->publish(make_ranging_record(
+                                                RECORD_PING,
+                                                dev_cfg.tag_slot,
+                                                sync_hw_ns,
+                                                start_ix + detector.
+                                                get_peak_position(),
+                                                detector.get_peak_value(),
+                                                detector.get_snr_estimate()));
+                                }
+                                double turnaround = scheduler.schedule(
+                                        sync_hw_ns,
+                                        radio.get_hardware_time());
+                                long long int burst_hw_ns = pong_burst_time(
+                                        sync_hw_ns, turnaround, tracker,
+                                        dev_cfg);
+                                // The hw time of the schedule is read
+                                // right before the write
+                                g_metrics.detection_latency.record(
+                                        std::llround(
+                                                scheduler.get_latency() *
+                                                1e9));
+                                record_tx_slack(std::llround(
+                                        scheduler.get_slack() * 1e9));
+                                radio.write(tx_buffs_data, no_of_tx_samples,
+                                            burst_hw_ns);
+                                g_logger.log(SOAPY_SDR_INFO,
+                                             "Found PING at hw time {}"
+                                             " guard {} drift {} ppm, PONG"
+                                             " slack {} ms",
+                                             sync_hw_ns, guard,
+                                             tracker.get_drift_ppm(),
+                                             scheduler.get_slack() * 1e3);
+                                if (alloc_check.found_ping(
+                                            num_of_found_pings)) {
+                                        g_stop = true;
+                                }
+                        } else {
+                                num_of_missed_pings++;
+                                tot_num_of_missed_pings++;
+                                g_metrics.missed_pings.add();
+                                tracker.miss();
+                        }
+                        next_ping_hw_ns = tracker.predict(std::llround(
+                                next_ping_hw_ns +
+                                tracker.get_period_ns() / 2));
+                        if (time_for_initial_sync(num_of_missed_pings,
+                                                  dev_cfg)) {
+                                g_metrics.resyncs.add();
+                                reanchor = false;
+                                g_logger.log(SOAPY_SDR_INFO,
+                                             "Faild PING detect");
+                                g_logger.log(SOAPY_SDR_INFO,
+                                             "Starting initial sync");
+                                history.clear();
+                                current_state = INITIAL_SYNC;
+                        }
+                }
+        }
+        g_stop = true;
+        pipeline.close();
+        capture.join();
+        radio.close();
+        if (capture_error) {
+                std::rethrow_exception(capture_error);
+        }
+        g_logger.flush();
+        g_tracer.dump();
+        print_tag_summary(radio, dev_cfg, detector, tracker,
+                          num_of_found_pings, tot_num_of_missed_pings,
+                          num_of_rx_samples);
+        std::cout << "pipeline: Max queue depth " << pipeline.get_max_depth()
+                  << ", capture waited " << pipeline.get_no_of_full_waits()
+                  << " times" << std::endl;
+        scheduler.print_stats();
+        return alloc_check.report();
+}
+
+template <typename RadioType>
+void print_tag_summary(RadioType &radio, const SDR_Device_Config &dev_cfg,
+                       const Detector &detector,
+                       const TimingTracker &tracker,
+                       size_t num_of_found_pings,
+                       size_t tot_num_of_missed_pings,
+                       uint64_t num_of_rx_samples)
+{
+        std::cout << "Number of found PINGS: "
+                  << num_of_found_pings
+                  << " Number of missed PINGS: "
+                  << tot_num_of_missed_pings
+                  << std::endl;
+        std::cout << "Clock drift: " << tracker.get_drift_ppm() << " ppm";
+        if (!tracker.has_drift_estimate()) {
+                std::cout << " (not estimated)";
+        }
+        std::cout << std::endl;
+        std::cout << "Number of RX samples: " << num_of_rx_samples
+                  << std::endl;
+        std::cout << "Number of RX gaps: "
+                  << radio.get_rx_timeline().get_no_of_gaps()
+                  << " Lost samples: "
+                  << radio.get_rx_timeline().get_no_of_lost_samples()
+                  << std::endl;
+        if (dev_cfg.dc_iq_correction) {
+                detector.get_front_end().print_stats();
+        }
+}
+
+AllocCheck::AllocCheck(const SDR_Device_Config &dev_cfg,
+                       size_t no_of_bursts)
+        : check_start(dev_cfg.alloc_check_warmup),
+          no_of_bursts(no_of_bursts),
+          start_count(0),
+          no_of_allocations(0),
+          done(false)
+{}
+
+bool AllocCheck::found_ping(size_t num_of_found_pings)
+{
+        if (no_of_bursts == 0) {
+                return false;
+        }
+        if (num_of_found_pings == check_start) {
+                start_count = get_no_of_allocations();
+        }
+        if (num_of_found_pings == check_start + no_of_bursts) {
+                no_of_allocations = get_no_of_allocations() - start_count;
+                done = true;
+        }
+        return done;
+}
+
+bool AllocCheck::report() const
+{
+        if (no_of_bursts == 0) {
+                return true;
+        }
+        std::cout << "alloc: " << no_of_allocations
+                  << " heap allocations in " << no_of_bursts
+                  << " steady-state bursts" << std::endl;
+        return done && (no_of_allocations == 0);
+}
+
+std::vector<std::complex<float>> generate_pong(
+        const SDR_Device_Config &dev_cfg)
+{
+        double scale_factor(1.0);
+        uint16_t Novs = dev_cfg.Novs_tx;
+        double extra_samples_for_filter = dev_cfg.extra_samples_filter;
+        size_t mod_length = dev_cfg.tx_burst_length_chip;
+        mod_length = mod_length * (1 + extra_samples_for_filter);
+        Modulator modulator(mod_length, scale_factor, Novs);
+        modulator.generate_cdma(slot_pong_code(dev_cfg, dev_cfg.tag_slot));
+        modulator.filter();
+        modulator.scrap_samples(mod_length * extra_samples_for_filter);
+        return modulator.get_data();
+}
+
+long long int pong_burst_time(int64_t sync_hw_ns, double turnaround,
+                              const TimingTracker &tracker,
+                              const SDR_Device_Config &dev_cfg)
+{
+        const double fs_tx = dev_cfg.sampling_rate_tx;
+        double pong_delay_rel_ns = turnaround;
+        // The beacon expects the PONG after pong_delay in its own clock
+        if (tracker.has_drift_estimate()) {
+                pong_delay_rel_ns *= 1 + tracker.get_drift_ppm() * 1e-6;
+        }
+        int64_t pong_delay_rel_ticks =
+                dev_cfg.D_tx * pong_delay_rel_ns * fs_tx;
+        int64_t tx_hw_ticks = SoapySDR::timeNsToTicks(
+                sync_hw_ns, dev_cfg.f_clk) + pong_delay_rel_ticks;
+        return SoapySDR::ticksToTimeNs(tx_hw_ticks, dev_cfg.f_clk);
 }
 
 bool time_for_initial_sync(size_t num_of_missed_pings,
-                           SDR_Device_Config dev_cfg)
+                           const SDR_Device_Config &dev_cfg)
 {
         return (num_of_missed_pings > dev_cfg.num_of_ping_tries);
 }
 
+size_t no_of_window_samples(const SDR_Device_Config &dev_cfg)
+{
+        return dev_cfg.tx_burst_length +
+                2 * (dev_cfg.ping_burst_guard + dev_cfg.rx_gate_margin);
+}
+
+int64_t schedule_ping_window(double sync_hw_ns, double period_ns,
+                             int64_t now_hw_ns,
+                             const SDR_Device_Config &dev_cfg)
+{
+        const double fs = dev_cfg.sampling_rate_rx;
+        // The window is centered on the PING, as in the detector
+        int64_t half_window_rel_ns = std::llround(
+                (no_of_window_samples(dev_cfg) / 2) * 1e9 / fs);
+        int64_t earliest_hw_ns = now_hw_ns + half_window_rel_ns +
+                (int64_t)(dev_cfg.rx_gate_lead * 1e9);
+        double k = std::ceil((earliest_hw_ns - sync_hw_ns) / period_ns);
+        if (k < 1) {
+                k = 1;
+        }
+        return std::llround(sync_hw_ns + k * period_ns) - half_window_rel_ns;
+}
+
 bool return_ok(int ret, size_t expected_num_samples)
 {
         bool data_ok(true);
+        count_stream_error(ret);
+        /* No data, but the stream goes on. The timeline flags the
+         * next block as a gap, and the tag re-anchors on it.
+         */
         if (ret == SOAPY_SDR_TIMEOUT) {
-                std::cout << "Timeout!" << std::endl;
+                g_logger.log(SOAPY_SDR_WARNING, "Timeout!");
+                return false;
         }
         if (ret == SOAPY_SDR_OVERFLOW) {
-                std::cout << "Overflow!" << std::endl;
+                g_logger.log(SOAPY_SDR_WARNING, "Overflow!");
+                return false;
         }
         if (ret == SOAPY_SDR_UNDERFLOW) {
-                std::cout << "Underflow!" << std::endl;
+                g_logger.log(SOAPY_SDR_WARNING, "Underflow!");
+        }
+        if (ret == SOAPY_SDR_TIME_ERROR) {
+                g_logger.log(SOAPY_SDR_WARNING, "Late RX window!");
+                return false;
         }
         if (ret < 0) {
                 std::string err = "Unexpected stream error ";
@@ -0,0 +1,273 @@
+/**
+ * \file tdma.cpp
+ *
+ * \brief TDMA ranging of several tags
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "tdma.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+uint32_t slot_pong_code(const SDR_Device_Config &dev_cfg, uint32_t slot)
+{
+        return dev_cfg.pong_scr_code + slot;
+}
+
+double slot_offset(const SDR_Device_Config &dev_cfg, uint32_t slot)
+{
+        return slot * dev_cfg.tag_slot_length;
+}
+
+TdmaDetector::TdmaDetector()
+        : m_window_half_length(0),
+          m_period_samples(1),
+          m_data(nullptr),
+          m_no_of_samples(0),
+          m_no_of_detects(0),
+          m_detect_time_ns(0),
+          m_max_detect_time_ns(0),
+          m_publisher(nullptr)
+{}
+
+void TdmaDetector::configure(const SDR_Device_Config &dev_cfg)
+{
+        m_dev_cfg = dev_cfg;
+        const double fs = m_dev_cfg.sampling_rate_rx;
+        const size_t no_of_tags = std::max((size_t)1, m_dev_cfg.no_of_tags);
+        // Same window as Detector::look_for_pong uses
+        m_window_half_length = m_dev_cfg.tx_burst_length / 2 +
+                m_dev_cfg.pong_burst_guard;
+        size_t window_length = 2 * m_window_half_length + 1;
+        int64_t slot_samples = std::llround(m_dev_cfg.tag_slot_length * fs);
+        if ((no_of_tags > 1) && (slot_samples < (int64_t)window_length)) {
+                throw std::runtime_error(
+                        "tdma: Slots overlap, increase tag_slot_length");
+        }
+        if (slot_offset(m_dev_cfg, no_of_tags) > m_dev_cfg.burst_period) {
+                throw std::runtime_error(
+                        "tdma: Slots do not fit in burst_period");
+        }
+        m_period_samples = std::llround(m_dev_cfg.burst_period * fs);
+        m_front_end.configure(m_dev_cfg);
+        m_corrected.clear();
+        if (m_dev_cfg.dc_iq_correction) {
+                m_corrected.resize(m_dev_cfg.no_of_rx_samples_pong);
+        }
+        // The tag detectors get the corrected data
+        SDR_Device_Config tag_cfg = m_dev_cfg;
+        tag_cfg.dc_iq_correction = false;
+        m_workers.reset();
+        m_detectors.clear();
+        m_pool.reset(new BufferPool(
+                             Detector::get_buffer_bytes(m_dev_cfg,
+                                                        window_length),
+                             Detector::no_of_buffers * no_of_tags,
+                             m_dev_cfg.huge_pages));
+        m_stats.assign(no_of_tags, TagStats());
+        m_ranges.assign(no_of_tags, RangeTracker());
+        m_expected_ix.assign(no_of_tags, 0);
+        m_pong_ix.assign(no_of_tags, -1);
+        m_pong_position.assign(no_of_tags, -1);
+        m_peak_value.assign(no_of_tags, 0);
+        m_snr_db.assign(no_of_tags, 0);
+        for (size_t n=0; n<no_of_tags; n++) {
+                m_stats[n].code = slot_pong_code(m_dev_cfg, n);
+                m_stats[n].slot_offset_ix = std::llround(
+                        slot_offset(m_dev_cfg, n) * fs);
+                m_detectors.push_back(
+                        std::unique_ptr<Detector>(new Detector()));
+                m_detectors[n]->configure(CDMA, {m_stats[n].code},
+                                          tag_cfg, *m_pool);
+                m_ranges[n].configure(m_dev_cfg, n);
+        }
+        size_t no_of_threads = std::min(m_dev_cfg.tdma_threads,
+                                        no_of_tags - 1);
+        m_workers.reset(new WorkerPool(
+                                "TDMA", no_of_threads,
+                                m_dev_cfg.rx_priority,
+                                [this](size_t tag, size_t) { detect_tag(tag); }));
+        m_no_of_detects = 0;
+        m_detect_time_ns = 0;
+        m_max_detect_time_ns = 0;
+        std::cout << "tdma: " << no_of_tags << " tags, slots of "
+                  << slot_samples << " samples, "
+                  << no_of_threads + 1 << " detection threads" << std::endl;
+}
+
+size_t TdmaDetector::detect(const std::complex<int16_t> *data,
+                            size_t no_of_samples, int64_t expected_ix,
+                            int64_t data_hw_ns, int64_t ping_tx_hw_ns)
+{
+        auto start = std::chrono::steady_clock::now();
+        m_data = correct(data, no_of_samples);
+        m_no_of_samples = no_of_samples;
+        for (size_t n=0; n<m_stats.size(); n++) {
+                int64_t ix = (expected_ix + m_stats[n].slot_offset_ix) %
+                        m_period_samples;
+                if (ix < 0) {
+                        ix += m_period_samples;
+                }
+                m_expected_ix[n] = ix;
+        }
+        m_workers->run(m_stats.size());
+        size_t no_of_found(0);
+        for (size_t n=0; n<m_stats.size(); n++) {
+                update_stats(n, data_hw_ns, ping_tx_hw_ns);
+                if (m_pong_ix[n] >= 0) {
+                        no_of_found++;
+                }
+        }
+        int64_t detect_time_ns =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+        m_no_of_detects++;
+        m_detect_time_ns += detect_time_ns;
+        m_max_detect_time_ns = std::max(m_max_detect_time_ns,
+                                        detect_time_ns);
+        trace_event(TRACE_DECISION, ping_tx_hw_ns, no_of_found);
+        return no_of_found;
+}
+
+const std::complex<int16_t> *TdmaDetector::correct(
+        const std::complex<int16_t> *data, size_t no_of_samples)
+{
+        if (!m_dev_cfg.dc_iq_correction) {
+                return data;
+        }
+        if (no_of_samples > m_corrected.size()) {
+                throw std::runtime_error("tdma: Too much data");
+        }
+        std::copy(data, data + no_of_samples, m_corrected.begin());
+        m_front_end.process(m_corrected.data(), no_of_samples);
+        return m_corrected.data();
+}
+
+void TdmaDetector::detect_tag(size_t tag)
+{
+        m_pong_ix[tag] = -1;
+        int64_t expected_ix = m_expected_ix[tag];
+        int64_t start_ix = std::max((int64_t)0,
+                                    expected_ix - m_window_half_length);
+        int64_t end_ix = std::min((int64_t)m_no_of_samples,
+                                  expected_ix + m_window_half_length + 1);
+        if (start_ix >= end_ix) {
+                return;
+        }
+        Detector &detector = *m_detectors[tag];
+        detector.add_data(m_data + start_ix, end_ix - start_ix);
+        int64_t ix = detector.look_for_pong(expected_ix - start_ix);
+        if (detector.found_pong(ix)) {
+                m_pong_ix[tag] = ix + start_ix;
+                m_pong_position[tag] = detector.get_peak_position() +
+                        start_ix;
+                m_peak_value[tag] = detector.get_peak_value();
+                g_metrics.peak_to_threshold.record(std::llround(
+                        1e3 * detector.get_peak_value() /
+                        detector.get_threshold()));
+                m_snr_db[tag] = detector.get_snr_estimate();
+        }
+}
+
+void TdmaDetector::update_stats(size_t tag, int64_t data_hw_ns,
+                                int64_t ping_tx_hw_ns)
+{
+        TagStats &stats = m_stats[tag];
+        int64_t ix = m_pong_ix[tag];
+        if (ix >= 0) {
+                g_metrics.found_pongs.add();
+                stats.no_of_found++;
+                stats.no_of_consecutive_missed = 0;
+                stats.last_pong_hw_ns = data_hw_ns + std::llround(
+                        m_pong_position[tag] * 1e9 /
+                        m_dev_cfg.sampling_rate_rx);
+                stats.last_diff = m_expected_ix[tag] - ix;
+                const RangeEstimate &estimate = m_ranges[tag].update(
+                        ping_tx_hw_ns, stats.last_pong_hw_ns);
+                if (m_publisher != nullptr) {
+                        RangingRecord record = make_ranging_record(
+                                RECORD_PONG | RECORD_RANGED, tag,
+                                ping_tx_hw_ns, m_pong_position[tag],
+                                m_peak_value[tag], m_snr_db[tag]);
+                        record.range = estimate.measured_range;
+                        record.range_filtered = estimate.range;
+                        if (estimate.outlier) {
+                                record.flags |= RECORD_OUTLIER;
+                        }
+                        m_publisher->publish(record);
+                }
+                if (!stats.tracking) {
+                        g_logger.log(SOAPY_SDR_INFO,
+                                     "tdma: Found tag {} (code {}) at index {}"
+                                     " diff {}", tag, stats.code, ix,
+                                     stats.last_diff);
+                }
+                stats.tracking = true;
+                return;
+        }
+        g_metrics.missed_pongs.add();
+        stats.no_of_missed++;
+        stats.no_of_consecutive_missed++;
+        if (stats.tracking && (stats.no_of_consecutive_missed >
+                               m_dev_cfg.num_of_ping_tries)) {
+                g_logger.log(SOAPY_SDR_INFO, "tdma: Lost tag {}", tag);
+                stats.tracking = false;
+        }
+}
+
+size_t TdmaDetector::get_no_of_tags() const
+{
+        return m_stats.size();
+}
+
+int64_t TdmaDetector::get_pong_ix(size_t tag) const
+{
+        return m_pong_ix.at(tag);
+}
+
+const TagStats &TdmaDetector::get_stats(size_t tag) const
+{
+        return m_stats.at(tag);
+}
+
+const RangeEstimate &TdmaDetector::get_range(size_t tag) const
+{
+        return m_ranges.at(tag).get_estimate();
+}
+
+void TdmaDetector::set_publisher(ResultsPublisher *publisher)
+{
+        m_publisher = publisher;
+}
+
+void TdmaDetector::print_stats() const
+{
+        for (size_t n=0; n<m_stats.size(); n++) {
+                std::cout << "tdma: Tag " << n
+                          << " code " << m_stats[n].code
+                          << " found " << m_stats[n].no_of_found
+                          << " missed " << m_stats[n].no_of_missed
+                          << " range " << m_ranges[n].get_estimate().range
+                          << " +- " << m_ranges[n].get_estimate().range_std
+                          << " m, outliers "
+                          << m_ranges[n].get_no_of_outliers()
+                          << std::endl;
+        }
+        if (m_no_of_detects > 0) {
+                std::cout << "tdma: Detection time mean "
+                          << m_detect_time_ns / m_no_of_detects / 1000
+                          << " us, max " << m_max_detect_time_ns / 1000
+                          << " us, burst period "
+                          << m_dev_cfg.burst_period * 1e6 << " us"
+                          << std::endl;
+        }
+        if (m_dev_cfg.dc_iq_correction) {
+                m_front_end.print_stats();
+        }
+}
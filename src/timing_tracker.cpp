@@ -0,0 +1,115 @@
+/**
+ * \file timing_tracker.cpp
+ *
+ * \brief Delay-locked tracking of periodic bursts
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "timing_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+TimingTracker::TimingTracker()
+        : m_sample_ns(1),
+          m_burst_hw_ns(0),
+          m_period_ns(1),
+          m_error_variance(0),
+          m_no_of_updates(0)
+{}
+
+void TimingTracker::configure(const SDR_Device_Config &dev_cfg)
+{
+        m_dev_cfg = dev_cfg;
+        m_sample_ns = 1e9 / m_dev_cfg.sampling_rate_rx;
+        m_no_of_updates = 0;
+        reset(0);
+}
+
+void TimingTracker::reset(double burst_hw_ns)
+{
+        m_burst_hw_ns = burst_hw_ns;
+        if (!has_drift_estimate()) {
+                m_period_ns = m_dev_cfg.burst_period * 1e9;
+                m_no_of_updates = 0;
+        }
+        // Start out with the fixed guard
+        double error_std = m_dev_cfg.ping_burst_guard /
+                m_dev_cfg.dll_guard_sigmas;
+        m_error_variance = error_std * error_std;
+}
+
+void TimingTracker::update(double burst_hw_ns)
+{
+        double no_of_periods = std::round((burst_hw_ns - m_burst_hw_ns) /
+                                          m_period_ns);
+        no_of_periods = std::max(1.0, no_of_periods);
+        double predicted_hw_ns = m_burst_hw_ns + no_of_periods * m_period_ns;
+        double error_ns = burst_hw_ns - predicted_hw_ns;
+        m_burst_hw_ns = predicted_hw_ns + m_dev_cfg.dll_phase_gain * error_ns;
+        m_period_ns += m_dev_cfg.dll_rate_gain * error_ns / no_of_periods;
+        // Beyond any real crystal, limit the damage of a false detection
+        const double nominal_ns = m_dev_cfg.burst_period * 1e9;
+        const double max_drift_ns = nominal_ns * m_dev_cfg.drift_max_ppm *
+                1e-6;
+        m_period_ns = std::max(nominal_ns - max_drift_ns,
+                               std::min(nominal_ns + max_drift_ns,
+                                        m_period_ns));
+        m_no_of_updates++;
+        double error = error_ns / m_sample_ns;
+        m_error_variance += m_dev_cfg.dll_variance_forget *
+                (error * error - m_error_variance);
+}
+
+void TimingTracker::miss()
+{
+        double max_variance = m_dev_cfg.dll_max_guard /
+                m_dev_cfg.dll_guard_sigmas;
+        max_variance *= max_variance;
+        m_error_variance = std::min(max_variance,
+                                    m_error_variance *
+                                    m_dev_cfg.dll_miss_inflation);
+}
+
+double TimingTracker::predict(int64_t after_hw_ns) const
+{
+        double no_of_periods = std::ceil((after_hw_ns - m_burst_hw_ns) /
+                                         m_period_ns);
+        return m_burst_hw_ns + no_of_periods * m_period_ns;
+}
+
+int64_t TimingTracker::get_guard() const
+{
+        int64_t guard = std::ceil(m_dev_cfg.dll_guard_sigmas *
+                                  get_error_std());
+        guard = std::max(guard, m_dev_cfg.dll_min_guard);
+        return std::min(guard, m_dev_cfg.dll_max_guard);
+}
+
+double TimingTracker::get_burst_hw_ns() const
+{
+        return m_burst_hw_ns;
+}
+
+double TimingTracker::get_period_ns() const
+{
+        return m_period_ns;
+}
+
+double TimingTracker::get_error_std() const
+{
+        return std::sqrt(m_error_variance);
+}
+
+double TimingTracker::get_drift_ppm() const
+{
+        return (m_period_ns / (m_dev_cfg.burst_period * 1e9) - 1) * 1e6;
+}
+
+bool TimingTracker::has_drift_estimate() const
+{
+        return m_no_of_updates >= m_dev_cfg.drift_min_pings;
+}
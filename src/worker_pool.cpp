@@ -0,0 +1,98 @@
+/**
+ * \file worker_pool.cpp
+ *
+ * \brief Pool of worker threads
+ *
+ * \author Mats Gustafsson
+ *
+ * Copyright (C) 2019 by Wittra. All rights reserved.
+ */
+
+#include "worker_pool.h"
+#include "burst_tracer.h"
+
+WorkerPool::WorkerPool(std::string name, size_t no_of_threads,
+                       int priority, std::function<void(size_t, size_t)> job)
+        : m_job(job),
+          m_generation(0),
+          m_no_of_jobs(0),
+          m_next_job(0),
+          m_no_of_busy(0),
+          m_stop(false)
+{
+        for (size_t n=0; n<no_of_threads; n++) {
+                m_threads.push_back(std::thread(&WorkerPool::worker_loop,
+                                                this, name, priority,
+                                                n + 1));
+        }
+}
+
+WorkerPool::~WorkerPool()
+{
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+        }
+        m_start.notify_all();
+        for (size_t n=0; n<m_threads.size(); n++) {
+                m_threads[n].join();
+        }
+}
+
+void WorkerPool::run(size_t no_of_jobs)
+{
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_no_of_jobs = no_of_jobs;
+                m_next_job = 0;
+                m_no_of_busy = m_threads.size();
+                m_generation++;
+        }
+        m_start.notify_all();
+        run_jobs(0);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_no_of_busy == 0; });
+}
+
+size_t WorkerPool::get_no_of_threads() const
+{
+        return m_threads.size();
+}
+
+void WorkerPool::worker_loop(std::string name, int priority,
+                             size_t worker)
+{
+        g_tracer.set_thread_name(name + " " + std::to_string(worker));
+        if (priority > 0) {
+                configure_rt_thread(name, -1, priority);
+        }
+        uint64_t generation(0);
+        while (true) {
+                {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_start.wait(lock, [this, generation] {
+                                        return m_stop ||
+                                                (m_generation != generation);
+                                });
+                        if (m_stop) {
+                                return;
+                        }
+                        generation = m_generation;
+                }
+                run_jobs(worker);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_no_of_busy--;
+                if (m_no_of_busy == 0) {
+                        m_done.notify_one();
+                }
+        }
+}
+
+void WorkerPool::run_jobs(size_t worker)
+{
+        size_t job = m_next_job.fetch_add(1);
+        while (job < m_no_of_jobs) {
+                m_job(job, worker);
+                job = m_next_job.fetch_add(1);
+        }
+}